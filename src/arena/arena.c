@@ -0,0 +1,71 @@
+#include "arena.h"
+#include <stdlib.h>
+
+const size_t ARENA_ALIGNMENT = _Alignof(max_align_t);
+
+size_t align_arena_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+void init_arena(Arena *arena, size_t size) {
+    arena->size = align_arena_size(size);
+    arena->block = arena->size > 0 ? malloc(arena->size) : NULL;
+    arena->used = 0;
+    arena->overflows = NULL;
+    arena->overflow_size = 0;
+}
+
+/* aligned for any type, valid until the next reset_arena
+ * */
+void* arena_alloc(Arena *arena, size_t size) {
+    size = align_arena_size(size);
+    if (arena->block && arena->size - arena->used >= size) {
+        void *allocated = arena->block + arena->used;
+        arena->used += size;
+        return allocated;
+    }
+
+    ArenaOverflow *overflow = malloc(sizeof(ArenaOverflow) + size);
+    overflow->next = arena->overflows;
+    arena->overflows = overflow;
+    arena->overflow_size += size;
+    return overflow->data;
+}
+
+void free_arena_overflows(Arena *arena) {
+    while (arena->overflows) {
+        ArenaOverflow *next = arena->overflows->next;
+        free(arena->overflows);
+        arena->overflows = next;
+    }
+}
+
+/* frees this cycle's allocations. a cycle that overflowed leaves one
+ * block big enough for all of it (at least double the old one, so a table
+ * that keeps growing doesn't reallocate every cycle)
+ * */
+void reset_arena(Arena *arena) {
+    if (arena->overflows) {
+        free_arena_overflows(arena);
+
+        size_t new_size = 2 * arena->size;
+        if (new_size < arena->used + arena->overflow_size) {
+            new_size = arena->used + arena->overflow_size;
+        }
+        free(arena->block);
+        arena->block = malloc(new_size);
+        arena->size = new_size;
+        arena->overflow_size = 0;
+    }
+
+    arena->used = 0;
+}
+
+void free_arena(Arena *arena) {
+    free_arena_overflows(arena);
+    free(arena->block);
+    arena->block = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->overflow_size = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* bump allocator for memory that lives for one packet or one cycle of a
+ * thread, which resets it when the packet or cycle is done. an arena
+ * belongs to one thread and takes no locks.
+ *
+ * an allocation that doesn't fit gets a block of its own, and the next
+ * reset grows the arena to cover it, so a thread whose cycles look alike
+ * stops calling malloc after its first cycle
+ * */
+
+typedef struct ArenaOverflow {
+    struct ArenaOverflow *next;
+    max_align_t data[];
+} ArenaOverflow;
+
+typedef struct {
+    uint8_t *block;
+    size_t size;
+    size_t used;
+    // blocks taken this cycle while block was full
+    ArenaOverflow *overflows;
+    size_t overflow_size;
+} Arena;
+
+extern const size_t ARENA_ALIGNMENT;
+
+void init_arena(Arena *arena, size_t size);
+
+void* arena_alloc(Arena *arena, size_t size);
+
+void reset_arena(Arena *arena);
+
+void free_arena(Arena *arena);
+
+#endif
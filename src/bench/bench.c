@@ -0,0 +1,473 @@
+#include <first.h>
+#include <router.h>
+#include <arena.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* microbenchmarks of the table engine over synthetic tables.
+ * every run uses the same seed, so the tables and queries are identical
+ * between builds and only the code under test changes.
+ * allocations are counted by wrapping malloc/calloc/realloc at link time
+ * */
+
+const uint64_t BENCH_SEED = 0x5eed5eed;
+const uint32_t BENCH_REPETITIONS = 5;
+const uint32_t BENCH_QUERY_POOL_SIZE = 4096;
+// ops for the constant time benchmarks
+const uint32_t BENCH_FAST_OPS = 1 << 22;
+// budget of touched entries for the linear ones, ops = budget / num_prefixes
+const uint32_t BENCH_SCAN_BUDGET = 1 << 26;
+const uint32_t BENCH_MIN_SCAN_OPS = 64;
+
+// relative share of every prefix length, roughly a full internet table
+const uint32_t PREFIX_LENGTH_WEIGHTS[33] = {
+    [8] = 10, [9] = 5, [10] = 10, [11] = 25, [12] = 40, [13] = 70, [14] = 100, [15] = 150,
+    [16] = 150, [17] = 200, [18] = 350, [19] = 600, [20] = 450, [21] = 500, [22] = 1100,
+    [23] = 1000, [24] = 5000, [25] = 20, [26] = 30, [27] = 25, [28] = 30, [29] = 40,
+    [30] = 60, [31] = 5, [32] = 75
+};
+
+uint8_t BENCH_INTERFACE_IP[4] = { 10, 0, 0, 1 };
+uint8_t BENCH_INTERFACE_NETMASK[4] = { 255, 255, 255, 0 };
+uint8_t BENCH_SENDER_IP[4] = { 10, 0, 0, 2 };
+uint8_t BENCH_UPSTREAM_IP[4] = { 10, 0, 1, 1 };
+
+uint64_t num_allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    num_allocations += 1;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size) {
+    num_allocations += 1;
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size) {
+    num_allocations += 1;
+    return __real_realloc(ptr, size);
+}
+
+typedef struct {
+    uint32_t num_prefixes;
+    // sorted, more specific networks first
+    RouterTableEntry *prefixes;
+    // half of them are in the table, half are not
+    RouterTableEntry *exact_queries;
+    // more specific networks of table entries and unrelated ones
+    RouterTableEntry *subsume_queries;
+    // networks that are not in the table
+    RouterTableEntry *new_prefixes;
+    // table entries as the neighbor they were learned from advertises them
+    RouterTableEntry *readvertised;
+    uint64_t random_state;
+} BenchData;
+
+// splitmix64
+uint32_t next_bench_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31)) >> 32;
+}
+
+double get_elapsed_ns(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+uint32_t get_random_prefix_length(uint64_t *state) {
+    uint32_t total_weight = 0;
+    for (uint32_t i = 0; i <= 32; i++) {
+        total_weight += PREFIX_LENGTH_WEIGHTS[i];
+    }
+
+    uint32_t pick = next_bench_random(state) % total_weight;
+    for (uint32_t i = 0; i <= 32; i++) {
+        if (pick < PREFIX_LENGTH_WEIGHTS[i]) {
+            return i;
+        }
+        pick -= PREFIX_LENGTH_WEIGHTS[i];
+    }
+
+    return 24;
+}
+
+void set_prefix(RouterTableEntry *entry, uint32_t address, uint32_t prefix_length) {
+    uint32_t netmask = prefix_length == 0 ? 0 : 0xffffffffu << (32 - prefix_length);
+    uint32_t destination = htonl(address & netmask);
+    netmask = htonl(netmask);
+    memcpy(entry->destination, &destination, 4);
+    memcpy(entry->netmask, &netmask, 4);
+}
+
+/* unicast space without 10/8, which belongs to the interfaces
+ * */
+void make_random_prefix(RouterTableEntry *entry, uint64_t *state, uint32_t prefix_length) {
+    uint32_t first_octet = 11 + next_bench_random(state) % (223 - 11);
+    uint32_t address = (first_octet << 24) | (next_bench_random(state) & 0xffffff);
+
+    set_prefix(entry, address, prefix_length);
+    memcpy(entry->gateway, BENCH_SENDER_IP, 4);
+    memcpy(entry->interface, BENCH_INTERFACE_IP, 4);
+    entry->metric = 1 + next_bench_random(state) % 14;
+}
+
+int compare_prefixes(const void *a, const void *b) {
+    const RouterTableEntry *first = (const RouterTableEntry*) a;
+    const RouterTableEntry *second = (const RouterTableEntry*) b;
+
+    uint32_t first_length = get_prefix_length((uint8_t*) first->netmask);
+    uint32_t second_length = get_prefix_length((uint8_t*) second->netmask);
+    if (first_length != second_length) {
+        return first_length > second_length ? -1 : 1;
+    }
+
+    return memcmp(first->destination, second->destination, 4);
+}
+
+void create_bench_data(BenchData *data, uint32_t num_prefixes) {
+    memset(data, 0, sizeof(BenchData));
+    data->random_state = BENCH_SEED;
+    data->prefixes = malloc(num_prefixes * sizeof(RouterTableEntry));
+
+    for (uint32_t i = 0; i < num_prefixes; i++) {
+        make_random_prefix(&data->prefixes[i], &data->random_state, get_random_prefix_length(&data->random_state));
+    }
+    qsort(data->prefixes, num_prefixes, sizeof(RouterTableEntry), compare_prefixes);
+
+    // short prefixes collide, the table keeps one of each
+    uint32_t num_unique = 0;
+    for (uint32_t i = 0; i < num_prefixes; i++) {
+        if (num_unique == 0 || compare_prefixes(&data->prefixes[num_unique - 1], &data->prefixes[i]) != 0) {
+            data->prefixes[num_unique++] = data->prefixes[i];
+        }
+    }
+    data->num_prefixes = num_unique;
+
+    data->exact_queries = malloc(BENCH_QUERY_POOL_SIZE * sizeof(RouterTableEntry));
+    data->subsume_queries = malloc(BENCH_QUERY_POOL_SIZE * sizeof(RouterTableEntry));
+    data->new_prefixes = malloc(BENCH_QUERY_POOL_SIZE * sizeof(RouterTableEntry));
+    data->readvertised = malloc(BENCH_QUERY_POOL_SIZE * sizeof(RouterTableEntry));
+    for (uint32_t i = 0; i < BENCH_QUERY_POOL_SIZE; i++) {
+        RouterTableEntry *existing = &data->prefixes[next_bench_random(&data->random_state) % num_unique];
+
+        if (i % 2 == 0) {
+            data->exact_queries[i] = *existing;
+        } else {
+            make_random_prefix(&data->exact_queries[i], &data->random_state, get_random_prefix_length(&data->random_state));
+        }
+
+        uint32_t prefix_length = get_prefix_length(existing->netmask);
+        if (i % 2 == 0 && prefix_length < 32) {
+            uint32_t address;
+            memcpy(&address, existing->destination, 4);
+            address = ntohl(address) | (next_bench_random(&data->random_state) >> prefix_length);
+            data->subsume_queries[i] = *existing;
+            set_prefix(&data->subsume_queries[i], address, prefix_length + 1 + next_bench_random(&data->random_state) % (32 - prefix_length));
+        } else {
+            make_random_prefix(&data->subsume_queries[i], &data->random_state, get_random_prefix_length(&data->random_state));
+        }
+
+        // a /32 at a random spot is almost never in the table
+        make_random_prefix(&data->new_prefixes[i], &data->random_state, 32);
+
+        data->readvertised[i] = *existing;
+        memcpy(data->readvertised[i].gateway, BENCH_UPSTREAM_IP, 4);
+        data->readvertised[i].metric = existing->metric - 1;
+    }
+}
+
+void free_bench_data(BenchData *data) {
+    free(data->prefixes);
+    free(data->exact_queries);
+    free(data->subsume_queries);
+    free(data->new_prefixes);
+    free(data->readvertised);
+}
+
+/* steady state of a router that learned every prefix from one neighbor
+ * */
+RouterState* create_bench_router_state(BenchData *data, uint32_t extra_entries) {
+    RouterState *router_state = calloc(1, sizeof(RouterState));
+    router_state->rip_type = RIP_DYNAMIC;
+    router_state->max_interfaces = 1;
+    router_state->num_interfaces = 1;
+    router_state->interfaces = malloc(sizeof(InterfaceTableEntry));
+    memcpy(router_state->interfaces[0].interface_ip, BENCH_INTERFACE_IP, 4);
+    memcpy(router_state->interfaces[0].interface_netmask, BENCH_INTERFACE_NETMASK, 4);
+
+    router_state->max_entries = data->num_prefixes + extra_entries;
+    router_state->router_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
+    router_state->life_table = malloc(router_state->max_entries * sizeof(LifeTableEntry));
+    memcpy(router_state->router_table, data->prefixes, data->num_prefixes * sizeof(RouterTableEntry));
+    router_state->num_entries = data->num_prefixes;
+
+    // the life table is keyed by received destination
+    for (uint32_t i = 0; i < data->num_prefixes; i++) {
+        if (router_state->life_entries > 0 && match_ips(
+                    router_state->life_table[router_state->life_entries - 1].gateway,
+                    data->prefixes[i].destination)) {
+            continue;
+        }
+        memcpy(router_state->life_table[router_state->life_entries].gateway, data->prefixes[i].destination, 4);
+        router_state->life_table[router_state->life_entries].life_left = MAX_GATEWAY_LIFE;
+        router_state->life_entries += 1;
+    }
+
+    rebuild_route_index(router_state);
+    rebuild_life_index(router_state);
+    init_router_table_lock(router_state);
+    return router_state;
+}
+
+void free_bench_router_state(RouterState *router_state) {
+    free(router_state->interfaces);
+    free(router_state->router_table);
+    free(router_state->life_table);
+    free_table_index(&router_state->route_index);
+    free_table_index(&router_state->life_index);
+    pthread_rwlock_destroy(&router_state->router_table_lock);
+    free(router_state);
+}
+
+/* undoes a benchmark that grew the tables, outside of the measurement
+ * */
+void restore_bench_router_state(RouterState *router_state, BenchData *data, uint32_t life_entries) {
+    memcpy(router_state->router_table, data->prefixes, data->num_prefixes * sizeof(RouterTableEntry));
+    router_state->num_entries = data->num_prefixes;
+    router_state->life_entries = life_entries;
+    rebuild_route_index(router_state);
+    rebuild_life_index(router_state);
+}
+
+uint32_t get_scan_ops(BenchData *data) {
+    uint32_t ops = BENCH_SCAN_BUDGET / data->num_prefixes;
+    return ops < BENCH_MIN_SCAN_OPS ? BENCH_MIN_SCAN_OPS : ops;
+}
+
+// keeps the compiler from dropping calls whose result is unused
+volatile int64_t bench_sink;
+
+void bench_match_ips(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    (void) router_state;
+    int64_t sink = 0;
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        RouterTableEntry *query = &data->exact_queries[i & (BENCH_QUERY_POOL_SIZE - 1)];
+        RouterTableEntry *entry = &data->prefixes[i % data->num_prefixes];
+        sink += match_ips(query->destination, entry->destination);
+    }
+    bench_sink = sink;
+}
+
+void bench_is_network_subsumed(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    (void) router_state;
+    int64_t sink = 0;
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        RouterTableEntry *query = &data->subsume_queries[i & (BENCH_QUERY_POOL_SIZE - 1)];
+        RouterTableEntry *entry = &data->prefixes[i % data->num_prefixes];
+        sink += is_network_subsumed(query->destination, query->netmask, entry->destination, entry->netmask);
+    }
+    bench_sink = sink;
+}
+
+void bench_find_exacts(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    int64_t sink = 0;
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        RouterTableEntry *query = &data->exact_queries[i & (BENCH_QUERY_POOL_SIZE - 1)];
+        sink += find_index_of_network_that_exacts(router_state, query->destination, query->netmask);
+    }
+    bench_sink = sink;
+}
+
+void bench_find_subsumes(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    int64_t sink = 0;
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        RouterTableEntry *query = &data->subsume_queries[i & (BENCH_QUERY_POOL_SIZE - 1)];
+        sink += find_index_of_network_that_subsumes(router_state, query->destination, query->netmask);
+    }
+    bench_sink = sink;
+}
+
+void bench_add_to_table_at_pos(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        RouterTableEntry *entry = &data->new_prefixes[i & (BENCH_QUERY_POOL_SIZE - 1)];
+        int pos = data->exact_queries[i & (BENCH_QUERY_POOL_SIZE - 1)].metric * (router_state->num_entries / 16);
+        add_to_table_at_pos(router_state, pos,
+                entry->destination, entry->netmask,
+                entry->gateway, entry->interface, entry->metric
+        );
+    }
+}
+
+/* rip_listen per-entry loop, ops are received entries */
+void apply_bench_packets(RouterState *router_state, RouterTableEntry *pool, uint32_t first_op, uint32_t num_ops) {
+    InterfaceTableEntry curr_interface = router_state->interfaces[0];
+    RouterTableEntry received_table[ROUTER_TABLE_MAX_SIZE];
+
+    for (uint32_t i = first_op; i < first_op + num_ops; i += ROUTER_TABLE_MAX_SIZE) {
+        uint32_t num_received = first_op + num_ops - i < ROUTER_TABLE_MAX_SIZE ? first_op + num_ops - i : ROUTER_TABLE_MAX_SIZE;
+        for (uint32_t j = 0; j < num_received; j++) {
+            received_table[j] = pool[(i + j) & (BENCH_QUERY_POOL_SIZE - 1)];
+        }
+        apply_router_update(router_state, &curr_interface, BENCH_SENDER_IP, received_table, num_received);
+    }
+}
+
+void bench_update_known(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    apply_bench_packets(router_state, data->readvertised, first_op, num_ops);
+}
+
+void bench_update_new(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    apply_bench_packets(router_state, data->new_prefixes, first_op, num_ops);
+}
+
+// kept across repetitions like the broadcaster's, only its first cycles grow it
+Arena bench_cycle_arena;
+
+// run_broadcast_cycle's sender, nothing goes on the wire
+int count_broadcast_packet(void *arg_sink, InterfaceTableEntry *interface, uint8_t *packet, uint32_t packet_size) {
+    (void) interface;
+    *(int64_t*) arg_sink += packet_size + packet[packet_size - 1];
+    return 0;
+}
+
+/* rip_broadcaster cycle as peer-listen runs it, without the socket.
+ * ops are cycles
+ * */
+void bench_broadcast_cycle(BenchData *data, RouterState *router_state, uint32_t first_op, uint32_t num_ops) {
+    (void) data;
+    int64_t sink = 0;
+    for (uint32_t i = first_op; i < first_op + num_ops; i++) {
+        run_broadcast_cycle(router_state, &bench_cycle_arena, count_broadcast_packet, &sink);
+    }
+    bench_sink = sink;
+}
+
+typedef void (*BenchFunction)(BenchData*, RouterState*, uint32_t first_op, uint32_t num_ops);
+
+typedef struct {
+    const char *name;
+    BenchFunction function;
+    int is_scan;
+    // grows the tables, which are restored after every batch
+    int is_growing;
+} Benchmark;
+
+/* growing benchmarks add at most an eighth of the table per batch,
+ * so the table size stays close to num_prefixes
+ * */
+uint32_t get_batch_size(Benchmark *benchmark, BenchData *data, uint32_t num_ops) {
+    if (!benchmark->is_growing) {
+        return num_ops;
+    }
+
+    uint32_t batch_size = data->num_prefixes / 8;
+    return batch_size < 1 ? 1 : batch_size;
+}
+
+/* best of BENCH_REPETITIONS, allocations of the last repetition
+ * */
+void run_benchmark(Benchmark *benchmark, BenchData *data) {
+    uint32_t num_ops = benchmark->is_scan ? get_scan_ops(data) : BENCH_FAST_OPS;
+    if (benchmark->is_growing && num_ops > BENCH_QUERY_POOL_SIZE) {
+        // every new prefix is inserted at most once per repetition
+        num_ops = BENCH_QUERY_POOL_SIZE;
+    }
+    const uint32_t batch_size = get_batch_size(benchmark, data, num_ops);
+
+    RouterState *router_state = create_bench_router_state(data, benchmark->is_growing ? batch_size : 0);
+    const uint32_t life_entries = router_state->life_entries;
+
+    double best_ns = 0;
+    uint64_t allocations = 0;
+    for (uint32_t i = 0; i < BENCH_REPETITIONS; i++) {
+        double elapsed_ns = 0;
+        allocations = 0;
+
+        for (uint32_t first_op = 0; first_op < num_ops; first_op += batch_size) {
+            const uint32_t num_batch_ops = num_ops - first_op < batch_size ? num_ops - first_op : batch_size;
+            if (benchmark->is_growing) {
+                restore_bench_router_state(router_state, data, life_entries);
+            }
+
+            struct timespec start, end;
+            uint64_t allocations_before = num_allocations;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            benchmark->function(data, router_state, first_op, num_batch_ops);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            allocations += num_allocations - allocations_before;
+            elapsed_ns += get_elapsed_ns(&start, &end);
+        }
+
+        if (i == 0 || elapsed_ns < best_ns) {
+            best_ns = elapsed_ns;
+        }
+    }
+
+    printf("%-36s %10u %10u %12.1f %10.3f\n",
+            benchmark->name, data->num_prefixes, num_ops,
+            best_ns / num_ops, (double) allocations / num_ops);
+
+    free_bench_router_state(router_state);
+}
+
+Benchmark benchmarks[] = {
+    { "match_ips", bench_match_ips, 0, 0 },
+    { "is_network_subsumed", bench_is_network_subsumed, 0, 0 },
+    { "find_index_of_network_that_exacts", bench_find_exacts, 0, 0 },
+    { "find_index_of_network_that_subsumes", bench_find_subsumes, 1, 0 },
+    { "add_to_table_at_pos", bench_add_to_table_at_pos, 1, 1 },
+    { "rip_listen update, known routes", bench_update_known, 0, 0 },
+    { "rip_listen update, new routes", bench_update_new, 1, 1 },
+    { "rip_broadcaster cycle", bench_broadcast_cycle, 1, 0 },
+};
+
+int main(int argc, char *argv[]) {
+    uint32_t default_sizes[] = { 10, 100, 10000, 1000000 };
+    uint32_t num_sizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+    uint32_t *sizes = default_sizes;
+
+    if (argc > 1) {
+        num_sizes = argc - 1;
+        sizes = malloc(num_sizes * sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_sizes; i++) {
+            int size = atoi(argv[i + 1]);
+            if (size <= 0) {
+                errno = EINVAL;
+                perror("Usage: bench [num_prefixes ...]");
+                exit(EXIT_FAILURE);
+            }
+            sizes[i] = size;
+        }
+    }
+
+    setbuf(stdout, NULL);
+    enable_logging = 0;
+
+    printf("%-36s %10s %10s %12s %10s\n", "benchmark", "prefixes", "ops", "ns/op", "allocs/op");
+    init_arena(&bench_cycle_arena, 0);
+    for (uint32_t i = 0; i < num_sizes; i++) {
+        BenchData data;
+        create_bench_data(&data, sizes[i]);
+        for (uint32_t j = 0; j < sizeof(benchmarks) / sizeof(benchmarks[0]); j++) {
+            run_benchmark(&benchmarks[j], &data);
+        }
+        free_bench_data(&data);
+    }
+    free_arena(&bench_cycle_arena);
+
+    if (sizes != default_sizes) {
+        free(sizes);
+    }
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,307 @@
+#include "capture.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+const uint32_t CAPTURE_RING_SIZE = 1024;
+const uint32_t CAPTURE_FLUSH_MS = 20;
+
+const uint32_t PCAP_MAGIC_MICROSECONDS = 0xa1b2c3d4;
+const uint32_t PCAP_MAGIC_NANOSECONDS = 0xa1b23c4d;
+const uint32_t LINKTYPE_ETHERNET = 1;
+const uint32_t LINKTYPE_RAW = 101;
+const uint32_t LINKTYPE_IPV4 = 228;
+const uint32_t IPV4_HEADER_SIZE = 20;
+const uint32_t UDP_HEADER_SIZE = 8;
+const uint32_t ETHERNET_HEADER_SIZE = 14;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t link_type;
+} PcapFileHeader;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t captured_size;
+    uint32_t original_size;
+} PcapRecordHeader;
+
+CaptureSlot* get_capture_slot(Capture *capture, uint64_t pos) {
+    return (CaptureSlot*) (capture->slots + (pos & (capture->num_slots - 1)) * capture->slot_size);
+}
+
+uint16_t get_ipv4_checksum(uint8_t *header) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < IPV4_HEADER_SIZE; i += 2) {
+        sum += (header[i] << 8) | header[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+void write_capture_slot(Capture *capture, CaptureSlot *slot) {
+    uint8_t headers[IPV4_HEADER_SIZE + UDP_HEADER_SIZE];
+    memset(headers, 0, sizeof(headers));
+
+    uint16_t ip_size = htons(IPV4_HEADER_SIZE + UDP_HEADER_SIZE + slot->packet_size);
+    headers[0] = 0x45;
+    memcpy(headers + 2, &ip_size, 2);
+    headers[8] = 64;
+    headers[9] = IPPROTO_UDP;
+    memcpy(headers + 12, slot->src_ip, 4);
+    memcpy(headers + 16, slot->dst_ip, 4);
+    uint16_t checksum = htons(get_ipv4_checksum(headers));
+    memcpy(headers + 10, &checksum, 2);
+
+    uint16_t port = htons(BROADCAST_PORT);
+    uint16_t udp_size = htons(UDP_HEADER_SIZE + slot->packet_size);
+    memcpy(headers + IPV4_HEADER_SIZE, &port, 2);
+    memcpy(headers + IPV4_HEADER_SIZE + 2, &port, 2);
+    memcpy(headers + IPV4_HEADER_SIZE + 4, &udp_size, 2);
+
+    PcapRecordHeader record = {
+        .ts_sec = slot->timestamp_ns / 1000000000,
+        .ts_frac = slot->timestamp_ns % 1000000000,
+        .captured_size = sizeof(headers) + slot->captured_size,
+        .original_size = sizeof(headers) + slot->packet_size
+    };
+    fwrite(&record, sizeof(record), 1, capture->file);
+    fwrite(headers, sizeof(headers), 1, capture->file);
+    fwrite(slot->data, slot->captured_size, 1, capture->file);
+}
+
+/* returns the number of datagrams written
+ * */
+uint32_t drain_capture(Capture *capture) {
+    uint32_t num_written = 0;
+
+    for (;;) {
+        CaptureSlot *slot = get_capture_slot(capture, capture->dequeue_pos);
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != capture->dequeue_pos + 1) {
+            break;
+        }
+
+        write_capture_slot(capture, slot);
+        atomic_store_explicit(&slot->sequence, capture->dequeue_pos + capture->num_slots, memory_order_release);
+        capture->dequeue_pos += 1;
+        num_written += 1;
+    }
+
+    capture->packets_written += num_written;
+    return num_written;
+}
+
+void* capture_writer(void *arg_capture) {
+    Capture *capture = (Capture*) arg_capture;
+
+    for (;;) {
+        if (drain_capture(capture) > 0) {
+            fflush(capture->file);
+            continue;
+        }
+
+        if (wait_for_wakeup(capture->stop_fd, CAPTURE_FLUSH_MS)) {
+            break;
+        }
+    }
+
+    // datagrams pushed before the stop
+    drain_capture(capture);
+    fflush(capture->file);
+    return NULL;
+}
+
+Capture* start_capture(const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("capture file open failed");
+        return NULL;
+    }
+
+    Capture *capture = calloc(1, sizeof(Capture));
+    capture->file = file;
+    capture->num_slots = CAPTURE_RING_SIZE;
+    // rip_listen never receives more than BUFFER_SIZE, longer broadcasts are truncated
+    capture->slot_size = (sizeof(CaptureSlot) + BUFFER_SIZE + 7) & ~7u;
+    capture->slots = malloc((size_t) capture->num_slots * capture->slot_size);
+    for (uint32_t i = 0; i < capture->num_slots; i++) {
+        atomic_init(&get_capture_slot(capture, i)->sequence, i);
+    }
+    atomic_init(&capture->enqueue_pos, 0);
+    atomic_init(&capture->packets_dropped, 0);
+
+    PcapFileHeader header = {
+        .magic = PCAP_MAGIC_NANOSECONDS,
+        .version_major = 2,
+        .version_minor = 4,
+        .snaplen = IPV4_HEADER_SIZE + UDP_HEADER_SIZE + BUFFER_SIZE,
+        .link_type = LINKTYPE_IPV4
+    };
+    fwrite(&header, sizeof(header), 1, capture->file);
+
+    capture->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (capture->stop_fd < 0) {
+        perror("eventfd creation failed");
+        fclose(capture->file);
+        free(capture->slots);
+        free(capture);
+        return NULL;
+    }
+
+    if (pthread_create(&capture->writer, NULL, capture_writer, capture)) {
+        perror("Error initializing threads.");
+        close(capture->stop_fd);
+        fclose(capture->file);
+        free(capture->slots);
+        free(capture);
+        return NULL;
+    }
+
+    return capture;
+}
+
+/* called from any router thread. returns -1 when the ring is full
+ * and the datagram was dropped
+ * */
+int capture_packet(Capture *capture, uint8_t *src_ip, uint8_t *dst_ip, uint8_t *packet, uint32_t packet_size) {
+    uint64_t pos = atomic_load_explicit(&capture->enqueue_pos, memory_order_relaxed);
+    CaptureSlot *slot;
+
+    for (;;) {
+        slot = get_capture_slot(capture, pos);
+        const int64_t diff = (int64_t) atomic_load_explicit(&slot->sequence, memory_order_acquire) - (int64_t) pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&capture->enqueue_pos, &pos, pos + 1,
+                        memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the writer is a whole ring behind
+            atomic_fetch_add(&capture->packets_dropped, 1);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&capture->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    slot->timestamp_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    memcpy(slot->src_ip, src_ip, 4);
+    memcpy(slot->dst_ip, dst_ip, 4);
+    slot->packet_size = packet_size;
+    slot->captured_size = packet_size < BUFFER_SIZE ? packet_size : BUFFER_SIZE;
+    memcpy(slot->data, packet, slot->captured_size);
+
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return 0;
+}
+
+void stop_capture(Capture *capture) {
+    signal_wakeup(capture->stop_fd);
+    pthread_join(capture->writer, NULL);
+
+    log_printf("capture: %lu datagrams written, %lu dropped\n",
+            capture->packets_written, atomic_load(&capture->packets_dropped));
+
+    close(capture->stop_fd);
+    fclose(capture->file);
+    free(capture->slots);
+    free(capture);
+}
+
+int open_capture_reader(const char *filename, CaptureReader *reader) {
+    memset(reader, 0, sizeof(CaptureReader));
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) {
+        perror("capture file open failed");
+        return -1;
+    }
+
+    PcapFileHeader header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1 ||
+            (header.magic != PCAP_MAGIC_MICROSECONDS && header.magic != PCAP_MAGIC_NANOSECONDS) ||
+            (header.link_type != LINKTYPE_IPV4 && header.link_type != LINKTYPE_RAW &&
+             header.link_type != LINKTYPE_ETHERNET)) {
+        errno = EINVAL;
+        perror("not a native byte order IPv4 pcap file");
+        fclose(reader->file);
+        return -1;
+    }
+
+    reader->link_type = header.link_type;
+    reader->is_nanosecond = header.magic == PCAP_MAGIC_NANOSECONDS;
+    reader->buffer_size = header.snaplen > BUFFER_SIZE ? header.snaplen : BUFFER_SIZE;
+    reader->buffer = malloc(reader->buffer_size);
+    return 0;
+}
+
+/* next udp datagram to BROADCAST_PORT, anything else is skipped.
+ * returns 1 on success, 0 at the end of the file, -1 on a corrupt file
+ * */
+int read_captured_packet(CaptureReader *reader, CapturedPacket *packet) {
+    PcapRecordHeader record;
+
+    while (fread(&record, sizeof(record), 1, reader->file) == 1) {
+        if (record.captured_size > reader->buffer_size) {
+            errno = EINVAL;
+            perror("corrupt pcap record");
+            return -1;
+        }
+        if (fread(reader->buffer, record.captured_size, 1, reader->file) != 1) {
+            return 0;
+        }
+
+        uint8_t *ip_header = reader->buffer;
+        uint32_t remaining = record.captured_size;
+        if (reader->link_type == LINKTYPE_ETHERNET) {
+            if (remaining < ETHERNET_HEADER_SIZE || reader->buffer[12] != 0x08 || reader->buffer[13] != 0x00) {
+                continue;
+            }
+            ip_header += ETHERNET_HEADER_SIZE;
+            remaining -= ETHERNET_HEADER_SIZE;
+        }
+
+        if (remaining < IPV4_HEADER_SIZE || (ip_header[0] >> 4) != 4 || ip_header[9] != IPPROTO_UDP) {
+            continue;
+        }
+        const uint32_t ip_header_size = (ip_header[0] & 0x0f) * 4;
+        if (remaining < ip_header_size + UDP_HEADER_SIZE) {
+            continue;
+        }
+
+        uint8_t *udp_header = ip_header + ip_header_size;
+        uint16_t dst_port;
+        memcpy(&dst_port, udp_header + 2, 2);
+        if (ntohs(dst_port) != BROADCAST_PORT) {
+            continue;
+        }
+
+        packet->timestamp_ns = (uint64_t) record.ts_sec * 1000000000ULL +
+            (reader->is_nanosecond ? record.ts_frac : record.ts_frac * 1000ULL);
+        memcpy(packet->src_ip, ip_header + 12, 4);
+        memcpy(packet->dst_ip, ip_header + 16, 4);
+        packet->data = udp_header + UDP_HEADER_SIZE;
+        packet->size = remaining - ip_header_size - UDP_HEADER_SIZE;
+        return 1;
+    }
+
+    return 0;
+}
+
+void close_capture_reader(CaptureReader *reader) {
+    fclose(reader->file);
+    free(reader->buffer);
+}
@@ -0,0 +1,77 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <first.h>
+
+/* pcap capture of router protocol datagrams.
+ *
+ * router threads push into a bounded lock-free ring (one sequence number
+ * per slot), a writer thread drains it into the file. a full ring drops
+ * the datagram and counts it, the router never waits for the disk.
+ * datagrams are written as IPv4/UDP packets (LINKTYPE_IPV4), so
+ * wireshark and tcpdump read the files as well
+ * */
+
+typedef struct {
+    atomic_ulong sequence;
+    uint64_t timestamp_ns;
+    uint8_t src_ip[4];
+    uint8_t dst_ip[4];
+    uint32_t packet_size;
+    uint32_t captured_size;
+    uint8_t data[];
+} CaptureSlot;
+
+struct Capture {
+    uint8_t *slots;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    // claimed by producers
+    atomic_ulong enqueue_pos;
+    // writer thread only
+    uint64_t dequeue_pos;
+    atomic_ulong packets_dropped;
+    uint64_t packets_written;
+    FILE *file;
+    int stop_fd;
+    pthread_t writer;
+};
+
+// one datagram read back from a capture
+typedef struct {
+    uint64_t timestamp_ns;
+    uint8_t src_ip[4];
+    uint8_t dst_ip[4];
+    uint32_t size;
+    // points into the reader's buffer, valid until the next read
+    uint8_t *data;
+} CapturedPacket;
+
+typedef struct {
+    FILE *file;
+    uint32_t link_type;
+    int is_nanosecond;
+    uint8_t *buffer;
+    uint32_t buffer_size;
+} CaptureReader;
+
+extern const uint32_t CAPTURE_RING_SIZE;
+extern const uint32_t CAPTURE_FLUSH_MS;
+
+Capture* start_capture(const char *filename);
+
+int capture_packet(Capture *capture, uint8_t *src_ip, uint8_t *dst_ip, uint8_t *packet, uint32_t packet_size);
+
+void stop_capture(Capture *capture);
+
+int open_capture_reader(const char *filename, CaptureReader *reader);
+
+int read_captured_packet(CaptureReader *reader, CapturedPacket *packet);
+
+void close_capture_reader(CaptureReader *reader);
+
+#endif
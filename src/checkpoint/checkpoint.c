@@ -0,0 +1,247 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const uint32_t CHECKPOINT_VERSION = 1;
+const uint32_t CHECKPOINT_INTERVAL = 5;
+const uint8_t CHECKPOINT_MAGIC[8] = { 'R', 'I', 'P', 'C', 'K', 'P', 'T', '\0' };
+
+void get_checkpoint_filename(uint32_t router_id, char *filename, size_t filename_size) {
+    snprintf(filename, filename_size, "router_%u.ckpt", router_id);
+}
+
+size_t get_checkpoint_slot_size(uint32_t max_entries) {
+    return sizeof(CheckpointSlotHeader) +
+        max_entries * (sizeof(RouterTableEntry) + sizeof(LifeTableEntry));
+}
+
+size_t get_checkpoint_file_size(uint32_t max_entries) {
+    return sizeof(CheckpointFileHeader) + 2 * get_checkpoint_slot_size(max_entries);
+}
+
+CheckpointSlotHeader* get_checkpoint_slot(uint8_t *map, uint32_t max_entries, uint32_t slot) {
+    return (CheckpointSlotHeader*) (map + sizeof(CheckpointFileHeader) +
+            slot * get_checkpoint_slot_size(max_entries));
+}
+
+uint32_t get_checkpoint_slot_checksum(CheckpointSlotHeader *slot_header, uint32_t max_entries) {
+    uint8_t *payload = (uint8_t*) (slot_header + 1);
+
+    uint32_t hash = FNV1A_OFFSET_BASIS;
+    hash = fnv1a(hash, &slot_header->sequence, sizeof(slot_header->sequence));
+    hash = fnv1a(hash, &slot_header->written_at, sizeof(slot_header->written_at));
+    hash = fnv1a(hash, &slot_header->num_entries, sizeof(slot_header->num_entries));
+    hash = fnv1a(hash, &slot_header->life_entries, sizeof(slot_header->life_entries));
+    hash = fnv1a(hash, payload, slot_header->num_entries * sizeof(RouterTableEntry));
+    hash = fnv1a(hash,
+            payload + max_entries * sizeof(RouterTableEntry),
+            slot_header->life_entries * sizeof(LifeTableEntry)
+    );
+    return hash;
+}
+
+int is_checkpoint_slot_valid(CheckpointSlotHeader *slot_header, uint32_t max_entries) {
+    if (slot_header->sequence == 0 ||
+            slot_header->num_entries > max_entries ||
+            slot_header->life_entries > max_entries) {
+        return 0;
+    }
+
+    return slot_header->checksum == get_checkpoint_slot_checksum(slot_header, max_entries);
+}
+
+int is_checkpoint_header_valid(CheckpointFileHeader *file_header, uint32_t router_id, size_t file_size) {
+    return memcmp(file_header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0 &&
+        file_header->version == CHECKPOINT_VERSION &&
+        file_header->router_id == router_id &&
+        file_size == get_checkpoint_file_size(file_header->max_entries);
+}
+
+/* maps router_<id>.ckpt for writing. a file from another router,
+ * version or table size is reset
+ * */
+Checkpoint* open_checkpoint(uint32_t router_id, uint32_t max_entries) {
+    char filename[100];
+    get_checkpoint_filename(router_id, filename, sizeof(filename));
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("checkpoint open failed");
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        perror("checkpoint stat failed");
+        close(fd);
+        return NULL;
+    }
+
+    const size_t map_size = get_checkpoint_file_size(max_entries);
+    int needs_reset = 1;
+    if (file_stat.st_size == map_size) {
+        CheckpointFileHeader file_header;
+        if (pread(fd, &file_header, sizeof(file_header), 0) == sizeof(file_header) &&
+                is_checkpoint_header_valid(&file_header, router_id, map_size)) {
+            needs_reset = 0;
+        }
+    }
+
+    if (needs_reset && ftruncate(fd, 0) < 0) {
+        perror("checkpoint truncate failed");
+        close(fd);
+        return NULL;
+    }
+    if (ftruncate(fd, map_size) < 0) {
+        perror("checkpoint truncate failed");
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("checkpoint mmap failed");
+        close(fd);
+        return NULL;
+    }
+
+    Checkpoint *checkpoint = malloc(sizeof(Checkpoint));
+    checkpoint->fd = fd;
+    checkpoint->map = map;
+    checkpoint->map_size = map_size;
+    checkpoint->max_entries = max_entries;
+    checkpoint->sequence = 0;
+
+    if (needs_reset) {
+        CheckpointFileHeader *file_header = (CheckpointFileHeader*) map;
+        memcpy(file_header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        file_header->version = CHECKPOINT_VERSION;
+        file_header->router_id = router_id;
+        file_header->max_entries = max_entries;
+        file_header->reserved = 0;
+    } else {
+        for (uint32_t slot = 0; slot < 2; slot++) {
+            CheckpointSlotHeader *slot_header = get_checkpoint_slot(map, max_entries, slot);
+            if (is_checkpoint_slot_valid(slot_header, max_entries) &&
+                    slot_header->sequence > checkpoint->sequence) {
+                checkpoint->sequence = slot_header->sequence;
+            }
+        }
+    }
+
+    return checkpoint;
+}
+
+/* copies the router and life tables into the older slot. the read lock is
+ * held only for the two copies, checksumming happens after releasing it
+ * */
+int write_checkpoint(Checkpoint *checkpoint, RouterState *router_state) {
+    const uint64_t next_sequence = checkpoint->sequence + 1;
+    CheckpointSlotHeader *slot_header =
+        get_checkpoint_slot(checkpoint->map, checkpoint->max_entries, next_sequence % 2);
+    uint8_t *payload = (uint8_t*) (slot_header + 1);
+
+    // a crash while copying must not leave a slot that looks valid
+    slot_header->sequence = 0;
+
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
+    uint32_t num_entries = router_state->num_entries;
+    uint32_t life_entries = router_state->life_entries;
+    if (num_entries > checkpoint->max_entries) {
+        num_entries = checkpoint->max_entries;
+    }
+    if (life_entries > checkpoint->max_entries) {
+        life_entries = checkpoint->max_entries;
+    }
+    memcpy(payload, router_state->router_table, num_entries * sizeof(RouterTableEntry));
+    copy_life_table((LifeTableEntry*) (payload + checkpoint->max_entries * sizeof(RouterTableEntry)),
+           router_state->life_table,
+           life_entries
+    );
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+
+    slot_header->written_at = time(NULL);
+    slot_header->num_entries = num_entries;
+    slot_header->life_entries = life_entries;
+    slot_header->sequence = next_sequence;
+    slot_header->checksum = get_checkpoint_slot_checksum(slot_header, checkpoint->max_entries);
+
+    if (msync(checkpoint->map, checkpoint->map_size, MS_ASYNC) < 0) {
+        perror("checkpoint msync failed");
+        return -1;
+    }
+
+    checkpoint->sequence = next_sequence;
+    return 0;
+}
+
+/* maps router_<id>.ckpt read-only and copies out the newest valid slot.
+ * returns -1 if there is no usable checkpoint
+ * */
+int read_checkpoint(uint32_t router_id,
+        RouterTableEntry *router_table, uint32_t *num_entries,
+        LifeTableEntry *life_table, uint32_t *life_entries,
+        uint32_t max_entries) {
+    char filename[100];
+    get_checkpoint_filename(router_id, filename, sizeof(filename));
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 || file_stat.st_size < sizeof(CheckpointFileHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    CheckpointFileHeader *file_header = (CheckpointFileHeader*) map;
+    CheckpointSlotHeader *newest_slot = NULL;
+    if (is_checkpoint_header_valid(file_header, router_id, file_stat.st_size)) {
+        for (uint32_t slot = 0; slot < 2; slot++) {
+            CheckpointSlotHeader *slot_header = get_checkpoint_slot(map, file_header->max_entries, slot);
+            if (is_checkpoint_slot_valid(slot_header, file_header->max_entries) &&
+                    (newest_slot == NULL || slot_header->sequence > newest_slot->sequence)) {
+                newest_slot = slot_header;
+            }
+        }
+    }
+
+    if (newest_slot == NULL) {
+        munmap(map, file_stat.st_size);
+        return -1;
+    }
+
+    uint8_t *payload = (uint8_t*) (newest_slot + 1);
+    *num_entries = newest_slot->num_entries < max_entries ? newest_slot->num_entries : max_entries;
+    *life_entries = newest_slot->life_entries < max_entries ? newest_slot->life_entries : max_entries;
+    memcpy(router_table, payload, *num_entries * sizeof(RouterTableEntry));
+    memcpy(life_table,
+           payload + file_header->max_entries * sizeof(RouterTableEntry),
+           *life_entries * sizeof(LifeTableEntry)
+    );
+
+    munmap(map, file_stat.st_size);
+    return 0;
+}
+
+void close_checkpoint(Checkpoint *checkpoint) {
+    msync(checkpoint->map, checkpoint->map_size, MS_SYNC);
+    munmap(checkpoint->map, checkpoint->map_size);
+    close(checkpoint->fd);
+    free(checkpoint);
+}
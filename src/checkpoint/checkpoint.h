@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <first.h>
+
+/* on-disk layout (native byte order):
+ *
+ * CheckpointFileHeader
+ * 2 x [ CheckpointSlotHeader
+ *       RouterTableEntry[max_entries]
+ *       LifeTableEntry[max_entries] ]
+ *
+ * slots are written alternately, so a crash in the middle of a write
+ * always leaves the previous slot intact. the newest slot with a valid
+ * checksum wins
+ * */
+typedef struct {
+    uint8_t magic[8];
+    uint32_t version;
+    uint32_t router_id;
+    uint32_t max_entries;
+    uint32_t reserved;
+} CheckpointFileHeader;
+
+typedef struct {
+    uint64_t sequence;
+    uint64_t written_at;
+    uint32_t num_entries;
+    uint32_t life_entries;
+    uint32_t checksum;
+    uint32_t reserved;
+} CheckpointSlotHeader;
+
+typedef struct {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint32_t max_entries;
+    uint64_t sequence;
+} Checkpoint;
+
+extern const uint32_t CHECKPOINT_VERSION;
+extern const uint32_t CHECKPOINT_INTERVAL;
+
+Checkpoint* open_checkpoint(uint32_t router_id, uint32_t max_entries);
+
+int write_checkpoint(Checkpoint *checkpoint, RouterState *router_state);
+
+int read_checkpoint(uint32_t router_id,
+        RouterTableEntry *router_table, uint32_t *num_entries,
+        LifeTableEntry *life_table, uint32_t *life_entries,
+        uint32_t max_entries);
+
+void close_checkpoint(Checkpoint *checkpoint);
+
+#endif
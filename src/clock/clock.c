@@ -0,0 +1,201 @@
+#include "clock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const uint32_t EVENT_SCHEDULER_INITIAL_SIZE = 1024;
+
+/* splitmix64, small and good enough to spread seeds and delays
+ * */
+uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t clock_now_ms(Clock *clock) {
+    return clock->now_ms(clock);
+}
+
+int clock_sleep(Clock *clock, int wakeup_fd, uint32_t seconds) {
+    return clock->sleep_ms(clock, wakeup_fd, (uint64_t) seconds * 1000);
+}
+
+uint32_t clock_random(Clock *clock) {
+    return clock->random(clock);
+}
+
+uint32_t clock_random_below(Clock *clock, uint32_t bound) {
+    if (bound == 0) {
+        return 0;
+    }
+
+    return clock->random(clock) % bound;
+}
+
+// in [0, 1)
+double clock_random_unit(Clock *clock) {
+    return clock->random(clock) / 4294967296.0;
+}
+
+uint64_t system_now_ms(Clock *clock) {
+    (void) clock;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int system_sleep_ms(Clock *clock, int wakeup_fd, uint64_t duration_ms) {
+    (void) clock;
+    return wait_for_wakeup(wakeup_fd, duration_ms);
+}
+
+uint32_t system_random(Clock *clock) {
+    SystemClock *system_clock = (SystemClock*) clock;
+    pthread_mutex_lock(&system_clock->random_mutex);
+    uint32_t random = next_random(&system_clock->random_state) >> 32;
+    pthread_mutex_unlock(&system_clock->random_mutex);
+    return random;
+}
+
+SystemClock* create_system_clock(uint64_t seed) {
+    SystemClock *system_clock = malloc(sizeof(SystemClock));
+    system_clock->clock.now_ms = system_now_ms;
+    system_clock->clock.sleep_ms = system_sleep_ms;
+    system_clock->clock.random = system_random;
+    system_clock->random_state = seed;
+    pthread_mutex_init(&system_clock->random_mutex, NULL);
+    return system_clock;
+}
+
+void free_system_clock(SystemClock *system_clock) {
+    pthread_mutex_destroy(&system_clock->random_mutex);
+    free(system_clock);
+}
+
+int is_event_before(ScheduledEvent *first, ScheduledEvent *second) {
+    if (first->at_ms != second->at_ms) {
+        return first->at_ms < second->at_ms;
+    }
+
+    return first->sequence < second->sequence;
+}
+
+void swap_events(ScheduledEvent *first, ScheduledEvent *second) {
+    ScheduledEvent tmp = *first;
+    *first = *second;
+    *second = tmp;
+}
+
+void schedule_event(EventScheduler *scheduler, uint64_t delay_ms, EventCallback callback, void *arg) {
+    if (scheduler->num_events >= scheduler->max_events) {
+        scheduler->max_events *= 2;
+        scheduler->events = realloc(scheduler->events, scheduler->max_events * sizeof(ScheduledEvent));
+    }
+
+    uint32_t i = scheduler->num_events;
+    scheduler->events[i].at_ms = scheduler->now_ms + delay_ms;
+    scheduler->events[i].sequence = scheduler->next_sequence;
+    scheduler->events[i].callback = callback;
+    scheduler->events[i].arg = arg;
+    scheduler->next_sequence += 1;
+    scheduler->num_events += 1;
+
+    while (i > 0 && is_event_before(&scheduler->events[i], &scheduler->events[(i - 1) / 2])) {
+        swap_events(&scheduler->events[i], &scheduler->events[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+}
+
+/* returns 0 if nothing is scheduled
+ * */
+int get_next_event_time(EventScheduler *scheduler, uint64_t *at_ms) {
+    if (scheduler->num_events == 0) {
+        return 0;
+    }
+
+    *at_ms = scheduler->events[0].at_ms;
+    return 1;
+}
+
+/* advances the virtual time to the earliest event and runs it.
+ * returns 0 if nothing is scheduled
+ * */
+int run_next_event(EventScheduler *scheduler) {
+    if (scheduler->num_events == 0) {
+        return 0;
+    }
+
+    ScheduledEvent next_event = scheduler->events[0];
+    scheduler->num_events -= 1;
+    scheduler->events[0] = scheduler->events[scheduler->num_events];
+
+    uint32_t i = 0;
+    while (1) {
+        uint32_t smallest = i;
+        uint32_t left = 2 * i + 1;
+        uint32_t right = 2 * i + 2;
+        if (left < scheduler->num_events && is_event_before(&scheduler->events[left], &scheduler->events[smallest])) {
+            smallest = left;
+        }
+        if (right < scheduler->num_events && is_event_before(&scheduler->events[right], &scheduler->events[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+
+        swap_events(&scheduler->events[i], &scheduler->events[smallest]);
+        i = smallest;
+    }
+
+    scheduler->now_ms = next_event.at_ms;
+    next_event.callback(next_event.arg);
+    return 1;
+}
+
+void run_events_until(EventScheduler *scheduler, uint64_t until_ms) {
+    uint64_t next_at_ms;
+    while (get_next_event_time(scheduler, &next_at_ms) && next_at_ms <= until_ms) {
+        run_next_event(scheduler);
+    }
+
+    if (until_ms > scheduler->now_ms) {
+        scheduler->now_ms = until_ms;
+    }
+}
+
+uint64_t scheduler_now_ms(Clock *clock) {
+    return ((EventScheduler*) clock)->now_ms;
+}
+
+/* sleeping in virtual time runs everything that is due meanwhile.
+ * nothing can signal wakeup_fd from outside, so it is never woken
+ * */
+int scheduler_sleep_ms(Clock *clock, int wakeup_fd, uint64_t duration_ms) {
+    (void) wakeup_fd;
+    EventScheduler *scheduler = (EventScheduler*) clock;
+    run_events_until(scheduler, scheduler->now_ms + duration_ms);
+    return 0;
+}
+
+uint32_t scheduler_random(Clock *clock) {
+    return next_random(&((EventScheduler*) clock)->random_state) >> 32;
+}
+
+EventScheduler* create_event_scheduler(uint64_t seed) {
+    EventScheduler *scheduler = calloc(1, sizeof(EventScheduler));
+    scheduler->clock.now_ms = scheduler_now_ms;
+    scheduler->clock.sleep_ms = scheduler_sleep_ms;
+    scheduler->clock.random = scheduler_random;
+    scheduler->random_state = seed;
+    scheduler->max_events = EVENT_SCHEDULER_INITIAL_SIZE;
+    scheduler->events = malloc(scheduler->max_events * sizeof(ScheduledEvent));
+    return scheduler;
+}
+
+void free_event_scheduler(EventScheduler *scheduler) {
+    free(scheduler->events);
+    free(scheduler);
+}
@@ -0,0 +1,77 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <first.h>
+
+/* time, sleeping and randomness as seen by router code.
+ *
+ * the system clock is wall time with poll()-based sleeps for the threads
+ * of peer-listen. the event scheduler is a discrete-event virtual clock:
+ * nothing blocks, time jumps straight to the next scheduled event, and
+ * every random number comes from the seed, so a run replays exactly
+ * */
+struct Clock {
+    uint64_t (*now_ms)(Clock *clock);
+    // returns 1 if wakeup_fd was signalled before duration_ms passed
+    int (*sleep_ms)(Clock *clock, int wakeup_fd, uint64_t duration_ms);
+    uint32_t (*random)(Clock *clock);
+};
+
+typedef struct {
+    Clock clock;
+    uint64_t random_state;
+    pthread_mutex_t random_mutex;
+} SystemClock;
+
+typedef void (*EventCallback)(void *arg);
+
+typedef struct {
+    uint64_t at_ms;
+    // insertion order breaks ties, so equal times always run the same way
+    uint64_t sequence;
+    EventCallback callback;
+    void *arg;
+} ScheduledEvent;
+
+typedef struct {
+    Clock clock;
+    uint64_t now_ms;
+    uint64_t random_state;
+    uint64_t next_sequence;
+    // binary min-heap on (at_ms, sequence)
+    ScheduledEvent *events;
+    uint32_t num_events;
+    uint32_t max_events;
+} EventScheduler;
+
+extern const uint32_t EVENT_SCHEDULER_INITIAL_SIZE;
+
+uint64_t clock_now_ms(Clock *clock);
+
+int clock_sleep(Clock *clock, int wakeup_fd, uint32_t seconds);
+
+uint32_t clock_random(Clock *clock);
+
+uint32_t clock_random_below(Clock *clock, uint32_t bound);
+
+double clock_random_unit(Clock *clock);
+
+SystemClock* create_system_clock(uint64_t seed);
+
+void free_system_clock(SystemClock *system_clock);
+
+EventScheduler* create_event_scheduler(uint64_t seed);
+
+void schedule_event(EventScheduler *scheduler, uint64_t delay_ms, EventCallback callback, void *arg);
+
+int get_next_event_time(EventScheduler *scheduler, uint64_t *at_ms);
+
+int run_next_event(EventScheduler *scheduler);
+
+void run_events_until(EventScheduler *scheduler, uint64_t until_ms);
+
+void free_event_scheduler(EventScheduler *scheduler);
+
+#endif
@@ -0,0 +1,425 @@
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+const uint32_t COMPILED_RIPTBL_VERSION = 1;
+const uint8_t COMPILED_RIPTBL_MAGIC[8] = { 'R', 'I', 'P', 'T', 'B', 'L', 'C', '\0' };
+
+int is_valid_netmask(uint8_t *netmask) {
+    uint32_t inverted_mask;
+    memcpy(&inverted_mask, netmask, 4);
+    inverted_mask = ~ntohl(inverted_mask);
+    return (inverted_mask & (inverted_mask + 1)) == 0;
+}
+
+/* stable counting sort, most specific prefix first. this is the order
+ * rip_listen keeps the table in (a network always before the one subsuming it),
+ * so sorted routes can be copied into the table without any searching
+ * */
+void sort_routes_by_prefix_length(RouterTableEntry *routes, uint32_t num_routes) {
+    uint32_t bucket_start[34] = { 0 };
+    for (uint32_t i = 0; i < num_routes; i++) {
+        bucket_start[32 - get_prefix_length(routes[i].netmask) + 1] += 1;
+    }
+    for (uint32_t i = 1; i < 34; i++) {
+        bucket_start[i] += bucket_start[i - 1];
+    }
+
+    RouterTableEntry *sorted_routes = malloc(num_routes * sizeof(RouterTableEntry));
+    for (uint32_t i = 0; i < num_routes; i++) {
+        uint32_t bucket = 32 - get_prefix_length(routes[i].netmask);
+        sorted_routes[bucket_start[bucket]++] = routes[i];
+    }
+
+    memcpy(routes, sorted_routes, num_routes * sizeof(RouterTableEntry));
+    free(sorted_routes);
+}
+
+int compare_config_keys(const void *first, const void *second) {
+    uint64_t first_key = *(const uint64_t*) first;
+    uint64_t second_key = *(const uint64_t*) second;
+    return (first_key > second_key) - (first_key < second_key);
+}
+
+/* the network with its host bits cleared, then the prefix length, then
+ * is_static in the lowest bit so equal networks sort next to each other
+ * */
+uint64_t get_network_config_key(uint8_t *ip, uint8_t *netmask, int is_static) {
+    uint32_t network;
+    uint32_t mask;
+    memcpy(&network, ip, 4);
+    memcpy(&mask, netmask, 4);
+    network = ntohl(network & mask);
+    return ((uint64_t) network << 9) | (get_prefix_length(netmask) << 1) | (is_static ? 1 : 0);
+}
+
+/* duplicate interfaces, duplicate static networks and static routes to
+ * the network of an interface are rejected. networks are compared
+ * without their host bits. done by sorting keys so it stays cheap for
+ * large riptbls
+ * */
+int has_config_duplicates(RouterConfig *config) {
+    uint64_t *keys = malloc((config->num_interfaces + config->num_static_routes + 1) * sizeof(uint64_t));
+    int has_duplicates = 0;
+
+    for (uint32_t i = 0; i < config->num_interfaces; i++) {
+        uint32_t ip;
+        memcpy(&ip, config->interfaces[i].interface_ip, 4);
+        keys[i] = ntohl(ip);
+    }
+    qsort(keys, config->num_interfaces, sizeof(uint64_t), compare_config_keys);
+    for (uint32_t i = 1; i < config->num_interfaces && !has_duplicates; i++) {
+        has_duplicates = keys[i] == keys[i - 1];
+    }
+
+    // interfaces may share a network, a static route may not
+    uint32_t num_keys = 0;
+    for (uint32_t i = 0; i < config->num_interfaces; i++) {
+        keys[num_keys++] = get_network_config_key(config->interfaces[i].interface_ip,
+                config->interfaces[i].interface_netmask, 0);
+    }
+    for (uint32_t i = 0; i < config->num_static_routes; i++) {
+        keys[num_keys++] = get_network_config_key(config->static_routes[i].destination,
+                config->static_routes[i].netmask, 1);
+    }
+    qsort(keys, num_keys, sizeof(uint64_t), compare_config_keys);
+    for (uint32_t i = 1; i < num_keys && !has_duplicates; i++) {
+        has_duplicates = (keys[i] >> 1) == (keys[i - 1] >> 1) && (keys[i] & 1);
+    }
+
+    free(keys);
+    return has_duplicates;
+}
+
+/* every static route goes out of the interface whose network contains its gateway */
+int resolve_static_route_interfaces(RouterConfig *config) {
+    uint8_t host_mask[4] = { 255, 255, 255, 255 };
+    uint32_t last_interface = 0;
+
+    for (uint32_t i = 0; i < config->num_static_routes; i++) {
+        RouterTableEntry *route = &config->static_routes[i];
+
+        // consecutive routes usually share a gateway
+        int found_interface = -1;
+        if (config->num_interfaces > 0 && is_network_subsumed(
+                    config->interfaces[last_interface].interface_ip,
+                    config->interfaces[last_interface].interface_netmask,
+                    route->gateway, host_mask)) {
+            found_interface = last_interface;
+        }
+        for (uint32_t j = 0; j < config->num_interfaces && found_interface < 0; j++) {
+            if (is_network_subsumed(
+                        config->interfaces[j].interface_ip,
+                        config->interfaces[j].interface_netmask,
+                        route->gateway, host_mask)) {
+                found_interface = j;
+            }
+        }
+
+        if (found_interface < 0) {
+            char gateway_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, route->gateway, gateway_str, sizeof(gateway_str));
+            fprintf(stderr, "riptbl: gateway %s is not on a configured interface\n", gateway_str);
+            return -1;
+        }
+
+        memcpy(route->interface, config->interfaces[found_interface].interface_ip, 4);
+        last_interface = found_interface;
+    }
+
+    return 0;
+}
+
+int parse_riptbl_text(FILE *file, RouterConfig *config) {
+    memset(config, 0, sizeof(RouterConfig));
+    uint32_t interfaces_capacity = 0;
+    uint32_t static_routes_capacity = 0;
+
+    const uint32_t MAX_LINE = 100;
+    char line[MAX_LINE];
+    uint32_t line_number = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        line_number += 1;
+        size_t line_len = strlen(line);
+        if (line[line_len - 1] != '\n' && !feof(file)) {
+            fprintf(stderr, "riptbl: line %u is too long\n", line_number);
+            goto invalid_riptbl;
+        }
+
+        char *content = line + strspn(line, " \t");
+        if (*content == '\n' || *content == '\0' || *content == '#') {
+            continue;
+        }
+
+        if (strchr(content, ',')) {
+            char dest_str[20];
+            char netmask_str[20];
+            char gateway_str[20];
+            uint32_t metric;
+            if (static_routes_capacity == config->num_static_routes) {
+                static_routes_capacity = static_routes_capacity ? static_routes_capacity * 2 : 16;
+                config->static_routes = realloc(config->static_routes, static_routes_capacity * sizeof(RouterTableEntry));
+            }
+
+            RouterTableEntry *route = &config->static_routes[config->num_static_routes];
+            if (sscanf(content, "%19[^, ] , %19[^, ] , %19[^, ] , %u",
+                        dest_str, netmask_str, gateway_str, &metric) != 4 ||
+                    inet_pton(AF_INET, dest_str, route->destination) != 1 ||
+                    inet_pton(AF_INET, netmask_str, route->netmask) != 1 ||
+                    inet_pton(AF_INET, gateway_str, route->gateway) != 1 ||
+                    !is_valid_netmask(route->netmask) ||
+                    metric >= INFINITY_METRIC
+            ) {
+                fprintf(stderr, "riptbl: invalid static route on line %u\n", line_number);
+                goto invalid_riptbl;
+            }
+
+            route->metric = metric;
+            config->num_static_routes += 1;
+        } else {
+            char ip_str[20];
+            char netmask_str[20];
+            if (interfaces_capacity == config->num_interfaces) {
+                interfaces_capacity = interfaces_capacity ? interfaces_capacity * 2 : 16;
+                config->interfaces = realloc(config->interfaces, interfaces_capacity * sizeof(InterfaceTableEntry));
+            }
+
+            InterfaceTableEntry *interface = &config->interfaces[config->num_interfaces];
+            if (sscanf(content, "%19s %19s", ip_str, netmask_str) != 2 ||
+                    inet_pton(AF_INET, ip_str, interface->interface_ip) != 1 ||
+                    inet_pton(AF_INET, netmask_str, interface->interface_netmask) != 1 ||
+                    !is_valid_netmask(interface->interface_netmask)
+            ) {
+                fprintf(stderr, "riptbl: invalid interface on line %u\n", line_number);
+                goto invalid_riptbl;
+            }
+
+            config->num_interfaces += 1;
+        }
+    }
+
+    if (has_config_duplicates(config)) {
+        fprintf(stderr, "riptbl: duplicate interface, duplicate static route or static route to an interface network\n");
+        goto invalid_riptbl;
+    }
+
+    if (resolve_static_route_interfaces(config) < 0) {
+        goto invalid_riptbl;
+    }
+
+    sort_routes_by_prefix_length(config->static_routes, config->num_static_routes);
+    return 0;
+
+invalid_riptbl:
+    free_router_config(config);
+    errno = EIO;
+    perror("Invalid riptbl file");
+    return -1;
+}
+
+int read_riptbl_text(const char *filename, RouterConfig *config) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("riptbl file reading error");
+        return -1;
+    }
+
+    int parse_rc = parse_riptbl_text(file, config);
+    fclose(file);
+    return parse_rc;
+}
+
+uint32_t get_compiled_riptbl_checksum(RouterConfig *config) {
+    uint32_t hash = FNV1A_OFFSET_BASIS;
+    hash = fnv1a(hash, &config->num_interfaces, sizeof(config->num_interfaces));
+    hash = fnv1a(hash, &config->num_static_routes, sizeof(config->num_static_routes));
+    hash = fnv1a(hash, config->interfaces, config->num_interfaces * sizeof(InterfaceTableEntry));
+    hash = fnv1a(hash, config->static_routes, config->num_static_routes * sizeof(RouterTableEntry));
+    return hash;
+}
+
+/* written to a temporary file and renamed, so a running router
+ * never maps a half written riptbl
+ * */
+int write_compiled_riptbl(const char *filename, RouterConfig *config) {
+    char tmp_filename[256];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+
+    FILE *file = fopen(tmp_filename, "wb");
+    if (!file) {
+        perror("compiled riptbl open failed");
+        return -1;
+    }
+
+    CompiledRiptblHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COMPILED_RIPTBL_MAGIC, sizeof(COMPILED_RIPTBL_MAGIC));
+    header.version = COMPILED_RIPTBL_VERSION;
+    header.num_interfaces = config->num_interfaces;
+    header.num_static_routes = config->num_static_routes;
+    header.checksum = get_compiled_riptbl_checksum(config);
+
+    int is_write_ok =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(config->interfaces, sizeof(InterfaceTableEntry), config->num_interfaces, file) == config->num_interfaces &&
+        fwrite(config->static_routes, sizeof(RouterTableEntry), config->num_static_routes, file) == config->num_static_routes;
+
+    if (fclose(file) != 0 || !is_write_ok || rename(tmp_filename, filename) < 0) {
+        perror("compiled riptbl write failed");
+        unlink(tmp_filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* maps a compiled riptbl. the compiler already validated every entry,
+ * so only the header, the size and the checksum are checked here and
+ * the config points straight into the mapping
+ * */
+int load_compiled_riptbl(const char *filename, RouterConfig *config) {
+    memset(config, 0, sizeof(RouterConfig));
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror("compiled riptbl open failed");
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 || file_stat.st_size < sizeof(CompiledRiptblHeader)) {
+        errno = EIO;
+        perror("Invalid compiled riptbl");
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("compiled riptbl mmap failed");
+        return -1;
+    }
+
+    CompiledRiptblHeader *header = (CompiledRiptblHeader*) map;
+    config->map = map;
+    config->map_size = file_stat.st_size;
+    config->num_interfaces = header->num_interfaces;
+    config->num_static_routes = header->num_static_routes;
+    config->interfaces = (InterfaceTableEntry*) (map + sizeof(CompiledRiptblHeader));
+    config->static_routes = (RouterTableEntry*) (map + sizeof(CompiledRiptblHeader) +
+            header->num_interfaces * sizeof(InterfaceTableEntry));
+
+    const uint64_t expected_size = sizeof(CompiledRiptblHeader) +
+        (uint64_t) header->num_interfaces * sizeof(InterfaceTableEntry) +
+        (uint64_t) header->num_static_routes * sizeof(RouterTableEntry);
+    if (memcmp(header->magic, COMPILED_RIPTBL_MAGIC, sizeof(COMPILED_RIPTBL_MAGIC)) != 0 ||
+            header->version != COMPILED_RIPTBL_VERSION ||
+            expected_size != file_stat.st_size ||
+            header->checksum != get_compiled_riptbl_checksum(config)
+    ) {
+        free_router_config(config);
+        errno = EIO;
+        perror("Invalid compiled riptbl");
+        return -1;
+    }
+
+    return 0;
+}
+
+int is_file_older(struct stat *file_stat, struct stat *other_stat) {
+    if (file_stat->st_mtim.tv_sec != other_stat->st_mtim.tv_sec) {
+        return file_stat->st_mtim.tv_sec < other_stat->st_mtim.tv_sec;
+    }
+    return file_stat->st_mtim.tv_nsec < other_stat->st_mtim.tv_nsec;
+}
+
+/* router_<id>.riptblc is used when present, router_<id>.riptbl otherwise.
+ * a compiled file older than the text next to it is stale (the text was
+ * edited after compiling) and the text wins
+ * */
+int read_router_config(uint32_t router_id, RouterConfig *config) {
+    char compiled_filename[100], filename[100];
+    snprintf(compiled_filename, sizeof(compiled_filename), "router_%u.riptblc", router_id);
+    snprintf(filename, sizeof(filename), "router_%u.riptbl", router_id);
+
+    struct stat compiled_stat, text_stat;
+    if (stat(compiled_filename, &compiled_stat) == 0) {
+        if (stat(filename, &text_stat) < 0 || !is_file_older(&compiled_stat, &text_stat)) {
+            return load_compiled_riptbl(compiled_filename, config);
+        }
+        fprintf(stderr, "%s is older than %s, using %s. recompile it with riptbl-compile\n",
+                compiled_filename, filename, filename);
+    }
+
+    return read_riptbl_text(filename, config);
+}
+
+/* bulk insert into a router with an empty table, in a single pass.
+ * static routes are already sorted, connected routes (RIP_STATIC only)
+ * get sorted and merged into them
+ * */
+int add_config_to_state(RouterState *router_state, RouterConfig *config) {
+    const uint32_t num_connected = (router_state->rip_type == RIP_STATIC) ? config->num_interfaces : 0;
+    if (config->num_interfaces > router_state->max_interfaces ||
+            router_state->num_entries + num_connected + config->num_static_routes > router_state->max_entries) {
+        errno = ENOSPC;
+        perror("riptbl does not fit in router state");
+        return -1;
+    }
+
+    memcpy(router_state->interfaces, config->interfaces, config->num_interfaces * sizeof(InterfaceTableEntry));
+    router_state->num_interfaces = config->num_interfaces;
+
+    RouterTableEntry *table_end = &router_state->router_table[router_state->num_entries];
+    if (num_connected == 0) {
+        memcpy(table_end, config->static_routes, config->num_static_routes * sizeof(RouterTableEntry));
+        router_state->num_entries += config->num_static_routes;
+        return 0;
+    }
+
+    RouterTableEntry *connected_routes = malloc(num_connected * sizeof(RouterTableEntry));
+    for (uint32_t i = 0; i < num_connected; i++) {
+        memcpy(connected_routes[i].destination, config->interfaces[i].interface_ip, 4);
+        memcpy(connected_routes[i].netmask, config->interfaces[i].interface_netmask, 4);
+        memcpy(connected_routes[i].gateway, config->interfaces[i].interface_ip, 4);
+        memcpy(connected_routes[i].interface, config->interfaces[i].interface_ip, 4);
+        connected_routes[i].metric = 1;
+    }
+    sort_routes_by_prefix_length(connected_routes, num_connected);
+
+    uint32_t connected_index = 0;
+    uint32_t static_index = 0;
+    while (connected_index < num_connected || static_index < config->num_static_routes) {
+        int take_connected = static_index == config->num_static_routes ||
+            (connected_index < num_connected &&
+             get_prefix_length(connected_routes[connected_index].netmask) >=
+             get_prefix_length(config->static_routes[static_index].netmask));
+
+        *table_end++ = take_connected
+            ? connected_routes[connected_index++]
+            : config->static_routes[static_index++];
+    }
+
+    router_state->num_entries += num_connected + config->num_static_routes;
+    free(connected_routes);
+    return 0;
+}
+
+void free_router_config(RouterConfig *config) {
+    if (config->map) {
+        munmap(config->map, config->map_size);
+    } else {
+        free(config->interfaces);
+        free(config->static_routes);
+    }
+
+    memset(config, 0, sizeof(RouterConfig));
+}
@@ -0,0 +1,54 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <first.h>
+
+/* riptbl text format, one entry per line:
+ *
+ * <ip> <netmask>                          -> interface
+ * <dest>, <netmask>, <gateway>, <metric>  -> static route
+ *
+ * compiled riptbl layout (native byte order), produced by riptbl-compile:
+ *
+ * CompiledRiptblHeader
+ * InterfaceTableEntry[num_interfaces]
+ * RouterTableEntry[num_static_routes]  - interface resolved, most specific first
+ * */
+typedef struct {
+    uint8_t magic[8];
+    uint32_t version;
+    uint32_t num_interfaces;
+    uint32_t num_static_routes;
+    uint32_t checksum;
+} CompiledRiptblHeader;
+
+typedef struct {
+    InterfaceTableEntry *interfaces;
+    uint32_t num_interfaces;
+    RouterTableEntry *static_routes;
+    uint32_t num_static_routes;
+    // set when the entries point into a mapped compiled riptbl
+    void *map;
+    size_t map_size;
+} RouterConfig;
+
+extern const uint32_t COMPILED_RIPTBL_VERSION;
+
+int parse_riptbl_text(FILE *file, RouterConfig *config);
+
+int read_riptbl_text(const char *filename, RouterConfig *config);
+
+int write_compiled_riptbl(const char *filename, RouterConfig *config);
+
+int load_compiled_riptbl(const char *filename, RouterConfig *config);
+
+int read_router_config(uint32_t router_id, RouterConfig *config);
+
+int add_config_to_state(RouterState *router_state, RouterConfig *config);
+
+void free_router_config(RouterConfig *config);
+
+#endif
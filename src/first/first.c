@@ -1,9 +1,12 @@
 #include "first.h"
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdarg.h>
-#include <termios.h>
+#include <stdlib.h>
+#include <string.h>
 
 const uint32_t BROADCAST_PORT = 12345;
 const uint32_t LIVENESS_PORT = 12346;
@@ -11,9 +14,16 @@ const uint32_t BUFFER_SIZE = 2048;
 const uint32_t ROUTER_TABLE_MAX_SIZE = 100;
 const uint32_t INFINITY_METRIC = 16;
 const uint32_t MAX_GATEWAY_LIFE = 5;
+const uint32_t STALE_GATEWAY_LIFE = 1;
 const uint32_t TIME_FOR_LIFE_DROP = 10;
 const uint32_t RAND_DELAY_BONUS = 3;
+const uint32_t RAND_DELAY_SPREAD = 8;
 const uint32_t MAX_NUM_INTERFACES = 10;
+const uint32_t CONTROL_MAX_CLIENTS = 16;
+const uint32_t CONTROL_DUMP_CHUNK = 64;
+const uint32_t CONTROL_SEND_TIMEOUT = 1;
+const uint32_t FNV1A_OFFSET_BASIS = 2166136261u;
+const uint32_t TABLE_INDEX_MIN_SIZE = 64;
 
 int enable_logging = 1;
 
@@ -32,30 +42,145 @@ int is_valid_ip(const char *ip) {
     return inet_pton(AF_INET, ip, &(sa.sin_addr)) == 1;
 }
 
-int is_network_subsumed(uint8_t *ip1, uint8_t *mask1, uint8_t *ip2, uint8_t *mask2) {
-    int mask1_bits = 0, mask2_bits = 0;
+uint32_t get_prefix_length(uint8_t *netmask) {
+    uint32_t prefix_length = 0;
     for (int i = 0; i < 4; i++) {
-        mask1_bits += __builtin_popcount(mask1[i]);
-        mask2_bits += __builtin_popcount(mask2[i]);
+        prefix_length += __builtin_popcount(netmask[i]);
     }
 
-    if (mask1_bits > mask2_bits) return 0;
+    return prefix_length;
+}
 
-    for (int i = 0; i < 4; i++) {
-        if ((ip1[i] & mask1[i]) != (ip2[i] & mask1[i])) {
-            return 0;
+int is_network_subsumed(uint8_t *ip1, uint8_t *mask1, uint8_t *ip2, uint8_t *mask2) {
+    uint32_t mask1_word, mask2_word, ip1_word, ip2_word;
+    memcpy(&mask1_word, mask1, 4);
+    memcpy(&mask2_word, mask2, 4);
+
+    if (__builtin_popcount(mask1_word) > __builtin_popcount(mask2_word)) return 0;
+
+    memcpy(&ip1_word, ip1, 4);
+    memcpy(&ip2_word, ip2, 4);
+    return (ip1_word & mask1_word) == (ip2_word & mask1_word);
+}
+
+/* empties the index and makes room for num_positions entries
+ * */
+void reset_table_index(TableIndex *index, uint32_t num_positions) {
+    uint32_t new_size = TABLE_INDEX_MIN_SIZE;
+    while (new_size < 4 * num_positions) {
+        new_size *= 2;
+    }
+
+    if (new_size != index->size) {
+        free(index->slots);
+        index->slots = malloc(new_size * sizeof(uint32_t));
+        index->size = new_size;
+    }
+    memset(index->slots, 0, new_size * sizeof(uint32_t));
+    index->used = 0;
+    index->num_indexed = 0;
+}
+
+/* returns -1 when the index is half full and has to be reset
+ * */
+int add_to_table_index(TableIndex *index, uint32_t hash, uint32_t position) {
+    if ((index->used + 1) * 2 > index->size) {
+        return -1;
+    }
+
+    uint32_t i = hash & (index->size - 1);
+    while (index->slots[i] != 0) {
+        i = (i + 1) & (index->size - 1);
+    }
+
+    index->slots[i] = position + 1;
+    index->used += 1;
+    return 0;
+}
+
+void free_table_index(TableIndex *index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->size = 0;
+    index->used = 0;
+    index->num_indexed = 0;
+}
+
+uint32_t get_network_hash(uint8_t *ip, uint8_t *mask) {
+    return fnv1a(fnv1a(FNV1A_OFFSET_BASIS, ip, 4), mask, 4);
+}
+
+void rebuild_route_index(RouterState *router_state) {
+    reset_table_index(&router_state->route_index, router_state->num_entries);
+    for (uint32_t i = 0; i < router_state->num_entries; i++) {
+        add_to_table_index(&router_state->route_index,
+                get_network_hash(router_state->router_table[i].destination, router_state->router_table[i].netmask),
+                i
+        );
+    }
+    router_state->route_index.num_indexed = router_state->num_entries;
+}
+
+/* the entries after position moved one up, their slots are found again
+ * by hash. from the top down, so the old value searched for is held by
+ * the moved entry alone
+ * */
+void reprobe_shifted_routes(RouterState *router_state, uint32_t position) {
+    TableIndex *index = &router_state->route_index;
+    for (uint32_t moved = router_state->num_entries - 1; moved > position; moved--) {
+        RouterTableEntry *entry = &router_state->router_table[moved];
+        uint32_t i = get_network_hash(entry->destination, entry->netmask) & (index->size - 1);
+        // it was at moved - 1, slots hold position + 1
+        while (index->slots[i] != moved) {
+            i = (i + 1) & (index->size - 1);
         }
+        index->slots[i] = moved + 1;
     }
+}
 
-    return 1;
+/* router_table[position] was just filled in, appended or inserted in
+ * front of the entries that moved one position up
+ * */
+void index_route_at_pos(RouterState *router_state, uint32_t position) {
+    TableIndex *index = &router_state->route_index;
+    if (index->num_indexed + 1 != router_state->num_entries) {
+        // already out of date, gets rebuilt on the next miss
+        return;
+    }
+
+    // the moved entries only, the index is 4 to 8 times their number
+    reprobe_shifted_routes(router_state, position);
+
+    int add_rc = add_to_table_index(index,
+            get_network_hash(router_state->router_table[position].destination, router_state->router_table[position].netmask),
+            position
+    );
+    if (add_rc < 0) {
+        rebuild_route_index(router_state);
+        return;
+    }
+    index->num_indexed = router_state->num_entries;
 }
 
 int find_index_of_network_that_exacts(RouterState *router_state, uint8_t *ip_to_find, uint8_t *mask_to_find) {
-    for (int i = 0; i < router_state->num_entries; i++) {
-        if (match_ips(router_state->router_table[i].destination, ip_to_find) &&
-                match_ips(router_state->router_table[i].netmask, mask_to_find)
+    TableIndex *index = &router_state->route_index;
+    const uint32_t hash = get_network_hash(ip_to_find, mask_to_find);
+
+    if (index->num_indexed != router_state->num_entries) {
+        rebuild_route_index(router_state);
+    }
+
+    if (index->size == 0) {
+        return -1;
+    }
+
+    for (uint32_t i = hash & (index->size - 1); index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        uint32_t position = index->slots[i] - 1;
+        if (position < router_state->num_entries &&
+                match_ips(router_state->router_table[position].destination, ip_to_find) &&
+                match_ips(router_state->router_table[position].netmask, mask_to_find)
         ) {
-            return i;
+            return position;
         }
     }
 
@@ -92,20 +217,6 @@ void log_printf(const char *format, ...) {
     va_end(args);
 }
 
-void enable_raw_term() {
-    struct termios term;
-    tcgetattr(STDIN_FILENO, &term);
-    term.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &term);
-}
-
-void disable_raw_term() {
-    struct termios term;
-    tcgetattr(STDIN_FILENO, &term);
-    term.c_lflag |= (ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &term);
-}
-
 uint32_t cap_metric(uint32_t metric_to_cap) {
     if (metric_to_cap > INFINITY_METRIC) {
         return INFINITY_METRIC;
@@ -113,3 +224,53 @@ uint32_t cap_metric(uint32_t metric_to_cap) {
 
     return metric_to_cap;
 }
+
+/* sleeps for timeout_ms or until wakeup_fd is signalled.
+ * returns 1 if woken up, 0 on timeout
+ * */
+int wait_for_wakeup(int wakeup_fd, uint32_t timeout_ms) {
+    struct pollfd wakeup_poll = { .fd = wakeup_fd, .events = POLLIN };
+    int poll_res;
+    do {
+        poll_res = poll(&wakeup_poll, 1, timeout_ms);
+    } while (poll_res < 0 && errno == EINTR);
+
+    return poll_res > 0;
+}
+
+/* the counter is never read back, so the eventfd stays readable
+ * and every thread polling it sees the wakeup
+ * */
+void signal_wakeup(int wakeup_fd) {
+    uint64_t one = 1;
+    ssize_t write_res = write(wakeup_fd, &one, sizeof(one));
+    (void) write_res;
+}
+
+void init_router_table_lock(RouterState *router_state) {
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+    // a steady stream of readers must not starve a listener with a change
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&router_state->router_table_lock, &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
+}
+
+/* for readers: other readers may be refreshing life_left meanwhile
+ * */
+void copy_life_table(LifeTableEntry *to, LifeTableEntry *from, uint32_t num_entries) {
+    for (uint32_t i = 0; i < num_entries; i++) {
+        memcpy(to[i].gateway, from[i].gateway, 4);
+        to[i].life_left = __atomic_load_n(&from[i].life_left, __ATOMIC_RELAXED);
+    }
+}
+
+uint32_t fnv1a(uint32_t hash, const void *data, size_t data_size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < data_size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
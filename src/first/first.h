@@ -2,6 +2,7 @@
 #define FIRST_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <pthread.h>
 #include <stdatomic.h>
 
@@ -30,34 +31,95 @@ typedef enum {
     RIP_STATIC = 1
 } RipType;
 
+typedef struct RipListenState RipListenState;
+
+// time, sleeping and randomness, see clock.h
+typedef struct Clock Clock;
+
+// pcap writer, see capture.h
+typedef struct Capture Capture;
+
+// cpus and stack sizes of router threads, see placement.h
+typedef struct Placement Placement;
+
+// workers that apply received tables, see pool.h
+typedef struct UpdatePool UpdatePool;
+
+// open addressing hash of table positions, slot = position + 1, 0 = empty.
+// a found position is always checked against the table. a miss is only
+// final while num_indexed matches the table size, otherwise the index is
+// rebuilt first, so code that fills a table directly doesn't have to know
+typedef struct {
+    uint32_t *slots;
+    uint32_t size;
+    uint32_t used;
+    uint32_t num_indexed;
+} TableIndex;
+
 typedef struct {
     uint32_t router_id;
     RipType rip_type;
     InterfaceTableEntry *interfaces;
+    // one rip_listen slot per possible interface, slots never move
+    RipListenState *listeners;
     RouterTableEntry *router_table;
     LifeTableEntry *life_table;
     uint32_t num_interfaces;
     uint32_t num_entries;
     uint32_t life_entries;
+    // capacities of interfaces/listeners and of router_table/life_table
+    uint32_t max_interfaces;
+    uint32_t max_entries;
+    // lookup indexes for router_table and life_table, zeroed = empty
+    TableIndex route_index;
+    TableIndex life_index;
     uint32_t rand_delay;
-    pthread_mutex_t change_router_table_mutex;
-    int should_restart;
-    int should_terminate;
+    Clock *clock;
+    // datagrams sent and received are captured when set
+    Capture *capture;
+    Placement *placement;
+    // set while split_threads runs, rip_listen hands its updates to it
+    UpdatePool *pool;
+    /* router_table, life_table, interfaces and their indexes. writers are
+     * preferred and leave both indexes fresh when they unlock (see
+     * unlock_router_table_after_write), so readers never rebuild one.
+     * life_left is the only field written under the read lock, with
+     * relaxed atomics, to refresh gateways that are already known
+     * */
+    pthread_rwlock_t router_table_lock;
+    atomic_int should_terminate;
+    // eventfd that wakes up every router thread blocked in poll
+    int wakeup_fd;
+    // counters served by the control socket
+    atomic_ulong packets_received;
+    atomic_ulong packets_sent;
+    atomic_ulong entries_received;
+    atomic_ulong routes_changed;
 } RouterState;
 
 // command return status
 typedef enum {
     CMD_DONE,
-    CMD_DONT_RESTORE_SHOULD_LOG,
-    CMD_RESTART_ROUTER,
+    CMD_CLIENT_ERROR,
     CMD_TERMINATE
 } HandleCmdReturnCode;
 
-// rip_listen param type
+// control socket client connection
 typedef struct {
+    int fd;
+    char buffer[100];
+    uint32_t buffer_len;
+} ControlClient;
+
+// rip_listen param type
+struct RipListenState {
     RouterState *router_state;
-    uint32_t curr_interface;
-} RipListenState;
+    InterfaceTableEntry interface;
+    // eventfd that stops only this listener
+    int stop_fd;
+    int is_running;
+    pthread_t thread;
+};
 
 extern const uint32_t BROADCAST_PORT;
 extern const uint32_t LIVENESS_PORT;
@@ -65,9 +127,16 @@ extern const uint32_t BUFFER_SIZE;
 extern const uint32_t ROUTER_TABLE_MAX_SIZE;
 extern const uint32_t INFINITY_METRIC;
 extern const uint32_t MAX_GATEWAY_LIFE;
+extern const uint32_t STALE_GATEWAY_LIFE;
 extern const uint32_t TIME_FOR_LIFE_DROP;
 extern const uint32_t RAND_DELAY_BONUS;
+extern const uint32_t RAND_DELAY_SPREAD;
 extern const uint32_t MAX_NUM_INTERFACES;
+extern const uint32_t CONTROL_MAX_CLIENTS;
+extern const uint32_t CONTROL_DUMP_CHUNK;
+extern const uint32_t CONTROL_SEND_TIMEOUT;
+extern const uint32_t FNV1A_OFFSET_BASIS;
+extern const uint32_t TABLE_INDEX_MIN_SIZE;
 
 extern int enable_logging;
 
@@ -77,8 +146,22 @@ int match_ips(uint8_t *first_ip, uint8_t *second_ip);
 int is_valid_ip(const char *ip);
 
 
+uint32_t get_prefix_length(uint8_t *netmask);
+
 int is_network_subsumed(uint8_t *ip1, uint8_t *mask1, uint8_t *ip2, uint8_t *mask2);
 
+void reset_table_index(TableIndex *index, uint32_t num_positions);
+
+int add_to_table_index(TableIndex *index, uint32_t hash, uint32_t position);
+
+void free_table_index(TableIndex *index);
+
+uint32_t get_network_hash(uint8_t *ip, uint8_t *mask);
+
+void rebuild_route_index(RouterState *router_state);
+
+void index_route_at_pos(RouterState *router_state, uint32_t position);
+
 int find_index_of_network_that_exacts(RouterState *router_state, uint8_t *ip_to_find, uint8_t *mask_to_find);
 
 int find_index_of_network_that_subsumes(RouterState *router_state, uint8_t *ip_to_find, uint8_t *mask_to_find);
@@ -87,10 +170,16 @@ void get_broadcast_ip(uint8_t *host_ip, uint8_t *netmask, uint8_t *broadcast_ip)
 
 void log_printf(const char *format, ...);
 
-void enable_raw_term();
+uint32_t cap_metric(uint32_t metric_to_cap);
 
-void disable_raw_term();
+int wait_for_wakeup(int wakeup_fd, uint32_t timeout_ms);
 
-uint32_t cap_metric(uint32_t metric_to_cap);
+void signal_wakeup(int wakeup_fd);
+
+uint32_t fnv1a(uint32_t hash, const void *data, size_t data_size);
+
+void init_router_table_lock(RouterState *router_state);
+
+void copy_life_table(LifeTableEntry *to, LifeTableEntry *from, uint32_t num_entries);
 
 #endif
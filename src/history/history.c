@@ -0,0 +1,335 @@
+#include "history.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const uint32_t HISTORY_SAMPLES = 64;
+const uint32_t EDGE_HISTORY_SAMPLES = 8;
+const uint32_t HISTORY_MAX_EVENTS = 1 << 16;
+const uint32_t HISTORY_HEAT_WINDOW_MS = 30000;
+const uint32_t HISTORY_HEAT_LEVELS = 4;
+
+uint64_t get_history_clock_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void init_topology_history(TopologyHistory *history) {
+    memset(history, 0, sizeof(TopologyHistory));
+    history->start_ms = get_history_clock_ms();
+    history->events = malloc(HISTORY_MAX_EVENTS * sizeof(TopologyEvent));
+}
+
+void free_topology_history(TopologyHistory *history) {
+    for (uint32_t i = 0; i < history->num_vertices; i++) {
+        free(history->last_tables[i]);
+    }
+    free(history->router_samples);
+    free(history->num_router_samples);
+    free(history->last_tables);
+    free(history->last_table_sizes);
+    free(history->max_last_table_sizes);
+    free(history->edge_confirmations);
+    free(history->num_edge_confirmations);
+    free(history->events);
+    free_table_index(&history->pair_index);
+    memset(history, 0, sizeof(TopologyHistory));
+}
+
+uint32_t get_history_ms(TopologyHistory *history) {
+    return get_history_clock_ms() - history->start_ms;
+}
+
+void reserve_history_vertices(TopologyHistory *history, uint32_t num_vertices) {
+    if (num_vertices > history->max_vertices) {
+        uint32_t old_max = history->max_vertices;
+        history->max_vertices = old_max > 0 ? 2 * old_max : 64;
+        while (history->max_vertices < num_vertices) {
+            history->max_vertices *= 2;
+        }
+        history->router_samples = realloc(history->router_samples,
+                (size_t) history->max_vertices * HISTORY_SAMPLES * sizeof(RouterSample));
+        history->num_router_samples = realloc(history->num_router_samples, history->max_vertices * sizeof(uint32_t));
+        history->last_tables = realloc(history->last_tables, history->max_vertices * sizeof(RouterTableEntry*));
+        history->last_table_sizes = realloc(history->last_table_sizes, history->max_vertices * sizeof(uint16_t));
+        history->max_last_table_sizes = realloc(history->max_last_table_sizes, history->max_vertices * sizeof(uint16_t));
+    }
+
+    for (uint32_t i = history->num_vertices; i < num_vertices; i++) {
+        history->num_router_samples[i] = 0;
+        history->last_tables[i] = NULL;
+        history->last_table_sizes[i] = 0;
+        history->max_last_table_sizes[i] = 0;
+    }
+    if (num_vertices > history->num_vertices) {
+        history->num_vertices = num_vertices;
+    }
+}
+
+void reserve_history_edges(TopologyHistory *history, uint32_t num_edges) {
+    if (num_edges <= history->max_edges) {
+        return;
+    }
+
+    history->max_edges = history->max_edges > 0 ? 2 * history->max_edges : 64;
+    while (history->max_edges < num_edges) {
+        history->max_edges *= 2;
+    }
+    history->edge_confirmations = realloc(history->edge_confirmations,
+            (size_t) history->max_edges * EDGE_HISTORY_SAMPLES * sizeof(uint32_t));
+    history->num_edge_confirmations = realloc(history->num_edge_confirmations, history->max_edges * sizeof(uint32_t));
+}
+
+void confirm_edge(TopologyHistory *history, uint32_t edge_index, uint32_t at_ms) {
+    const uint32_t n = history->num_edge_confirmations[edge_index]++;
+    history->edge_confirmations[(size_t) edge_index * EDGE_HISTORY_SAMPLES + n % EDGE_HISTORY_SAMPLES] = at_ms;
+}
+
+// by destination, then netmask
+int compare_table_entries(const void *first, const void *second) {
+    return memcmp(first, second, 8);
+}
+
+/* merges two sorted tables
+ * */
+uint32_t count_route_changes(RouterTableEntry *old_table, uint32_t old_size, RouterTableEntry *new_table, uint32_t new_size) {
+    uint32_t route_changes = 0;
+    uint32_t i = 0, j = 0;
+    while (i < old_size || j < new_size) {
+        const int cmp = i == old_size ? 1 : j == new_size ? -1 : compare_table_entries(&old_table[i], &new_table[j]);
+        if (cmp != 0) {
+            route_changes += 1;
+            i += cmp < 0;
+            j += cmp > 0;
+            continue;
+        }
+        if (old_table[i].metric != new_table[j].metric || !match_ips(old_table[i].gateway, new_table[j].gateway)) {
+            route_changes += 1;
+        }
+        i++;
+        j++;
+    }
+    return route_changes;
+}
+
+/* a sample for the router, and a confirmation for every edge it still
+ * lists. sorts entries in place
+ * */
+void record_router_update(TopologyHistory *history, TopologyGraph *graph, uint32_t vertex,
+        RouterTableEntry *entries, uint32_t num_entries) {
+    const uint32_t now_ms = get_history_ms(history);
+    reserve_history_vertices(history, vertex + 1);
+
+    qsort(entries, num_entries, sizeof(RouterTableEntry), compare_table_entries);
+    // the first table only tells where the router is now
+    const uint32_t route_changes = history->num_router_samples[vertex] == 0 ? 0
+        : count_route_changes(history->last_tables[vertex], history->last_table_sizes[vertex], entries, num_entries);
+
+    if (num_entries > history->max_last_table_sizes[vertex]) {
+        history->last_tables[vertex] = realloc(history->last_tables[vertex], num_entries * sizeof(RouterTableEntry));
+        history->max_last_table_sizes[vertex] = num_entries;
+    }
+    memcpy(history->last_tables[vertex], entries, num_entries * sizeof(RouterTableEntry));
+    history->last_table_sizes[vertex] = num_entries;
+
+    const uint32_t n = history->num_router_samples[vertex]++;
+    RouterSample *sample = &history->router_samples[(size_t) vertex * HISTORY_SAMPLES + n % HISTORY_SAMPLES];
+    sample->at_ms = now_ms;
+    sample->table_size = num_entries;
+    sample->route_changes = route_changes < UINT16_MAX ? route_changes : UINT16_MAX;
+
+    Vertex *graph_vertex = &graph->vertices[vertex];
+    for (uint32_t i = 0; i < graph_vertex->degree; i++) {
+        confirm_edge(history, graph_vertex->adjacent_edges[i], now_ms);
+    }
+}
+
+/* for the graph's change callback
+ * */
+void record_topology_change(TopologyHistory *history, TopologyGraph *graph,
+        TopologyChange change, uint32_t v, uint32_t u) {
+    const uint32_t now_ms = get_history_ms(history);
+
+    if (change == TOPOLOGY_INTERFACE_ADDED) {
+        return;
+    }
+    if (change == TOPOLOGY_EDGE_MOVED) {
+        memcpy(&history->edge_confirmations[(size_t) u * EDGE_HISTORY_SAMPLES],
+                &history->edge_confirmations[(size_t) v * EDGE_HISTORY_SAMPLES],
+                EDGE_HISTORY_SAMPLES * sizeof(uint32_t));
+        history->num_edge_confirmations[u] = history->num_edge_confirmations[v];
+        return;
+    }
+    if (change == TOPOLOGY_VERTEX_ADDED) {
+        reserve_history_vertices(history, v + 1);
+    }
+    if (change == TOPOLOGY_EDGE_ADDED) {
+        // the new edge is the last one
+        const uint32_t edge_index = graph->num_edges - 1;
+        reserve_history_edges(history, graph->num_edges);
+        history->num_edge_confirmations[edge_index] = 0;
+        confirm_edge(history, edge_index, now_ms);
+    }
+
+    TopologyEvent *event = &history->events[history->num_events % HISTORY_MAX_EVENTS];
+    event->at_ms = now_ms;
+    event->change = change;
+    event->v = v < u ? v : u;
+    event->u = v < u ? u : v;
+    history->num_events += 1;
+}
+
+/* 0 without route changes in the last HISTORY_HEAT_WINDOW_MS, then one
+ * level per four times as many
+ * */
+uint32_t get_router_heat(TopologyHistory *history, uint32_t vertex, uint32_t now_ms) {
+    if (vertex >= history->num_vertices) {
+        return 0;
+    }
+
+    uint32_t route_changes = 0;
+    const uint32_t num_samples = history->num_router_samples[vertex];
+    for (uint32_t i = 0; i < num_samples && i < HISTORY_SAMPLES; i++) {
+        RouterSample *sample = &history->router_samples[(size_t) vertex * HISTORY_SAMPLES + (num_samples - 1 - i) % HISTORY_SAMPLES];
+        if (now_ms - sample->at_ms > HISTORY_HEAT_WINDOW_MS) {
+            break;
+        }
+        route_changes += sample->route_changes;
+    }
+
+    uint32_t heat = 0;
+    while (route_changes > 0 && heat < HISTORY_HEAT_LEVELS - 1) {
+        heat += 1;
+        route_changes >>= 2;
+    }
+    return heat;
+}
+
+/* how long the edge went unconfirmed, in multiples of its usual
+ * confirmation interval: 0 up to twice that, then one level per doubling
+ * */
+uint32_t get_edge_heat(TopologyHistory *history, uint32_t edge_index, uint32_t now_ms) {
+    if (edge_index >= history->max_edges) {
+        return 0;
+    }
+
+    const uint32_t n = history->num_edge_confirmations[edge_index];
+    if (n == 0) {
+        return 0;
+    }
+    const uint32_t *confirmations = &history->edge_confirmations[(size_t) edge_index * EDGE_HISTORY_SAMPLES];
+    const uint32_t last_ms = confirmations[(n - 1) % EDGE_HISTORY_SAMPLES];
+    const uint32_t num_kept = n < EDGE_HISTORY_SAMPLES ? n : EDGE_HISTORY_SAMPLES;
+    const uint32_t first_ms = confirmations[(n - num_kept) % EDGE_HISTORY_SAMPLES];
+    uint32_t interval_ms = num_kept > 1 ? (last_ms - first_ms) / (num_kept - 1) : HISTORY_HEAT_WINDOW_MS;
+    if (interval_ms < 100) {
+        interval_ms = 100;
+    }
+
+    uint32_t heat = 0;
+    for (uint64_t limit = 2 * (uint64_t) interval_ms; now_ms - last_ms > limit && heat < HISTORY_HEAT_LEVELS - 1; limit *= 2) {
+        heat += 1;
+    }
+    return heat;
+}
+
+/* oldest first, returns how many. samples must hold HISTORY_SAMPLES
+ * */
+uint32_t get_router_samples(TopologyHistory *history, uint32_t vertex, RouterSample *samples) {
+    if (vertex >= history->num_vertices) {
+        return 0;
+    }
+
+    const uint32_t n = history->num_router_samples[vertex];
+    const uint32_t num_kept = n < HISTORY_SAMPLES ? n : HISTORY_SAMPLES;
+    for (uint32_t i = 0; i < num_kept; i++) {
+        samples[i] = history->router_samples[(size_t) vertex * HISTORY_SAMPLES + (n - num_kept + i) % HISTORY_SAMPLES];
+    }
+    return num_kept;
+}
+
+uint64_t get_first_kept_event(TopologyHistory *history) {
+    return history->num_events > HISTORY_MAX_EVENTS ? history->num_events - HISTORY_MAX_EVENTS : 0;
+}
+
+/* how far back get_edges_at is exact
+ * */
+uint32_t get_oldest_event_ms(TopologyHistory *history) {
+    if (history->num_events <= HISTORY_MAX_EVENTS) {
+        return 0;
+    }
+    return history->events[get_first_kept_event(history) % HISTORY_MAX_EVENTS].at_ms;
+}
+
+uint32_t get_pair_hash(uint32_t v, uint32_t u) {
+    uint32_t pair[2] = { v, u };
+    return fnv1a(FNV1A_OFFSET_BASIS, pair, sizeof(pair));
+}
+
+// the number of the first event after from_event for the pair
+uint64_t find_first_pair_event(TopologyHistory *history, uint64_t from_event, uint32_t v, uint32_t u) {
+    TableIndex *index = &history->pair_index;
+    for (uint32_t i = get_pair_hash(v, u) & (index->size - 1); index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        const uint64_t event_number = from_event + index->slots[i] - 1;
+        TopologyEvent *event = &history->events[event_number % HISTORY_MAX_EVENTS];
+        if (event->v == v && event->u == u) {
+            return event_number;
+        }
+    }
+    return UINT64_MAX;
+}
+
+/* the edges as they were at at_ms, undoing every later event: a pair
+ * touched since then existed iff its first later event removed it, any
+ * other pair is as it is now. returns the number of edges, num_vertices
+ * is set to the vertices that existed
+ * */
+uint32_t get_edges_at(TopologyHistory *history, TopologyGraph *graph, uint32_t at_ms,
+        uint32_t **edge_vs, uint32_t **edge_us, uint32_t *max_edges, uint32_t *num_vertices) {
+    uint64_t from_event = history->num_events;
+    while (from_event > get_first_kept_event(history) &&
+            history->events[(from_event - 1) % HISTORY_MAX_EVENTS].at_ms > at_ms) {
+        from_event -= 1;
+    }
+
+    *num_vertices = graph->num_vertices;
+    reset_table_index(&history->pair_index, history->num_events - from_event);
+    for (uint64_t i = from_event; i < history->num_events; i++) {
+        TopologyEvent *event = &history->events[i % HISTORY_MAX_EVENTS];
+        if (event->change == TOPOLOGY_VERTEX_ADDED) {
+            *num_vertices -= 1;
+        } else if (find_first_pair_event(history, from_event, event->v, event->u) == UINT64_MAX) {
+            add_to_table_index(&history->pair_index, get_pair_hash(event->v, event->u), i - from_event);
+        }
+    }
+
+    const uint32_t most_edges = graph->num_edges + (history->num_events - from_event);
+    if (*max_edges < most_edges) {
+        *max_edges = most_edges;
+        *edge_vs = realloc(*edge_vs, *max_edges * sizeof(uint32_t));
+        *edge_us = realloc(*edge_us, *max_edges * sizeof(uint32_t));
+    }
+
+    uint32_t num_edges = 0;
+    for (uint32_t i = 0; i < graph->num_edges; i++) {
+        const uint32_t v = graph->edges[i].v < graph->edges[i].u ? graph->edges[i].v : graph->edges[i].u;
+        const uint32_t u = graph->edges[i].v < graph->edges[i].u ? graph->edges[i].u : graph->edges[i].v;
+        if (find_first_pair_event(history, from_event, v, u) == UINT64_MAX) {
+            (*edge_vs)[num_edges] = v;
+            (*edge_us)[num_edges] = u;
+            num_edges += 1;
+        }
+    }
+    for (uint64_t i = from_event; i < history->num_events; i++) {
+        TopologyEvent *event = &history->events[i % HISTORY_MAX_EVENTS];
+        if (event->change == TOPOLOGY_EDGE_REMOVED &&
+                find_first_pair_event(history, from_event, event->v, event->u) == i) {
+            (*edge_vs)[num_edges] = event->v;
+            (*edge_us)[num_edges] = event->u;
+            num_edges += 1;
+        }
+    }
+
+    return num_edges;
+}
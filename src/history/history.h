@@ -0,0 +1,88 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <first.h>
+#include <topology.h>
+
+/* what the topology graph forgets: when every router was heard from, how
+ * big its table was and how many of its routes changed, when every edge
+ * was last confirmed, and in which order the topology changed.
+ *
+ * memory is bounded: HISTORY_SAMPLES samples per router and
+ * EDGE_HISTORY_SAMPLES confirmations per edge in fixed rings, the last
+ * HISTORY_MAX_EVENTS topology changes, and the last table of every router
+ * (at most ROUTER_TABLE_MAX_SIZE entries) to count route changes against.
+ * times are ms since init_topology_history
+ * */
+
+typedef struct {
+    uint32_t at_ms;
+    uint16_t table_size;
+    // routes that appeared, disappeared or got another metric
+    uint16_t route_changes;
+} RouterSample;
+
+typedef struct {
+    uint32_t at_ms;
+    // TOPOLOGY_VERTEX_ADDED, TOPOLOGY_EDGE_ADDED or TOPOLOGY_EDGE_REMOVED
+    uint32_t change;
+    uint32_t v, u;
+} TopologyEvent;
+
+typedef struct {
+    uint64_t start_ms;
+
+    // HISTORY_SAMPLES per vertex, sample n of a vertex is at n % HISTORY_SAMPLES
+    RouterSample *router_samples;
+    uint32_t *num_router_samples;
+    // sorted by destination and netmask
+    RouterTableEntry **last_tables;
+    uint16_t *last_table_sizes;
+    uint16_t *max_last_table_sizes;
+    uint32_t num_vertices;
+    uint32_t max_vertices;
+
+    // EDGE_HISTORY_SAMPLES times per edge index of the graph
+    uint32_t *edge_confirmations;
+    uint32_t *num_edge_confirmations;
+    uint32_t max_edges;
+
+    // event n is at n % HISTORY_MAX_EVENTS
+    TopologyEvent *events;
+    uint64_t num_events;
+
+    // first event of every vertex pair, for get_edges_at
+    TableIndex pair_index;
+} TopologyHistory;
+
+extern const uint32_t HISTORY_SAMPLES;
+extern const uint32_t EDGE_HISTORY_SAMPLES;
+extern const uint32_t HISTORY_MAX_EVENTS;
+extern const uint32_t HISTORY_HEAT_WINDOW_MS;
+extern const uint32_t HISTORY_HEAT_LEVELS;
+
+void init_topology_history(TopologyHistory *history);
+
+void free_topology_history(TopologyHistory *history);
+
+uint32_t get_history_ms(TopologyHistory *history);
+
+void record_router_update(TopologyHistory *history, TopologyGraph *graph, uint32_t vertex,
+        RouterTableEntry *entries, uint32_t num_entries);
+
+void record_topology_change(TopologyHistory *history, TopologyGraph *graph,
+        TopologyChange change, uint32_t v, uint32_t u);
+
+uint32_t get_router_heat(TopologyHistory *history, uint32_t vertex, uint32_t now_ms);
+
+uint32_t get_edge_heat(TopologyHistory *history, uint32_t edge_index, uint32_t now_ms);
+
+uint32_t get_router_samples(TopologyHistory *history, uint32_t vertex, RouterSample *samples);
+
+uint32_t get_oldest_event_ms(TopologyHistory *history);
+
+uint32_t get_edges_at(TopologyHistory *history, TopologyGraph *graph, uint32_t at_ms,
+        uint32_t **edge_vs, uint32_t **edge_us, uint32_t *max_edges, uint32_t *num_vertices);
+
+#endif
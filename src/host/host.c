@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "host.h"
 #include <errno.h>
 #include <first.h>
@@ -11,107 +12,137 @@
 #include <sys/socket.h>
 
 const uint32_t HOST_RAND_DELAY_BONUS = 3;
+const uint32_t HOST_SEND_JITTER_MS = 500;
+const uint32_t HOST_SEND_BATCH = 256;
+const uint32_t HOST_BATCH_WINDOW_MS = 10;
 
-void* host_broadcaster(void *arg_host_state) {
-    HostState *host_state = (HostState*) arg_host_state;
+void free_host_state(HostState *host_state) {
+    if (host_state->sock >= 0) {
+        close(host_state->sock);
+    }
+    if (host_state->scheduler) {
+        free_event_scheduler(host_state->scheduler);
+    }
+    free(host_state->hosts);
+    free(host_state->batch);
+    free(host_state);
+}
 
-    int sock;
-    struct sockaddr_in broadcast_addr;
+void flush_host_batch(HostState *host_state) {
+    uint32_t num_sent = 0;
+    while (num_sent < host_state->batch_size) {
+        int sendmmsg_res = sendmmsg(host_state->sock,
+                host_state->batch + num_sent, host_state->batch_size - num_sent, 0);
+        if (sendmmsg_res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("sendmmsg failed");
+            free_host_state(host_state);
+            exit(EXIT_FAILURE);
+        }
+        num_sent += sendmmsg_res;
+    }
 
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        perror("socket creation failed");
-        free(host_state);
-        exit(EXIT_FAILURE);
+    if (host_state->batch_size > 0) {
+        log_printf("Hosts: %u broadcast messages sent\n", host_state->batch_size);
     }
+    host_state->packets_sent += host_state->batch_size;
+    host_state->batch_size = 0;
+}
 
-    int broadcast_enable = 1;
-    int setsockopt_res = setsockopt(
-            sock,
-            SOL_SOCKET, SO_BROADCAST,
-            &broadcast_enable, sizeof(broadcast_enable)
-    );
-    if (setsockopt_res < 0) {
-        perror("setsockopt failed");
-        close(sock);
-        free(host_state);
-        exit(EXIT_FAILURE);
+/* queues the host's prebuilt packet and plans its next send
+ * */
+void host_send_event(void *arg_host) {
+    EmulatedHost *host = (EmulatedHost*) arg_host;
+    HostState *host_state = host->host_state;
+    Clock *clock = &host_state->scheduler->clock;
+
+    struct mmsghdr *message = &host_state->batch[host_state->batch_size];
+    message->msg_hdr.msg_name = &host->broadcast_addr;
+    message->msg_hdr.msg_namelen = sizeof(host->broadcast_addr);
+    message->msg_hdr.msg_iov->iov_base = host->packet;
+    message->msg_hdr.msg_iov->iov_len = sizeof(host->packet);
+    host_state->batch_size += 1;
+    if (host_state->batch_size == HOST_SEND_BATCH) {
+        flush_host_batch(host_state);
     }
 
-    memset(&broadcast_addr, 0, sizeof(broadcast_addr));
-    broadcast_addr.sin_family = AF_INET;
-    broadcast_addr.sin_port = htons(BROADCAST_PORT);
+    uint64_t next_delay_ms = (uint64_t) host->rand_delay * 1000 - HOST_SEND_JITTER_MS +
+        clock_random_below(clock, 2 * HOST_SEND_JITTER_MS + 1);
+    schedule_event(host_state->scheduler, next_delay_ms, host_send_event, host);
+}
 
-    uint8_t broadcast_ip[4];
-    get_broadcast_ip(
-        host_state->interface_ip,
-        host_state->interface_netmask,
-        broadcast_ip
-    );
-    memcpy(&broadcast_addr.sin_addr.s_addr, broadcast_ip, 4);
-
-    while (1) {
-        // one table entry [ip, netmask, ip, 0]
-        // plus 12 bytes - interface_ip, host_id and num_entries of host
-        const uint32_t SIZEOF_PACKET_TO_SEND = 
-            sizeof(RouterTableEntry) + 12;
-        uint8_t *packet_to_send = malloc(SIZEOF_PACKET_TO_SEND);
-
-        memcpy(packet_to_send, host_state->interface_ip, 4);
-        memcpy(packet_to_send + 4, &host_state->host_id, 4);
-        uint32_t single_num_entries = 1;
-        memcpy(packet_to_send + 8, &single_num_entries, 4);
-        RouterTableEntry table_entry_to_send = {
-            .destination = {
-                host_state->interface_ip[0],
-                host_state->interface_ip[1],
-                host_state->interface_ip[2],
-                host_state->interface_ip[3]
-            },
-            .netmask = {
-                host_state->interface_netmask[0],
-                host_state->interface_netmask[1],
-                host_state->interface_netmask[2],
-                host_state->interface_netmask[3]
-            },
-            .gateway = {
-                host_state->interface_ip[0],
-                host_state->interface_ip[1],
-                host_state->interface_ip[2],
-                host_state->interface_ip[3]
-            },
-            .metric = 0
-        };
-        memcpy(packet_to_send + 12, &table_entry_to_send, sizeof(RouterTableEntry));
-
-        ssize_t sendto_res =
-            sendto(sock, packet_to_send, SIZEOF_PACKET_TO_SEND, 0,
-                    (struct sockaddr*)&broadcast_addr, sizeof(broadcast_addr));
-        if (sendto_res < 0) {
-            perror("sendto failed");
-            free(packet_to_send);
-            close(sock);
-            free(host_state);
-            exit(EXIT_FAILURE);
+/* one thread for every host: sleeps until the earliest host is due,
+ * runs every host that is due by then and sends their packets together
+ * */
+void* host_broadcaster(void *arg_host_state) {
+    HostState *host_state = (HostState*) arg_host_state;
+    EventScheduler *scheduler = host_state->scheduler;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint64_t next_at_ms;
+    while (get_next_event_time(scheduler, &next_at_ms)) {
+        struct timespec wake_at = start;
+        wake_at.tv_sec += next_at_ms / 1000;
+        wake_at.tv_nsec += (next_at_ms % 1000) * 1000000;
+        if (wake_at.tv_nsec >= 1000000000) {
+            wake_at.tv_sec += 1;
+            wake_at.tv_nsec -= 1000000000;
         }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_at, NULL) == EINTR);
 
-        free(packet_to_send);
-        
-        char interface_ip_str[16];
-        snprintf(interface_ip_str, sizeof(interface_ip_str), "%u.%u.%u.%u",
-                host_state->interface_ip[0],
-                host_state->interface_ip[1],
-                host_state->interface_ip[2],
-                host_state->interface_ip[3]
-        );
-        log_printf("Host %s broadcast message sent\n", interface_ip_str);
-        sleep(host_state->rand_delay);
+        // hosts due within the window (or while the previous batch was sent)
+        // go out together, a few ms early is nothing next to the jitter
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t now_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        run_events_until(scheduler, (now_ms > next_at_ms ? now_ms : next_at_ms) + HOST_BATCH_WINDOW_MS);
+        flush_host_batch(host_state);
     }
 
-    close(sock);
     return NULL;
 }
 
+/* appends count hosts with consecutive addresses, stops at the
+ * broadcast address of the subnet
+ * */
+int add_hosts_to_state(HostState *host_state, uint8_t *first_ip, uint8_t *netmask, uint32_t count) {
+    uint32_t ip;
+    uint32_t mask;
+    memcpy(&ip, first_ip, 4);
+    memcpy(&mask, netmask, 4);
+    ip = ntohl(ip);
+    mask = ntohl(mask);
+
+    for (uint32_t i = 0; i < count; i++, ip++) {
+        if ((ip & ~mask) == ~mask) {
+            errno = ERANGE;
+            perror("hosttbl range runs past the subnet");
+            return -1;
+        }
+
+        if (host_state->num_hosts == host_state->max_hosts) {
+            host_state->max_hosts = host_state->max_hosts > 0 ? 2 * host_state->max_hosts : 16;
+            host_state->hosts = realloc(host_state->hosts, host_state->max_hosts * sizeof(EmulatedHost));
+        }
+
+        EmulatedHost *host = &host_state->hosts[host_state->num_hosts];
+        uint32_t host_ip = htonl(ip);
+        memcpy(host->interface_ip, &host_ip, 4);
+        memcpy(host->interface_netmask, netmask, 4);
+        // the first host keeps the process id, the rest can't collide with other ids
+        host->host_id = host_state->num_hosts == 0
+            ? host_state->host_id
+            : (host_state->host_id << 16) | host_state->num_hosts;
+        host_state->num_hosts += 1;
+    }
+
+    return 0;
+}
+
 int read_hosttbl_and_add_to_state(int host_id, HostState *host_state) {
     char id_str[30];
     snprintf(id_str, sizeof(id_str), "%d", host_id);
@@ -122,54 +153,129 @@ int read_hosttbl_and_add_to_state(int host_id, HostState *host_state) {
     FILE *file = fopen(filename, "r");
     if (!file) {
         perror("hosttbl file reading errror");
-        fclose(file);
         return -1;
     }
 
     const uint32_t MAX_LINE = 100;
     char line[MAX_LINE];
-    if (!fgets(line, sizeof(line), file)) {
-        errno = EIO;
-        perror("Invalid hosttbl");
-        fclose(file);
-        return -1;
-    }
+    while (fgets(line, sizeof(line), file)) {
+        if (line[strlen(line) - 1] != '\n') {
+            errno = EIO;
+            perror("Invalid hosttbl");
+            fclose(file);
+            return -1;
+        }
 
-    if (line[strlen(line) - 1] != '\n') {
-        errno = EIO;
-        perror("Invalid hosttbl");
-        fclose(file);
-        return -1;
+        char line_ip[20];
+        char line_netmask[20];
+        uint32_t line_count = 1;
+        int num_fields = sscanf(line, "%19s %19s %u", line_ip, line_netmask, &line_count);
+        if (num_fields <= 0) {
+            // empty line
+            continue;
+        }
+        if (num_fields < 2 || !is_valid_ip(line_ip) || !is_valid_ip(line_netmask) || line_count == 0) {
+            errno = EIO;
+            perror("Invalid hosttbl");
+            fclose(file);
+            return -1;
+        }
+
+        uint8_t first_ip[4];
+        uint8_t netmask[4];
+        inet_pton(AF_INET, line_ip, first_ip);
+        inet_pton(AF_INET, line_netmask, netmask);
+        if (add_hosts_to_state(host_state, first_ip, netmask, line_count) < 0) {
+            fclose(file);
+            return -1;
+        }
     }
 
-    char first_line_ip[20];
-    char first_line_netmask[20];
-    sscanf(line, "%s %s", first_line_ip, first_line_netmask);
-    if (!is_valid_ip(first_line_ip) || !is_valid_ip(first_line_netmask)) {
+    fclose(file);
+    if (host_state->num_hosts == 0) {
         errno = EIO;
         perror("Invalid hosttbl");
-        fclose(file);
         return -1;
     }
-    
-    inet_pton(AF_INET, first_line_ip, host_state->interface_ip);
-    inet_pton(AF_INET, first_line_netmask, host_state->interface_netmask);
 
     return 0;
 }
 
-HostState* startup_host(uint32_t host_id) {
-    HostState *host_state = malloc(sizeof(HostState));
+void build_host_packet(EmulatedHost *host) {
+    memcpy(host->packet, host->interface_ip, 4);
+    memcpy(host->packet + 4, &host->host_id, 4);
+    uint32_t single_num_entries = 1;
+    memcpy(host->packet + 8, &single_num_entries, 4);
 
+    RouterTableEntry table_entry_to_send;
+    memset(&table_entry_to_send, 0, sizeof(table_entry_to_send));
+    memcpy(table_entry_to_send.destination, host->interface_ip, 4);
+    memcpy(table_entry_to_send.netmask, host->interface_netmask, 4);
+    memcpy(table_entry_to_send.gateway, host->interface_ip, 4);
+    table_entry_to_send.metric = 0;
+    memcpy(host->packet + 12, &table_entry_to_send, sizeof(RouterTableEntry));
+
+    uint8_t broadcast_ip[4];
+    get_broadcast_ip(host->interface_ip, host->interface_netmask, broadcast_ip);
+    memset(&host->broadcast_addr, 0, sizeof(host->broadcast_addr));
+    host->broadcast_addr.sin_family = AF_INET;
+    host->broadcast_addr.sin_port = htons(BROADCAST_PORT);
+    memcpy(&host->broadcast_addr.sin_addr.s_addr, broadcast_ip, 4);
+}
+
+HostState* startup_host(uint32_t host_id) {
+    HostState *host_state = calloc(1, sizeof(HostState));
     host_state->host_id = host_id;
-    host_state->rand_delay = (rand() % 8) + HOST_RAND_DELAY_BONUS;
-    log_printf("host_rand_delay: %u\n", host_state->rand_delay);
+    host_state->sock = -1;
+
     int read_hosttbl_rc = read_hosttbl_and_add_to_state(host_id, host_state);
     if (read_hosttbl_rc < 0) {
-        free(host_state);
+        free_host_state(host_state);
         exit(EXIT_FAILURE);
     }
 
+    host_state->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (host_state->sock < 0) {
+        perror("socket creation failed");
+        free_host_state(host_state);
+        exit(EXIT_FAILURE);
+    }
+
+    int broadcast_enable = 1;
+    int setsockopt_res = setsockopt(
+            host_state->sock,
+            SOL_SOCKET, SO_BROADCAST,
+            &broadcast_enable, sizeof(broadcast_enable)
+    );
+    if (setsockopt_res < 0) {
+        perror("setsockopt failed");
+        free_host_state(host_state);
+        exit(EXIT_FAILURE);
+    }
+
+    // every message has one iovec, only the pointers change per send
+    host_state->batch = calloc(HOST_SEND_BATCH, sizeof(struct mmsghdr) + sizeof(struct iovec));
+    struct iovec *iovecs = (struct iovec*) (host_state->batch + HOST_SEND_BATCH);
+    for (uint32_t i = 0; i < HOST_SEND_BATCH; i++) {
+        host_state->batch[i].msg_hdr.msg_iov = &iovecs[i];
+        host_state->batch[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // hosts started together still get different schedules
+    host_state->scheduler = create_event_scheduler(((uint64_t) host_id << 32) ^ time(NULL));
+    Clock *clock = &host_state->scheduler->clock;
+    for (uint32_t i = 0; i < host_state->num_hosts; i++) {
+        EmulatedHost *host = &host_state->hosts[i];
+        host->host_state = host_state;
+        host->rand_delay = clock_random_below(clock, 8) + HOST_RAND_DELAY_BONUS;
+        build_host_packet(host);
+        // spread over the first period instead of all sending at startup
+        schedule_event(host_state->scheduler,
+                clock_random_below(clock, host->rand_delay * 1000),
+                host_send_event, host);
+    }
+
+    log_printf("hosts: %u, first host_rand_delay: %u\n", host_state->num_hosts, host_state->hosts[0].rand_delay);
     return host_state;
 }
 
@@ -186,7 +292,7 @@ int host_split_threads(HostState *host_state) {
     pthread_join(threads[0], NULL);
 
 cleanup_host_state:
-    free(host_state);
+    free_host_state(host_state);
 
     if (is_thread_error) {
         return -1;
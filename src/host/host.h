@@ -2,15 +2,53 @@
 #define HOST_H
 
 #include <stdint.h>
+#include <netinet/in.h>
+#include <first.h>
+#include <clock.h>
+
+/* hosttbl lines:
+ *
+ * <ip> <netmask>           -> one host
+ * <ip> <netmask> <count>   -> count hosts with consecutive addresses from ip
+ *
+ * one process emulates every host of its hosttbl. each host has its own
+ * jittered schedule on a shared event scheduler driven by one timer loop,
+ * packets are built once at startup and sent in batches
+ * */
+
+typedef struct HostState HostState;
+
+struct mmsghdr;
 
 typedef struct {
-    uint32_t host_id;
     uint8_t interface_ip[4];
     uint8_t interface_netmask[4];
+    // id in the packet header, the first host keeps the id of the process
+    uint32_t host_id;
     uint32_t rand_delay;
-} HostState;
+    struct sockaddr_in broadcast_addr;
+    // header plus one table entry [ip, netmask, ip, 0]
+    uint8_t packet[12 + sizeof(RouterTableEntry)];
+    HostState *host_state;
+} EmulatedHost;
+
+struct HostState {
+    uint32_t host_id;
+    EmulatedHost *hosts;
+    uint32_t num_hosts;
+    uint32_t max_hosts;
+    EventScheduler *scheduler;
+    int sock;
+    // packets of the hosts that are due, sent with one sendmmsg
+    struct mmsghdr *batch;
+    uint32_t batch_size;
+    uint64_t packets_sent;
+};
 
 extern const uint32_t HOST_RAND_DELAY_BONUS;
+extern const uint32_t HOST_SEND_JITTER_MS;
+extern const uint32_t HOST_SEND_BATCH;
+extern const uint32_t HOST_BATCH_WINDOW_MS;
 
 HostState* startup_host(uint32_t host_id);
 
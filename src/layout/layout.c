@@ -0,0 +1,480 @@
+#include "layout.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+const double LAYOUT_DEFAULT_THETA = 0.8;
+const double LAYOUT_START_TEMPERATURE = 5.0;
+const double LAYOUT_COOLING = 0.99;
+const double LAYOUT_MIN_TEMPERATURE = 0.05;
+const double LAYOUT_SETTLED_ENERGY = 0.01;
+const uint32_t QUADTREE_MAX_DEPTH = 32;
+
+void reset_quad_node(QuadNode *node, double center_x, double center_y, double half_size) {
+    node->center_x = center_x;
+    node->center_y = center_y;
+    node->half_size = half_size;
+    node->mass = 0;
+    node->sum_x = 0;
+    node->sum_y = 0;
+    node->first_child = -1;
+    node->body = -1;
+}
+
+/* 0 top left, 1 top right, 2 bottom left, 3 bottom right
+ * */
+uint32_t get_quadrant(QuadNode *node, double x, double y) {
+    return (x >= node->center_x ? 1 : 0) + (y >= node->center_y ? 2 : 0);
+}
+
+int is_in_quad_node(QuadNode *node, double x, double y) {
+    return fabs(x - node->center_x) <= node->half_size && fabs(y - node->center_y) <= node->half_size;
+}
+
+/* returns the index of the first of the four new children, the node
+ * array can move
+ * */
+int32_t split_quad_node(QuadTree *tree, int32_t node_index) {
+    if (tree->num_nodes + 4 > tree->max_nodes) {
+        tree->max_nodes = tree->max_nodes > 0 ? 2 * tree->max_nodes : 64;
+        tree->nodes = realloc(tree->nodes, tree->max_nodes * sizeof(QuadNode));
+    }
+
+    QuadNode *node = &tree->nodes[node_index];
+    const double quarter = node->half_size / 2;
+    const int32_t first_child = tree->num_nodes;
+    for (uint32_t i = 0; i < 4; i++) {
+        reset_quad_node(&tree->nodes[first_child + i],
+                node->center_x + (i & 1 ? quarter : -quarter),
+                node->center_y + (i & 2 ? quarter : -quarter),
+                quarter
+        );
+    }
+    tree->num_nodes += 4;
+    node->first_child = first_child;
+    return first_child;
+}
+
+void add_mass_to_quad_node(QuadNode *node, double x, double y) {
+    node->mass += 1;
+    node->sum_x += x;
+    node->sum_y += y;
+}
+
+void insert_into_quadtree(QuadTree *tree, uint32_t body) {
+    const double x = tree->xs[body];
+    const double y = tree->ys[body];
+    int32_t node_index = 0;
+
+    for (uint32_t depth = 0;; depth++) {
+        QuadNode *node = &tree->nodes[node_index];
+        if (node->first_child < 0) {
+            if (node->mass == 0 || depth >= QUADTREE_MAX_DEPTH) {
+                // empty leaf, or vertices on (almost) the same spot
+                node->body = node->mass == 0 ? (int32_t) body : -1;
+                add_mass_to_quad_node(node, x, y);
+                return;
+            }
+
+            // move the vertex already here one level down
+            const int32_t other = node->body;
+            const int32_t first_child = split_quad_node(tree, node_index);
+            node = &tree->nodes[node_index];
+            node->body = -1;
+            QuadNode *child = &tree->nodes[first_child + get_quadrant(node, tree->xs[other], tree->ys[other])];
+            child->body = other;
+            add_mass_to_quad_node(child, tree->xs[other], tree->ys[other]);
+        }
+
+        add_mass_to_quad_node(node, x, y);
+        node_index = node->first_child + get_quadrant(node, x, y);
+    }
+}
+
+/* rebuilt from scratch every layout step, the node array is kept
+ * between builds
+ * */
+void build_quadtree(QuadTree *tree, const double *xs, const double *ys, uint32_t num_bodies) {
+    tree->xs = xs;
+    tree->ys = ys;
+    tree->num_nodes = 0;
+    if (tree->max_nodes == 0) {
+        tree->max_nodes = 64;
+        tree->nodes = malloc(tree->max_nodes * sizeof(QuadNode));
+    }
+
+    double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+    for (uint32_t i = 0; i < num_bodies; i++) {
+        if (i == 0 || xs[i] < min_x) min_x = xs[i];
+        if (i == 0 || ys[i] < min_y) min_y = ys[i];
+        if (i == 0 || xs[i] > max_x) max_x = xs[i];
+        if (i == 0 || ys[i] > max_y) max_y = ys[i];
+    }
+    const double half_size = fmax(fmax(max_x - min_x, max_y - min_y) / 2, 1.0);
+    reset_quad_node(&tree->nodes[0], (min_x + max_x) / 2, (min_y + max_y) / 2, half_size);
+    tree->num_nodes = 1;
+
+    for (uint32_t i = 0; i < num_bodies; i++) {
+        insert_into_quadtree(tree, i);
+    }
+}
+
+void push_interaction(Interactions *interactions, double x, double y, double mass) {
+    if (interactions->num_cells == interactions->max_cells) {
+        interactions->max_cells = interactions->max_cells > 0 ? 2 * interactions->max_cells : 256;
+        interactions->xs = realloc(interactions->xs, interactions->max_cells * sizeof(double));
+        interactions->ys = realloc(interactions->ys, interactions->max_cells * sizeof(double));
+        interactions->masses = realloc(interactions->masses, interactions->max_cells * sizeof(double));
+    }
+
+    interactions->xs[interactions->num_cells] = x;
+    interactions->ys[interactions->num_cells] = y;
+    interactions->masses[interactions->num_cells] = mass;
+    interactions->num_cells += 1;
+}
+
+/* replaces the list with the point masses acting on body: single
+ * vertices, and cells far enough away to count as one mass
+ * */
+void collect_interactions(QuadTree *tree, uint32_t body, double theta, Interactions *interactions) {
+    const double x = tree->xs[body];
+    const double y = tree->ys[body];
+    interactions->num_cells = 0;
+
+    // the leaf body was inserted into
+    int32_t own_leaf = 0;
+    while (tree->nodes[own_leaf].first_child >= 0) {
+        own_leaf = tree->nodes[own_leaf].first_child + get_quadrant(&tree->nodes[own_leaf], x, y);
+    }
+
+    // three siblings wait on every level
+    int32_t stack[3 * QUADTREE_MAX_DEPTH + 4];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const int32_t node_index = stack[--stack_size];
+        QuadNode *node = &tree->nodes[node_index];
+        if (node->mass == 0 || (node_index == own_leaf && node->body >= 0)) {
+            continue;
+        }
+
+        // a cell around body itself is never taken as one mass
+        if (node->first_child >= 0 && (is_in_quad_node(node, x, y) || 2 * node->half_size >= theta * hypot(
+                x - node->sum_x / node->mass, y - node->sum_y / node->mass))) {
+            for (uint32_t i = 0; i < 4; i++) {
+                stack[stack_size++] = node->first_child + i;
+            }
+            continue;
+        }
+
+        double mass = node->mass;
+        double sum_x = node->sum_x;
+        double sum_y = node->sum_y;
+        if (node_index == own_leaf) {
+            // shared leaf at QUADTREE_MAX_DEPTH, without body itself
+            mass -= 1;
+            sum_x -= x;
+            sum_y -= y;
+            if (mass == 0) {
+                continue;
+            }
+        }
+
+        push_interaction(interactions, sum_x / mass, sum_y / mass, mass);
+    }
+}
+
+/* sum of mass * fr(dist) along the direction from each cell to (x, y).
+ * four independent lanes, so the loop vectorizes without reassociating
+ * the floating point sums
+ * */
+void sum_repulsion(const Interactions *interactions, double x, double y, double k, double *disp_x, double *disp_y) {
+    const double *restrict cell_xs = interactions->xs;
+    const double *restrict cell_ys = interactions->ys;
+    const double *restrict masses = interactions->masses;
+    const uint32_t num_cells = interactions->num_cells;
+    double lane_xs[4] = { 0, 0, 0, 0 };
+    double lane_ys[4] = { 0, 0, 0, 0 };
+
+    uint32_t i = 0;
+    for (; i + 4 <= num_cells; i += 4) {
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            const double dx = x - cell_xs[i + lane];
+            const double dy = y - cell_ys[i + lane];
+            const double dist = sqrt(dx * dx + dy * dy) + 0.1;
+            // (d / dist) * mass * k / dist
+            const double scale = masses[i + lane] * k / (dist * dist);
+            lane_xs[lane] += dx * scale;
+            lane_ys[lane] += dy * scale;
+        }
+    }
+    for (; i < num_cells; i++) {
+        const double dx = x - cell_xs[i];
+        const double dy = y - cell_ys[i];
+        const double dist = sqrt(dx * dx + dy * dy) + 0.1;
+        const double scale = masses[i] * k / (dist * dist);
+        lane_xs[0] += dx * scale;
+        lane_ys[0] += dy * scale;
+    }
+
+    *disp_x += (lane_xs[0] + lane_xs[1]) + (lane_xs[2] + lane_xs[3]);
+    *disp_y += (lane_ys[0] + lane_ys[1]) + (lane_ys[2] + lane_ys[3]);
+}
+
+void free_quadtree(QuadTree *tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->num_nodes = 0;
+    tree->max_nodes = 0;
+}
+
+/* the vertices [first, last) of one worker
+ * */
+void get_worker_range(Layout *layout, uint32_t worker, uint32_t *first, uint32_t *last) {
+    *first = (uint64_t) layout->num_vertices * worker / layout->num_workers;
+    *last = (uint64_t) layout->num_vertices * (worker + 1) / layout->num_workers;
+}
+
+void repulsion_task(Layout *layout, uint32_t worker) {
+    uint32_t first, last;
+    get_worker_range(layout, worker, &first, &last);
+    Interactions *interactions = &layout->interactions[worker];
+
+    for (uint32_t i = first; i < last; i++) {
+        layout->disp_xs[i] = 0;
+        layout->disp_ys[i] = 0;
+        if (layout->pinned[i] || layout->ts[i] == 0) {
+            continue;
+        }
+        collect_interactions(&layout->quadtree, i, layout->theta, interactions);
+        sum_repulsion(interactions, layout->xs[i], layout->ys[i], layout->k,
+                &layout->disp_xs[i], &layout->disp_ys[i]);
+    }
+}
+
+/* moves every vertex along its displacement, at most its temperature,
+ * keeps it inside the drawing area and cools it
+ * */
+void displacement_task(Layout *layout, uint32_t worker) {
+    uint32_t first, last;
+    get_worker_range(layout, worker, &first, &last);
+    double *restrict xs = layout->xs;
+    double *restrict ys = layout->ys;
+    const double *restrict disp_xs = layout->disp_xs;
+    const double *restrict disp_ys = layout->disp_ys;
+    const uint8_t *restrict pinned = layout->pinned;
+    double *restrict ts = layout->ts;
+    double *restrict kinetic_energies = layout->kinetic_energies;
+    const double width = layout->width;
+    const double height = layout->height;
+    double energy = 0;
+    uint32_t num_hot = 0;
+
+    for (uint32_t i = first; i < last; i++) {
+        const double dist = sqrt(disp_xs[i] * disp_xs[i] + disp_ys[i] * disp_ys[i]);
+        double scale = dist > 1e-8 ? fmin(dist, ts[i]) / dist : 0;
+        scale = pinned[i] ? 0 : scale;
+        const double new_x = fmin(fmax(xs[i] + disp_xs[i] * scale, 0), width);
+        const double new_y = fmin(fmax(ys[i] + disp_ys[i] * scale, 0), height);
+        kinetic_energies[i] = (new_x - xs[i]) * (new_x - xs[i]) + (new_y - ys[i]) * (new_y - ys[i]);
+        xs[i] = new_x;
+        ys[i] = new_y;
+
+        energy += kinetic_energies[i];
+        num_hot += ts[i] > 0;
+        const double t = ts[i] * LAYOUT_COOLING;
+        ts[i] = t < LAYOUT_MIN_TEMPERATURE ? 0 : t;
+    }
+
+    layout->worker_energies[worker] = energy;
+    layout->worker_num_hot[worker] = num_hot;
+}
+
+/* edges touch two vertices of possibly different workers, so they are
+ * summed on the calling thread
+ * */
+void add_attraction(Layout *layout) {
+    for (uint32_t i = 0; i < layout->num_edges; i++) {
+        const uint32_t v = layout->edge_vs[i];
+        const uint32_t u = layout->edge_us[i];
+        const double dx = layout->xs[v] - layout->xs[u];
+        const double dy = layout->ys[v] - layout->ys[u];
+        const double dist = sqrt(dx * dx + dy * dy) + 0.1;
+        // (d / dist) * fa(dist)
+        const double scale = dist / layout->k;
+        if (!layout->pinned[v]) {
+            layout->disp_xs[v] -= dx * scale;
+            layout->disp_ys[v] -= dy * scale;
+        }
+        if (!layout->pinned[u]) {
+            layout->disp_xs[u] += dx * scale;
+            layout->disp_ys[u] += dy * scale;
+        }
+    }
+}
+
+void run_layout_task(Layout *layout, LayoutTask task) {
+    layout->task = task;
+    pthread_barrier_wait(&layout->start_barrier);
+    task(layout, 0);
+    pthread_barrier_wait(&layout->done_barrier);
+}
+
+typedef struct {
+    Layout *layout;
+    uint32_t worker;
+} LayoutWorkerArgs;
+
+void* layout_worker(void *arg_worker_args) {
+    LayoutWorkerArgs worker_args = *(LayoutWorkerArgs*) arg_worker_args;
+    free(arg_worker_args);
+    Layout *layout = worker_args.layout;
+
+    for (;;) {
+        pthread_barrier_wait(&layout->start_barrier);
+        if (layout->is_stopping) {
+            break;
+        }
+        layout->task(layout, worker_args.worker);
+        pthread_barrier_wait(&layout->done_barrier);
+    }
+
+    return NULL;
+}
+
+Layout* create_layout(double width, double height, double theta, uint32_t num_workers) {
+    Layout *layout = calloc(1, sizeof(Layout));
+    layout->width = width;
+    layout->height = height;
+    layout->k = sqrt(width * height);
+    layout->theta = theta;
+    layout->is_settled = 1;
+    layout->num_workers = num_workers > 0 ? num_workers : 1;
+    layout->worker_energies = calloc(layout->num_workers, sizeof(double));
+    layout->worker_num_hot = calloc(layout->num_workers, sizeof(uint32_t));
+    layout->interactions = calloc(layout->num_workers, sizeof(Interactions));
+    layout->workers = calloc(layout->num_workers, sizeof(pthread_t));
+    pthread_barrier_init(&layout->start_barrier, NULL, layout->num_workers);
+    pthread_barrier_init(&layout->done_barrier, NULL, layout->num_workers);
+
+    for (uint32_t i = 1; i < layout->num_workers; i++) {
+        LayoutWorkerArgs *worker_args = malloc(sizeof(LayoutWorkerArgs));
+        worker_args->layout = layout;
+        worker_args->worker = i;
+        if (pthread_create(&layout->workers[i], NULL, layout_worker, worker_args)) {
+            perror("Error initializing threads.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return layout;
+}
+
+uint32_t add_layout_vertex(Layout *layout, double x, double y) {
+    if (layout->num_vertices == layout->max_vertices) {
+        layout->max_vertices = layout->max_vertices > 0 ? 2 * layout->max_vertices : 64;
+        layout->xs = realloc(layout->xs, layout->max_vertices * sizeof(double));
+        layout->ys = realloc(layout->ys, layout->max_vertices * sizeof(double));
+        layout->disp_xs = realloc(layout->disp_xs, layout->max_vertices * sizeof(double));
+        layout->disp_ys = realloc(layout->disp_ys, layout->max_vertices * sizeof(double));
+        layout->pinned = realloc(layout->pinned, layout->max_vertices * sizeof(uint8_t));
+        layout->ts = realloc(layout->ts, layout->max_vertices * sizeof(double));
+        layout->kinetic_energies = realloc(layout->kinetic_energies, layout->max_vertices * sizeof(double));
+    }
+
+    const uint32_t vertex = layout->num_vertices++;
+    layout->xs[vertex] = x;
+    layout->ys[vertex] = y;
+    layout->disp_xs[vertex] = 0;
+    layout->disp_ys[vertex] = 0;
+    layout->pinned[vertex] = 0;
+    layout->ts[vertex] = 0;
+    layout->kinetic_energies[vertex] = 0;
+    heat_layout_vertex(layout, vertex, LAYOUT_START_TEMPERATURE);
+    return vertex;
+}
+
+void add_layout_edge(Layout *layout, uint32_t v, uint32_t u) {
+    if (layout->num_edges == layout->max_edges) {
+        layout->max_edges = layout->max_edges > 0 ? 2 * layout->max_edges : 64;
+        layout->edge_vs = realloc(layout->edge_vs, layout->max_edges * sizeof(uint32_t));
+        layout->edge_us = realloc(layout->edge_us, layout->max_edges * sizeof(uint32_t));
+    }
+
+    layout->edge_vs[layout->num_edges] = v;
+    layout->edge_us[layout->num_edges] = u;
+    layout->num_edges += 1;
+}
+
+/* lets the vertex move up to t per step again, unless it is hotter
+ * already
+ * */
+void heat_layout_vertex(Layout *layout, uint32_t vertex, double t) {
+    layout->ts[vertex] = fmax(layout->ts[vertex], t);
+    layout->is_settled = 0;
+}
+
+void heat_layout(Layout *layout, double t) {
+    for (uint32_t i = 0; i < layout->num_vertices; i++) {
+        heat_layout_vertex(layout, i, t);
+    }
+}
+
+void step_layout(Layout *layout) {
+    if (layout->num_vertices == 0 || layout->is_settled) {
+        return;
+    }
+
+    build_quadtree(&layout->quadtree, layout->xs, layout->ys, layout->num_vertices);
+    run_layout_task(layout, repulsion_task);
+    add_attraction(layout);
+    run_layout_task(layout, displacement_task);
+
+    layout->energy = 0;
+    layout->num_hot_vertices = 0;
+    for (uint32_t i = 0; i < layout->num_workers; i++) {
+        layout->energy += layout->worker_energies[i];
+        layout->num_hot_vertices += layout->worker_num_hot[i];
+    }
+
+    // vertices that are still warm would otherwise wake up with the next
+    // local change and keep the whole layout going
+    if (layout->energy <= LAYOUT_SETTLED_ENERGY * layout->num_hot_vertices) {
+        for (uint32_t i = 0; i < layout->num_vertices; i++) {
+            layout->ts[i] = 0;
+        }
+        layout->is_settled = 1;
+    }
+}
+
+void free_layout(Layout *layout) {
+    layout->is_stopping = 1;
+    pthread_barrier_wait(&layout->start_barrier);
+    for (uint32_t i = 1; i < layout->num_workers; i++) {
+        pthread_join(layout->workers[i], NULL);
+    }
+    pthread_barrier_destroy(&layout->start_barrier);
+    pthread_barrier_destroy(&layout->done_barrier);
+
+    for (uint32_t i = 0; i < layout->num_workers; i++) {
+        free(layout->interactions[i].xs);
+        free(layout->interactions[i].ys);
+        free(layout->interactions[i].masses);
+    }
+    free(layout->interactions);
+    free(layout->workers);
+    free(layout->worker_energies);
+    free(layout->worker_num_hot);
+    free_quadtree(&layout->quadtree);
+    free(layout->xs);
+    free(layout->ys);
+    free(layout->disp_xs);
+    free(layout->disp_ys);
+    free(layout->pinned);
+    free(layout->ts);
+    free(layout->kinetic_energies);
+    free(layout->edge_vs);
+    free(layout->edge_us);
+    free(layout);
+}
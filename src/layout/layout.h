@@ -0,0 +1,129 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* force directed layout, no GTK in here.
+ *
+ * repulsion between every pair of vertices is approximated with a
+ * Barnes-Hut quadtree: a cell that looks small from a vertex (cell size /
+ * distance < theta) pushes it as one mass at its center of mass. theta 0
+ * is the exact O(V^2) sum, larger values are faster and rougher.
+ *
+ * positions and displacements are kept as separate arrays (index = vertex
+ * index of the caller). every step the tree is built on the calling
+ * thread, then the vertices are split between the workers: each one
+ * collects the cells acting on a vertex into its interaction list and
+ * sums the list in a loop the compiler vectorizes.
+ *
+ * every vertex has its own temperature, the longest move it may make in
+ * a step, which cools after each step. a vertex that went cold neither
+ * moves nor has its forces computed, so a settled layout costs nothing
+ * until a change heats the vertices around it again. the layout is
+ * settled once the hot vertices move less than LAYOUT_SETTLED_ENERGY
+ * (squared distance per step) on average
+ * */
+
+typedef struct {
+    double x, y;
+} Vec2;
+
+typedef struct {
+    double center_x, center_y;
+    double half_size;
+    // number of vertices in the cell and the sum of their positions
+    uint32_t mass;
+    double sum_x, sum_y;
+    // four consecutive children, -1 for a leaf
+    int32_t first_child;
+    // the only vertex of a leaf, -1 when empty or when several vertices
+    // share a leaf at QUADTREE_MAX_DEPTH
+    int32_t body;
+} QuadNode;
+
+typedef struct {
+    QuadNode *nodes;
+    uint32_t num_nodes;
+    uint32_t max_nodes;
+    const double *xs;
+    const double *ys;
+} QuadTree;
+
+// cells acting on one vertex, as point masses
+typedef struct {
+    double *xs;
+    double *ys;
+    double *masses;
+    uint32_t num_cells;
+    uint32_t max_cells;
+} Interactions;
+
+typedef struct Layout Layout;
+
+typedef void (*LayoutTask)(Layout *layout, uint32_t worker);
+
+struct Layout {
+    double *xs, *ys;
+    double *disp_xs, *disp_ys;
+    // pinned vertices (dragged by the user) feel no forces
+    uint8_t *pinned;
+    // longest move of a vertex in the next step, 0 = cold
+    double *ts;
+    // squared distance every vertex moved in the last step
+    double *kinetic_energies;
+    uint32_t num_vertices;
+    uint32_t max_vertices;
+    uint32_t *edge_vs, *edge_us;
+    uint32_t num_edges;
+    uint32_t max_edges;
+    QuadTree quadtree;
+    Interactions *interactions;
+    double width, height;
+    // fr(x) = k / x, fa(x) = x^2 / k
+    double k;
+    double theta;
+    // of the last step, over the vertices that were hot
+    double energy;
+    uint32_t num_hot_vertices;
+    int is_settled;
+    // worker 0 is the thread calling step_layout
+    pthread_t *workers;
+    uint32_t num_workers;
+    // per worker parts of energy and num_hot_vertices
+    double *worker_energies;
+    uint32_t *worker_num_hot;
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t done_barrier;
+    LayoutTask task;
+    int is_stopping;
+};
+
+extern const double LAYOUT_DEFAULT_THETA;
+extern const double LAYOUT_START_TEMPERATURE;
+extern const double LAYOUT_COOLING;
+extern const double LAYOUT_MIN_TEMPERATURE;
+extern const double LAYOUT_SETTLED_ENERGY;
+extern const uint32_t QUADTREE_MAX_DEPTH;
+
+void build_quadtree(QuadTree *tree, const double *xs, const double *ys, uint32_t num_bodies);
+
+void collect_interactions(QuadTree *tree, uint32_t body, double theta, Interactions *interactions);
+
+void free_quadtree(QuadTree *tree);
+
+Layout* create_layout(double width, double height, double theta, uint32_t num_workers);
+
+uint32_t add_layout_vertex(Layout *layout, double x, double y);
+
+void add_layout_edge(Layout *layout, uint32_t v, uint32_t u);
+
+void heat_layout_vertex(Layout *layout, uint32_t vertex, double t);
+
+void heat_layout(Layout *layout, double t);
+
+void step_layout(Layout *layout);
+
+void free_layout(Layout *layout);
+
+#endif
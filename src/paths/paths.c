@@ -0,0 +1,204 @@
+#include "paths.h"
+#include <stdlib.h>
+#include <string.h>
+
+void init_path_index(PathIndex *index) {
+    memset(index, 0, sizeof(PathIndex));
+}
+
+void free_path_index(PathIndex *index) {
+    free(index->hop_kinds);
+    free(index->hop_gateways);
+    free(index->statuses);
+    free(index->next_vertices);
+    free(index->visit_states);
+    free(index->stack);
+    memset(index, 0, sizeof(PathIndex));
+}
+
+void reserve_path_vertices(PathIndex *index, uint32_t num_vertices) {
+    if (num_vertices > index->max_vertices) {
+        index->max_vertices = index->max_vertices > 0 ? 2 * index->max_vertices : 64;
+        while (index->max_vertices < num_vertices) {
+            index->max_vertices *= 2;
+        }
+        index->hop_kinds = realloc(index->hop_kinds, index->max_vertices * sizeof(uint8_t));
+        index->hop_gateways = realloc(index->hop_gateways, index->max_vertices * sizeof(uint8_t[4]));
+        index->statuses = realloc(index->statuses, index->max_vertices * sizeof(uint8_t));
+        index->next_vertices = realloc(index->next_vertices, index->max_vertices * sizeof(int32_t));
+        index->visit_states = realloc(index->visit_states, index->max_vertices * sizeof(uint8_t));
+        index->stack = realloc(index->stack, index->max_vertices * sizeof(uint32_t));
+    }
+
+    for (uint32_t i = index->num_vertices; i < num_vertices; i++) {
+        // not heard from yet
+        index->hop_kinds[i] = HOP_NO_ROUTE;
+        index->statuses[i] = PATH_BLACK_HOLE;
+        index->next_vertices[i] = -1;
+    }
+    if (num_vertices > index->num_vertices) {
+        index->num_vertices = num_vertices;
+        index->is_dirty = 1;
+    }
+}
+
+void set_path_destination(PathIndex *index, TopologyGraph *graph, TopologyHistory *history, uint8_t *destination) {
+    index->is_active = 1;
+    memcpy(index->destination, destination, 4);
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        update_path_hop(index, graph, history, i);
+    }
+    index->is_dirty = 1;
+}
+
+void clear_path_destination(PathIndex *index) {
+    index->is_active = 0;
+}
+
+int is_vertex_interface(Vertex *vertex, uint8_t *ip) {
+    for (uint32_t i = 0; i < vertex->num_interfaces; i++) {
+        if (match_ips(vertex->interfaces[i].interface_ip, ip)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* the hop of one router toward the destination: its own interfaces
+ * first, then the longest prefix in its last table, the lower metric on a
+ * tie. a connected route (the router's own interface as gateway) delivers
+ * */
+void update_path_hop(PathIndex *index, TopologyGraph *graph, TopologyHistory *history, uint32_t vertex) {
+    if (!index->is_active) {
+        return;
+    }
+    reserve_path_vertices(index, vertex + 1);
+
+    uint8_t host_mask[4] = { 255, 255, 255, 255 };
+    Vertex *curr_vertex = &graph->vertices[vertex];
+    HopKind kind = HOP_NO_ROUTE;
+    uint8_t gateway[4] = { 0 };
+
+    if (is_vertex_interface(curr_vertex, index->destination)) {
+        kind = HOP_DELIVERS;
+    }
+
+    RouterTableEntry *best_entry = NULL;
+    int best_prefix = -1;
+    const uint32_t table_size = vertex < history->num_vertices ? history->last_table_sizes[vertex] : 0;
+    for (uint32_t i = 0; kind == HOP_NO_ROUTE && i < table_size; i++) {
+        RouterTableEntry *curr_entry = &history->last_tables[vertex][i];
+        if (!is_network_subsumed(curr_entry->destination, curr_entry->netmask, index->destination, host_mask)) {
+            continue;
+        }
+        uint32_t mask_word;
+        memcpy(&mask_word, curr_entry->netmask, 4);
+        const int prefix = __builtin_popcount(mask_word);
+        if (prefix > best_prefix || (prefix == best_prefix && curr_entry->metric < best_entry->metric)) {
+            best_entry = curr_entry;
+            best_prefix = prefix;
+        }
+    }
+
+    if (best_entry != NULL) {
+        if (best_entry->metric >= INFINITY_METRIC) {
+            kind = HOP_UNREACHABLE;
+        }
+        else if (best_entry->metric == 0 || is_vertex_interface(curr_vertex, best_entry->gateway)) {
+            kind = HOP_DELIVERS;
+        }
+        else {
+            kind = HOP_VIA_GATEWAY;
+            memcpy(gateway, best_entry->gateway, 4);
+        }
+    }
+
+    if (index->hop_kinds[vertex] != kind || !match_ips(index->hop_gateways[vertex], gateway)) {
+        index->hop_kinds[vertex] = kind;
+        memcpy(index->hop_gateways[vertex], gateway, 4);
+        index->is_dirty = 1;
+    }
+}
+
+/* the hops make a functional graph: every walk ends in a router that
+ * delivers, in one without a usable hop, or in a cycle. every router is
+ * walked once, the routers of a walk take the status it ended in
+ * */
+void resolve_path_statuses(PathIndex *index, TopologyGraph *graph) {
+    reserve_path_vertices(index, graph->num_vertices);
+
+    for (uint32_t i = 0; i < index->num_vertices; i++) {
+        index->next_vertices[i] = index->hop_kinds[i] == HOP_VIA_GATEWAY
+            ? get_index_of_vertex_in_graph_with_interface_ip(graph, index->hop_gateways[i])
+            : -1;
+        index->visit_states[i] = 0;
+    }
+
+    for (uint32_t start = 0; start < index->num_vertices; start++) {
+        uint32_t depth = 0;
+        uint32_t curr_vertex = start;
+        PathStatus status;
+        while (1) {
+            if (index->visit_states[curr_vertex] == 2) {
+                status = index->statuses[curr_vertex];
+                break;
+            }
+            if (index->visit_states[curr_vertex] == 1) {
+                status = PATH_LOOP;
+                break;
+            }
+            index->visit_states[curr_vertex] = 1;
+            index->stack[depth++] = curr_vertex;
+
+            if (index->hop_kinds[curr_vertex] == HOP_DELIVERS) {
+                status = PATH_DELIVERED;
+                break;
+            }
+            if (index->next_vertices[curr_vertex] < 0) {
+                status = PATH_BLACK_HOLE;
+                break;
+            }
+            curr_vertex = index->next_vertices[curr_vertex];
+        }
+
+        for (uint32_t i = 0; i < depth; i++) {
+            index->statuses[index->stack[i]] = status;
+            index->visit_states[index->stack[i]] = 2;
+        }
+    }
+
+    index->is_dirty = 0;
+}
+
+/* the routers from from_vertex on, as of the last resolve_path_statuses.
+ * a loop ends with its first router again. when the last router delivers
+ * to a network, the router that owns the destination is added after it
+ * */
+uint32_t get_path(PathIndex *index, TopologyGraph *graph, uint32_t from_vertex, uint32_t *path, uint32_t max_path_length) {
+    if (!index->is_active || from_vertex >= index->num_vertices) {
+        return 0;
+    }
+
+    uint32_t path_length = 0;
+    int32_t curr_vertex = from_vertex;
+    while (curr_vertex >= 0 && path_length < max_path_length) {
+        path[path_length++] = curr_vertex;
+        if (index->visit_states[curr_vertex] == 3) {
+            break;
+        }
+        index->visit_states[curr_vertex] = 3;
+        if (index->hop_kinds[curr_vertex] == HOP_DELIVERS) {
+            const int owner = get_index_of_vertex_in_graph_with_interface_ip(graph, index->destination);
+            if (owner >= 0 && (uint32_t) owner < index->num_vertices && owner != curr_vertex && path_length < max_path_length) {
+                path[path_length++] = owner;
+            }
+            break;
+        }
+        curr_vertex = index->next_vertices[curr_vertex];
+    }
+
+    for (uint32_t i = 0; i < path_length; i++) {
+        index->visit_states[path[i]] = 2;
+    }
+    return path_length;
+}
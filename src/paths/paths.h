@@ -0,0 +1,67 @@
+#ifndef PATHS_H
+#define PATHS_H
+
+#include <stdint.h>
+#include <first.h>
+#include <topology.h>
+#include <history.h>
+
+/* where traffic for one destination ip goes, from the last table every
+ * router sent (kept by the history).
+ *
+ * every router's hop toward the destination is the longest prefix match
+ * in its table and is cached: a new table only redoes the hop of its own
+ * router. following the hops from every router ends in delivery, in a
+ * black hole (no route, a poisoned route or a gateway nobody owns) or in
+ * a loop; these statuses are resolved for all routers at once in O(V),
+ * and only after a hop changed
+ * */
+
+typedef enum {
+    // the router owns the destination or is connected to its network
+    HOP_DELIVERS,
+    HOP_VIA_GATEWAY,
+    HOP_NO_ROUTE,
+    HOP_UNREACHABLE
+} HopKind;
+
+typedef enum {
+    PATH_DELIVERED,
+    PATH_LOOP,
+    PATH_BLACK_HOLE
+} PathStatus;
+
+typedef struct {
+    int is_active;
+    uint8_t destination[4];
+
+    // per vertex
+    uint8_t *hop_kinds;
+    uint8_t (*hop_gateways)[4];
+    uint8_t *statuses;
+    // resolve_path_statuses scratch
+    int32_t *next_vertices;
+    uint8_t *visit_states;
+    uint32_t *stack;
+    uint32_t num_vertices;
+    uint32_t max_vertices;
+
+    // a hop changed since the statuses were resolved
+    int is_dirty;
+} PathIndex;
+
+void init_path_index(PathIndex *index);
+
+void free_path_index(PathIndex *index);
+
+void set_path_destination(PathIndex *index, TopologyGraph *graph, TopologyHistory *history, uint8_t *destination);
+
+void clear_path_destination(PathIndex *index);
+
+void update_path_hop(PathIndex *index, TopologyGraph *graph, TopologyHistory *history, uint32_t vertex);
+
+void resolve_path_statuses(PathIndex *index, TopologyGraph *graph);
+
+uint32_t get_path(PathIndex *index, TopologyGraph *graph, uint32_t from_vertex, uint32_t *path, uint32_t max_path_length);
+
+#endif
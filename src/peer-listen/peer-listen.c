@@ -1,5 +1,13 @@
 #include <first.h>
 #include <host.h>
+#include <checkpoint.h>
+#include <config.h>
+#include <router.h>
+#include <clock.h>
+#include <capture.h>
+#include <placement.h>
+#include <pool.h>
+#include <arena.h>
 #include <errno.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -8,190 +16,20 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdarg.h>
 #include <pthread.h>
 #include <time.h>
 
-int life_table_contains_gateway(RouterState *router_state, uint8_t *gateway_to_find) {
-    for (uint32_t i = 0; i < router_state->life_entries; i++) {
-        if (match_ips(router_state->life_table[i].gateway, gateway_to_find)) {
-            return 1;
-        }
-    }
-
-    return 0;
-}
-
-int add_new_gateway_to_life_table(RouterState *router_state, uint8_t *arg_gateway) {
-    if (router_state->life_entries >= ROUTER_TABLE_MAX_SIZE) {
-        return -1;
-    }
-
-    memcpy(router_state->life_table[router_state->life_entries].gateway, arg_gateway, 4);
-    router_state->life_table[router_state->life_entries].life_left = MAX_GATEWAY_LIFE;
-    router_state->life_entries += 1;
-    return 0;
-}
-
-int reset_gateway_in_life_table(RouterState *router_state, uint8_t *arg_gateway) {
-    for (uint32_t i = 0; i < router_state->life_entries; i++) {
-        if (match_ips(router_state->life_table[i].gateway, arg_gateway)) {
-            router_state->life_table[i].life_left = MAX_GATEWAY_LIFE;
-            return 1;
-        }
-    }
-
-    return 0;
-}
-
-int add_to_table(RouterState *router_state,
-        uint8_t *dest,
-        uint8_t *netmask,
-        uint8_t *gateway,
-        uint8_t *if_to_hop,
-        uint32_t metric) {
-
-    if (router_state->num_entries >= ROUTER_TABLE_MAX_SIZE) {
-        return -1;
-    }
-
-    memcpy(router_state->router_table[router_state->num_entries].destination, dest, 4);
-    memcpy(router_state->router_table[router_state->num_entries].netmask, netmask, 4);
-    memcpy(router_state->router_table[router_state->num_entries].gateway, gateway, 4);
-    memcpy(router_state->router_table[router_state->num_entries].interface, if_to_hop, 4);
-    router_state->router_table[router_state->num_entries].metric = metric;
-    router_state->num_entries += 1;
-    return 0;
-}
-
-/* meant to be used to insert an entry for a network that is
- * subsumed by another and needs to be inserted before it
- *
- * one cannot add an entry at a position that isn't already taken
+/* takes the read lock, pool workers change the table meanwhile
  * */
-int add_to_table_at_pos(RouterState *router_state, int pos,
-        uint8_t *dest,
-        uint8_t *netmask,
-        uint8_t *gateway,
-        uint8_t *if_to_hop,
-        uint32_t metric) {
-
-    if (pos >= router_state->num_entries) {
-        return -1;
-    }
-
-    if (router_state->num_entries >= ROUTER_TABLE_MAX_SIZE) {
-        return -1;
-    }
-
-    for (int i = router_state->num_entries - 1; i >= pos; i--) {
-        memcpy(&router_state->router_table[i + 1], &router_state->router_table[i], sizeof(RouterTableEntry));
-    }
-
-    memcpy(router_state->router_table[pos].destination, dest, 4);
-    memcpy(router_state->router_table[pos].netmask, netmask, 4);
-    memcpy(router_state->router_table[pos].gateway, gateway, 4);
-    memcpy(router_state->router_table[pos].interface, if_to_hop, 4);
-    router_state->router_table[pos].metric = metric;
-    router_state->num_entries += 1;
-    return 0;
-}
-
-int add_to_table_strings(RouterState *router_state,
-        const char *dest,
-        const char *netmask,
-        const char *gateway,
-        const char *if_to_hop,
-        uint32_t metric) {
-
-    if (router_state->num_entries >= ROUTER_TABLE_MAX_SIZE) {
-        return -1;
-    }
-
-    int dest_rc = inet_pton(AF_INET, dest, router_state->router_table[router_state->num_entries].destination);
-    int mask_rc = inet_pton(AF_INET, netmask, router_state->router_table[router_state->num_entries].netmask);
-    int gateway_rc = inet_pton(AF_INET, gateway, router_state->router_table[router_state->num_entries].gateway);
-    int if_to_hop_rc = inet_pton(AF_INET, if_to_hop, router_state->router_table[router_state->num_entries].interface);
-    router_state->router_table[router_state->num_entries].metric = metric;
-
-    if (dest_rc != 1 || mask_rc != 1 || gateway_rc != 1 || if_to_hop_rc != 1) {
-        return -1;
-    }
-
-    router_state->num_entries += 1;
-    return 0;
-}
-
-int remove_current_interface_from_router_table_and_get_index(
-        InterfaceTableEntry *interface_to_delete,
-        RouterTableEntry *router_table,
-        uint32_t num_entries
-) {
-    if (num_entries == 0) {
-        return -1;
-    }
-
-    for (uint32_t i = 0; i < num_entries; i++) {
-        if (match_ips(router_table[i].destination, interface_to_delete->interface_ip) && 
-                match_ips(router_table[i].netmask, interface_to_delete->interface_netmask)) {
-            if (i == num_entries - 1) {
-                memset(&router_table[i], 0, sizeof(RouterTableEntry));
-            } else {
-                memcpy(&router_table[i],
-                       &router_table[num_entries - 1],
-                       sizeof(RouterTableEntry)
-                );
-                memset(&router_table[num_entries - 1], 0, sizeof(RouterTableEntry));
-            }
-
-            return i;
-        }
-    }
-
-    return -1;
-}
-
-int add_current_interface_to_router_table_at_pos(
-        InterfaceTableEntry *interface_to_add,
-        int pos,
-        RouterTableEntry *router_table,
-        uint32_t num_entries
-) {
-    if (pos >= num_entries) {
-        return -1;
-    }
-
-    if (num_entries >= ROUTER_TABLE_MAX_SIZE) {
-        return -1;
-    }
-
-    for (int i = num_entries - 1; i >= pos; i--) {
-        memcpy(&router_table[i + 1], &router_table[i], sizeof(RouterTableEntry));
-    }
-
-    memcpy(router_table[pos].destination, interface_to_add->interface_ip, 4);
-    memcpy(router_table[pos].netmask, interface_to_add->interface_netmask, 4);
-    memcpy(router_table[pos].gateway, interface_to_add->interface_ip, 4);
-    memcpy(router_table[pos].interface, interface_to_add->interface_ip, 4);
-    router_table[pos].metric = 1;
-
-    return 0;
-}
-
-int set_metric_for_all_entries_with_destination(RouterState *router_state, uint8_t *arg_destination, int new_metric) {
-    if (router_state->num_entries == 0) {
-        return -1;
-    }
-
-    for (uint32_t i = 0; i < router_state->num_entries; i++) {
-        if (match_ips(router_state->router_table[i].destination, arg_destination)) {
-            router_state->router_table[i].metric = new_metric;
-        }
-    }
-
-    return 0;
-}
-
 void print_router_table(RouterState *router_state) {
+    if (!enable_logging) {
+        return;
+    }
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
     char interface_str[16];
     snprintf(interface_str, sizeof(interface_str), "%u.%u.%u.%u",
         router_state->interfaces[0].interface_ip[0],
@@ -220,9 +58,16 @@ void print_router_table(RouterState *router_state) {
             router_state->router_table[i].metric
         );
     }
+    pthread_rwlock_unlock(&router_state->router_table_lock);
 }
 
+/* takes the read lock, life_left is refreshed under it by other readers
+ * */
 void print_life_table(RouterState *router_state) {
+    if (!enable_logging) {
+        return;
+    }
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
     char interface_str[16];
     snprintf(interface_str, sizeof(interface_str), "%u.%u.%u.%u",
             router_state->interfaces[0].interface_ip[0],
@@ -242,118 +87,189 @@ void print_life_table(RouterState *router_state) {
         );
         log_printf("%-20s %-20u\n",
                 gateway_str,
-                router_state->life_table[i].life_left
+                __atomic_load_n(&router_state->life_table[i].life_left, __ATOMIC_RELAXED)
         );
     }
+    pthread_rwlock_unlock(&router_state->router_table_lock);
 }
 
-int read_riptbl_and_add_to_state(int router_id, RouterState *router_state) {
-    char id_str[30];
-    snprintf(id_str, sizeof(id_str), "%d", router_id);
-    char filename[100] = "router_";
-    strncat(filename, id_str, sizeof(filename) - strlen(filename) - 1);
-    strncat(filename, ".riptbl", sizeof(filename) - strlen(filename) - 1);
-
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        perror("riptbl file reading error");
-        fclose(file);
-        return -1;
+void free_router_state(RouterState *router_state) {
+    if (router_state->wakeup_fd >= 0) {
+        close(router_state->wakeup_fd);
     }
+    free(router_state->router_table);
+    free(router_state->life_table);
+    free(router_state->interfaces);
+    free(router_state->listeners);
+    free_table_index(&router_state->route_index);
+    free_table_index(&router_state->life_index);
+    if (router_state->placement) {
+        free_placement(router_state->placement);
+    }
+    pthread_rwlock_destroy(&router_state->router_table_lock);
+    free(router_state);
+}
 
-    const uint32_t MAX_LINE = 100;
-    char line[MAX_LINE];
-    uint32_t file_line_count = 0;
-
+/* routes from the last checkpoint are put back so the router forwards right
+ * away after a restart. their gateways start with STALE_GATEWAY_LIFE, so
+ * whatever a neighbor doesn't confirm soon gets poisoned by gateway_life_clock
+ * */
+void restore_checkpoint_into_state(RouterState *router_state) {
+    RouterTableEntry *saved_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
+    LifeTableEntry *saved_life_table = malloc(router_state->max_entries * sizeof(LifeTableEntry));
+    uint32_t saved_entries = 0;
+    uint32_t saved_life_entries = 0;
+
+    int read_checkpoint_rc = read_checkpoint(router_state->router_id,
+            saved_table, &saved_entries,
+            saved_life_table, &saved_life_entries,
+            router_state->max_entries
+    );
+    if (read_checkpoint_rc < 0) {
+        free(saved_table);
+        free(saved_life_table);
+        return;
+    }
 
-    pthread_mutex_lock(&router_state->change_router_table_mutex);
-    while (fgets(line, sizeof(line), file)) {
-        if (file_line_count >= MAX_NUM_INTERFACES ||
-                (line[strlen(line) - 1] != '\n' && !feof(file))
-        ) {
-            errno = EIO;
-            perror("Invalid riptbl file");
-            fclose(file);
-            return -1;
+    uint32_t num_restored = 0;
+    for (uint32_t i = 0; i < saved_entries; i++) {
+        RouterTableEntry *saved_entry = &saved_table[i];
+        if (saved_entry->metric >= INFINITY_METRIC) {
+            continue;
         }
 
-        char line_ip[20];
-        char line_netmask[20];
-        sscanf(line, "%s %s", line_ip, line_netmask);
-        if (!is_valid_ip(line_ip) || !is_valid_ip(line_netmask)) {
-            errno = EIO;
-            perror("Invalid riptbl file");
-            fclose(file);
-            return -1;
+        // only routes through interfaces that are still configured
+        int is_interface_present = 0;
+        for (uint32_t j = 0; j < router_state->num_interfaces; j++) {
+            if (match_ips(saved_entry->interface, router_state->interfaces[j].interface_ip)) {
+                is_interface_present = 1;
+                break;
+            }
         }
 
-        inet_pton(
-            AF_INET,
-            line_ip,
-            router_state->interfaces[router_state->num_interfaces].interface_ip
-        );
-        inet_pton(
-            AF_INET,
-            line_netmask,
-            router_state->interfaces[router_state->num_interfaces].interface_netmask
-        );
-        router_state->num_interfaces += 1;
+        // connected routes from the riptbl win over saved ones
+        if (!is_interface_present ||
+                find_index_of_network_that_exacts(router_state, saved_entry->destination, saved_entry->netmask) >= 0) {
+            continue;
+        }
 
-        if (router_state->rip_type == RIP_STATIC) {
-            add_to_table_strings(
+        int index_of_parent_network = find_index_of_network_that_subsumes(
                 router_state,
-                line_ip,
-                line_netmask,
-                line_ip,
-                line_ip,
-                1
+                saved_entry->destination,
+                saved_entry->netmask
+        );
+        int add_rc;
+        if (index_of_parent_network != -1) {
+            add_rc = add_to_table_at_pos(router_state, index_of_parent_network,
+                    saved_entry->destination,
+                    saved_entry->netmask,
+                    saved_entry->gateway,
+                    saved_entry->interface,
+                    saved_entry->metric
+            );
+        } else {
+            add_rc = add_to_table(router_state,
+                    saved_entry->destination,
+                    saved_entry->netmask,
+                    saved_entry->gateway,
+                    saved_entry->interface,
+                    saved_entry->metric
             );
         }
 
-        file_line_count += 1;
+        if (add_rc == 0) {
+            num_restored += 1;
+        }
     }
-    pthread_mutex_unlock(&router_state->change_router_table_mutex);
 
-    fclose(file);
-    return 0;
+    for (uint32_t i = 0; i < saved_life_entries; i++) {
+        if (life_table_contains_gateway(router_state, saved_life_table[i].gateway) ||
+                add_new_gateway_to_life_table(router_state, saved_life_table[i].gateway) < 0) {
+            continue;
+        }
+
+        uint32_t stale_life = saved_life_table[i].life_left < STALE_GATEWAY_LIFE
+            ? saved_life_table[i].life_left
+            : STALE_GATEWAY_LIFE;
+        router_state->life_table[router_state->life_entries - 1].life_left = stale_life;
+    }
+
+    log_printf("Restored %u routes from checkpoint\n", num_restored);
+    free(saved_table);
+    free(saved_life_table);
 }
 
-RouterState* startup_router(uint32_t router_id, RipType rip_type) {
-    RouterState *router_state = malloc(sizeof(RouterState));
-    router_state->router_table = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry));
+RouterState* startup_router(uint32_t router_id, RipType rip_type, Clock *clock) {
+    RouterConfig config;
+    int read_config_rc = read_router_config(router_id, &config);
+    if (read_config_rc < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // the defaults are a floor, large riptbls get room for all their entries
+    // plus the usual ROUTER_TABLE_MAX_SIZE learned routes
+    RouterState *router_state = calloc(1, sizeof(RouterState));
+    router_state->max_interfaces = config.num_interfaces > MAX_NUM_INTERFACES
+        ? config.num_interfaces
+        : MAX_NUM_INTERFACES;
+    router_state->max_entries = ROUTER_TABLE_MAX_SIZE + config.num_interfaces + config.num_static_routes;
+    router_state->router_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
 
     // interfaces def
-    router_state->interfaces = malloc(MAX_NUM_INTERFACES * sizeof(InterfaceTableEntry));
+    router_state->interfaces = malloc(router_state->max_interfaces * sizeof(InterfaceTableEntry));
     router_state->num_interfaces = 0;
+    router_state->listeners = calloc(router_state->max_interfaces, sizeof(RipListenState));
 
     // life table def
-    router_state->life_table = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(LifeTableEntry));
+    router_state->life_table = malloc(router_state->max_entries * sizeof(LifeTableEntry));
     router_state->life_entries = 0;
 
     // router table and additional router state def
     router_state->num_entries = 0;
-    router_state->should_restart = 0;
-    router_state->should_terminate = 0;
+    atomic_init(&router_state->should_terminate, 0);
     router_state->router_id = router_id;
     router_state->rip_type = rip_type;
+    atomic_init(&router_state->packets_received, 0);
+    atomic_init(&router_state->packets_sent, 0);
+    atomic_init(&router_state->entries_received, 0);
+    atomic_init(&router_state->routes_changed, 0);
 
     enable_logging = 1;
-    uint32_t new_rand_delay = (rand() % 8) + RAND_DELAY_BONUS;
+    router_state->clock = clock;
+    uint32_t new_rand_delay = clock_random_below(clock, RAND_DELAY_SPREAD) + RAND_DELAY_BONUS;
     router_state->rand_delay = new_rand_delay;
     log_printf("router_rand_delay: %u\n", new_rand_delay);
 
-    pthread_mutex_init(&router_state->change_router_table_mutex, NULL);
+    init_router_table_lock(router_state);
+
+    router_state->placement = read_placement(router_id);
+    if (!router_state->placement) {
+        free_router_config(&config);
+        free_router_state(router_state);
+        exit(EXIT_FAILURE);
+    }
+
+    router_state->wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    if (router_state->wakeup_fd < 0) {
+        perror("eventfd creation failed");
+        free_router_config(&config);
+        free_router_state(router_state);
+        exit(EXIT_FAILURE);
+    }
 
-    int read_riptbl_rc = read_riptbl_and_add_to_state(router_id, router_state);
-    if (read_riptbl_rc < 0) {
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
+    pthread_rwlock_wrlock(&router_state->router_table_lock);
+    int add_config_rc = add_config_to_state(router_state, &config);
+    unlock_router_table_after_write(router_state);
+    free_router_config(&config);
+    if (add_config_rc < 0) {
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
+    pthread_rwlock_wrlock(&router_state->router_table_lock);
+    restore_checkpoint_into_state(router_state);
+    unlock_router_table_after_write(router_state);
+
     log_printf("INITIAL_STATE:\n");
     print_router_table(router_state);
     log_printf("\n");
@@ -361,15 +277,46 @@ RouterState* startup_router(uint32_t router_id, RipType rip_type) {
     return router_state;
 }
 
-// packet structure:
-// 1. 4 bytes -> ip of the interface that is broadcasting
-// 2. 4 bytes -> router_id - additional identifier needed for topology grapher
-// 3. 4 bytes -> num_entries (uint32_t)
-// 4. [router_state->num_entires] times RouterTableEntry for every row
-//      in the router table
-// 5. RouterTableEntry for the interface of the router as a destination
-//      in the router table
-//
+int router_should_stop(RouterState *router_state) {
+    return atomic_load(&router_state->should_terminate);
+}
+
+// check build_router_packet in router.c for the structure of a packet
+typedef struct {
+    RouterState *router_state;
+    int sock;
+    struct sockaddr_in *broadcast_addr;
+} BroadcastSocket;
+
+// run_broadcast_cycle's sender: the broadcast address based on the interface
+int send_broadcast_packet(void *arg_socket, InterfaceTableEntry *interface, uint8_t *packet, uint32_t packet_size) {
+    BroadcastSocket *broadcast_socket = (BroadcastSocket*) arg_socket;
+    RouterState *router_state = broadcast_socket->router_state;
+
+    uint8_t broadcast_ip[4];
+    get_broadcast_ip(
+        interface->interface_ip,
+        interface->interface_netmask,
+        broadcast_ip
+    );
+    memcpy(&broadcast_socket->broadcast_addr->sin_addr.s_addr, broadcast_ip, 4);
+
+    ssize_t sendto_res = sendto(broadcast_socket->sock, packet, packet_size, 0,
+        (struct sockaddr *) broadcast_socket->broadcast_addr, sizeof(struct sockaddr_in));
+
+    if (sendto_res < 0) {
+        perror("sendto failed");
+        return -1;
+    }
+    atomic_fetch_add(&router_state->packets_sent, 1);
+    if (router_state->capture) {
+        capture_packet(router_state->capture,
+                interface->interface_ip, broadcast_ip,
+                packet, packet_size);
+    }
+    return 0;
+}
+
 void* rip_broadcaster(void *arg_router_state) {
     RouterState *router_state = (RouterState*) arg_router_state;
 
@@ -379,11 +326,7 @@ void* rip_broadcaster(void *arg_router_state) {
     sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
         perror("socket creation failed");
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
@@ -396,11 +339,7 @@ void* rip_broadcaster(void *arg_router_state) {
     if (setsock_res < 0) {
         perror("setsockopt failed");
         close(sock);
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
@@ -408,108 +347,29 @@ void* rip_broadcaster(void *arg_router_state) {
     broadcast_addr.sin_family = AF_INET;
     broadcast_addr.sin_port = htons(BROADCAST_PORT);
 
-    while (!router_state->should_restart && !router_state->should_terminate) {
-        pthread_mutex_lock(&router_state->change_router_table_mutex);
-
-        const uint32_t max_num_entries = router_state->num_entries + 1;
-        const uint32_t real_num_entries = (router_state->rip_type == RIP_STATIC)
-            ? router_state->num_entries - 1
-            : max_num_entries;
-
-        // check docs for structure of packet being sent
-        const uint32_t SIZEOF_PACKET_TO_SEND =
-            (max_num_entries * sizeof(RouterTableEntry)) + 12;
-        uint8_t *packet_to_send = malloc(SIZEOF_PACKET_TO_SEND);
-        const uint32_t offset_for_router_table_in_packet = 12;
-
-        memcpy(packet_to_send + 4, &router_state->router_id, 4);
-        memcpy(packet_to_send + 8, &real_num_entries, 4);
-        memcpy(packet_to_send + offset_for_router_table_in_packet,
-               router_state->router_table,
-               router_state->num_entries * sizeof(RouterTableEntry)
-        );
-
-        pthread_mutex_unlock(&router_state->change_router_table_mutex);
-
-        RouterTableEntry myself_to_add;
-        inet_pton(AF_INET, "127.0.0.1", &myself_to_add.interface);
-        myself_to_add.metric = 0;
-
-        // broadcast address based on every interface
-        for (uint32_t i = 0; i < router_state->num_interfaces; i++) {
-            int rip_static_index_of_current_interface = -1;
-
-            if (router_state->rip_type == RIP_DYNAMIC) {
-                memcpy(myself_to_add.destination, router_state->interfaces[i].interface_ip, 4);
-                memcpy(myself_to_add.netmask, router_state->interfaces[i].interface_netmask, 4);
-                memcpy(myself_to_add.gateway, router_state->interfaces[i].interface_ip, 4);
-                memcpy(
-                    &packet_to_send[SIZEOF_PACKET_TO_SEND - sizeof(RouterTableEntry)],
-                    &myself_to_add,
-                    sizeof(RouterTableEntry)
-                );
-            } else {
-                rip_static_index_of_current_interface = remove_current_interface_from_router_table_and_get_index(
-                    &router_state->interfaces[i],
-                    (RouterTableEntry*) (packet_to_send + offset_for_router_table_in_packet),
-                    real_num_entries + 1
-                );
-
-                if (rip_static_index_of_current_interface < 0) {
-                    perror("failed deletion of current interface on rip_static broadcast");
-                    free(packet_to_send);
-                    close(sock);
-                    free(router_state->router_table);
-                    free(router_state->life_table);
-                    free(router_state->interfaces);
-                    pthread_mutex_destroy(&router_state->change_router_table_mutex);
-                    free(router_state);
-                    exit(EXIT_FAILURE);
-                }
-            }
-
-            uint8_t broadcast_ip[4];
-            get_broadcast_ip(
-                router_state->interfaces[i].interface_ip,
-                router_state->interfaces[i].interface_netmask,
-                broadcast_ip
-            );
-            memcpy(&broadcast_addr.sin_addr.s_addr, broadcast_ip, 4);
-            memcpy(packet_to_send, router_state->interfaces[i].interface_ip, 4);
-
-            ssize_t sendto_res = sendto(sock, packet_to_send, SIZEOF_PACKET_TO_SEND, 0,
-                (struct sockaddr *)&broadcast_addr, sizeof(broadcast_addr));
-
-            if (sendto_res < 0) {
-                perror("sendto failed");
-                free(packet_to_send);
-                close(sock);
-                free(router_state->router_table);
-                free(router_state->life_table);
-                free(router_state->interfaces);
-                pthread_mutex_destroy(&router_state->change_router_table_mutex);
-                free(router_state);
-                exit(EXIT_FAILURE);
-            }
-
-            if (rip_static_index_of_current_interface != -1) {
-                add_current_interface_to_router_table_at_pos(
-                    &router_state->interfaces[i],
-                    rip_static_index_of_current_interface,
-                    (RouterTableEntry*) (packet_to_send + offset_for_router_table_in_packet),
-                    real_num_entries
-                );
-            }
-
+    // the snapshots and the packet of one cycle, sized for a full packet
+    // and the padding of the three allocations
+    Arena cycle_arena;
+    init_arena(&cycle_arena, ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry) +
+            router_state->max_interfaces * sizeof(InterfaceTableEntry) +
+            get_max_router_packet_size(ROUTER_TABLE_MAX_SIZE) + 3 * ARENA_ALIGNMENT);
+
+    BroadcastSocket broadcast_socket = { router_state, sock, &broadcast_addr };
+    while (!router_should_stop(router_state)) {
+        if (run_broadcast_cycle(router_state, &cycle_arena, send_broadcast_packet, &broadcast_socket) < 0) {
+            free_arena(&cycle_arena);
+            close(sock);
+            free_router_state(router_state);
+            exit(EXIT_FAILURE);
         }
-        free(packet_to_send);
 
         log_printf("Broadcast messages sent\n");
         print_router_table(router_state);
         log_printf("\n");
-        sleep(router_state->rand_delay);
+        clock_sleep(router_state->clock, router_state->wakeup_fd, router_state->rand_delay);
     }
 
+    free_arena(&cycle_arena);
     close(sock);
     log_printf("rip_broadcaster ended\n");
     return NULL;
@@ -519,7 +379,7 @@ void* rip_broadcaster(void *arg_router_state) {
 void* rip_listen(void *arg_rip_listen_state) {
     RipListenState *rip_listen_state = (RipListenState *) arg_rip_listen_state;
     RouterState *router_state = rip_listen_state->router_state;
-    uint32_t curr_interface = rip_listen_state->curr_interface;
+    InterfaceTableEntry *curr_interface = &rip_listen_state->interface;
 
 
     int sock;
@@ -530,12 +390,7 @@ void* rip_listen(void *arg_rip_listen_state) {
     sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
         perror("socket creation failed");
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
-        free(rip_listen_state);
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
@@ -547,19 +402,14 @@ void* rip_listen(void *arg_rip_listen_state) {
     if (setsock_res < 0) {
         perror("setsockopt with SO_REUSEADDR failed");
         close(sock);
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
-        free(rip_listen_state);
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
     uint8_t broadcast_ip[4];
     get_broadcast_ip(
-        router_state->interfaces[curr_interface].interface_ip,
-        router_state->interfaces[curr_interface].interface_netmask,
+        curr_interface->interface_ip,
+        curr_interface->interface_netmask,
         broadcast_ip
     );
 
@@ -579,23 +429,36 @@ void* rip_listen(void *arg_rip_listen_state) {
     if (bind_res < 0) {
         perror("bind failed");
         close(sock);
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
-        free(rip_listen_state);
+        free_router_state(router_state);
         exit(EXIT_FAILURE);
     }
 
-    while (!router_state->should_restart && !router_state->should_terminate) {
+    while (!router_should_stop(router_state)) {
         log_printf("Router %u.%u.%u.%u listening for broadcasts on port %d...\n",
-                router_state->interfaces[curr_interface].interface_ip[0],
-                router_state->interfaces[curr_interface].interface_ip[1],
-                router_state->interfaces[curr_interface].interface_ip[2],
-                router_state->interfaces[curr_interface].interface_ip[3],
+                curr_interface->interface_ip[0],
+                curr_interface->interface_ip[1],
+                curr_interface->interface_ip[2],
+                curr_interface->interface_ip[3],
                 BROADCAST_PORT);
 
+        struct pollfd poll_fds[3] = {
+            { .fd = sock, .events = POLLIN },
+            { .fd = router_state->wakeup_fd, .events = POLLIN },
+            { .fd = rip_listen_state->stop_fd, .events = POLLIN }
+        };
+        if (poll(poll_fds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            break;
+        }
+
+        // woken up by exit, or by a reload that removed this interface
+        if ((poll_fds[1].revents & POLLIN) || (poll_fds[2].revents & POLLIN)) {
+            break;
+        }
+
         int bytes_received = recvfrom(sock,
                 rec_buffer, BUFFER_SIZE - 1,
                 0,
@@ -605,429 +468,929 @@ void* rip_listen(void *arg_rip_listen_state) {
         if (bytes_received < 0) {
             perror("recvform failed");
             close(sock);
-            free(router_state->router_table);
-            free(router_state->life_table);
-            free(router_state->interfaces);
-            pthread_mutex_destroy(&router_state->change_router_table_mutex);
-            free(router_state);
-            free(rip_listen_state);
+            free_router_state(router_state);
             exit(EXIT_FAILURE);
         }
 
-        // tombstone packet from other packet received
-        if (bytes_received == 1 && rec_buffer[0] == 1) {
-            continue;
+        if (router_state->capture) {
+            capture_packet(router_state->capture,
+                    (uint8_t*) &sender_addr.sin_addr.s_addr, broadcast_ip,
+                    rec_buffer, bytes_received);
         }
 
-        // tombstone packet form myself was received
-        if (router_state->should_restart || router_state->should_terminate) {
-            close(sock);
-            log_printf("rip_listen ended\n");
-            return NULL;
+        uint8_t sender_ip[4];
+        uint32_t sender_router_id;
+        uint32_t num_received;
+        if (parse_router_packet(rec_buffer, bytes_received,
+                    sender_ip, &sender_router_id, &num_received) < 0) {
+            // tombstone packet from a router running an older build, or garbage
+            continue;
         }
 
-        RouterState *rec_router_state = malloc(sizeof(RouterState));
-        rec_router_state->router_table = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry));
-        rec_router_state->interfaces = malloc(1 * sizeof(InterfaceTableEntry));
-        memcpy(rec_router_state->interfaces[0].interface_ip, rec_buffer, 4);
-
-        if (match_ips(
-                    rec_router_state->interfaces[0].interface_ip,
-                    router_state->interfaces[curr_interface].interface_ip
-        )) {
+        if (match_ips(sender_ip, curr_interface->interface_ip)) {
             // ignore router table if it came from me
-            free(rec_router_state->router_table);
-            free(rec_router_state->interfaces);
-            free(rec_router_state);
             continue;
         }
-        memcpy(&rec_router_state->router_id, rec_buffer + 4, 4);
-        memcpy(&rec_router_state->num_entries, rec_buffer + 8, 4);
-        memcpy(rec_router_state->router_table,
-                rec_buffer + 12,
-                rec_router_state->num_entries * sizeof(RouterTableEntry));
+
+        if (num_received > ROUTER_TABLE_MAX_SIZE) {
+            num_received = ROUTER_TABLE_MAX_SIZE;
+        }
+
+        atomic_fetch_add(&router_state->packets_received, 1);
+        atomic_fetch_add(&router_state->entries_received, num_received);
 
         log_printf("Router %u.%u.%u.%u received on listen\n",
-            router_state->interfaces[curr_interface].interface_ip[0],
-            router_state->interfaces[curr_interface].interface_ip[1],
-            router_state->interfaces[curr_interface].interface_ip[2],
-            router_state->interfaces[curr_interface].interface_ip[3]
+            curr_interface->interface_ip[0],
+            curr_interface->interface_ip[1],
+            curr_interface->interface_ip[2],
+            curr_interface->interface_ip[3]
         );
 
-        pthread_mutex_lock(&router_state->change_router_table_mutex);
-        for (uint32_t i = 0; i < rec_router_state->num_entries; i++) {
-            if (match_ips(
-                        rec_router_state->router_table[i].gateway,
-                        router_state->interfaces[curr_interface].interface_ip
-            )) {
-                // split horizon
-                continue;
-            }
+        // applied by the pool, the listener goes straight back to its socket
+        submit_router_update(router_state->pool, curr_interface, sender_ip,
+                rec_buffer + ROUTER_PACKET_HEADER_SIZE, num_received);
+    }
 
-            int index_of_exact_dest = find_index_of_network_that_exacts(
-                        router_state,
-                        rec_router_state->router_table[i].destination,
-                        rec_router_state->router_table[i].netmask
-            );
+    close(sock);
+    log_printf("rip_listen ended\n");
+    return NULL;
+}
 
-            int should_do_life_table_update = 1;
-
-            if (index_of_exact_dest != -1) {
-                // a network in my router table is exactly the currenty received network
-                uint32_t old_metric = router_state->
-                    router_table[index_of_exact_dest].metric;
-                uint32_t rec_metric = rec_router_state->
-                    router_table[i].metric;
-                if (match_ips(
-                        router_state->router_table[index_of_exact_dest].gateway,
-                        rec_router_state->interfaces[0].interface_ip) &&
-                    rec_router_state->router_table[i].metric != 0
-                ) {
-                    // TODO check this
-                    // the gateway for this entry is the router i currently receive from,
-                    // so i trust the received metric and update even if it is worse
-                    router_state->router_table[index_of_exact_dest].metric =
-                        cap_metric(rec_metric + 1);
-                    memcpy(
-                        router_state->router_table[index_of_exact_dest].interface,
-                        router_state->interfaces[curr_interface].interface_ip,
-                        4
-                    );
-
-                } else if (rec_metric + 1 < old_metric) {
-                    // the gateway for this entry is being changed, so i have to check if
-                    // the new metric is better than the old one before updating
-                    memcpy(router_state->router_table[index_of_exact_dest].gateway,
-                            rec_router_state->interfaces[0].interface_ip,
-                            4
-                    );
-                    router_state->router_table[index_of_exact_dest].metric =
-                        cap_metric(rec_metric + 1);
-                    memcpy(
-                        router_state->router_table[index_of_exact_dest].interface,
-                        router_state->interfaces[curr_interface].interface_ip,
-                        4
-                    );
-                } else {
-                    should_do_life_table_update = 0;
-                }
-            } else {
-                int index_of_parent_network = find_index_of_network_that_subsumes(
-                        router_state,
-                        rec_router_state->router_table[i].destination,
-                        rec_router_state->router_table[i].netmask
-                );
-
-                if (index_of_parent_network != -1) {
-                    // a network in my router table subsumes the currently received network.
-                    // add the new network before the parent network in the router table
-                    add_to_table_at_pos(
-                            router_state, index_of_parent_network,
-                            rec_router_state->router_table[i].destination,
-                            rec_router_state->router_table[i].netmask,
-                            rec_router_state->interfaces[0].interface_ip,
-                            router_state->interfaces[curr_interface].interface_ip,
-                            cap_metric(rec_router_state->router_table[i].metric + 1)
-                    );
-                } else {
-                    // this is the first time i encounter this network
-                    // just add it to the table
-                    add_to_table(
-                            router_state,
-                            rec_router_state->router_table[i].destination,
-                            rec_router_state->router_table[i].netmask,
-                            rec_router_state->interfaces[0].interface_ip,
-                            router_state->interfaces[curr_interface].interface_ip,
-                            cap_metric(rec_router_state->router_table[i].metric + 1)
-                    );
+int start_rip_listener(RouterState *router_state, RipListenState *listener, InterfaceTableEntry *interface) {
+    listener->router_state = router_state;
+    memcpy(&listener->interface, interface, sizeof(InterfaceTableEntry));
+
+    listener->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (listener->stop_fd < 0) {
+        perror("eventfd creation failed");
+        return -1;
+    }
+
+    char thread_name[40];
+    snprintf(thread_name, sizeof(thread_name), "rip_listen %u.%u.%u.%u",
+            interface->interface_ip[0],
+            interface->interface_ip[1],
+            interface->interface_ip[2],
+            interface->interface_ip[3]
+    );
+    int rc_rip_listen = create_placed_thread(&listener->thread, router_state->placement,
+            get_listen_cpu(router_state->placement, interface), thread_name,
+            rip_listen, (void*) listener);
+    if (rc_rip_listen) {
+        perror("Error initializing threads.");
+        close(listener->stop_fd);
+        return -1;
+    }
+
+    listener->is_running = 1;
+    return 0;
+}
+
+void stop_rip_listener(RipListenState *listener) {
+    signal_wakeup(listener->stop_fd);
+    pthread_join(listener->thread, NULL);
+    close(listener->stop_fd);
+    listener->is_running = 0;
+}
+
+int find_index_of_interface(InterfaceTableEntry *interfaces, uint32_t num_interfaces, InterfaceTableEntry *interface_to_find) {
+    for (uint32_t i = 0; i < num_interfaces; i++) {
+        if (match_ips(interfaces[i].interface_ip, interface_to_find->interface_ip) &&
+                match_ips(interfaces[i].interface_netmask, interface_to_find->interface_netmask)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* the connected entry of a removed interface is dropped and every route
+ * that was learned through it is poisoned, same as a dead gateway
+ * */
+void remove_interface_routes(RouterState *router_state, InterfaceTableEntry *removed_interface) {
+    if (router_state->rip_type == RIP_STATIC) {
+        int connected_index = find_index_of_network_that_exacts(
+                router_state,
+                removed_interface->interface_ip,
+                removed_interface->interface_netmask
+        );
+        if (connected_index >= 0 &&
+                match_ips(router_state->router_table[connected_index].interface, removed_interface->interface_ip)) {
+            remove_from_table_at_pos(router_state, connected_index);
+        }
+    }
+
+    for (uint32_t i = 0; i < router_state->num_entries; i++) {
+        if (match_ips(router_state->router_table[i].interface, removed_interface->interface_ip)) {
+            router_state->router_table[i].metric = INFINITY_METRIC;
+        }
+    }
+}
+
+void add_interface_routes(RouterState *router_state, InterfaceTableEntry *added_interface) {
+    if (router_state->rip_type != RIP_STATIC) {
+        return;
+    }
+
+    int exact_index = find_index_of_network_that_exacts(
+            router_state,
+            added_interface->interface_ip,
+            added_interface->interface_netmask
+    );
+    if (exact_index >= 0) {
+        // the network was learned from a neighbor, now it is directly connected
+        memcpy(router_state->router_table[exact_index].gateway, added_interface->interface_ip, 4);
+        memcpy(router_state->router_table[exact_index].interface, added_interface->interface_ip, 4);
+        router_state->router_table[exact_index].metric = 1;
+        return;
+    }
+
+    int parent_index = find_index_of_network_that_subsumes(
+            router_state,
+            added_interface->interface_ip,
+            added_interface->interface_netmask
+    );
+    if (parent_index >= 0) {
+        add_to_table_at_pos(router_state, parent_index,
+                added_interface->interface_ip,
+                added_interface->interface_netmask,
+                added_interface->interface_ip,
+                added_interface->interface_ip,
+                1
+        );
+    } else {
+        add_to_table(router_state,
+                added_interface->interface_ip,
+                added_interface->interface_netmask,
+                added_interface->interface_ip,
+                added_interface->interface_ip,
+                1
+        );
+    }
+}
+
+/* warm reload: re-reads the riptbl and applies only the difference.
+ * listeners are stopped/started just for interfaces that were removed/added
+ * (a changed netmask counts as both), learned routes and the life table are kept
+ *
+ * only called from control_listen, which is the only thread touching
+ * router_state->listeners while the router runs
+ * */
+int reload_router(RouterState *router_state) {
+    RouterConfig config;
+    int read_config_rc = read_router_config(router_state->router_id, &config);
+    if (read_config_rc < 0) {
+        return -1;
+    }
+
+    // listener slots and the interfaces array were sized on startup
+    if (config.num_interfaces > router_state->max_interfaces) {
+        errno = ENOSPC;
+        perror("Too many interfaces for reload");
+        free_router_config(&config);
+        return -1;
+    }
+    InterfaceTableEntry *new_interfaces = config.interfaces;
+    const uint32_t new_num_interfaces = config.num_interfaces;
+
+    for (uint32_t i = 0; i < router_state->max_interfaces; i++) {
+        RipListenState *listener = &router_state->listeners[i];
+        if (listener->is_running &&
+                find_index_of_interface(new_interfaces, new_num_interfaces, &listener->interface) < 0) {
+            stop_rip_listener(listener);
+        }
+    }
+
+    pthread_rwlock_wrlock(&router_state->router_table_lock);
+    for (uint32_t i = 0; i < router_state->num_interfaces; i++) {
+        if (find_index_of_interface(new_interfaces, new_num_interfaces, &router_state->interfaces[i]) < 0) {
+            remove_interface_routes(router_state, &router_state->interfaces[i]);
+        }
+    }
+    for (uint32_t i = 0; i < new_num_interfaces; i++) {
+        if (find_index_of_interface(router_state->interfaces, router_state->num_interfaces, &new_interfaces[i]) < 0) {
+            add_interface_routes(router_state, &new_interfaces[i]);
+        }
+    }
+    memcpy(router_state->interfaces, new_interfaces, new_num_interfaces * sizeof(InterfaceTableEntry));
+    router_state->num_interfaces = new_num_interfaces;
+    unlock_router_table_after_write(router_state);
+
+    int is_listener_error = 0;
+    for (uint32_t i = 0; i < new_num_interfaces; i++) {
+        int is_listened = 0;
+        uint32_t free_slot = router_state->max_interfaces;
+        for (uint32_t j = 0; j < router_state->max_interfaces; j++) {
+            RipListenState *listener = &router_state->listeners[j];
+            if (!listener->is_running) {
+                if (free_slot == router_state->max_interfaces) {
+                    free_slot = j;
                 }
+            } else if (match_ips(listener->interface.interface_ip, new_interfaces[i].interface_ip) &&
+                    match_ips(listener->interface.interface_netmask, new_interfaces[i].interface_netmask)) {
+                is_listened = 1;
+                break;
             }
+        }
 
-            if (should_do_life_table_update) {
-                if (!life_table_contains_gateway(router_state, rec_router_state->router_table[i].destination)) {
-                    add_new_gateway_to_life_table(router_state, rec_router_state->router_table[i].destination);
-                } else {
-                    reset_gateway_in_life_table(router_state, rec_router_state->router_table[i].destination);
-                }
+        if (!is_listened) {
+            log_printf("Starting listener for new interface %u.%u.%u.%u\n",
+                    new_interfaces[i].interface_ip[0],
+                    new_interfaces[i].interface_ip[1],
+                    new_interfaces[i].interface_ip[2],
+                    new_interfaces[i].interface_ip[3]
+            );
+            if (start_rip_listener(router_state, &router_state->listeners[free_slot], &new_interfaces[i]) < 0) {
+                is_listener_error = 1;
             }
         }
-        pthread_mutex_unlock(&router_state->change_router_table_mutex);
+    }
 
-        free(rec_router_state->router_table);
-        free(rec_router_state->interfaces);
-        free(rec_router_state);
+    free_router_config(&config);
+    if (is_listener_error) {
+        return -1;
     }
+    return 0;
+}
 
-    close(sock);
-    log_printf("rip_listen ended\n");
-    return NULL;
+void get_control_socket_path(uint32_t router_id, char *path, size_t path_size) {
+    snprintf(path, path_size, "router_%u.sock", router_id);
 }
 
-void send_tombstone_packets(RouterState *router_state) {
-    int sock;
-    struct sockaddr_in tombstone_addr;
+int control_send_all(int fd, const char *data, uint32_t data_len) {
+    uint32_t sent = 0;
+    while (sent < data_len) {
+        ssize_t send_res = send(fd, data + sent, data_len - sent, MSG_NOSIGNAL);
+        if (send_res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += send_res;
+    }
 
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        perror("socket creation failed");
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
-        exit(EXIT_FAILURE);
+    return 0;
+}
+
+int control_printf(int fd, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int line_len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (line_len < 0) {
+        return -1;
+    }
+    if (line_len >= sizeof(line)) {
+        line_len = sizeof(line) - 1;
     }
 
-    int broadcast_enable = 1;
-    int setsockopt_res = setsockopt(
-        sock,
-        SOL_SOCKET, SO_BROADCAST,
-        &broadcast_enable, sizeof(broadcast_enable)
-    );
-    if (setsockopt_res < 0) {
-        perror("setsockopt failed");
-        close(sock);
-        free(router_state->router_table);
-        free(router_state->life_table);
-        free(router_state->interfaces);
-        pthread_mutex_destroy(&router_state->change_router_table_mutex);
-        free(router_state);
-        exit(EXIT_FAILURE);
+    return control_send_all(fd, line, line_len);
+}
+
+/* streams the router table in chunks of CONTROL_DUMP_CHUNK entries.
+ * the lock is only held while a chunk is copied out, so a slow client
+ * never stalls the listeners. the dump is consistent per chunk, not
+ * across the whole table
+ * */
+int control_dump_router_table(int fd, RouterState *router_state) {
+    RouterTableEntry chunk[CONTROL_DUMP_CHUNK];
+    char out[CONTROL_DUMP_CHUNK * 96];
+    uint32_t offset = 0;
+
+    while (1) {
+        uint32_t num_to_copy = 0;
+        pthread_rwlock_rdlock(&router_state->router_table_lock);
+        if (offset < router_state->num_entries) {
+            num_to_copy = router_state->num_entries - offset;
+            if (num_to_copy > CONTROL_DUMP_CHUNK) {
+                num_to_copy = CONTROL_DUMP_CHUNK;
+            }
+            memcpy(chunk, &router_state->router_table[offset], num_to_copy * sizeof(RouterTableEntry));
+        }
+        pthread_rwlock_unlock(&router_state->router_table_lock);
+
+        if (num_to_copy == 0) {
+            break;
+        }
+
+        uint32_t out_len = 0;
+        for (uint32_t i = 0; i < num_to_copy; i++) {
+            char dest_str[INET_ADDRSTRLEN];
+            char netmask_str[INET_ADDRSTRLEN];
+            char gateway_str[INET_ADDRSTRLEN];
+            char if_to_hop_str[INET_ADDRSTRLEN];
+
+            inet_ntop(AF_INET, chunk[i].destination, dest_str, sizeof(dest_str));
+            inet_ntop(AF_INET, chunk[i].netmask, netmask_str, sizeof(netmask_str));
+            inet_ntop(AF_INET, chunk[i].gateway, gateway_str, sizeof(gateway_str));
+            inet_ntop(AF_INET, chunk[i].interface, if_to_hop_str, sizeof(if_to_hop_str));
+
+            out_len += snprintf(out + out_len, sizeof(out) - out_len, "%s %s %s %s %u\n",
+                dest_str,
+                netmask_str,
+                gateway_str,
+                if_to_hop_str,
+                chunk[i].metric
+            );
+        }
+
+        if (control_send_all(fd, out, out_len) < 0) {
+            return -1;
+        }
+        offset += num_to_copy;
     }
 
-    tombstone_addr.sin_family = AF_INET;
-    tombstone_addr.sin_port = htons(BROADCAST_PORT);
-    for (uint32_t i = 0; i < router_state->num_entries; i++) {
-        uint8_t broadcast_ip[4];
-        get_broadcast_ip(
-            router_state->interfaces[i].interface_ip,
-            router_state->interfaces[i].interface_netmask,
-            broadcast_ip
-        );
-        memcpy(&tombstone_addr.sin_addr.s_addr, broadcast_ip, 4);
-
-        const uint32_t SIZEOF_PACKET_TO_SEND = 1;
-        const uint8_t data_to_send = 1;
-        ssize_t sendto_res =
-            sendto(sock, &data_to_send, SIZEOF_PACKET_TO_SEND, 0,
-                   (struct sockaddr *)&tombstone_addr, sizeof(tombstone_addr));
-        if (sendto_res < 0) {
-            perror("sendto failed");
-            free(router_state->router_table);
-            free(router_state->life_table);
-            free(router_state->interfaces);
-            pthread_mutex_destroy(&router_state->change_router_table_mutex);
-            free(router_state);
-            close(sock);
-            exit(EXIT_FAILURE);
+    return control_printf(fd, "OK %u\n", offset);
+}
+
+int control_dump_life_table(int fd, RouterState *router_state) {
+    LifeTableEntry chunk[CONTROL_DUMP_CHUNK];
+    char out[CONTROL_DUMP_CHUNK * 32];
+    uint32_t offset = 0;
+
+    while (1) {
+        uint32_t num_to_copy = 0;
+        pthread_rwlock_rdlock(&router_state->router_table_lock);
+        if (offset < router_state->life_entries) {
+            num_to_copy = router_state->life_entries - offset;
+            if (num_to_copy > CONTROL_DUMP_CHUNK) {
+                num_to_copy = CONTROL_DUMP_CHUNK;
+            }
+            copy_life_table(chunk, &router_state->life_table[offset], num_to_copy);
+        }
+        pthread_rwlock_unlock(&router_state->router_table_lock);
+
+        if (num_to_copy == 0) {
+            break;
         }
+
+        uint32_t out_len = 0;
+        for (uint32_t i = 0; i < num_to_copy; i++) {
+            char gateway_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, chunk[i].gateway, gateway_str, sizeof(gateway_str));
+            out_len += snprintf(out + out_len, sizeof(out) - out_len, "%s %u\n",
+                gateway_str,
+                chunk[i].life_left
+            );
+        }
+
+        if (control_send_all(fd, out, out_len) < 0) {
+            return -1;
+        }
+        offset += num_to_copy;
     }
 
-    close(sock);
-    log_printf("Tombstone packets sent\n");
+    return control_printf(fd, "OK %u\n", offset);
+}
+
+int control_lookup_route(int fd, RouterState *router_state, const char *ip_str) {
+    uint8_t ip_to_find[4];
+    uint8_t host_mask[4] = { 255, 255, 255, 255 };
+    if (inet_pton(AF_INET, ip_str, ip_to_find) != 1) {
+        return control_printf(fd, "ERR invalid address\n");
+    }
+
+    RouterTableEntry found_entry;
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
+    int found_index = find_index_of_network_that_subsumes(router_state, ip_to_find, host_mask);
+    if (found_index >= 0) {
+        memcpy(&found_entry, &router_state->router_table[found_index], sizeof(RouterTableEntry));
+    }
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+
+    if (found_index < 0) {
+        return control_printf(fd, "ERR no route\n");
+    }
+
+    char dest_str[INET_ADDRSTRLEN];
+    char netmask_str[INET_ADDRSTRLEN];
+    char gateway_str[INET_ADDRSTRLEN];
+    char if_to_hop_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, found_entry.destination, dest_str, sizeof(dest_str));
+    inet_ntop(AF_INET, found_entry.netmask, netmask_str, sizeof(netmask_str));
+    inet_ntop(AF_INET, found_entry.gateway, gateway_str, sizeof(gateway_str));
+    inet_ntop(AF_INET, found_entry.interface, if_to_hop_str, sizeof(if_to_hop_str));
+
+    return control_printf(fd, "%s %s %s %s %u\nOK 1\n",
+        dest_str,
+        netmask_str,
+        gateway_str,
+        if_to_hop_str,
+        found_entry.metric
+    );
 }
 
-HandleCmdReturnCode handle_cmd(char *cmd, RouterState *router_state) {
+int control_print_stats(int fd, RouterState *router_state) {
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
+    uint32_t num_interfaces = router_state->num_interfaces;
+    uint32_t num_entries = router_state->num_entries;
+    uint32_t life_entries = router_state->life_entries;
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+
+    return control_printf(fd,
+        "router_id %u\n"
+        "rip_type %s\n"
+        "num_interfaces %u\n"
+        "num_entries %u\n"
+        "life_entries %u\n"
+        "packets_received %lu\n"
+        "packets_sent %lu\n"
+        "entries_received %lu\n"
+        "routes_changed %lu\n"
+        "updates_dropped %lu\n"
+        "updates_applied %lu\n"
+        "entries_applied %lu\n"
+        "OK 12\n",
+        router_state->router_id,
+        (router_state->rip_type == RIP_STATIC) ? "static" : "dynamic",
+        num_interfaces,
+        num_entries,
+        life_entries,
+        atomic_load(&router_state->packets_received),
+        atomic_load(&router_state->packets_sent),
+        atomic_load(&router_state->entries_received),
+        atomic_load(&router_state->routes_changed),
+        atomic_load(&router_state->pool->updates_dropped),
+        atomic_load(&router_state->pool->updates_applied),
+        atomic_load(&router_state->pool->entries_applied)
+    );
+}
+
+/* control protocol: one command per line, every response ends with
+ * a single "OK <num_lines>" or "ERR <reason>" line
+ *
+ * dump | life | stats | lookup <ip> | log on | log off | reload | exit
+ * */
+HandleCmdReturnCode handle_cmd(char *cmd, RouterState *router_state, int client_fd) {
+    int send_rc = 0;
+    HandleCmdReturnCode cmd_return_code = CMD_DONE;
+
     if (strcmp(cmd, "log on") == 0) {
-        printf("Logging on.\n");
         enable_logging = 1;
-        return CMD_DONT_RESTORE_SHOULD_LOG;
+        log_printf("Logging on.\n");
+        send_rc = control_printf(client_fd, "OK 0\n");
     }
     else if (strcmp(cmd, "log off") == 0) {
-        printf("Logging off.\n");
         enable_logging = 0;
-        return CMD_DONT_RESTORE_SHOULD_LOG;
+        send_rc = control_printf(client_fd, "OK 0\n");
+    }
+    else if (strcmp(cmd, "dump") == 0) {
+        send_rc = control_dump_router_table(client_fd, router_state);
+    }
+    else if (strcmp(cmd, "life") == 0) {
+        send_rc = control_dump_life_table(client_fd, router_state);
+    }
+    else if (strcmp(cmd, "stats") == 0) {
+        send_rc = control_print_stats(client_fd, router_state);
+    }
+    else if (strncmp(cmd, "lookup ", 7) == 0) {
+        send_rc = control_lookup_route(client_fd, router_state, cmd + 7);
     }
     else if (strcmp(cmd, "reload") == 0) {
-        printf("Reloading router...\n");
+        log_printf("Reloading router...\n");
+        if (reload_router(router_state) < 0) {
+            send_rc = control_printf(client_fd, "ERR reload failed\n");
+        } else {
+            send_rc = control_printf(client_fd, "OK 0\n");
+        }
+    }
+    else if (strcmp(cmd, "exit") == 0) {
+        log_printf("Terminating router...\n");
 
-        pthread_mutex_lock(&router_state->change_router_table_mutex);
-        router_state->should_restart = 1;
-        pthread_mutex_unlock(&router_state->change_router_table_mutex);
+        atomic_store(&router_state->should_terminate, 1);
+        signal_wakeup(router_state->wakeup_fd);
+        control_printf(client_fd, "OK 0\n");
+        cmd_return_code = CMD_TERMINATE;
+    }
+    else {
+        send_rc = control_printf(client_fd, "ERR unknown command\n");
+    }
 
-        send_tombstone_packets(router_state);
-        return CMD_RESTART_ROUTER;
+    if (send_rc < 0) {
+        return CMD_CLIENT_ERROR;
     }
-    else if (strcmp(cmd, "exit") == 0) {
-        printf("Terminating router...\n");
+    return cmd_return_code;
+}
 
-        pthread_mutex_lock(&router_state->change_router_table_mutex);
-        router_state->should_terminate = 1;
-        pthread_mutex_unlock(&router_state->change_router_table_mutex);
+/* reads whatever the client sent and runs every complete line.
+ * returns -1 when the client should be dropped
+ * */
+int handle_control_client(ControlClient *client, RouterState *router_state, HandleCmdReturnCode *last_cmd_return_code) {
+    ssize_t bytes_received = recv(client->fd,
+            client->buffer + client->buffer_len,
+            sizeof(client->buffer) - client->buffer_len,
+            0
+    );
+    if (bytes_received <= 0) {
+        return -1;
+    }
+    client->buffer_len += bytes_received;
 
-        send_tombstone_packets(router_state);
-        return CMD_TERMINATE;
+    uint32_t line_start = 0;
+    for (uint32_t i = 0; i < client->buffer_len; i++) {
+        if (client->buffer[i] != '\n') {
+            continue;
+        }
+
+        client->buffer[i] = '\0';
+        char *cmd = &client->buffer[line_start];
+        cmd[strcspn(cmd, "\r")] = '\0';
+        line_start = i + 1;
+
+        *last_cmd_return_code = handle_cmd(cmd, router_state, client->fd);
+        if (*last_cmd_return_code == CMD_CLIENT_ERROR) {
+            return -1;
+        }
+        if (*last_cmd_return_code == CMD_TERMINATE) {
+            return 0;
+        }
+    }
+
+    memmove(client->buffer, client->buffer + line_start, client->buffer_len - line_start);
+    client->buffer_len -= line_start;
+
+    if (client->buffer_len == sizeof(client->buffer)) {
+        control_printf(client->fd, "ERR command too long\n");
+        return -1;
     }
 
-    return CMD_DONE;
+    return 0;
 }
 
-void* listen_for_command(void *arg_router_state) {
+void* control_listen(void *arg_router_state) {
     RouterState *router_state = (RouterState*) arg_router_state;
-    log_printf("Press '+' to stop logging...\n");
 
+    char socket_path[100];
+    get_control_socket_path(router_state->router_id, socket_path, sizeof(socket_path));
+
+    int listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_sock < 0) {
+        perror("control socket creation failed");
+        free_router_state(router_state);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_un control_addr;
+    memset(&control_addr, 0, sizeof(control_addr));
+    control_addr.sun_family = AF_UNIX;
+    strncpy(control_addr.sun_path, socket_path, sizeof(control_addr.sun_path) - 1);
+
+    // a stale socket file is left behind if the previous run crashed
+    unlink(socket_path);
+    int bind_res = bind(listen_sock,
+            (struct sockaddr*) &control_addr,
+            sizeof(control_addr)
+    );
+    if (bind_res < 0 || listen(listen_sock, CONTROL_MAX_CLIENTS) < 0) {
+        perror("control socket bind failed");
+        close(listen_sock);
+        free_router_state(router_state);
+        exit(EXIT_FAILURE);
+    }
+    log_printf("Control socket listening on %s\n", socket_path);
+
+    ControlClient clients[CONTROL_MAX_CLIENTS];
+    struct pollfd poll_fds[CONTROL_MAX_CLIENTS + 2];
+    uint32_t num_clients = 0;
     HandleCmdReturnCode last_cmd_return_code = CMD_DONE;
 
-    while (last_cmd_return_code != CMD_RESTART_ROUTER &&
-           last_cmd_return_code != CMD_TERMINATE) {
-        enable_raw_term();
-        char c = getchar();
-        if (c == '+') {
-            if (enable_logging) {
-                log_printf("Logging stopped.\n");
-                enable_logging = 0;
-            } else {
-                enable_logging = 1;
-                log_printf("Logging started.\n");
+    while (last_cmd_return_code != CMD_TERMINATE) {
+        poll_fds[0].fd = listen_sock;
+        poll_fds[0].events = POLLIN;
+        poll_fds[1].fd = router_state->wakeup_fd;
+        poll_fds[1].events = POLLIN;
+        for (uint32_t i = 0; i < num_clients; i++) {
+            poll_fds[i + 2].fd = clients[i].fd;
+            poll_fds[i + 2].events = POLLIN;
+        }
+
+        int poll_res = poll(poll_fds, num_clients + 2, -1);
+        if (poll_res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("control socket poll failed");
+            break;
+        }
+
+        // the router is being terminated from somewhere else
+        if (poll_fds[1].revents & POLLIN) {
+            break;
+        }
+
+        // walk backwards so a dropped client can be swapped with the last one
+        for (int i = num_clients - 1; i >= 0; i--) {
+            if (!(poll_fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            int client_rc = handle_control_client(&clients[i], router_state, &last_cmd_return_code);
+            if (client_rc < 0) {
+                close(clients[i].fd);
+                clients[i] = clients[num_clients - 1];
+                num_clients -= 1;
+            }
+
+            if (last_cmd_return_code == CMD_TERMINATE) {
+                break;
             }
         }
-        else if (c == '/') {
-            int old_should_log = enable_logging;
-            enable_logging = 0;
-            printf("/");
-            disable_raw_term();
-
-            const size_t cmd_size = 100;
-            char cmd_buffer[cmd_size];
-            fgets(cmd_buffer, cmd_size, stdin);
-            cmd_buffer[strcspn(cmd_buffer, "\n")] = '\0';
-            last_cmd_return_code = handle_cmd(cmd_buffer, router_state);
-
-            if (last_cmd_return_code != CMD_DONT_RESTORE_SHOULD_LOG) {
-                enable_logging = old_should_log;
+
+        if (last_cmd_return_code != CMD_TERMINATE &&
+                (poll_fds[0].revents & POLLIN)) {
+            int client_fd = accept(listen_sock, NULL, NULL);
+            if (client_fd < 0) {
+                continue;
+            }
+            if (num_clients >= CONTROL_MAX_CLIENTS) {
+                control_printf(client_fd, "ERR too many clients\n");
+                close(client_fd);
+                continue;
             }
+
+            // a client that stops reading gets dropped instead of blocking the router
+            struct timeval send_timeout = { .tv_sec = CONTROL_SEND_TIMEOUT, .tv_usec = 0 };
+            setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+            clients[num_clients].fd = client_fd;
+            clients[num_clients].buffer_len = 0;
+            num_clients += 1;
         }
     }
 
-    log_printf("listen_for_command ended\n");
+    for (uint32_t i = 0; i < num_clients; i++) {
+        close(clients[i].fd);
+    }
+    close(listen_sock);
+    unlink(socket_path);
+
+    log_printf("control_listen ended\n");
     return NULL;
 }
 
 void* gateway_life_clock(void *arg_router_state) {
     RouterState *router_state = (RouterState*) arg_router_state;
 
-    while (!router_state->should_restart && !router_state->should_terminate) {
-      sleep(TIME_FOR_LIFE_DROP);
-      // TODO CHANGE LIFE TABLE MUTEX - can be omitted for now since this is
-      // the only place where the life_table is being read/written to
-      for (uint32_t i = 0; i < router_state->life_entries; i++) {
-          if (router_state->life_table[i].life_left == 0) {
-              pthread_mutex_lock(&router_state->change_router_table_mutex);
-              set_metric_for_all_entries_with_destination(
-                      router_state,
-                      router_state->life_table[i].gateway,
-                      INFINITY_METRIC
-              );
-              pthread_mutex_unlock(&router_state->change_router_table_mutex);
-          } else if (!match_ips(router_state->life_table[i].gateway,
-                                router_state->interfaces[0].interface_ip)) {
-              router_state->life_table[i].life_left -= 1;
-          }
+    while (!router_should_stop(router_state)) {
+      if (clock_sleep(router_state->clock, router_state->wakeup_fd, TIME_FOR_LIFE_DROP)) {
+          break;
+      }
+
+      // interfaces can change on reload
+      uint8_t first_interface_ip[4] = { 0, 0, 0, 0 };
+      pthread_rwlock_wrlock(&router_state->router_table_lock);
+      if (router_state->num_interfaces > 0) {
+          memcpy(first_interface_ip, router_state->interfaces[0].interface_ip, 4);
       }
+      age_life_table(router_state, first_interface_ip);
+      unlock_router_table_after_write(router_state);
     }
 
     log_printf("gateway_life_clock ended\n");
     return NULL;
 }
 
+void* checkpoint_clock(void *arg_router_state) {
+    RouterState *router_state = (RouterState*) arg_router_state;
+
+    Checkpoint *checkpoint = open_checkpoint(router_state->router_id, router_state->max_entries);
+    if (!checkpoint) {
+        log_printf("checkpointing disabled\n");
+        return NULL;
+    }
+
+    // also runs once after the wakeup, so a clean exit leaves a fresh checkpoint
+    while (!router_should_stop(router_state)) {
+        clock_sleep(router_state->clock, router_state->wakeup_fd, CHECKPOINT_INTERVAL);
+        write_checkpoint(checkpoint, router_state);
+    }
+
+    close_checkpoint(checkpoint);
+    log_printf("checkpoint_clock ended\n");
+    return NULL;
+}
+
 /**
  * Threads:
  * 0 -> rip_broadcaster
- * 1 -> listen_for_command
+ * 1 -> control_listen
  * 2 -> gateway_life_clock
- * 3,4,5... -> rip_listen
+ * 3 -> checkpoint_clock
+ * router_state->listeners -> rip_listen, one per interface.
+ *      started/stopped by reload_router while the router runs
+ * router_state->pool -> pool_worker, applying what the listeners received
  */
 int split_threads(RouterState *router_state) {
     int is_thread_error = 0;
-    uint32_t the_router_id = router_state->router_id;
-    const uint32_t num_threads = 3 + router_state->num_interfaces;
+    pthread_t threads[4];
+    uint32_t num_started_threads = 0;
 
-    pthread_t threads[num_threads];
-    RipListenState *rip_listen_states = malloc(router_state->num_interfaces * sizeof(RipListenState));
+    router_state->pool = start_update_pool(router_state, router_state->placement->num_workers);
+    if (!router_state->pool) {
+        is_thread_error = 1;
+        goto stop_threads;
+    }
 
     for (uint32_t i = 0; i < router_state->num_interfaces; i++) {
-        rip_listen_states[i] = (RipListenState) { router_state, i };
-        int rc_rip_listen = pthread_create(&threads[3 + i], NULL, rip_listen, (void*) &rip_listen_states[i]);
-        if (rc_rip_listen) {
-            perror("Error initializing threads.");
+        int rc_rip_listen = start_rip_listener(
+                router_state,
+                &router_state->listeners[i],
+                &router_state->interfaces[i]
+        );
+        if (rc_rip_listen < 0) {
             is_thread_error = 1;
-            goto cleanup_router_state;
+            goto stop_threads;
         }
     }
 
+    // the rest only wakes up now and then, they share the housekeeping cpu
+    const int housekeeping_cpu = router_state->placement->housekeeping_cpu;
+
     sleep(1);
-    int rc_two = pthread_create(&threads[0], NULL, rip_broadcaster, (void*) router_state);
+    int rc_two = create_placed_thread(&threads[0], router_state->placement, housekeeping_cpu,
+            "rip_broadcaster", rip_broadcaster, (void*) router_state);
     if (rc_two) {
         perror("Error initializing threads.");
         is_thread_error = 1;
-        goto cleanup_router_state;
+        goto stop_threads;
     }
+    num_started_threads += 1;
 
     sleep(1);
-    int rc_three = pthread_create(&threads[1], NULL, listen_for_command, (void*) router_state);
+    int rc_three = create_placed_thread(&threads[1], router_state->placement, housekeeping_cpu,
+            "control_listen", control_listen, (void*) router_state);
     if (rc_three) {
         perror("Error initializing threads.");
         is_thread_error = 1;
-        goto cleanup_router_state;
+        goto stop_threads;
     }
+    num_started_threads += 1;
 
-    int rc_four = pthread_create(&threads[2], NULL, gateway_life_clock, (void*) router_state);
+    int rc_four = create_placed_thread(&threads[2], router_state->placement, housekeeping_cpu,
+            "gateway_life_clock", gateway_life_clock, (void*) router_state);
     if (rc_four) {
         perror("Error initializing threads.");
         is_thread_error = 1;
-        goto cleanup_router_state;
+        goto stop_threads;
     }
+    num_started_threads += 1;
 
-    for (uint32_t i = 0; i < num_threads; i++) {
+    int rc_five = create_placed_thread(&threads[3], router_state->placement, housekeeping_cpu,
+            "checkpoint_clock", checkpoint_clock, (void*) router_state);
+    if (rc_five) {
+        perror("Error initializing threads.");
+        is_thread_error = 1;
+        goto stop_threads;
+    }
+    num_started_threads += 1;
+
+stop_threads:
+    if (is_thread_error) {
+        atomic_store(&router_state->should_terminate, 1);
+        signal_wakeup(router_state->wakeup_fd);
+    }
+
+    for (uint32_t i = 0; i < num_started_threads; i++) {
         pthread_join(threads[i], NULL);
     }
 
-    int was_should_terminate = router_state->should_terminate;
-    RipType was_router_rip_type = router_state->rip_type;
+    // control_listen has ended, nothing else touches the listeners now
+    for (uint32_t i = 0; i < router_state->max_interfaces; i++) {
+        if (router_state->listeners[i].is_running) {
+            stop_rip_listener(&router_state->listeners[i]);
+        }
+    }
 
-cleanup_router_state:
-    free(rip_listen_states);
-    free(router_state->router_table);
-    free(router_state->life_table);
-    free(router_state->interfaces);
-    pthread_mutex_destroy(&router_state->change_router_table_mutex);
-    free(router_state);
+    // after the listeners, nothing submits anymore
+    if (router_state->pool) {
+        stop_update_pool(router_state->pool);
+        router_state->pool = NULL;
+    }
+
+    free_router_state(router_state);
 
     if (is_thread_error) {
         // there was a thread initialization error
         return -1;
-    } else if (was_should_terminate) {
-        // the user requested for the router to terminate
-        return 0;
-    } else {
-        // recursive call - the router should restart
-        RouterState *reloaded_router = startup_router(the_router_id, was_router_rip_type);
-        return split_threads(reloaded_router);
     }
+    return 0;
+}
+
+/* sends a single command to a running router and prints the response.
+ * returns 0 if the router answered OK
+ * */
+int run_control_client(uint32_t router_id, int argc, char *argv[]) {
+    char cmd[100] = "";
+    for (int i = 0; i < argc; i++) {
+        if (i > 0) {
+            strncat(cmd, " ", sizeof(cmd) - strlen(cmd) - 1);
+        }
+        strncat(cmd, argv[i], sizeof(cmd) - strlen(cmd) - 1);
+    }
+    strncat(cmd, "\n", sizeof(cmd) - strlen(cmd) - 1);
+
+    char socket_path[100];
+    get_control_socket_path(router_id, socket_path, sizeof(socket_path));
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("control socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_un control_addr;
+    memset(&control_addr, 0, sizeof(control_addr));
+    control_addr.sun_family = AF_UNIX;
+    strncpy(control_addr.sun_path, socket_path, sizeof(control_addr.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr*) &control_addr, sizeof(control_addr)) < 0) {
+        perror("control socket connect failed");
+        close(sock);
+        return -1;
+    }
+
+    if (control_send_all(sock, cmd, strlen(cmd)) < 0) {
+        perror("control socket send failed");
+        close(sock);
+        return -1;
+    }
+
+    FILE *response = fdopen(sock, "r");
+    if (!response) {
+        perror("fdopen failed");
+        close(sock);
+        return -1;
+    }
+
+    int rc = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), response)) {
+        if (strncmp(line, "OK", 2) == 0) {
+            rc = 0;
+            break;
+        }
+        if (strncmp(line, "ERR", 3) == 0) {
+            fputs(line, stderr);
+            break;
+        }
+        fputs(line, stdout);
+    }
+
+    fclose(response);
+    return rc;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 3 || argc > 4) {
+    if (argc >= 4 && strcmp(argv[1], "ctl") == 0) {
+        uint32_t ctl_router_id = atoi(argv[2]);
+        int ctl_rc = run_control_client(ctl_router_id, argc - 3, argv + 3);
+        exit(ctl_rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if (argc < 3 || argc > 6) {
         errno = EINVAL;
         perror("Invalid arguments");
         exit(EXIT_FAILURE);
     }
 
     setbuf(stdout, NULL);
-    srand(time(NULL));
 
     if (strcmp(argv[1], "router") == 0) {
         uint32_t curr_num_router = atoi(argv[2]);
 
-        RipType curr_rip_type;
-        if (argc == 3 || strcmp(argv[3], "static") != 0) {
-            curr_rip_type = RIP_DYNAMIC;
-        } else {
-            curr_rip_type = RIP_STATIC;
+        // router <id> [static] [capture <file>]
+        RipType curr_rip_type = RIP_DYNAMIC;
+        const char *capture_filename = NULL;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "static") == 0) {
+                curr_rip_type = RIP_STATIC;
+            } else if (strcmp(argv[i], "capture") == 0 && i + 1 < argc) {
+                capture_filename = argv[++i];
+            }
+        }
+
+        // routers started together still get different delays
+        SystemClock *system_clock = create_system_clock(((uint64_t) curr_num_router << 32) ^ time(NULL));
+        RouterState *router_one = startup_router(curr_num_router, curr_rip_type, &system_clock->clock);
+
+        Capture *capture = NULL;
+        if (capture_filename) {
+            capture = start_capture(capture_filename);
+            if (!capture) {
+                free_router_state(router_one);
+                exit(EXIT_FAILURE);
+            }
+            router_one->capture = capture;
         }
 
-        RouterState *router_one = startup_router(curr_num_router, curr_rip_type);
         int split_rc = split_threads(router_one);
+        if (capture) {
+            stop_capture(capture);
+        }
+        free_system_clock(system_clock);
         if (split_rc < 0) {
             exit(EXIT_FAILURE);
         }
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include <dirent.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+const uint32_t PLACEMENT_DEFAULT_STACK_KIB = 1024;
+
+int parse_placement_cpu(const char *cpu_str, int *cpu) {
+    char *end;
+    long parsed_cpu = strtol(cpu_str, &end, 10);
+    if (*end != '\0' || parsed_cpu < 0 || parsed_cpu >= CPU_SETSIZE) {
+        return -1;
+    }
+
+    *cpu = parsed_cpu;
+    return 0;
+}
+
+/* returns NULL only for a file that exists and is invalid
+ * */
+Placement* read_placement(uint32_t router_id) {
+    Placement *placement = calloc(1, sizeof(Placement));
+    placement->housekeeping_cpu = -1;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    placement->num_workers = num_cpus > 0 ? num_cpus : 1;
+    placement->stack_size = (size_t) PLACEMENT_DEFAULT_STACK_KIB * 1024;
+
+    char filename[100];
+    snprintf(filename, sizeof(filename), "router_%u.placement", router_id);
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return placement;
+    }
+
+    uint32_t listens_capacity = 0;
+    char line[100];
+    uint32_t line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number += 1;
+        char keyword[20], first_arg[20], second_arg[20];
+        int num_args = sscanf(line, "%19s %19s %19s", keyword, first_arg, second_arg);
+        if (num_args < 1 || keyword[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(keyword, "listen") == 0 && num_args == 3) {
+            if (listens_capacity == placement->num_listens) {
+                listens_capacity = listens_capacity ? listens_capacity * 2 : 8;
+                placement->listens = realloc(placement->listens, listens_capacity * sizeof(ListenPlacement));
+            }
+
+            ListenPlacement *listen = &placement->listens[placement->num_listens];
+            memset(listen, 0, sizeof(ListenPlacement));
+            listen->is_any_interface = strcmp(first_arg, "*") == 0;
+            listen->is_near_irq = strcmp(second_arg, "irq") == 0;
+            listen->cpu = -1;
+            if ((!listen->is_any_interface && inet_pton(AF_INET, first_arg, listen->interface_ip) != 1) ||
+                    (!listen->is_near_irq && parse_placement_cpu(second_arg, &listen->cpu) < 0)) {
+                fprintf(stderr, "placement: invalid listen on line %u\n", line_number);
+                goto invalid_placement;
+            }
+            placement->num_listens += 1;
+        }
+        else if (strcmp(keyword, "housekeeping") == 0 && num_args == 2) {
+            if (parse_placement_cpu(first_arg, &placement->housekeeping_cpu) < 0) {
+                fprintf(stderr, "placement: invalid cpu on line %u\n", line_number);
+                goto invalid_placement;
+            }
+        }
+        else if (strcmp(keyword, "workers") == 0 && num_args == 2) {
+            long num_workers = atol(first_arg);
+            if (num_workers <= 0 || num_workers > CPU_SETSIZE) {
+                fprintf(stderr, "placement: invalid number of workers on line %u\n", line_number);
+                goto invalid_placement;
+            }
+            placement->num_workers = num_workers;
+        }
+        else if (strcmp(keyword, "stack") == 0 && num_args == 2) {
+            long stack_kib = atol(first_arg);
+            if (stack_kib <= 0 || (size_t) stack_kib * 1024 < (size_t) PTHREAD_STACK_MIN) {
+                fprintf(stderr, "placement: invalid stack size on line %u\n", line_number);
+                goto invalid_placement;
+            }
+            placement->stack_size = (size_t) stack_kib * 1024;
+        }
+        else {
+            fprintf(stderr, "placement: invalid line %u\n", line_number);
+            goto invalid_placement;
+        }
+    }
+
+    fclose(file);
+    return placement;
+
+invalid_placement:
+    fclose(file);
+    free_placement(placement);
+    errno = EIO;
+    perror("Invalid placement file");
+    return NULL;
+}
+
+void free_placement(Placement *placement) {
+    free(placement->listens);
+    free(placement);
+}
+
+// first cpu of a list like "0-3,8"
+int read_first_cpu(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return -1;
+    }
+
+    int cpu = -1;
+    if (fscanf(file, "%d", &cpu) != 1) {
+        cpu = -1;
+    }
+    fclose(file);
+    return cpu;
+}
+
+/* the cpu that serves the first interrupt of the NIC that has
+ * interface_ip, or a cpu on its NUMA node when the interrupts can't be
+ * read. -1 for virtual interfaces and addresses that aren't local.
+ * irq is -1 when only the node was found
+ * */
+int get_nic_irq_cpu(uint8_t *interface_ip, int *irq) {
+    *irq = -1;
+
+    struct ifaddrs *interfaces;
+    if (getifaddrs(&interfaces) < 0) {
+        return -1;
+    }
+    char device_name[IFNAMSIZ] = "";
+    for (struct ifaddrs *curr = interfaces; curr; curr = curr->ifa_next) {
+        if (curr->ifa_addr && curr->ifa_addr->sa_family == AF_INET &&
+                match_ips((uint8_t*) &((struct sockaddr_in*) curr->ifa_addr)->sin_addr.s_addr, interface_ip)) {
+            strncpy(device_name, curr->ifa_name, sizeof(device_name) - 1);
+            break;
+        }
+    }
+    freeifaddrs(interfaces);
+    if (device_name[0] == '\0') {
+        return -1;
+    }
+
+    // MSI vectors, lowest first. legacy NICs have a single irq file instead
+    char path[160];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs", device_name);
+    DIR *irq_dir = opendir(path);
+    if (irq_dir) {
+        struct dirent *entry;
+        while ((entry = readdir(irq_dir))) {
+            int entry_irq = atoi(entry->d_name);
+            if (entry_irq > 0 && (*irq < 0 || entry_irq < *irq)) {
+                *irq = entry_irq;
+            }
+        }
+        closedir(irq_dir);
+    }
+    if (*irq < 0) {
+        snprintf(path, sizeof(path), "/sys/class/net/%s/device/irq", device_name);
+        FILE *irq_file = fopen(path, "r");
+        if (irq_file) {
+            if (fscanf(irq_file, "%d", irq) != 1 || *irq <= 0) {
+                *irq = -1;
+            }
+            fclose(irq_file);
+        }
+    }
+
+    if (*irq > 0) {
+        snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", *irq);
+        int cpu = read_first_cpu(path);
+        if (cpu >= 0) {
+            return cpu;
+        }
+        *irq = -1;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/local_cpulist", device_name);
+    return read_first_cpu(path);
+}
+
+/* the first matching listen line wins, an exact ip before '*'
+ * */
+int get_listen_cpu(Placement *placement, InterfaceTableEntry *interface) {
+    ListenPlacement *found_listen = NULL;
+    for (uint32_t i = 0; i < placement->num_listens; i++) {
+        ListenPlacement *listen = &placement->listens[i];
+        if (!listen->is_any_interface && match_ips(listen->interface_ip, interface->interface_ip)) {
+            found_listen = listen;
+            break;
+        }
+        if (listen->is_any_interface && !found_listen) {
+            found_listen = listen;
+        }
+    }
+
+    if (!found_listen) {
+        return -1;
+    }
+    if (!found_listen->is_near_irq) {
+        return found_listen->cpu;
+    }
+
+    int irq;
+    int cpu = get_nic_irq_cpu(interface->interface_ip, &irq);
+    log_printf("placement: %u.%u.%u.%u ",
+            interface->interface_ip[0],
+            interface->interface_ip[1],
+            interface->interface_ip[2],
+            interface->interface_ip[3]
+    );
+    if (cpu < 0) {
+        log_printf("has no NIC interrupts to follow\n");
+    } else if (irq < 0) {
+        log_printf("has its NIC on the node of cpu %d\n", cpu);
+    } else {
+        log_printf("has its NIC's irq %d on cpu %d\n", irq, cpu);
+    }
+    return cpu;
+}
+
+/* pthread_create with the placement's stack size, pinned to cpu unless
+ * it is -1. a cpu that doesn't exist or isn't allowed leaves the thread
+ * unpinned rather than failing the router. reports where the thread went
+ * */
+int create_placed_thread(pthread_t *thread, Placement *placement, int cpu, const char *name,
+        void *(*start_routine)(void*), void *arg) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, placement->stack_size);
+
+    if (cpu >= 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+    }
+
+    int create_rc = pthread_create(thread, &attr, start_routine, arg);
+    if (create_rc == EINVAL && cpu >= 0) {
+        // outside the cpus this process may use
+        log_printf("placement: %s can't run on cpu %d\n", name, cpu);
+        cpu = -1;
+        pthread_attr_destroy(&attr);
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, placement->stack_size);
+        create_rc = pthread_create(thread, &attr, start_routine, arg);
+    }
+    pthread_attr_destroy(&attr);
+    if (create_rc) {
+        return create_rc;
+    }
+
+    if (cpu >= 0) {
+        log_printf("placement: %s on cpu %d, %zu KiB stack\n", name, cpu, placement->stack_size / 1024);
+    } else {
+        log_printf("placement: %s on any cpu, %zu KiB stack\n", name, placement->stack_size / 1024);
+    }
+    return 0;
+}
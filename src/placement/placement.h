@@ -0,0 +1,52 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <first.h>
+
+/* where router threads run, from the optional router_<id>.placement,
+ * one entry per line ('#' starts a comment):
+ *
+ * listen <ip> <cpu>         -> rip_listen of the interface with <ip> on <cpu>
+ * listen <ip> irq           -> on a cpu its NIC's interrupts are routed to
+ * listen * <cpu>|irq        -> the same for every other interface
+ * housekeeping <cpu>        -> rip_broadcaster and the clock and control threads
+ * workers <n>               -> number of pool workers, one per online cpu by default
+ * stack <kib>               -> stack size of every router thread
+ *
+ * without a file (or a matching line) threads float over all cpus.
+ * stacks are always sized explicitly, PLACEMENT_DEFAULT_STACK_KIB by default
+ * */
+
+typedef struct {
+    uint8_t interface_ip[4];
+    int is_any_interface;
+    int is_near_irq;
+    int cpu;
+} ListenPlacement;
+
+struct Placement {
+    ListenPlacement *listens;
+    uint32_t num_listens;
+    // -1 = not pinned
+    int housekeeping_cpu;
+    uint32_t num_workers;
+    size_t stack_size;
+};
+
+extern const uint32_t PLACEMENT_DEFAULT_STACK_KIB;
+
+Placement* read_placement(uint32_t router_id);
+
+void free_placement(Placement *placement);
+
+int get_nic_irq_cpu(uint8_t *interface_ip, int *irq);
+
+int get_listen_cpu(Placement *placement, InterfaceTableEntry *interface);
+
+int create_placed_thread(pthread_t *thread, Placement *placement, int cpu, const char *name,
+        void *(*start_routine)(void*), void *arg);
+
+#endif
@@ -0,0 +1,347 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <router.h>
+#include <placement.h>
+
+const uint32_t POOL_MAX_PENDING_UPDATES = 256;
+// a power of two, queue positions wrap with it
+const uint32_t POOL_MAX_LANES = 64;
+// so one busy neighbor leaves updates for the others
+const uint32_t POOL_MAX_LANE_UPDATES = 16;
+// updates applied under one write lock
+const uint32_t POOL_MAX_WRITE_BATCH = 8;
+
+uint32_t get_sender_hash(uint8_t *sender_ip) {
+    return fnv1a(FNV1A_OFFSET_BASIS, sender_ip, 4);
+}
+
+// sized for every lane, so it is never reallocated
+void rebuild_lane_index(UpdatePool *pool) {
+    reset_table_index(&pool->lane_index, POOL_MAX_LANES);
+    for (uint32_t i = 0; i < pool->num_lanes; i++) {
+        add_to_table_index(&pool->lane_index, get_sender_hash(pool->lanes[i].sender_ip), i);
+    }
+    pool->lane_index.num_indexed = pool->num_lanes;
+}
+
+/* a lane stays with its sender while it has updates queued. past
+ * POOL_MAX_LANES senders a new one takes over an idle lane, returns -1 when
+ * there is none. with pool->mutex held
+ * */
+int32_t get_lane_of_sender(UpdatePool *pool, uint8_t *sender_ip) {
+    TableIndex *index = &pool->lane_index;
+    const uint32_t hash = get_sender_hash(sender_ip);
+    for (uint32_t i = hash & (index->size - 1); index->size > 0 && index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        uint32_t position = index->slots[i] - 1;
+        if (match_ips(pool->lanes[position].sender_ip, sender_ip)) {
+            return position;
+        }
+    }
+
+    uint32_t lane = pool->num_lanes;
+    int is_taken_over = 0;
+    if (pool->num_lanes < POOL_MAX_LANES) {
+        pool->num_lanes += 1;
+    } else {
+        lane = 0;
+        while (lane < POOL_MAX_LANES && pool->lanes[lane].is_scheduled) {
+            lane++;
+        }
+        if (lane == POOL_MAX_LANES) {
+            return -1;
+        }
+        is_taken_over = 1;
+    }
+
+    PoolLane *new_lane = &pool->lanes[lane];
+    memcpy(new_lane->sender_ip, sender_ip, 4);
+    new_lane->first_update = -1;
+    new_lane->last_update = -1;
+    new_lane->num_updates = 0;
+    new_lane->is_scheduled = 0;
+    new_lane->home_worker = hash % pool->num_workers;
+
+    // the old sender's slot can't be removed from the index
+    if (is_taken_over || add_to_table_index(index, hash, lane) < 0) {
+        rebuild_lane_index(pool);
+    } else {
+        index->num_indexed = pool->num_lanes;
+    }
+    return lane;
+}
+
+// behind the lanes that are already waiting
+void push_ready_lane(UpdatePool *pool, PoolWorker *worker, uint32_t lane) {
+    pthread_mutex_lock(&worker->queue_mutex);
+    worker->queue[worker->queue_tail++ & (POOL_MAX_LANES - 1)] = lane;
+    pthread_mutex_unlock(&worker->queue_mutex);
+
+    // counted after the push, so a woken worker finds it
+    pthread_mutex_lock(&pool->mutex);
+    pool->num_ready_lanes += 1;
+    pthread_cond_signal(&pool->lanes_ready);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/* the oldest lane of the worker's own queue, otherwise the oldest lane
+ * of the next worker that has one
+ * */
+int32_t take_ready_lane(UpdatePool *pool, PoolWorker *worker) {
+    int32_t lane = -1;
+    for (uint32_t i = 0; lane < 0 && i < pool->num_workers; i++) {
+        PoolWorker *victim = &pool->workers[(worker->index + i) % pool->num_workers];
+        pthread_mutex_lock(&victim->queue_mutex);
+        if (victim->queue_head != victim->queue_tail) {
+            lane = victim->queue[victim->queue_head++ & (POOL_MAX_LANES - 1)];
+        }
+        pthread_mutex_unlock(&victim->queue_mutex);
+    }
+
+    if (lane >= 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->num_ready_lanes -= 1;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return lane;
+}
+
+/* the listener of the interface may have been stopped by a reload since
+ * the update was received, its routes are gone and stay gone.
+ * returns 0 when the update only confirmed routes and was applied under
+ * the read lock, 1 when it was skipped, -1 when it needs the write lock
+ * */
+int refresh_pool_update(RouterState *router_state, PoolUpdate *update) {
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
+    int refresh_rc = 1;
+    if (is_own_interface_ip(router_state, update->interface.interface_ip)) {
+        refresh_rc = refresh_router_update(router_state, &update->interface,
+                update->sender_ip, update->entries, update->num_entries);
+    }
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+    return refresh_rc;
+}
+
+/* with the write lock held. returns 0 when the update was applied, -1
+ * when it was skipped
+ * */
+int apply_pool_update(RouterState *router_state, PoolUpdate *update) {
+    if (!is_own_interface_ip(router_state, update->interface.interface_ip)) {
+        return -1;
+    }
+    apply_router_update(router_state, &update->interface,
+            update->sender_ip, update->entries, update->num_entries);
+    return 0;
+}
+
+// the next update of a ready lane, which stays scheduled while it runs
+int32_t take_lane_update(UpdatePool *pool, uint32_t lane) {
+    pthread_mutex_lock(&pool->mutex);
+    PoolLane *curr_lane = &pool->lanes[lane];
+    const int32_t update_index = curr_lane->first_update;
+    curr_lane->first_update = pool->updates[update_index].next;
+    curr_lane->num_updates -= 1;
+    if (curr_lane->first_update < 0) {
+        curr_lane->last_update = -1;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return update_index;
+}
+
+/* frees the update and puts its lane back at the end of the queue while
+ * it has more
+ * */
+void finish_lane_update(UpdatePool *pool, PoolWorker *worker, uint32_t lane, int32_t update_index, int is_applied) {
+    if (is_applied) {
+        atomic_fetch_add(&pool->updates_applied, 1);
+        atomic_fetch_add(&pool->entries_applied, pool->updates[update_index].num_entries);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->updates[update_index].next = pool->first_free_update;
+    pool->first_free_update = update_index;
+    PoolLane *curr_lane = &pool->lanes[lane];
+    const int has_more = curr_lane->first_update >= 0;
+    if (!has_more) {
+        curr_lane->is_scheduled = 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (has_more) {
+        push_ready_lane(pool, worker, lane);
+    }
+}
+
+/* runs one update of a lane at a time. an update that changes routes
+ * takes the write lock, which is kept for up to POOL_MAX_WRITE_BATCH
+ * updates of the lanes next in line, so the indexes are brought up to
+ * date once per batch
+ * */
+void* pool_worker(void *arg_worker) {
+    PoolWorker *worker = (PoolWorker *) arg_worker;
+    UpdatePool *pool = worker->pool;
+    RouterState *router_state = pool->router_state;
+
+    while (1) {
+        int32_t lane = take_ready_lane(pool, worker);
+        if (lane < 0) {
+            pthread_mutex_lock(&pool->mutex);
+            while (pool->num_ready_lanes == 0 && !pool->is_stopping) {
+                pthread_cond_wait(&pool->lanes_ready, &pool->mutex);
+            }
+            const int is_stopping = pool->is_stopping;
+            pthread_mutex_unlock(&pool->mutex);
+            if (is_stopping) {
+                break;
+            }
+            continue;
+        }
+
+        int32_t update_index = take_lane_update(pool, lane);
+        const int refresh_rc = refresh_pool_update(router_state, &pool->updates[update_index]);
+        if (refresh_rc >= 0) {
+            finish_lane_update(pool, worker, lane, update_index, refresh_rc == 0);
+            continue;
+        }
+
+        pthread_rwlock_wrlock(&router_state->router_table_lock);
+        for (uint32_t i = 0; i < POOL_MAX_WRITE_BATCH; i++) {
+            if (i > 0) {
+                lane = take_ready_lane(pool, worker);
+                if (lane < 0) {
+                    break;
+                }
+                update_index = take_lane_update(pool, lane);
+            }
+            const int apply_rc = apply_pool_update(router_state, &pool->updates[update_index]);
+            finish_lane_update(pool, worker, lane, update_index, apply_rc == 0);
+        }
+        unlock_router_table_after_write(router_state);
+    }
+
+    log_printf("pool_worker %u ended\n", worker->index);
+    return NULL;
+}
+
+/* returns NULL when the workers can't be started, the ones that were
+ * are stopped again
+ * */
+UpdatePool* start_update_pool(RouterState *router_state, uint32_t num_workers) {
+    UpdatePool *pool = calloc(1, sizeof(UpdatePool));
+    pool->router_state = router_state;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->lanes_ready, NULL);
+    atomic_init(&pool->updates_dropped, 0);
+    atomic_init(&pool->updates_applied, 0);
+    atomic_init(&pool->entries_applied, 0);
+
+    pool->updates = malloc(POOL_MAX_PENDING_UPDATES * sizeof(PoolUpdate));
+    for (uint32_t i = 0; i < POOL_MAX_PENDING_UPDATES; i++) {
+        pool->updates[i].entries = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry));
+        pool->updates[i].next = i + 1 < POOL_MAX_PENDING_UPDATES ? (int32_t) i + 1 : -1;
+    }
+    pool->first_free_update = 0;
+    pool->lanes = malloc(POOL_MAX_LANES * sizeof(PoolLane));
+    rebuild_lane_index(pool);
+
+    pool->num_workers = num_workers > 0 ? num_workers : 1;
+    pool->workers = calloc(pool->num_workers, sizeof(PoolWorker));
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pthread_mutex_init(&pool->workers[i].queue_mutex, NULL);
+        pool->workers[i].queue = malloc(POOL_MAX_LANES * sizeof(uint32_t));
+    }
+
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        char thread_name[40];
+        snprintf(thread_name, sizeof(thread_name), "pool_worker %u", i);
+        int rc_worker = create_placed_thread(&pool->workers[i].thread, router_state->placement,
+                -1, thread_name, pool_worker, (void*) &pool->workers[i]);
+        if (rc_worker) {
+            perror("Error initializing threads.");
+            stop_update_pool(pool);
+            return NULL;
+        }
+        pool->num_started_workers += 1;
+    }
+
+    return pool;
+}
+
+/* copies the entries of a received packet into a free update and queues
+ * it behind the earlier updates of the same sender. never waits for the
+ * router table and never allocates, returns -1 when the update was dropped
+ * */
+int submit_router_update(UpdatePool *pool,
+        InterfaceTableEntry *interface,
+        uint8_t *sender_ip,
+        uint8_t *packet_entries,
+        uint32_t num_entries) {
+    pthread_mutex_lock(&pool->mutex);
+    const int32_t update_index = pool->first_free_update;
+    const int32_t lane = update_index >= 0 ? get_lane_of_sender(pool, sender_ip) : -1;
+    if (lane < 0 || pool->lanes[lane].num_updates >= POOL_MAX_LANE_UPDATES) {
+        pthread_mutex_unlock(&pool->mutex);
+        atomic_fetch_add(&pool->updates_dropped, 1);
+        return -1;
+    }
+
+    PoolUpdate *update = &pool->updates[update_index];
+    pool->first_free_update = update->next;
+    memcpy(&update->interface, interface, sizeof(InterfaceTableEntry));
+    memcpy(update->sender_ip, sender_ip, 4);
+    // the packet is not aligned for RouterTableEntry
+    memcpy(update->entries, packet_entries, num_entries * sizeof(RouterTableEntry));
+    update->num_entries = num_entries;
+    update->next = -1;
+
+    PoolLane *curr_lane = &pool->lanes[lane];
+    if (curr_lane->last_update >= 0) {
+        pool->updates[curr_lane->last_update].next = update_index;
+    } else {
+        curr_lane->first_update = update_index;
+    }
+    curr_lane->last_update = update_index;
+    curr_lane->num_updates += 1;
+
+    const int becomes_ready = !curr_lane->is_scheduled;
+    curr_lane->is_scheduled = 1;
+    const uint32_t home_worker = curr_lane->home_worker;
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (becomes_ready) {
+        push_ready_lane(pool, &pool->workers[home_worker], lane);
+    }
+    return 0;
+}
+
+/* updates still queued are dropped, the router is going away or they
+ * would be resent soon anyway
+ * */
+void stop_update_pool(UpdatePool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->is_stopping = 1;
+    pthread_cond_broadcast(&pool->lanes_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->num_started_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+
+    for (uint32_t i = 0; i < POOL_MAX_PENDING_UPDATES; i++) {
+        free(pool->updates[i].entries);
+    }
+    free(pool->updates);
+    for (uint32_t i = 0; i < pool->num_workers; i++) {
+        pthread_mutex_destroy(&pool->workers[i].queue_mutex);
+        free(pool->workers[i].queue);
+    }
+    free(pool->workers);
+    free(pool->lanes);
+    free_table_index(&pool->lane_index);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->lanes_ready);
+    free(pool);
+}
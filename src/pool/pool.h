@@ -0,0 +1,100 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <first.h>
+
+/* applies received tables on a pool of workers instead of on the
+ * listener that received them.
+ *
+ * updates queue up per neighbor (a lane per sender ip) and a lane is run
+ * by one worker at a time, so the updates of a neighbor are applied in
+ * the order they arrived. ready lanes sit in per-worker queues: a lane
+ * goes to its home worker, and idle workers steal from the others. a lane
+ * runs one update and goes back behind the other ready lanes, so a busy
+ * neighbor can't starve the rest.
+ * updates that only confirm routes run side by side under the read lock
+ * of the router table. a worker that needs the write lock applies the
+ * updates next in line under it too, a few at a time.
+ * sender ips come from the network, so lanes are a fixed set: an idle lane
+ * is taken over by a new sender. an update is dropped and counted when
+ * the pool is full, its lane is full or every lane is busy, neighbors
+ * resend anyway
+ * */
+
+typedef struct {
+    InterfaceTableEntry interface;
+    uint8_t sender_ip[4];
+    // ROUTER_TABLE_MAX_SIZE entries
+    RouterTableEntry *entries;
+    uint32_t num_entries;
+    // next update of the lane or of the free list, -1 for none
+    int32_t next;
+} PoolUpdate;
+
+typedef struct {
+    uint8_t sender_ip[4];
+    int32_t first_update;
+    int32_t last_update;
+    uint32_t num_updates;
+    // in a queue or being run
+    int is_scheduled;
+    uint32_t home_worker;
+} PoolLane;
+
+typedef struct {
+    UpdatePool *pool;
+    uint32_t index;
+    pthread_t thread;
+    // ready lanes, a ring of POOL_MAX_LANES. a lane is in one queue at
+    // most, so it always fits
+    pthread_mutex_t queue_mutex;
+    uint32_t *queue;
+    // taken by the owner and stolen by the others
+    uint32_t queue_head;
+    uint32_t queue_tail;
+} PoolWorker;
+
+struct UpdatePool {
+    RouterState *router_state;
+
+    // guards the updates, the lanes, num_ready_lanes and is_stopping
+    pthread_mutex_t mutex;
+    pthread_cond_t lanes_ready;
+    // POOL_MAX_PENDING_UPDATES, never moved
+    PoolUpdate *updates;
+    int32_t first_free_update;
+    // POOL_MAX_LANES, never moved
+    PoolLane *lanes;
+    uint32_t num_lanes;
+    TableIndex lane_index;
+    // lanes in the queues, off by one for a moment while a lane moves
+    int32_t num_ready_lanes;
+    int is_stopping;
+
+    PoolWorker *workers;
+    uint32_t num_workers;
+    uint32_t num_started_workers;
+    atomic_ulong updates_dropped;
+    atomic_ulong updates_applied;
+    atomic_ulong entries_applied;
+};
+
+extern const uint32_t POOL_MAX_PENDING_UPDATES;
+extern const uint32_t POOL_MAX_LANES;
+extern const uint32_t POOL_MAX_LANE_UPDATES;
+extern const uint32_t POOL_MAX_WRITE_BATCH;
+
+UpdatePool* start_update_pool(RouterState *router_state, uint32_t num_workers);
+
+int submit_router_update(UpdatePool *pool,
+        InterfaceTableEntry *interface,
+        uint8_t *sender_ip,
+        uint8_t *packet_entries,
+        uint32_t num_entries);
+
+void stop_update_pool(UpdatePool *pool);
+
+#endif
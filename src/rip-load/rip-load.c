@@ -0,0 +1,573 @@
+#include <first.h>
+#include <router.h>
+#include <clock.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* load generator for a running peer-listen.
+ *
+ * many fake neighbors broadcast router packets to BROADCAST_PORT, each
+ * advertising its own table in windows of entries_per_packet entries.
+ * churn is the share of advertised entries whose metric changes per packet.
+ * the router's control socket stats and the kernel's udp drop counter
+ * tell how much of the offered load was actually applied
+ * */
+
+typedef struct {
+    uint8_t broadcast_ip[4];
+    // first fake neighbor, the others follow it
+    uint8_t neighbor_base_ip[4];
+    uint32_t num_neighbors;
+    uint32_t num_prefixes;
+    uint32_t entries_per_packet;
+    double churn;
+    // packets per second, 0 = as fast as possible
+    uint32_t rate;
+    uint32_t step_seconds;
+    // doubles the rate every step until the drop ratio exceeds max_drop_ratio
+    int is_ramp;
+    double max_drop_ratio;
+    // router whose control socket is asked for stats, 0 = none
+    uint32_t router_id;
+    const char *record_filename;
+    const char *replay_filename;
+    // replay speed, 0 = as fast as possible
+    double replay_speed;
+    uint64_t seed;
+} LoadConfig;
+
+typedef struct {
+    uint8_t ip[4];
+    uint32_t router_id;
+    RouterTableEntry *table;
+    // start of the next advertised window
+    uint32_t next_entry;
+} FakeNeighbor;
+
+// counted by the router's update pool after the tables were applied
+typedef struct {
+    uint64_t updates_applied;
+    uint64_t entries_applied;
+    uint64_t routes_changed;
+} RouterStats;
+
+typedef struct {
+    uint64_t packets_sent;
+    uint64_t entries_sent;
+    uint64_t send_errors;
+    double seconds;
+} LoadStats;
+
+typedef struct {
+    LoadConfig config;
+    SystemClock *system_clock;
+    FakeNeighbor *neighbors;
+    int sock;
+    struct sockaddr_in broadcast_addr;
+    uint8_t *packet;
+    FILE *record_file;
+    struct timespec record_start;
+} LoadGenerator;
+
+const char LOAD_RECORD_MAGIC[8] = "RIPLOAD1";
+const uint32_t LOAD_DEFAULT_RATE = 1000;
+const uint32_t LOAD_MAX_RAMP_STEPS = 24;
+// time for the router to drain its socket before the counters are read
+const uint32_t LOAD_DRAIN_MS = 500;
+// first fake route, every prefix is a /24 after it
+const uint32_t LOAD_PREFIX_BASE = 0xac100000;
+
+// record file: LOAD_RECORD_MAGIC, then per packet
+// 1. 8 bytes -> microseconds since the recording started
+// 2. 4 bytes -> packet size
+// 3. [packet size] bytes -> the packet as sent
+typedef struct {
+    uint64_t at_us;
+    uint32_t packet_size;
+} __attribute__((packed)) LoadRecordHeader;
+
+double get_elapsed_seconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void add_ns_to_timespec(struct timespec *time, uint64_t ns) {
+    time->tv_sec += ns / 1000000000;
+    time->tv_nsec += ns % 1000000000;
+    if (time->tv_nsec >= 1000000000) {
+        time->tv_sec += 1;
+        time->tv_nsec -= 1000000000;
+    }
+}
+
+/* asks a running router for its counters over the control socket.
+ * returns -1 if the router is not reachable
+ * */
+int read_router_stats(uint32_t router_id, RouterStats *stats) {
+    char socket_path[100];
+    snprintf(socket_path, sizeof(socket_path), "router_%u.sock", router_id);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_un control_addr;
+    memset(&control_addr, 0, sizeof(control_addr));
+    control_addr.sun_family = AF_UNIX;
+    strncpy(control_addr.sun_path, socket_path, sizeof(control_addr.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr*) &control_addr, sizeof(control_addr)) < 0 ||
+            send(sock, "stats\n", 6, MSG_NOSIGNAL) != 6) {
+        close(sock);
+        return -1;
+    }
+
+    FILE *response = fdopen(sock, "r");
+    if (!response) {
+        close(sock);
+        return -1;
+    }
+
+    int rc = -1;
+    char line[256];
+    memset(stats, 0, sizeof(RouterStats));
+    while (fgets(line, sizeof(line), response)) {
+        if (strncmp(line, "OK", 2) == 0) {
+            rc = 0;
+            break;
+        }
+        if (strncmp(line, "ERR", 3) == 0) {
+            break;
+        }
+        sscanf(line, "updates_applied %lu", &stats->updates_applied);
+        sscanf(line, "entries_applied %lu", &stats->entries_applied);
+        sscanf(line, "routes_changed %lu", &stats->routes_changed);
+    }
+
+    fclose(response);
+    return rc;
+}
+
+/* receive buffer overflows of every udp socket bound to port,
+ * last column of /proc/net/udp
+ * */
+uint64_t get_kernel_udp_drops(uint32_t port) {
+    FILE *file = fopen("/proc/net/udp", "r");
+    if (!file) {
+        return 0;
+    }
+
+    uint64_t drops = 0;
+    char line[512];
+    // header line
+    if (!fgets(line, sizeof(line), file)) {
+        fclose(file);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        unsigned int local_port;
+        if (sscanf(line, " %*u: %*x:%x", &local_port) != 1 || local_port != port) {
+            continue;
+        }
+
+        char *last_column = NULL;
+        for (char *token = strtok(line, " \n"); token; token = strtok(NULL, " \n")) {
+            last_column = token;
+        }
+        if (last_column) {
+            drops += strtoull(last_column, NULL, 10);
+        }
+    }
+
+    fclose(file);
+    return drops;
+}
+
+void create_fake_neighbors(LoadGenerator *load) {
+    LoadConfig *config = &load->config;
+    load->neighbors = malloc(config->num_neighbors * sizeof(FakeNeighbor));
+
+    uint32_t base_ip;
+    memcpy(&base_ip, config->neighbor_base_ip, 4);
+    base_ip = ntohl(base_ip);
+
+    for (uint32_t i = 0; i < config->num_neighbors; i++) {
+        FakeNeighbor *neighbor = &load->neighbors[i];
+        uint32_t neighbor_ip = htonl(base_ip + i);
+        memcpy(neighbor->ip, &neighbor_ip, 4);
+        neighbor->router_id = 1000000 + i;
+        neighbor->next_entry = 0;
+
+        // every neighbor advertises the same prefixes with its own metrics
+        neighbor->table = malloc(config->num_prefixes * sizeof(RouterTableEntry));
+        for (uint32_t j = 0; j < config->num_prefixes; j++) {
+            RouterTableEntry *entry = &neighbor->table[j];
+            uint32_t destination = htonl(LOAD_PREFIX_BASE + (j << 8));
+            uint32_t netmask = htonl(0xffffff00);
+            memcpy(entry->destination, &destination, 4);
+            memcpy(entry->netmask, &netmask, 4);
+            memcpy(entry->gateway, neighbor->ip, 4);
+            memcpy(entry->interface, neighbor->ip, 4);
+            entry->metric = 1 + clock_random_below(&load->system_clock->clock, INFINITY_METRIC - 2);
+        }
+    }
+}
+
+/* next window of the neighbor's table, churned entries get a new metric.
+ * returns the packet size
+ * */
+uint32_t build_load_packet(LoadGenerator *load, FakeNeighbor *neighbor, uint32_t *num_entries) {
+    LoadConfig *config = &load->config;
+    Clock *clock = &load->system_clock->clock;
+
+    *num_entries = config->entries_per_packet < config->num_prefixes
+        ? config->entries_per_packet
+        : config->num_prefixes;
+
+    memcpy(load->packet, neighbor->ip, 4);
+    memcpy(load->packet + 4, &neighbor->router_id, 4);
+    memcpy(load->packet + 8, num_entries, 4);
+
+    for (uint32_t i = 0; i < *num_entries; i++) {
+        RouterTableEntry *entry = &neighbor->table[neighbor->next_entry];
+        if (config->churn > 0 && clock_random_unit(clock) < config->churn) {
+            entry->metric = 1 + clock_random_below(clock, INFINITY_METRIC - 2);
+        }
+
+        memcpy(load->packet + ROUTER_PACKET_HEADER_SIZE + i * sizeof(RouterTableEntry),
+                entry, sizeof(RouterTableEntry));
+        neighbor->next_entry = (neighbor->next_entry + 1) % config->num_prefixes;
+    }
+
+    return ROUTER_PACKET_HEADER_SIZE + *num_entries * sizeof(RouterTableEntry);
+}
+
+int send_load_packet(LoadGenerator *load, uint8_t *packet, uint32_t packet_size, LoadStats *stats) {
+    ssize_t send_res = sendto(load->sock,
+            packet, packet_size,
+            0,
+            (struct sockaddr*) &load->broadcast_addr,
+            sizeof(load->broadcast_addr)
+    );
+    if (send_res < 0) {
+        // ENOBUFS and friends, the packet never left
+        stats->send_errors += 1;
+        return -1;
+    }
+
+    stats->packets_sent += 1;
+    return 0;
+}
+
+/* a recording that can't be written is closed, the load goes on
+ * without it
+ * */
+void record_load_packet(LoadGenerator *load, uint8_t *packet, uint32_t packet_size) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    LoadRecordHeader header = {
+        .at_us = get_elapsed_seconds(&load->record_start, &now) * 1e6,
+        .packet_size = packet_size
+    };
+    if (fwrite(&header, sizeof(header), 1, load->record_file) != 1 ||
+            fwrite(packet, packet_size, 1, load->record_file) != 1) {
+        perror("record file write failed, recording stopped");
+        fclose(load->record_file);
+        load->record_file = NULL;
+    }
+}
+
+/* round robin over the neighbors at rate packets/s for seconds
+ * */
+void run_load_step(LoadGenerator *load, uint32_t rate, uint32_t seconds, LoadStats *stats) {
+    memset(stats, 0, sizeof(LoadStats));
+
+    struct timespec start, now, next_send;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next_send = start;
+    const uint64_t interval_ns = rate > 0 ? 1000000000ULL / rate : 0;
+
+    uint32_t curr_neighbor = 0;
+    do {
+        FakeNeighbor *neighbor = &load->neighbors[curr_neighbor];
+        curr_neighbor = (curr_neighbor + 1) % load->config.num_neighbors;
+
+        uint32_t num_entries;
+        uint32_t packet_size = build_load_packet(load, neighbor, &num_entries);
+        if (send_load_packet(load, load->packet, packet_size, stats) == 0) {
+            stats->entries_sent += num_entries;
+            if (load->record_file) {
+                record_load_packet(load, load->packet, packet_size);
+            }
+        }
+
+        if (interval_ns > 0) {
+            add_ns_to_timespec(&next_send, interval_ns);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_send, NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (get_elapsed_seconds(&start, &now) < seconds);
+
+    stats->seconds = get_elapsed_seconds(&start, &now);
+}
+
+/* sends a recording with its original gaps, scaled by replay_speed
+ * */
+int run_replay(LoadGenerator *load, LoadStats *stats) {
+    memset(stats, 0, sizeof(LoadStats));
+
+    FILE *file = fopen(load->config.replay_filename, "rb");
+    if (!file) {
+        perror("replay file open failed");
+        return -1;
+    }
+
+    char magic[sizeof(LOAD_RECORD_MAGIC)];
+    if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, LOAD_RECORD_MAGIC, sizeof(magic)) != 0) {
+        errno = EINVAL;
+        perror("not a rip-load recording");
+        fclose(file);
+        return -1;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    LoadRecordHeader header;
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.packet_size > BUFFER_SIZE) {
+            errno = EINVAL;
+            perror("corrupt rip-load recording");
+            fclose(file);
+            return -1;
+        }
+        if (fread(load->packet, header.packet_size, 1, file) != 1) {
+            break;
+        }
+
+        uint8_t sender_ip[4];
+        uint32_t sender_router_id;
+        uint32_t num_entries;
+        if (parse_router_packet(load->packet, header.packet_size, sender_ip, &sender_router_id, &num_entries) < 0) {
+            // shorter than a router packet header, not worth sending
+            continue;
+        }
+
+        if (load->config.replay_speed > 0) {
+            struct timespec send_at = start;
+            add_ns_to_timespec(&send_at, header.at_us * 1000 / load->config.replay_speed);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &send_at, NULL);
+        }
+
+        if (send_load_packet(load, load->packet, header.packet_size, stats) == 0) {
+            stats->entries_sent += num_entries;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats->seconds = get_elapsed_seconds(&start, &now);
+    fclose(file);
+    return 0;
+}
+
+/* one line per step, returns the share of sent packets the router missed
+ * */
+double print_load_step(LoadGenerator *load, LoadStats *stats,
+        RouterStats *before, uint64_t kernel_drops_before) {
+
+    const uint64_t kernel_drops = get_kernel_udp_drops(BROADCAST_PORT) - kernel_drops_before;
+    printf("sent %8.0f pkt/s %10.0f entries/s", stats->packets_sent / stats->seconds, stats->entries_sent / stats->seconds);
+    if (stats->send_errors > 0) {
+        printf(", send errors %lu", stats->send_errors);
+    }
+
+    double drop_ratio = (double) kernel_drops / (stats->packets_sent > 0 ? stats->packets_sent : 1);
+    RouterStats after;
+    if (load->config.router_id != 0 && read_router_stats(load->config.router_id, &after) == 0) {
+        const uint64_t packets_applied = after.updates_applied - before->updates_applied;
+        const uint64_t packets_missed = stats->packets_sent > packets_applied ? stats->packets_sent - packets_applied : 0;
+        drop_ratio = (double) packets_missed / (stats->packets_sent > 0 ? stats->packets_sent : 1);
+
+        printf(" | applied %8.0f pkt/s %10.0f entries/s, %8.0f route changes/s",
+                packets_applied / stats->seconds,
+                (after.entries_applied - before->entries_applied) / stats->seconds,
+                (after.routes_changed - before->routes_changed) / stats->seconds);
+    }
+    printf(" | kernel drops %lu, dropped %.2f%%\n", kernel_drops, drop_ratio * 100);
+
+    return drop_ratio;
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr,
+        "Usage: %s [-b broadcast_ip] [-N first_neighbor_ip] [-n neighbors]\n"
+        "          [-p prefixes] [-e entries_per_packet] [-c churn]\n"
+        "          [-r packets_per_s] [-t seconds] [-R] [-m max_drop_ratio]\n"
+        "          [-i router_id] [-w record_file] [-P replay_file] [-x speed] [-s seed]\n",
+        program);
+}
+
+int parse_ip_arg(const char *arg, uint8_t *ip) {
+    if (!is_valid_ip(arg) || inet_pton(AF_INET, arg, ip) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    LoadGenerator load;
+    memset(&load, 0, sizeof(load));
+    LoadConfig *config = &load.config;
+    parse_ip_arg("127.255.255.255", config->broadcast_ip);
+    parse_ip_arg("127.1.0.1", config->neighbor_base_ip);
+    config->num_neighbors = 16;
+    config->num_prefixes = 64;
+    config->entries_per_packet = ROUTER_TABLE_MAX_SIZE;
+    config->rate = LOAD_DEFAULT_RATE;
+    config->step_seconds = 5;
+    config->max_drop_ratio = 0.01;
+    config->replay_speed = 1;
+    config->seed = time(NULL);
+
+    int opt;
+    int ip_rc = 0;
+    while ((opt = getopt(argc, argv, "b:N:n:p:e:c:r:t:Rm:i:w:P:x:s:")) != -1) {
+        switch (opt) {
+            case 'b': ip_rc |= parse_ip_arg(optarg, config->broadcast_ip); break;
+            case 'N': ip_rc |= parse_ip_arg(optarg, config->neighbor_base_ip); break;
+            case 'n': config->num_neighbors = atoi(optarg); break;
+            case 'p': config->num_prefixes = atoi(optarg); break;
+            case 'e': config->entries_per_packet = atoi(optarg); break;
+            case 'c': config->churn = atof(optarg); break;
+            case 'r': config->rate = atoi(optarg); break;
+            case 't': config->step_seconds = atoi(optarg); break;
+            case 'R': config->is_ramp = 1; break;
+            case 'm': config->max_drop_ratio = atof(optarg); break;
+            case 'i': config->router_id = atoi(optarg); break;
+            case 'w': config->record_filename = optarg; break;
+            case 'P': config->replay_filename = optarg; break;
+            case 'x': config->replay_speed = atof(optarg); break;
+            case 's': config->seed = strtoull(optarg, NULL, 10); break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    // rip_listen reads at most BUFFER_SIZE - 1 bytes
+    const uint32_t max_entries_per_packet = (BUFFER_SIZE - 1 - ROUTER_PACKET_HEADER_SIZE) / sizeof(RouterTableEntry);
+    if (ip_rc < 0 || config->num_neighbors == 0 || config->num_prefixes == 0 ||
+            config->entries_per_packet == 0 || config->entries_per_packet > max_entries_per_packet ||
+            config->churn < 0 || config->churn > 1 || config->step_seconds == 0 ||
+            (config->is_ramp && config->rate == 0)) {
+        print_usage(argv[0]);
+        errno = EINVAL;
+        perror("Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    setbuf(stdout, NULL);
+    enable_logging = 0;
+    load.system_clock = create_system_clock(config->seed);
+    load.packet = malloc(BUFFER_SIZE);
+
+    load.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (load.sock < 0) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int broadcast_enable = 1;
+    if (setsockopt(load.sock, SOL_SOCKET, SO_BROADCAST, &broadcast_enable, sizeof(broadcast_enable)) < 0) {
+        perror("setsockopt failed");
+        close(load.sock);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(&load.broadcast_addr, 0, sizeof(load.broadcast_addr));
+    load.broadcast_addr.sin_family = AF_INET;
+    load.broadcast_addr.sin_port = htons(BROADCAST_PORT);
+    memcpy(&load.broadcast_addr.sin_addr.s_addr, config->broadcast_ip, 4);
+
+    RouterStats router_before;
+    memset(&router_before, 0, sizeof(router_before));
+    if (config->router_id != 0 && read_router_stats(config->router_id, &router_before) < 0) {
+        perror("router control socket unreachable");
+        close(load.sock);
+        exit(EXIT_FAILURE);
+    }
+
+    LoadStats stats;
+    uint64_t kernel_drops_before = get_kernel_udp_drops(BROADCAST_PORT);
+
+    if (config->replay_filename) {
+        if (run_replay(&load, &stats) < 0) {
+            close(load.sock);
+            exit(EXIT_FAILURE);
+        }
+        usleep(LOAD_DRAIN_MS * 1000);
+        print_load_step(&load, &stats, &router_before, kernel_drops_before);
+    } else {
+        if (config->record_filename) {
+            load.record_file = fopen(config->record_filename, "wb");
+            if (!load.record_file) {
+                perror("record file open failed");
+                close(load.sock);
+                exit(EXIT_FAILURE);
+            }
+            if (fwrite(LOAD_RECORD_MAGIC, sizeof(LOAD_RECORD_MAGIC), 1, load.record_file) != 1) {
+                perror("record file write failed");
+                fclose(load.record_file);
+                close(load.sock);
+                exit(EXIT_FAILURE);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &load.record_start);
+        }
+        create_fake_neighbors(&load);
+
+        uint32_t rate = config->rate;
+        uint32_t saturation_rate = 0;
+        for (uint32_t step = 0; step < (config->is_ramp ? LOAD_MAX_RAMP_STEPS : 1); step++) {
+            run_load_step(&load, rate, config->step_seconds, &stats);
+            usleep(LOAD_DRAIN_MS * 1000);
+            double drop_ratio = print_load_step(&load, &stats, &router_before, kernel_drops_before);
+            if (drop_ratio > config->max_drop_ratio) {
+                break;
+            }
+            saturation_rate = rate;
+            rate *= 2;
+
+            if (config->router_id != 0) {
+                read_router_stats(config->router_id, &router_before);
+            }
+            kernel_drops_before = get_kernel_udp_drops(BROADCAST_PORT);
+        }
+
+        if (config->is_ramp) {
+            printf("highest rate without drops: %u pkt/s\n", saturation_rate);
+        }
+
+        for (uint32_t i = 0; i < config->num_neighbors; i++) {
+            free(load.neighbors[i].table);
+        }
+        free(load.neighbors);
+        // buffered writes fail only here
+        if (load.record_file && fclose(load.record_file) != 0) {
+            perror("record file write failed");
+        }
+    }
+
+    free(load.packet);
+    free_system_clock(load.system_clock);
+    close(load.sock);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,267 @@
+#include <first.h>
+#include <router.h>
+#include <config.h>
+#include <capture.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* feeds a capture back into the update logic of one router, offline and
+ * as fast as possible.
+ *
+ * the router starts from its riptbl like peer-listen does. every captured
+ * datagram that reached the broadcast address of one of its interfaces is
+ * applied the way rip_listen applies it, and the life table ages at every
+ * TIME_FOR_LIFE_DROP of capture time. the same capture always ends in the
+ * same tables, which the checksum at the end shows
+ * */
+
+typedef struct {
+    uint64_t timestamp_ns;
+    uint8_t dst_ip[4];
+    uint32_t size;
+    // copy of the datagram, at most BUFFER_SIZE - 1 bytes
+    uint8_t *data;
+} ReplayPacket;
+
+typedef struct {
+    ReplayPacket *packets;
+    uint32_t num_packets;
+    uint32_t max_packets;
+} ReplayCorpus;
+
+double get_elapsed_ms(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 +
+        (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* the whole capture is read before the clock starts
+ * */
+int load_replay_corpus(const char *filename, ReplayCorpus *corpus) {
+    CaptureReader reader;
+    if (open_capture_reader(filename, &reader) < 0) {
+        return -1;
+    }
+
+    memset(corpus, 0, sizeof(ReplayCorpus));
+    CapturedPacket captured;
+    int read_rc;
+    while ((read_rc = read_captured_packet(&reader, &captured)) == 1) {
+        if (corpus->num_packets == corpus->max_packets) {
+            corpus->max_packets = corpus->max_packets > 0 ? 2 * corpus->max_packets : 1024;
+            corpus->packets = realloc(corpus->packets, corpus->max_packets * sizeof(ReplayPacket));
+        }
+
+        ReplayPacket *packet = &corpus->packets[corpus->num_packets++];
+        packet->timestamp_ns = captured.timestamp_ns;
+        memcpy(packet->dst_ip, captured.dst_ip, 4);
+        // rip_listen never reads more than BUFFER_SIZE - 1 bytes
+        packet->size = captured.size < BUFFER_SIZE - 1 ? captured.size : BUFFER_SIZE - 1;
+        packet->data = malloc(packet->size);
+        memcpy(packet->data, captured.data, packet->size);
+    }
+
+    close_capture_reader(&reader);
+    return read_rc < 0 ? -1 : 0;
+}
+
+void free_replay_corpus(ReplayCorpus *corpus) {
+    for (uint32_t i = 0; i < corpus->num_packets; i++) {
+        free(corpus->packets[i].data);
+    }
+    free(corpus->packets);
+}
+
+RouterState* create_replay_router_state(uint32_t router_id, RipType rip_type) {
+    RouterConfig config;
+    if (read_router_config(router_id, &config) < 0) {
+        return NULL;
+    }
+
+    RouterState *router_state = calloc(1, sizeof(RouterState));
+    router_state->router_id = router_id;
+    router_state->rip_type = rip_type;
+    router_state->wakeup_fd = -1;
+    router_state->max_interfaces = config.num_interfaces > MAX_NUM_INTERFACES
+        ? config.num_interfaces
+        : MAX_NUM_INTERFACES;
+    router_state->max_entries = ROUTER_TABLE_MAX_SIZE + config.num_interfaces + config.num_static_routes;
+    router_state->interfaces = malloc(router_state->max_interfaces * sizeof(InterfaceTableEntry));
+    router_state->router_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
+    router_state->life_table = malloc(router_state->max_entries * sizeof(LifeTableEntry));
+
+    int add_config_rc = add_config_to_state(router_state, &config);
+    free_router_config(&config);
+    if (add_config_rc < 0) {
+        free(router_state->interfaces);
+        free(router_state->router_table);
+        free(router_state->life_table);
+        free(router_state);
+        return NULL;
+    }
+
+    return router_state;
+}
+
+void free_replay_router_state(RouterState *router_state) {
+    free(router_state->interfaces);
+    free(router_state->router_table);
+    free(router_state->life_table);
+    free_table_index(&router_state->route_index);
+    free_table_index(&router_state->life_index);
+    free(router_state);
+}
+
+/* rip_listen and gateway_life_clock of one router over the corpus.
+ * returns the number of applied datagrams
+ * */
+uint32_t replay_corpus(RouterState *router_state, ReplayCorpus *corpus, uint64_t *num_entries) {
+    RouterTableEntry *received_table = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry));
+    const uint64_t life_drop_ns = (uint64_t) TIME_FOR_LIFE_DROP * 1000000000ULL;
+    uint64_t next_life_drop_ns = corpus->num_packets > 0 ? corpus->packets[0].timestamp_ns + life_drop_ns : 0;
+    uint32_t num_applied = 0;
+    *num_entries = 0;
+
+    for (uint32_t i = 0; i < corpus->num_packets; i++) {
+        ReplayPacket *packet = &corpus->packets[i];
+
+        while (packet->timestamp_ns >= next_life_drop_ns) {
+            age_life_table(router_state, router_state->interfaces[0].interface_ip);
+            next_life_drop_ns += life_drop_ns;
+        }
+
+        InterfaceTableEntry *curr_interface = NULL;
+        for (uint32_t j = 0; j < router_state->num_interfaces; j++) {
+            uint8_t broadcast_ip[4];
+            get_broadcast_ip(router_state->interfaces[j].interface_ip,
+                    router_state->interfaces[j].interface_netmask,
+                    broadcast_ip
+            );
+            if (match_ips(broadcast_ip, packet->dst_ip)) {
+                curr_interface = &router_state->interfaces[j];
+                break;
+            }
+        }
+        if (!curr_interface) {
+            // not on any of this router's segments
+            continue;
+        }
+
+        uint8_t sender_ip[4];
+        uint32_t sender_router_id;
+        uint32_t num_received;
+        if (parse_router_packet(packet->data, packet->size,
+                    sender_ip, &sender_router_id, &num_received) < 0 ||
+                match_ips(sender_ip, curr_interface->interface_ip)) {
+            continue;
+        }
+
+        if (num_received > ROUTER_TABLE_MAX_SIZE) {
+            num_received = ROUTER_TABLE_MAX_SIZE;
+        }
+        memcpy(received_table,
+                packet->data + ROUTER_PACKET_HEADER_SIZE,
+                num_received * sizeof(RouterTableEntry));
+
+        apply_router_update(router_state, curr_interface, sender_ip, received_table, num_received);
+        num_applied += 1;
+        *num_entries += num_received;
+    }
+
+    free(received_table);
+    return num_applied;
+}
+
+int main(int argc, char *argv[]) {
+    RipType rip_type = RIP_DYNAMIC;
+    uint32_t num_repetitions = 1;
+    int is_dump = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "sn:d")) != -1) {
+        switch (opt) {
+            case 's': rip_type = RIP_STATIC; break;
+            case 'n': num_repetitions = atoi(optarg); break;
+            case 'd': is_dump = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s] [-n repetitions] [-d] <router_id> <capture.pcap>\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 2 || num_repetitions == 0) {
+        fprintf(stderr, "Usage: %s [-s] [-n repetitions] [-d] <router_id> <capture.pcap>\n", argv[0]);
+        errno = EINVAL;
+        perror("Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    setbuf(stdout, NULL);
+    enable_logging = 0;
+    uint32_t router_id = atoi(argv[optind]);
+
+    ReplayCorpus corpus;
+    if (load_replay_corpus(argv[optind + 1], &corpus) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // every repetition starts from the riptbl again
+    double best_ms = 0;
+    RouterState *router_state = NULL;
+    uint32_t num_applied = 0;
+    uint64_t num_entries = 0;
+    for (uint32_t i = 0; i < num_repetitions; i++) {
+        if (router_state) {
+            free_replay_router_state(router_state);
+        }
+        router_state = create_replay_router_state(router_id, rip_type);
+        if (!router_state) {
+            free_replay_corpus(&corpus);
+            exit(EXIT_FAILURE);
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        num_applied = replay_corpus(router_state, &corpus, &num_entries);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double elapsed_ms = get_elapsed_ms(&start, &end);
+        if (i == 0 || elapsed_ms < best_ms) {
+            best_ms = elapsed_ms;
+        }
+    }
+
+    uint32_t checksum = FNV1A_OFFSET_BASIS;
+    checksum = fnv1a(checksum, router_state->router_table, router_state->num_entries * sizeof(RouterTableEntry));
+    checksum = fnv1a(checksum, router_state->life_table, router_state->life_entries * sizeof(LifeTableEntry));
+
+    printf("datagrams in capture  %u\n", corpus.num_packets);
+    printf("datagrams applied     %u\n", num_applied);
+    printf("entries applied       %lu\n", num_entries);
+    printf("routes changed        %lu\n", atomic_load(&router_state->routes_changed));
+    printf("replay time           %.3f ms (best of %u)\n", best_ms, num_repetitions);
+    if (num_entries > 0) {
+        printf("per entry             %.1f ns\n", best_ms * 1000000.0 / num_entries);
+    }
+    printf("final table           %u routes, %u gateways, checksum %08x\n",
+            router_state->num_entries, router_state->life_entries, checksum);
+
+    if (is_dump) {
+        for (uint32_t i = 0; i < router_state->num_entries; i++) {
+            RouterTableEntry *entry = &router_state->router_table[i];
+            printf("%u.%u.%u.%u %u.%u.%u.%u %u.%u.%u.%u %u.%u.%u.%u %u\n",
+                    entry->destination[0], entry->destination[1], entry->destination[2], entry->destination[3],
+                    entry->netmask[0], entry->netmask[1], entry->netmask[2], entry->netmask[3],
+                    entry->gateway[0], entry->gateway[1], entry->gateway[2], entry->gateway[3],
+                    entry->interface[0], entry->interface[1], entry->interface[2], entry->interface[3],
+                    entry->metric);
+        }
+    }
+
+    free_replay_router_state(router_state);
+    free_replay_corpus(&corpus);
+    exit(EXIT_SUCCESS);
+}
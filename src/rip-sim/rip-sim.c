@@ -0,0 +1,697 @@
+#include <first.h>
+#include <router.h>
+#include <clock.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* in-process network simulator.
+ *
+ * every router is a plain RouterState driven by the same update logic as
+ * peer-listen (router.c). segments stand in for the UDP broadcast domain:
+ * a broadcast on an interface reaches every other member of its segment.
+ * ring, grid and random topologies use point-to-point segments (a /30 per
+ * link), lan a ring of shared segments of segment_size routers, where
+ * neighboring segments share one router.
+ * broadcasts, life table ticks and deliveries are events on a virtual
+ * clock, so nothing ever sleeps and a seed replays the same run
+ * */
+
+typedef enum {
+    TOPOLOGY_RING,
+    TOPOLOGY_GRID,
+    TOPOLOGY_RANDOM,
+    TOPOLOGY_LAN
+} SimTopology;
+
+typedef struct {
+    uint32_t num_routers;
+    SimTopology topology;
+    // average number of links per router for TOPOLOGY_RANDOM
+    uint32_t random_degree;
+    // routers on every shared segment for TOPOLOGY_LAN
+    uint32_t segment_size;
+    // probability that a single delivery is lost
+    double loss;
+    // delivery delay in ms
+    uint32_t min_delay;
+    uint32_t max_delay;
+    // segments taken down at fail_at (seconds)
+    uint32_t num_failures;
+    uint32_t fail_at;
+    uint32_t max_time;
+    uint64_t seed;
+    // peer-listen's table capacity and receive buffer limits,
+    // otherwise tables and packets grow as needed
+    int is_wire_limited;
+    int is_verbose;
+} SimConfig;
+
+typedef struct {
+    uint32_t router;
+    uint32_t interface_index;
+} SimMember;
+
+typedef struct {
+    // members[first_member] .. members[first_member + num_members - 1]
+    uint32_t first_member;
+    uint32_t num_members;
+    int is_up;
+} SimSegment;
+
+typedef struct Simulator Simulator;
+
+typedef struct {
+    Simulator *sim;
+    uint8_t *packet;
+    uint32_t packet_size;
+    uint32_t router;
+    uint32_t interface_index;
+} SimDelivery;
+
+typedef struct {
+    Simulator *sim;
+    uint32_t index;
+    RouterState *router_state;
+    // segment behind every interface
+    uint32_t *segments;
+} SimRouter;
+
+typedef struct {
+    uint64_t packets_sent;
+    uint64_t packets_delivered;
+    uint64_t packets_lost;
+    uint64_t packets_link_down;
+    uint64_t entries_delivered;
+    uint64_t routes_changed;
+    uint64_t last_change_at_ms;
+} SimStats;
+
+struct Simulator {
+    SimConfig config;
+    SimRouter *routers;
+    SimSegment *segments;
+    uint32_t num_segments;
+    SimMember *members;
+    uint32_t num_members;
+    // addresses per segment, a power of two with room for every member
+    uint32_t segment_block_size;
+    EventScheduler *scheduler;
+    // shared by every broadcast, grown with the largest table
+    uint8_t *packet;
+    uint32_t max_packet_entries;
+    int has_failed;
+    SimStats stats;
+    SimStats before_failure;
+};
+
+const uint32_t SIM_INITIAL_TABLE_SIZE = 64;
+const uint32_t SIM_DEFAULT_MAX_TIME = 600;
+const uint32_t SIM_DEFAULT_SEGMENT_SIZE = 4;
+
+void get_segment_address(Simulator *sim, uint32_t segment, uint32_t member, uint8_t *ip, uint8_t *netmask) {
+    const uint32_t address = (10u << 24) + segment * sim->segment_block_size + member + 1;
+    const uint32_t mask = ~(sim->segment_block_size - 1);
+    for (int i = 0; i < 4; i++) {
+        ip[i] = (address >> (24 - 8 * i)) & 0xff;
+        netmask[i] = (mask >> (24 - 8 * i)) & 0xff;
+    }
+}
+
+/* a segment of the distinct routers among routers[], none with fewer
+ * than two
+ * */
+int add_segment(Simulator *sim, uint32_t *max_segments, uint32_t *max_members,
+        uint32_t *routers, uint32_t num_routers) {
+
+    uint32_t num_distinct = 0;
+    for (uint32_t i = 0; i < num_routers; i++) {
+        uint32_t j = 0;
+        while (j < i && routers[j] != routers[i]) {
+            j++;
+        }
+        num_distinct += (j == i);
+    }
+    if (num_distinct < 2) {
+        return 0;
+    }
+
+    // 10.0.0.0/8 holds 2^24 addresses
+    if ((uint64_t) (sim->num_segments + 1) * sim->segment_block_size > (1u << 24)) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (sim->num_segments >= *max_segments) {
+        *max_segments *= 2;
+        sim->segments = realloc(sim->segments, *max_segments * sizeof(SimSegment));
+    }
+    while (sim->num_members + num_distinct > *max_members) {
+        *max_members *= 2;
+        sim->members = realloc(sim->members, *max_members * sizeof(SimMember));
+    }
+
+    SimSegment *segment = &sim->segments[sim->num_segments];
+    segment->first_member = sim->num_members;
+    segment->num_members = 0;
+    segment->is_up = 1;
+    for (uint32_t i = 0; i < num_routers; i++) {
+        uint32_t j = 0;
+        while (j < i && routers[j] != routers[i]) {
+            j++;
+        }
+        if (j == i) {
+            sim->members[sim->num_members++].router = routers[i];
+            segment->num_members += 1;
+        }
+    }
+    sim->num_segments += 1;
+    return 0;
+}
+
+int add_link(Simulator *sim, uint32_t *max_segments, uint32_t *max_members, uint32_t router_a, uint32_t router_b) {
+    uint32_t routers[2] = { router_a, router_b };
+    return add_segment(sim, max_segments, max_members, routers, 2);
+}
+
+int build_topology(Simulator *sim) {
+    const uint32_t num_routers = sim->config.num_routers;
+    uint32_t max_segments = 2 * num_routers;
+    sim->segments = malloc(max_segments * sizeof(SimSegment));
+    sim->num_segments = 0;
+    uint32_t max_members = 4 * num_routers;
+    sim->members = malloc(max_members * sizeof(SimMember));
+    sim->num_members = 0;
+
+    // the network and broadcast addresses, then one per member
+    const uint32_t members_per_segment = sim->config.topology == TOPOLOGY_LAN ? sim->config.segment_size : 2;
+    sim->segment_block_size = 4;
+    while (sim->segment_block_size < members_per_segment + 2) {
+        sim->segment_block_size *= 2;
+    }
+
+    int add_rc = 0;
+    if (sim->config.topology == TOPOLOGY_LAN) {
+        const uint32_t step = sim->config.segment_size - 1;
+        const uint32_t num_lans = (num_routers + step - 1) / step;
+        uint32_t *routers = malloc(sim->config.segment_size * sizeof(uint32_t));
+        for (uint32_t i = 0; i < num_lans && add_rc == 0; i++) {
+            for (uint32_t j = 0; j < sim->config.segment_size; j++) {
+                routers[j] = (i * step + j) % num_routers;
+            }
+            add_rc = add_segment(sim, &max_segments, &max_members, routers, sim->config.segment_size);
+        }
+        free(routers);
+    } else if (sim->config.topology == TOPOLOGY_GRID) {
+        uint32_t side = 1;
+        while (side * side < num_routers) {
+            side += 1;
+        }
+
+        for (uint32_t i = 0; i < num_routers && add_rc == 0; i++) {
+            if ((i % side) + 1 < side && i + 1 < num_routers) {
+                add_rc = add_link(sim, &max_segments, &max_members, i, i + 1);
+            }
+            if (add_rc == 0 && i + side < num_routers) {
+                add_rc = add_link(sim, &max_segments, &max_members, i, i + side);
+            }
+        }
+    } else {
+        // a ring keeps the random topology connected
+        for (uint32_t i = 0; i < num_routers && add_rc == 0; i++) {
+            if (num_routers > 2 || i == 0) {
+                add_rc = add_link(sim, &max_segments, &max_members, i, (i + 1) % num_routers);
+            }
+        }
+
+        if (sim->config.topology == TOPOLOGY_RANDOM && sim->config.random_degree > 2) {
+            const uint64_t num_extra_links = (uint64_t) num_routers * (sim->config.random_degree - 2) / 2;
+            for (uint64_t i = 0; i < num_extra_links && add_rc == 0; i++) {
+                add_rc = add_link(sim, &max_segments, &max_members,
+                        clock_random_below(&sim->scheduler->clock, num_routers),
+                        clock_random_below(&sim->scheduler->clock, num_routers)
+                );
+            }
+        }
+    }
+
+    return add_rc;
+}
+
+void grow_sim_router_tables(RouterState *router_state, uint32_t needed_entries) {
+    if (needed_entries <= router_state->max_entries) {
+        return;
+    }
+
+    uint32_t new_max_entries = router_state->max_entries;
+    while (new_max_entries < needed_entries) {
+        new_max_entries *= 2;
+    }
+
+    router_state->router_table = realloc(router_state->router_table, new_max_entries * sizeof(RouterTableEntry));
+    router_state->life_table = realloc(router_state->life_table, new_max_entries * sizeof(LifeTableEntry));
+    router_state->max_entries = new_max_entries;
+}
+
+int create_routers(Simulator *sim) {
+    const uint32_t num_routers = sim->config.num_routers;
+    sim->routers = calloc(num_routers, sizeof(SimRouter));
+
+    uint32_t *num_links = calloc(num_routers, sizeof(uint32_t));
+    for (uint32_t i = 0; i < sim->num_members; i++) {
+        num_links[sim->members[i].router] += 1;
+    }
+
+    for (uint32_t i = 0; i < num_routers; i++) {
+        RouterState *router_state = calloc(1, sizeof(RouterState));
+        router_state->router_id = i + 1;
+        router_state->rip_type = RIP_DYNAMIC;
+        router_state->max_interfaces = num_links[i];
+        router_state->interfaces = malloc((num_links[i] + 1) * sizeof(InterfaceTableEntry));
+        // same capacity as startup_router gives a router with these interfaces
+        router_state->max_entries = sim->config.is_wire_limited
+            ? ROUTER_TABLE_MAX_SIZE + num_links[i]
+            : SIM_INITIAL_TABLE_SIZE;
+        router_state->router_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
+        router_state->life_table = malloc(router_state->max_entries * sizeof(LifeTableEntry));
+        router_state->clock = &sim->scheduler->clock;
+        router_state->rand_delay = clock_random_below(router_state->clock, RAND_DELAY_SPREAD) + RAND_DELAY_BONUS;
+        router_state->wakeup_fd = -1;
+
+        sim->routers[i].sim = sim;
+        sim->routers[i].index = i;
+        sim->routers[i].router_state = router_state;
+        sim->routers[i].segments = malloc((num_links[i] + 1) * sizeof(uint32_t));
+    }
+    free(num_links);
+
+    for (uint32_t i = 0; i < sim->num_segments; i++) {
+        SimSegment *segment = &sim->segments[i];
+        for (uint32_t j = 0; j < segment->num_members; j++) {
+            SimMember *member = &sim->members[segment->first_member + j];
+            SimRouter *sim_router = &sim->routers[member->router];
+            RouterState *router_state = sim_router->router_state;
+            InterfaceTableEntry *interface = &router_state->interfaces[router_state->num_interfaces];
+
+            get_segment_address(sim, i, j, interface->interface_ip, interface->interface_netmask);
+            sim_router->segments[router_state->num_interfaces] = i;
+            member->interface_index = router_state->num_interfaces;
+            router_state->num_interfaces += 1;
+        }
+    }
+
+    return 0;
+}
+
+void delivery_event(void *arg);
+
+void schedule_delivery(Simulator *sim,
+        uint8_t *packet, uint32_t packet_size,
+        uint32_t router, uint32_t interface_index) {
+
+    uint32_t delay_ms = sim->config.min_delay +
+        clock_random_below(&sim->scheduler->clock, sim->config.max_delay - sim->config.min_delay + 1);
+
+    SimDelivery *delivery = malloc(sizeof(SimDelivery));
+    delivery->sim = sim;
+    delivery->packet = malloc(packet_size);
+    memcpy(delivery->packet, packet, packet_size);
+    delivery->packet_size = packet_size;
+    delivery->router = router;
+    delivery->interface_index = interface_index;
+
+    schedule_event(sim->scheduler, delay_ms, delivery_event, delivery);
+}
+
+/* rip_broadcaster: one packet per interface, heard by every other member
+ * of its segment (each delivery is lost on its own), then sleep rand_delay
+ * */
+void broadcast_event(void *arg) {
+    SimRouter *sim_router = (SimRouter*) arg;
+    Simulator *sim = sim_router->sim;
+    RouterState *router_state = sim_router->router_state;
+
+    if (router_state->num_entries > sim->max_packet_entries) {
+        sim->max_packet_entries = router_state->max_entries;
+        sim->packet = realloc(sim->packet, get_max_router_packet_size(sim->max_packet_entries));
+    }
+
+    for (uint32_t i = 0; i < router_state->num_interfaces; i++) {
+        const uint32_t packet_size = build_router_packet(router_state,
+                router_state->router_table, router_state->num_entries,
+                &router_state->interfaces[i],
+                sim->packet
+        );
+        sim->stats.packets_sent += 1;
+        atomic_fetch_add(&router_state->packets_sent, 1);
+
+        SimSegment *segment = &sim->segments[sim_router->segments[i]];
+        if (!segment->is_up) {
+            sim->stats.packets_link_down += 1;
+            continue;
+        }
+
+        for (uint32_t j = 0; j < segment->num_members; j++) {
+            SimMember *member = &sim->members[segment->first_member + j];
+            if (member->router == sim_router->index) {
+                continue;
+            }
+
+            if (sim->config.loss > 0 && clock_random_unit(router_state->clock) < sim->config.loss) {
+                sim->stats.packets_lost += 1;
+                continue;
+            }
+
+            schedule_delivery(sim, sim->packet, packet_size, member->router, member->interface_index);
+        }
+    }
+
+    schedule_event(sim->scheduler, (uint64_t) router_state->rand_delay * 1000, broadcast_event, sim_router);
+}
+
+/* gateway_life_clock
+ * */
+void life_event(void *arg) {
+    SimRouter *sim_router = (SimRouter*) arg;
+    RouterState *router_state = sim_router->router_state;
+
+    age_life_table(router_state, router_state->interfaces[0].interface_ip);
+    schedule_event(sim_router->sim->scheduler, (uint64_t) TIME_FOR_LIFE_DROP * 1000, life_event, sim_router);
+}
+
+/* rip_listen
+ * */
+void delivery_event(void *arg) {
+    SimDelivery *delivery = (SimDelivery*) arg;
+    Simulator *sim = delivery->sim;
+    RouterState *router_state = sim->routers[delivery->router].router_state;
+    InterfaceTableEntry *curr_interface = &router_state->interfaces[delivery->interface_index];
+
+    // rip_listen receives at most BUFFER_SIZE - 1 bytes and ROUTER_TABLE_MAX_SIZE entries
+    uint32_t packet_size = delivery->packet_size;
+    if (sim->config.is_wire_limited && packet_size > BUFFER_SIZE - 1) {
+        packet_size = BUFFER_SIZE - 1;
+    }
+
+    uint8_t sender_ip[4];
+    uint32_t sender_router_id;
+    uint32_t num_received;
+    if (parse_router_packet(delivery->packet, packet_size,
+                sender_ip, &sender_router_id, &num_received) == 0) {
+
+        if (!sim->config.is_wire_limited) {
+            grow_sim_router_tables(router_state, router_state->num_entries + num_received);
+            grow_sim_router_tables(router_state, router_state->life_entries + num_received);
+        } else if (num_received > ROUTER_TABLE_MAX_SIZE) {
+            num_received = ROUTER_TABLE_MAX_SIZE;
+        }
+
+        sim->stats.packets_delivered += 1;
+        sim->stats.entries_delivered += num_received;
+        atomic_fetch_add(&router_state->packets_received, 1);
+        atomic_fetch_add(&router_state->entries_received, num_received);
+
+        // packets are malloced, so the entries are aligned
+        uint32_t num_changed = apply_router_update(router_state, curr_interface,
+                sender_ip,
+                (RouterTableEntry*) (delivery->packet + ROUTER_PACKET_HEADER_SIZE),
+                num_received
+        );
+        if (num_changed > 0) {
+            sim->stats.routes_changed += num_changed;
+            sim->stats.last_change_at_ms = clock_now_ms(router_state->clock);
+        }
+    }
+
+    free(delivery->packet);
+    free(delivery);
+}
+
+void failure_event(void *arg) {
+    Simulator *sim = (Simulator*) arg;
+    sim->before_failure = sim->stats;
+    sim->has_failed = 1;
+
+    uint32_t num_failed = 0;
+    for (uint32_t attempt = 0; num_failed < sim->config.num_failures && attempt < 4 * sim->num_segments; attempt++) {
+        SimSegment *segment = &sim->segments[clock_random_below(&sim->scheduler->clock, sim->num_segments)];
+        if (segment->is_up) {
+            segment->is_up = 0;
+            num_failed += 1;
+            if (sim->config.is_verbose && segment->num_members == 2) {
+                printf("t=%.3f: link %u <-> %u down\n", clock_now_ms(&sim->scheduler->clock) / 1000.0,
+                        sim->members[segment->first_member].router + 1,
+                        sim->members[segment->first_member + 1].router + 1);
+            } else if (sim->config.is_verbose) {
+                printf("t=%.3f: segment of %u routers from %u down\n", clock_now_ms(&sim->scheduler->clock) / 1000.0,
+                        segment->num_members, sim->members[segment->first_member].router + 1);
+            }
+        }
+    }
+}
+
+void progress_event(void *arg) {
+    Simulator *sim = (Simulator*) arg;
+    printf("t=%.0f: packets %lu, route changes %lu\n", clock_now_ms(&sim->scheduler->clock) / 1000.0,
+            sim->stats.packets_sent, sim->stats.routes_changed);
+    schedule_event(sim->scheduler, 10 * 1000, progress_event, sim);
+}
+
+void print_sim_summary(const char *phase, uint64_t phase_start_ms, SimStats *phase_stats) {
+    printf("%s\n", phase);
+    if (phase_stats->routes_changed > 0) {
+        printf("  converged after      %.3f s\n", (phase_stats->last_change_at_ms - phase_start_ms) / 1000.0);
+    } else {
+        printf("  converged after      - (no route changed)\n");
+    }
+    printf("  packets sent         %lu\n", phase_stats->packets_sent);
+    printf("  packets delivered    %lu\n", phase_stats->packets_delivered);
+    printf("  packets lost         %lu\n", phase_stats->packets_lost);
+    printf("  packets on down link %lu\n", phase_stats->packets_link_down);
+    printf("  entries delivered    %lu\n", phase_stats->entries_delivered);
+    printf("  routes changed       %lu\n", phase_stats->routes_changed);
+}
+
+void print_sim_tables_summary(Simulator *sim) {
+    uint64_t num_reachable = 0;
+    uint32_t max_entries = 0;
+    for (uint32_t i = 0; i < sim->config.num_routers; i++) {
+        RouterState *router_state = sim->routers[i].router_state;
+        for (uint32_t j = 0; j < router_state->num_entries; j++) {
+            if (router_state->router_table[j].metric < INFINITY_METRIC) {
+                num_reachable += 1;
+            }
+        }
+        if (router_state->num_entries > max_entries) {
+            max_entries = router_state->num_entries;
+        }
+    }
+
+    printf("tables\n");
+    printf("  reachable routes/router %.1f\n", (double) num_reachable / sim->config.num_routers);
+    printf("  largest table           %u\n", max_entries);
+}
+
+/* same seed and options must give the same checksum,
+ * anything else is a determinism bug
+ * */
+uint32_t get_sim_state_checksum(Simulator *sim) {
+    uint32_t checksum = FNV1A_OFFSET_BASIS;
+    for (uint32_t i = 0; i < sim->config.num_routers; i++) {
+        RouterState *router_state = sim->routers[i].router_state;
+        checksum = fnv1a(checksum, router_state->router_table, router_state->num_entries * sizeof(RouterTableEntry));
+        checksum = fnv1a(checksum, router_state->life_table, router_state->life_entries * sizeof(LifeTableEntry));
+    }
+
+    return checksum;
+}
+
+SimStats subtract_sim_stats(SimStats *later, SimStats *earlier) {
+    SimStats diff = *later;
+    diff.packets_sent -= earlier->packets_sent;
+    diff.packets_delivered -= earlier->packets_delivered;
+    diff.packets_lost -= earlier->packets_lost;
+    diff.packets_link_down -= earlier->packets_link_down;
+    diff.entries_delivered -= earlier->entries_delivered;
+    diff.routes_changed -= earlier->routes_changed;
+    return diff;
+}
+
+/* runs until max_time, or until nothing changed for long enough that
+ * every life table would have run out (no pending failure left)
+ * */
+void run_simulator(Simulator *sim) {
+    const uint64_t quiet_period_ms = ((MAX_GATEWAY_LIFE + 1) * TIME_FOR_LIFE_DROP +
+        RAND_DELAY_BONUS + RAND_DELAY_SPREAD) * 1000 + sim->config.max_delay;
+    const uint64_t max_time_ms = (uint64_t) sim->config.max_time * 1000;
+    const int has_failures = sim->config.num_failures > 0 && sim->config.fail_at <= sim->config.max_time;
+    EventScheduler *scheduler = sim->scheduler;
+
+    sim->max_packet_entries = SIM_INITIAL_TABLE_SIZE;
+    sim->packet = malloc(get_max_router_packet_size(sim->max_packet_entries));
+
+    // routers don't start in lockstep, same as containers coming up
+    for (uint32_t i = 0; i < sim->config.num_routers; i++) {
+        SimRouter *sim_router = &sim->routers[i];
+        schedule_event(scheduler,
+                clock_random_below(&scheduler->clock, sim_router->router_state->rand_delay * 1000),
+                broadcast_event, sim_router);
+        schedule_event(scheduler,
+                1 + clock_random_below(&scheduler->clock, TIME_FOR_LIFE_DROP * 1000),
+                life_event, sim_router);
+    }
+    if (has_failures) {
+        schedule_event(scheduler, (uint64_t) sim->config.fail_at * 1000, failure_event, sim);
+    }
+    if (sim->config.is_verbose) {
+        schedule_event(scheduler, 0, progress_event, sim);
+    }
+
+    uint64_t next_at_ms;
+    while (get_next_event_time(scheduler, &next_at_ms) && next_at_ms <= max_time_ms) {
+        if (has_failures && !sim->has_failed) {
+            run_next_event(scheduler);
+            continue;
+        }
+
+        // the failures themselves count as a change
+        uint64_t quiet_since_ms = sim->stats.last_change_at_ms;
+        if (has_failures && quiet_since_ms < (uint64_t) sim->config.fail_at * 1000) {
+            quiet_since_ms = (uint64_t) sim->config.fail_at * 1000;
+        }
+        if (next_at_ms > quiet_period_ms && next_at_ms - quiet_since_ms > quiet_period_ms) {
+            break;
+        }
+
+        run_next_event(scheduler);
+    }
+    free(sim->packet);
+
+    printf("simulated %.3f s\n", clock_now_ms(&scheduler->clock) / 1000.0);
+    if (has_failures) {
+        print_sim_summary("initial convergence", 0, &sim->before_failure);
+
+        SimStats after_failure = subtract_sim_stats(&sim->stats, &sim->before_failure);
+        print_sim_summary("after link failures", (uint64_t) sim->config.fail_at * 1000, &after_failure);
+    } else {
+        print_sim_summary("initial convergence", 0, &sim->stats);
+    }
+}
+
+void free_simulator(Simulator *sim) {
+    // deliveries still in flight own their packets
+    for (uint32_t i = 0; i < sim->scheduler->num_events; i++) {
+        if (sim->scheduler->events[i].callback == delivery_event) {
+            SimDelivery *delivery = sim->scheduler->events[i].arg;
+            free(delivery->packet);
+            free(delivery);
+        }
+    }
+    free_event_scheduler(sim->scheduler);
+
+    for (uint32_t i = 0; i < sim->config.num_routers; i++) {
+        RouterState *router_state = sim->routers[i].router_state;
+        free(router_state->interfaces);
+        free(router_state->router_table);
+        free(router_state->life_table);
+        free_table_index(&router_state->route_index);
+        free_table_index(&router_state->life_index);
+        free(router_state);
+        free(sim->routers[i].segments);
+    }
+    free(sim->routers);
+    free(sim->segments);
+    free(sim->members);
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr,
+        "usage: %s [-n routers] [-t ring|grid|random|lan] [-k degree] [-m segment_size]\n"
+        "          [-l loss] [-d min_delay_ms] [-D max_delay_ms]\n"
+        "          [-f failures] [-F fail_at] [-T max_time] [-s seed] [-w] [-v]\n",
+        program);
+}
+
+int main(int argc, char *argv[]) {
+    Simulator sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.config.num_routers = 100;
+    sim.config.topology = TOPOLOGY_GRID;
+    sim.config.random_degree = 4;
+    sim.config.segment_size = SIM_DEFAULT_SEGMENT_SIZE;
+    sim.config.max_time = SIM_DEFAULT_MAX_TIME;
+    sim.config.seed = time(NULL);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:k:m:l:d:D:f:F:T:s:wv")) != -1) {
+        switch (opt) {
+            case 'n': sim.config.num_routers = atoi(optarg); break;
+            case 'k': sim.config.random_degree = atoi(optarg); break;
+            case 'm': sim.config.segment_size = atoi(optarg); break;
+            case 'l': sim.config.loss = atof(optarg); break;
+            case 'd': sim.config.min_delay = atoi(optarg); break;
+            case 'D': sim.config.max_delay = atoi(optarg); break;
+            case 'f': sim.config.num_failures = atoi(optarg); break;
+            case 'F': sim.config.fail_at = atoi(optarg); break;
+            case 'T': sim.config.max_time = atoi(optarg); break;
+            case 's': sim.config.seed = strtoull(optarg, NULL, 10); break;
+            case 'w': sim.config.is_wire_limited = 1; break;
+            case 'v': sim.config.is_verbose = 1; break;
+            case 't':
+                if (strcmp(optarg, "ring") == 0) {
+                    sim.config.topology = TOPOLOGY_RING;
+                } else if (strcmp(optarg, "grid") == 0) {
+                    sim.config.topology = TOPOLOGY_GRID;
+                } else if (strcmp(optarg, "random") == 0) {
+                    sim.config.topology = TOPOLOGY_RANDOM;
+                } else if (strcmp(optarg, "lan") == 0) {
+                    sim.config.topology = TOPOLOGY_LAN;
+                } else {
+                    print_usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (sim.config.num_routers < 2 || sim.config.segment_size < 2 || sim.config.segment_size > 1024 ||
+            sim.config.loss < 0 || sim.config.loss > 1 ||
+            sim.config.max_delay < sim.config.min_delay) {
+        errno = EINVAL;
+        perror("Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    setbuf(stdout, NULL);
+    enable_logging = 0;
+    sim.scheduler = create_event_scheduler(sim.config.seed);
+
+    if (build_topology(&sim) < 0) {
+        perror("topology creation failed");
+        exit(EXIT_FAILURE);
+    }
+    create_routers(&sim);
+
+    printf("routers: %u, segments: %u, seed: %lu\n",
+            sim.config.num_routers, sim.num_segments, sim.config.seed);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run_simulator(&sim);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    print_sim_tables_summary(&sim);
+    printf("state checksum %08x\n", get_sim_state_checksum(&sim));
+    printf("wall time %.3f s\n",
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    free_simulator(&sim);
+    exit(EXIT_SUCCESS);
+}
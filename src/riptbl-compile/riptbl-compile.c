@@ -0,0 +1,157 @@
+#include <first.h>
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+const uint32_t BENCH_REPETITIONS = 5;
+
+double get_elapsed_ms(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 +
+        (end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+RouterState* create_bench_router_state(RouterConfig *config) {
+    RouterState *router_state = calloc(1, sizeof(RouterState));
+    router_state->rip_type = RIP_STATIC;
+    router_state->max_interfaces = config->num_interfaces;
+    router_state->max_entries = config->num_interfaces + config->num_static_routes;
+    router_state->interfaces = malloc(router_state->max_interfaces * sizeof(InterfaceTableEntry));
+    router_state->router_table = malloc(router_state->max_entries * sizeof(RouterTableEntry));
+    return router_state;
+}
+
+void free_bench_router_state(RouterState *router_state) {
+    free(router_state->interfaces);
+    free(router_state->router_table);
+    free_table_index(&router_state->route_index);
+    free(router_state);
+}
+
+/* one interface per 100 lines, the rest are static routes
+ * with prefix lengths between /24 and /30 behind those interfaces
+ * */
+int write_synthetic_riptbl(const char *filename, uint32_t num_lines) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("synthetic riptbl open failed");
+        return -1;
+    }
+
+    uint32_t num_interfaces = num_lines / 100 > 0 ? num_lines / 100 : 1;
+    for (uint32_t i = 0; i < num_interfaces; i++) {
+        fprintf(file, "10.%u.%u.1 255.255.255.0\n", (i >> 8) & 0xff, i & 0xff);
+    }
+
+    const char *netmasks[] = {
+        "255.255.255.0", "255.255.255.128", "255.255.255.192", "255.255.255.224",
+        "255.255.255.240", "255.255.255.248", "255.255.255.252"
+    };
+    for (uint32_t i = 0; i < num_lines - num_interfaces; i++) {
+        uint32_t gateway_interface = i % num_interfaces;
+        fprintf(file, "%u.%u.%u.0, %s, 10.%u.%u.254, %u\n",
+                172 + (i >> 16), (i >> 8) & 0xff, i & 0xff,
+                netmasks[i % 7],
+                (gateway_interface >> 8) & 0xff, gateway_interface & 0xff,
+                1 + i % 14
+        );
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int run_bench(uint32_t num_lines) {
+    char text_filename[] = "riptbl-bench.riptbl";
+    char compiled_filename[] = "riptbl-bench.riptblc";
+    if (write_synthetic_riptbl(text_filename, num_lines) < 0) {
+        return -1;
+    }
+
+    struct timespec start, end;
+    double text_ms = 0;
+    double compile_ms = 0;
+    double compiled_ms = 0;
+    uint32_t num_entries = 0;
+
+    for (uint32_t i = 0; i < BENCH_REPETITIONS; i++) {
+        RouterConfig config;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (read_riptbl_text(text_filename, &config) < 0) {
+            return -1;
+        }
+        RouterState *router_state = create_bench_router_state(&config);
+        add_config_to_state(router_state, &config);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        text_ms += get_elapsed_ms(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (write_compiled_riptbl(compiled_filename, &config) < 0) {
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        compile_ms += get_elapsed_ms(&start, &end);
+
+        free_router_config(&config);
+        free_bench_router_state(router_state);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (load_compiled_riptbl(compiled_filename, &config) < 0) {
+            return -1;
+        }
+        router_state = create_bench_router_state(&config);
+        add_config_to_state(router_state, &config);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        compiled_ms += get_elapsed_ms(&start, &end);
+
+        num_entries = router_state->num_entries;
+        free_router_config(&config);
+        free_bench_router_state(router_state);
+    }
+
+    printf("lines: %u, table entries: %u, repetitions: %u\n", num_lines, num_entries, BENCH_REPETITIONS);
+    printf("%-28s %10.3f ms\n", "text parse + insert", text_ms / BENCH_REPETITIONS);
+    printf("%-28s %10.3f ms\n", "compile (write .riptblc)", compile_ms / BENCH_REPETITIONS);
+    printf("%-28s %10.3f ms\n", "compiled load + insert", compiled_ms / BENCH_REPETITIONS);
+    printf("%-28s %10.1fx\n", "speedup", text_ms / compiled_ms);
+
+    unlink(text_filename);
+    unlink(compiled_filename);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "bench") == 0) {
+        uint32_t num_lines = atoi(argv[2]);
+        if (num_lines == 0) {
+            errno = EINVAL;
+            perror("Invalid arguments");
+            exit(EXIT_FAILURE);
+        }
+
+        exit(run_bench(num_lines) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <router_N.riptbl> <router_N.riptblc>\n", argv[0]);
+        fprintf(stderr, "       %s bench <num_lines>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    RouterConfig config;
+    if (read_riptbl_text(argv[1], &config) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    int write_rc = write_compiled_riptbl(argv[2], &config);
+    if (write_rc == 0) {
+        printf("%s: %u interfaces, %u static routes\n",
+                argv[2], config.num_interfaces, config.num_static_routes);
+    }
+
+    free_router_config(&config);
+    exit(write_rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
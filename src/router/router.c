@@ -0,0 +1,531 @@
+#include "router.h"
+#include <arpa/inet.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+const uint32_t ROUTER_PACKET_HEADER_SIZE = 12;
+
+void rebuild_life_index(RouterState *router_state) {
+    reset_table_index(&router_state->life_index, router_state->life_entries);
+    for (uint32_t i = 0; i < router_state->life_entries; i++) {
+        add_to_table_index(&router_state->life_index,
+                fnv1a(FNV1A_OFFSET_BASIS, router_state->life_table[i].gateway, 4),
+                i
+        );
+    }
+    router_state->life_index.num_indexed = router_state->life_entries;
+}
+
+int find_index_of_gateway_in_life_table(RouterState *router_state, uint8_t *gateway_to_find) {
+    TableIndex *index = &router_state->life_index;
+    const uint32_t hash = fnv1a(FNV1A_OFFSET_BASIS, gateway_to_find, 4);
+
+    if (index->num_indexed != router_state->life_entries) {
+        rebuild_life_index(router_state);
+    }
+
+    if (index->size == 0) {
+        return -1;
+    }
+
+    for (uint32_t i = hash & (index->size - 1); index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        uint32_t position = index->slots[i] - 1;
+        if (position < router_state->life_entries &&
+                match_ips(router_state->life_table[position].gateway, gateway_to_find)) {
+            return position;
+        }
+    }
+
+    return -1;
+}
+
+int life_table_contains_gateway(RouterState *router_state, uint8_t *gateway_to_find) {
+    return find_index_of_gateway_in_life_table(router_state, gateway_to_find) >= 0;
+}
+
+int add_new_gateway_to_life_table(RouterState *router_state, uint8_t *arg_gateway) {
+    if (router_state->life_entries >= router_state->max_entries) {
+        return -1;
+    }
+
+    memcpy(router_state->life_table[router_state->life_entries].gateway, arg_gateway, 4);
+    router_state->life_table[router_state->life_entries].life_left = MAX_GATEWAY_LIFE;
+    router_state->life_entries += 1;
+
+    TableIndex *index = &router_state->life_index;
+    if (index->num_indexed + 1 == router_state->life_entries) {
+        if (add_to_table_index(index, fnv1a(FNV1A_OFFSET_BASIS, arg_gateway, 4), router_state->life_entries - 1) < 0) {
+            rebuild_life_index(router_state);
+        } else {
+            index->num_indexed = router_state->life_entries;
+        }
+    }
+    return 0;
+}
+
+int reset_gateway_in_life_table(RouterState *router_state, uint8_t *arg_gateway) {
+    int index = find_index_of_gateway_in_life_table(router_state, arg_gateway);
+    if (index < 0) {
+        return 0;
+    }
+
+    router_state->life_table[index].life_left = MAX_GATEWAY_LIFE;
+    return 1;
+}
+
+int add_to_table(RouterState *router_state,
+        uint8_t *dest,
+        uint8_t *netmask,
+        uint8_t *gateway,
+        uint8_t *if_to_hop,
+        uint32_t metric) {
+
+    if (router_state->num_entries >= router_state->max_entries) {
+        return -1;
+    }
+
+    memcpy(router_state->router_table[router_state->num_entries].destination, dest, 4);
+    memcpy(router_state->router_table[router_state->num_entries].netmask, netmask, 4);
+    memcpy(router_state->router_table[router_state->num_entries].gateway, gateway, 4);
+    memcpy(router_state->router_table[router_state->num_entries].interface, if_to_hop, 4);
+    router_state->router_table[router_state->num_entries].metric = metric;
+    router_state->num_entries += 1;
+    index_route_at_pos(router_state, router_state->num_entries - 1);
+    return 0;
+}
+
+/* meant to be used to insert an entry for a network that is
+ * subsumed by another and needs to be inserted before it
+ *
+ * one cannot add an entry at a position that isn't already taken
+ * */
+int add_to_table_at_pos(RouterState *router_state, int pos,
+        uint8_t *dest,
+        uint8_t *netmask,
+        uint8_t *gateway,
+        uint8_t *if_to_hop,
+        uint32_t metric) {
+
+    if (pos >= router_state->num_entries) {
+        return -1;
+    }
+
+    if (router_state->num_entries >= router_state->max_entries) {
+        return -1;
+    }
+
+    for (int i = router_state->num_entries - 1; i >= pos; i--) {
+        memcpy(&router_state->router_table[i + 1], &router_state->router_table[i], sizeof(RouterTableEntry));
+    }
+
+    memcpy(router_state->router_table[pos].destination, dest, 4);
+    memcpy(router_state->router_table[pos].netmask, netmask, 4);
+    memcpy(router_state->router_table[pos].gateway, gateway, 4);
+    memcpy(router_state->router_table[pos].interface, if_to_hop, 4);
+    router_state->router_table[pos].metric = metric;
+    router_state->num_entries += 1;
+    index_route_at_pos(router_state, pos);
+    return 0;
+}
+
+int add_to_table_strings(RouterState *router_state,
+        const char *dest,
+        const char *netmask,
+        const char *gateway,
+        const char *if_to_hop,
+        uint32_t metric) {
+
+    if (router_state->num_entries >= router_state->max_entries) {
+        return -1;
+    }
+
+    int dest_rc = inet_pton(AF_INET, dest, router_state->router_table[router_state->num_entries].destination);
+    int mask_rc = inet_pton(AF_INET, netmask, router_state->router_table[router_state->num_entries].netmask);
+    int gateway_rc = inet_pton(AF_INET, gateway, router_state->router_table[router_state->num_entries].gateway);
+    int if_to_hop_rc = inet_pton(AF_INET, if_to_hop, router_state->router_table[router_state->num_entries].interface);
+    router_state->router_table[router_state->num_entries].metric = metric;
+
+    if (dest_rc != 1 || mask_rc != 1 || gateway_rc != 1 || if_to_hop_rc != 1) {
+        return -1;
+    }
+
+    router_state->num_entries += 1;
+    return 0;
+}
+
+int set_metric_for_all_entries_with_destination(RouterState *router_state, uint8_t *arg_destination, int new_metric) {
+    if (router_state->num_entries == 0) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < router_state->num_entries; i++) {
+        if (match_ips(router_state->router_table[i].destination, arg_destination)) {
+            router_state->router_table[i].metric = new_metric;
+        }
+    }
+
+    return 0;
+}
+
+int remove_from_table_at_pos(RouterState *router_state, uint32_t pos) {
+    if (pos >= router_state->num_entries) {
+        return -1;
+    }
+
+    memmove(&router_state->router_table[pos],
+            &router_state->router_table[pos + 1],
+            (router_state->num_entries - pos - 1) * sizeof(RouterTableEntry)
+    );
+    router_state->num_entries -= 1;
+    // the entries after pos moved down, the index is rebuilt on the next lookup
+    router_state->route_index.num_indexed = UINT32_MAX;
+    return 0;
+}
+
+uint32_t get_max_router_packet_size(uint32_t num_entries) {
+    return ROUTER_PACKET_HEADER_SIZE + (num_entries + 1) * sizeof(RouterTableEntry);
+}
+
+// packet structure:
+// 1. 4 bytes -> ip of the interface that is broadcasting
+// 2. 4 bytes -> router_id - additional identifier needed for topology grapher
+// 3. 4 bytes -> num_entries (uint32_t)
+// 4. [num_entries] times RouterTableEntry for every row
+//      in the router table
+// 5. RIP_DYNAMIC: RouterTableEntry for the interface of the router as a destination
+//    RIP_STATIC: the connected entry of the sending interface is left out instead
+//
+// packet must hold get_max_router_packet_size(num_entries) bytes.
+// returns the packet size, 0 if a static router has no connected entry for interface
+uint32_t build_router_packet(RouterState *router_state,
+        RouterTableEntry *router_table,
+        uint32_t num_entries,
+        InterfaceTableEntry *interface,
+        uint8_t *packet) {
+
+    RouterTableEntry *packet_table = (RouterTableEntry*) (packet + ROUTER_PACKET_HEADER_SIZE);
+    uint32_t num_packet_entries = 0;
+
+    if (router_state->rip_type == RIP_DYNAMIC) {
+        memcpy(packet_table, router_table, num_entries * sizeof(RouterTableEntry));
+        num_packet_entries = num_entries;
+
+        RouterTableEntry *myself_to_add = &packet_table[num_packet_entries];
+        memcpy(myself_to_add->destination, interface->interface_ip, 4);
+        memcpy(myself_to_add->netmask, interface->interface_netmask, 4);
+        memcpy(myself_to_add->gateway, interface->interface_ip, 4);
+        inet_pton(AF_INET, "127.0.0.1", myself_to_add->interface);
+        myself_to_add->metric = 0;
+        num_packet_entries += 1;
+    } else {
+        int is_connected_entry_found = 0;
+        for (uint32_t i = 0; i < num_entries; i++) {
+            if (!is_connected_entry_found &&
+                    match_ips(router_table[i].destination, interface->interface_ip) &&
+                    match_ips(router_table[i].netmask, interface->interface_netmask)) {
+                is_connected_entry_found = 1;
+                continue;
+            }
+
+            memcpy(&packet_table[num_packet_entries], &router_table[i], sizeof(RouterTableEntry));
+            num_packet_entries += 1;
+        }
+
+        if (!is_connected_entry_found) {
+            return 0;
+        }
+    }
+
+    memcpy(packet, interface->interface_ip, 4);
+    memcpy(packet + 4, &router_state->router_id, 4);
+    memcpy(packet + 8, &num_packet_entries, 4);
+    return ROUTER_PACKET_HEADER_SIZE + num_packet_entries * sizeof(RouterTableEntry);
+}
+
+/* reads the header of a received packet. num_entries is never trusted
+ * beyond what was actually received. returns -1 for packets too short
+ * to carry a header (tombstones from older builds, garbage)
+ * */
+int parse_router_packet(uint8_t *packet, uint32_t packet_size,
+        uint8_t *sender_ip,
+        uint32_t *sender_router_id,
+        uint32_t *num_entries) {
+
+    if (packet_size < ROUTER_PACKET_HEADER_SIZE) {
+        return -1;
+    }
+
+    memcpy(sender_ip, packet, 4);
+    memcpy(sender_router_id, packet + 4, 4);
+    memcpy(num_entries, packet + 8, 4);
+
+    const uint32_t num_entries_in_packet =
+        (packet_size - ROUTER_PACKET_HEADER_SIZE) / sizeof(RouterTableEntry);
+    if (*num_entries > num_entries_in_packet) {
+        *num_entries = num_entries_in_packet;
+    }
+
+    return 0;
+}
+
+int is_own_interface_ip(RouterState *router_state, uint8_t *ip) {
+    for (uint32_t i = 0; i < router_state->num_interfaces; i++) {
+        if (match_ips(router_state->interfaces[i].interface_ip, ip)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* merges a table received on curr_interface from the neighbor at sender_ip.
+ * returns the number of routes that changed
+ * */
+uint32_t apply_router_update(RouterState *router_state,
+        InterfaceTableEntry *curr_interface,
+        uint8_t *sender_ip,
+        RouterTableEntry *received_table,
+        uint32_t num_received) {
+
+    uint32_t num_changed = 0;
+
+    for (uint32_t i = 0; i < num_received; i++) {
+        RouterTableEntry *received_entry = &received_table[i];
+        if (match_ips(received_entry->gateway, curr_interface->interface_ip)) {
+            // split horizon
+            continue;
+        }
+
+        if (is_own_interface_ip(router_state, received_entry->destination)) {
+            // my own interfaces are never reached through a neighbor
+            continue;
+        }
+
+        int index_of_exact_dest = find_index_of_network_that_exacts(
+                    router_state,
+                    received_entry->destination,
+                    received_entry->netmask
+        );
+
+        int should_do_life_table_update = 1;
+
+        if (index_of_exact_dest != -1) {
+            // a network in my router table is exactly the currenty received network
+            RouterTableEntry *exact_entry = &router_state->router_table[index_of_exact_dest];
+            uint32_t old_metric = exact_entry->metric;
+            uint32_t rec_metric = received_entry->metric;
+            if (match_ips(exact_entry->gateway, sender_ip) && rec_metric != 0) {
+                // TODO check this
+                // the gateway for this entry is the router i currently receive from,
+                // so i trust the received metric and update even if it is worse
+                if (old_metric != cap_metric(rec_metric + 1)) {
+                    num_changed += 1;
+                }
+                exact_entry->metric = cap_metric(rec_metric + 1);
+                memcpy(exact_entry->interface, curr_interface->interface_ip, 4);
+
+            } else if (rec_metric + 1 < old_metric) {
+                // the gateway for this entry is being changed, so i have to check if
+                // the new metric is better than the old one before updating
+                num_changed += 1;
+                memcpy(exact_entry->gateway, sender_ip, 4);
+                exact_entry->metric = cap_metric(rec_metric + 1);
+                memcpy(exact_entry->interface, curr_interface->interface_ip, 4);
+            } else {
+                // an unchanged route still proves that its current gateway is alive
+                should_do_life_table_update = match_ips(exact_entry->gateway, sender_ip);
+            }
+        } else {
+            int index_of_parent_network = find_index_of_network_that_subsumes(
+                    router_state,
+                    received_entry->destination,
+                    received_entry->netmask
+            );
+
+            int add_rc;
+            if (index_of_parent_network != -1) {
+                // a network in my router table subsumes the currently received network.
+                // add the new network before the parent network in the router table
+                add_rc = add_to_table_at_pos(
+                        router_state, index_of_parent_network,
+                        received_entry->destination,
+                        received_entry->netmask,
+                        sender_ip,
+                        curr_interface->interface_ip,
+                        cap_metric(received_entry->metric + 1)
+                );
+            } else {
+                // this is the first time i encounter this network
+                // just add it to the table
+                add_rc = add_to_table(
+                        router_state,
+                        received_entry->destination,
+                        received_entry->netmask,
+                        sender_ip,
+                        curr_interface->interface_ip,
+                        cap_metric(received_entry->metric + 1)
+                );
+            }
+
+            if (add_rc == 0) {
+                num_changed += 1;
+            } else {
+                // table is full, the network stays unknown
+                should_do_life_table_update = 0;
+            }
+        }
+
+        if (should_do_life_table_update) {
+            if (!reset_gateway_in_life_table(router_state, received_entry->destination)) {
+                add_new_gateway_to_life_table(router_state, received_entry->destination);
+            }
+        }
+    }
+
+    atomic_fetch_add(&router_state->routes_changed, num_changed);
+    return num_changed;
+}
+
+/* the read only half of apply_router_update, safe under the read lock:
+ * when the update changes no route and every gateway it confirms is
+ * already known, their lives are refreshed and nothing else happens.
+ * returns -1 as soon as apply_router_update has to run under the write
+ * lock instead (lives refreshed until then are simply refreshed twice)
+ * */
+int refresh_router_update(RouterState *router_state,
+        InterfaceTableEntry *curr_interface,
+        uint8_t *sender_ip,
+        RouterTableEntry *received_table,
+        uint32_t num_received) {
+
+    // a stale index would be rebuilt by the lookups below
+    if (router_state->route_index.num_indexed != router_state->num_entries ||
+            router_state->life_index.num_indexed != router_state->life_entries) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < num_received; i++) {
+        RouterTableEntry *received_entry = &received_table[i];
+        if (match_ips(received_entry->gateway, curr_interface->interface_ip) ||
+                is_own_interface_ip(router_state, received_entry->destination)) {
+            continue;
+        }
+
+        int index_of_exact_dest = find_index_of_network_that_exacts(
+                    router_state,
+                    received_entry->destination,
+                    received_entry->netmask
+        );
+        if (index_of_exact_dest == -1) {
+            return -1;
+        }
+
+        // same decisions as apply_router_update, without acting on them
+        RouterTableEntry *exact_entry = &router_state->router_table[index_of_exact_dest];
+        const uint32_t rec_metric = received_entry->metric;
+        const int is_from_gateway = match_ips(exact_entry->gateway, sender_ip);
+        if (is_from_gateway && rec_metric != 0) {
+            if (exact_entry->metric != cap_metric(rec_metric + 1) ||
+                    !match_ips(exact_entry->interface, curr_interface->interface_ip)) {
+                return -1;
+            }
+        } else if (rec_metric + 1 < exact_entry->metric) {
+            return -1;
+        }
+        if (!is_from_gateway) {
+            continue;
+        }
+
+        int life_index = find_index_of_gateway_in_life_table(router_state, received_entry->destination);
+        if (life_index < 0) {
+            return -1;
+        }
+        __atomic_store_n(&router_state->life_table[life_index].life_left, MAX_GATEWAY_LIFE, __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+/* one TIME_FOR_LIFE_DROP tick. gateways that ran out of life get their
+ * routes poisoned, every other gateway except own_ip loses one life.
+ * returns the number of dead gateways
+ * */
+uint32_t age_life_table(RouterState *router_state, uint8_t *own_ip) {
+    uint32_t num_dead = 0;
+
+    for (uint32_t i = 0; i < router_state->life_entries; i++) {
+        if (router_state->life_table[i].life_left == 0) {
+            set_metric_for_all_entries_with_destination(
+                    router_state,
+                    router_state->life_table[i].gateway,
+                    INFINITY_METRIC
+            );
+            num_dead += 1;
+        } else if (!match_ips(router_state->life_table[i].gateway, own_ip)) {
+            router_state->life_table[i].life_left -= 1;
+        }
+    }
+
+    return num_dead;
+}
+
+/* one rip_broadcaster cycle: the table and the interfaces are copied
+ * under the read lock, then every interface gets its packet built and
+ * sent. the copies and the packet come out of arena, which is reset when
+ * the cycle ends. returns -1 when a packet can't be built or sent
+ * */
+int run_broadcast_cycle(RouterState *router_state, Arena *arena, BroadcastSender send_packet, void *send_arg) {
+    pthread_rwlock_rdlock(&router_state->router_table_lock);
+
+    const uint32_t num_entries_snapshot = router_state->num_entries;
+    RouterTableEntry *router_table_snapshot = arena_alloc(arena,
+            num_entries_snapshot * sizeof(RouterTableEntry));
+    memcpy(router_table_snapshot,
+           router_state->router_table,
+           num_entries_snapshot * sizeof(RouterTableEntry)
+    );
+
+    // interfaces can change on reload, take them together with the table
+    const uint32_t num_interfaces_snapshot = router_state->num_interfaces;
+    InterfaceTableEntry *interfaces_snapshot = arena_alloc(arena,
+            num_interfaces_snapshot * sizeof(InterfaceTableEntry));
+    memcpy(interfaces_snapshot,
+           router_state->interfaces,
+           num_interfaces_snapshot * sizeof(InterfaceTableEntry)
+    );
+
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+
+    uint8_t *packet_to_send = arena_alloc(arena, get_max_router_packet_size(num_entries_snapshot));
+
+    int cycle_rc = 0;
+    for (uint32_t i = 0; i < num_interfaces_snapshot && cycle_rc == 0; i++) {
+        const uint32_t packet_size = build_router_packet(router_state,
+                router_table_snapshot, num_entries_snapshot,
+                &interfaces_snapshot[i],
+                packet_to_send
+        );
+        if (packet_size == 0) {
+            perror("failed deletion of current interface on rip_static broadcast");
+            cycle_rc = -1;
+        } else {
+            cycle_rc = send_packet(send_arg, &interfaces_snapshot[i], packet_to_send, packet_size);
+        }
+    }
+
+    reset_arena(arena);
+    return cycle_rc;
+}
+
+/* readers find both indexes fresh, whatever the writer left behind
+ * */
+void unlock_router_table_after_write(RouterState *router_state) {
+    if (router_state->route_index.num_indexed != router_state->num_entries) {
+        rebuild_route_index(router_state);
+    }
+    if (router_state->life_index.num_indexed != router_state->life_entries) {
+        rebuild_life_index(router_state);
+    }
+    pthread_rwlock_unlock(&router_state->router_table_lock);
+}
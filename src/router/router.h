@@ -0,0 +1,88 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+#include <first.h>
+#include <arena.h>
+
+/* protocol logic shared by peer-listen and the simulator.
+ * none of these functions lock, callers hold router_table_lock for
+ * writing when other threads can touch router_state. only
+ * refresh_router_update is meant for the read lock, and
+ * run_broadcast_cycle takes it itself
+ * */
+
+extern const uint32_t ROUTER_PACKET_HEADER_SIZE;
+
+// puts one built packet on the wire, -1 ends the cycle
+typedef int (*BroadcastSender)(void *arg, InterfaceTableEntry *interface, uint8_t *packet, uint32_t packet_size);
+
+void rebuild_life_index(RouterState *router_state);
+
+int find_index_of_gateway_in_life_table(RouterState *router_state, uint8_t *gateway_to_find);
+
+int life_table_contains_gateway(RouterState *router_state, uint8_t *gateway_to_find);
+
+int add_new_gateway_to_life_table(RouterState *router_state, uint8_t *arg_gateway);
+
+int reset_gateway_in_life_table(RouterState *router_state, uint8_t *arg_gateway);
+
+int add_to_table(RouterState *router_state,
+        uint8_t *dest,
+        uint8_t *netmask,
+        uint8_t *gateway,
+        uint8_t *if_to_hop,
+        uint32_t metric);
+
+int add_to_table_at_pos(RouterState *router_state, int pos,
+        uint8_t *dest,
+        uint8_t *netmask,
+        uint8_t *gateway,
+        uint8_t *if_to_hop,
+        uint32_t metric);
+
+int add_to_table_strings(RouterState *router_state,
+        const char *dest,
+        const char *netmask,
+        const char *gateway,
+        const char *if_to_hop,
+        uint32_t metric);
+
+int remove_from_table_at_pos(RouterState *router_state, uint32_t pos);
+
+int set_metric_for_all_entries_with_destination(RouterState *router_state, uint8_t *arg_destination, int new_metric);
+
+uint32_t get_max_router_packet_size(uint32_t num_entries);
+
+uint32_t build_router_packet(RouterState *router_state,
+        RouterTableEntry *router_table,
+        uint32_t num_entries,
+        InterfaceTableEntry *interface,
+        uint8_t *packet);
+
+int parse_router_packet(uint8_t *packet, uint32_t packet_size,
+        uint8_t *sender_ip,
+        uint32_t *sender_router_id,
+        uint32_t *num_entries);
+
+int is_own_interface_ip(RouterState *router_state, uint8_t *ip);
+
+uint32_t apply_router_update(RouterState *router_state,
+        InterfaceTableEntry *curr_interface,
+        uint8_t *sender_ip,
+        RouterTableEntry *received_table,
+        uint32_t num_received);
+
+int refresh_router_update(RouterState *router_state,
+        InterfaceTableEntry *curr_interface,
+        uint8_t *sender_ip,
+        RouterTableEntry *received_table,
+        uint32_t num_received);
+
+uint32_t age_life_table(RouterState *router_state, uint8_t *own_ip);
+
+int run_broadcast_cycle(RouterState *router_state, Arena *arena, BroadcastSender send_packet, void *send_arg);
+
+void unlock_router_table_after_write(RouterState *router_state);
+
+#endif
@@ -0,0 +1,350 @@
+#include <first.h>
+#include <topology.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* headless topology-grapher: keeps the same graph from the broadcasts on
+ * BROADCAST_PORT and streams it instead of drawing it.
+ *
+ * every change is one JSON line:
+ *   {"event":"vertex_added","router_id":1,"ip":"10.0.0.1"}
+ *   {"event":"interface_added","router_id":1,"ip":"10.0.1.1"}
+ *   {"event":"edge_added","from":1,"to":2}
+ *   {"event":"edge_removed","from":1,"to":2}
+ * and every snapshot interval the whole graph follows as one
+ *   {"event":"snapshot","time":...,"routers":[...],"edges":[[1,2],...]}
+ * line, plus a Graphviz file when one is given. the output is a file,
+ * stdout, or a UNIX stream socket someone else listens on
+ * */
+
+typedef struct {
+    TopologyGraph graph;
+    TopologyDelta delta;
+    int sock;
+    FILE *out;
+    const char *dot_filename;
+    uint32_t snapshot_interval_ms;
+    uint64_t packets_received;
+    uint64_t packets_ignored;
+} CollectorState;
+
+const uint32_t COLLECTOR_INITIAL_VERTICES = 1024;
+const uint32_t COLLECTOR_INITIAL_EDGES = 4096;
+const uint32_t COLLECTOR_SNAPSHOT_INTERVAL_MS = 10000;
+const int COLLECTOR_RECEIVE_BUFFER = 4 << 20;
+// packets applied between two flushes of the output
+const uint32_t COLLECTOR_MAX_BATCH = 1024;
+
+
+void free_collector_state(CollectorState *collector_state) {
+    free_topology_graph(&collector_state->graph);
+    free(collector_state->delta.neighbor_ips);
+    if (collector_state->sock >= 0) {
+        close(collector_state->sock);
+    }
+    if (collector_state->out && collector_state->out != stdout) {
+        fclose(collector_state->out);
+    }
+    free(collector_state);
+}
+
+uint64_t get_monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void write_ip(FILE *out, uint8_t *ip) {
+    fprintf(out, "\"%u.%u.%u.%u\"", ip[0], ip[1], ip[2], ip[3]);
+}
+
+void write_change_event(TopologyGraph *graph, TopologyChange change, uint32_t v, uint32_t u) {
+    CollectorState *collector_state = (CollectorState*) graph->on_change_arg;
+    FILE *out = collector_state->out;
+    // edge indexes are not part of the stream
+    if (change == TOPOLOGY_EDGE_MOVED) {
+        return;
+    }
+    Vertex *vertex = &graph->vertices[v];
+
+    switch (change) {
+        case TOPOLOGY_VERTEX_ADDED:
+            fprintf(out, "{\"event\":\"vertex_added\",\"router_id\":%u,\"ip\":", vertex->router_id);
+            write_ip(out, vertex->interfaces[0].interface_ip);
+            fputs("}\n", out);
+            break;
+        case TOPOLOGY_INTERFACE_ADDED:
+            fprintf(out, "{\"event\":\"interface_added\",\"router_id\":%u,\"ip\":", vertex->router_id);
+            write_ip(out, vertex->interfaces[u].interface_ip);
+            fputs("}\n", out);
+            break;
+        case TOPOLOGY_EDGE_ADDED:
+        case TOPOLOGY_EDGE_REMOVED:
+            fprintf(out, "{\"event\":\"%s\",\"from\":%u,\"to\":%u}\n",
+                    change == TOPOLOGY_EDGE_ADDED ? "edge_added" : "edge_removed",
+                    vertex->router_id, graph->vertices[u].router_id);
+            break;
+        case TOPOLOGY_EDGE_MOVED:
+            break;
+    }
+}
+
+void write_json_snapshot(CollectorState *collector_state) {
+    TopologyGraph *graph = &collector_state->graph;
+    FILE *out = collector_state->out;
+
+    fprintf(out, "{\"event\":\"snapshot\",\"time\":%ld,\"packets\":%lu,\"ignored\":%lu,\"routers\":[",
+            (long) time(NULL), collector_state->packets_received, collector_state->packets_ignored);
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        Vertex *vertex = &graph->vertices[i];
+        fprintf(out, "%s{\"router_id\":%u,\"interfaces\":[", i > 0 ? "," : "", vertex->router_id);
+        for (uint32_t j = 0; j < vertex->num_interfaces; j++) {
+            if (j > 0) {
+                fputc(',', out);
+            }
+            write_ip(out, vertex->interfaces[j].interface_ip);
+        }
+        fputs("]}", out);
+    }
+    fputs("],\"edges\":[", out);
+    for (uint32_t i = 0; i < graph->num_edges; i++) {
+        fprintf(out, "%s[%u,%u]", i > 0 ? "," : "",
+                graph->vertices[graph->edges[i].v].router_id,
+                graph->vertices[graph->edges[i].u].router_id);
+    }
+    fputs("]}\n", out);
+}
+
+/* written to a temporary file and renamed, so a reader never sees half
+ * a graph
+ * */
+int write_dot_snapshot(CollectorState *collector_state) {
+    TopologyGraph *graph = &collector_state->graph;
+    char tmp_filename[256];
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", collector_state->dot_filename);
+
+    FILE *file = fopen(tmp_filename, "w");
+    if (!file) {
+        perror("dot snapshot open failed");
+        return -1;
+    }
+
+    fputs("graph topology {\n", file);
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        uint8_t *ip = graph->vertices[i].interfaces[0].interface_ip;
+        fprintf(file, "    r%u [label=\"%u\\n%u.%u.%u.%u\"];\n", graph->vertices[i].router_id,
+                graph->vertices[i].router_id, ip[0], ip[1], ip[2], ip[3]);
+    }
+    for (uint32_t i = 0; i < graph->num_edges; i++) {
+        fprintf(file, "    r%u -- r%u;\n",
+                graph->vertices[graph->edges[i].v].router_id,
+                graph->vertices[graph->edges[i].u].router_id);
+    }
+    fputs("}\n", file);
+
+    if (fclose(file) != 0 || rename(tmp_filename, collector_state->dot_filename) < 0) {
+        perror("dot snapshot write failed");
+        unlink(tmp_filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+void write_snapshots(CollectorState *collector_state) {
+    write_json_snapshot(collector_state);
+    if (collector_state->dot_filename) {
+        write_dot_snapshot(collector_state);
+    }
+}
+
+void flush_output(CollectorState *collector_state) {
+    if (fflush(collector_state->out) != 0) {
+        perror("output write failed");
+        free_collector_state(collector_state);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* everything on one thread: wait for packets or the next snapshot, then
+ * apply whatever is queued in the socket and flush the events once
+ * */
+void collector_listen(CollectorState *collector_state) {
+    uint8_t rec_buffer[BUFFER_SIZE];
+    uint64_t next_snapshot_ms = get_monotonic_ms();
+
+    while (1) {
+        uint64_t now_ms = get_monotonic_ms();
+        if (now_ms >= next_snapshot_ms) {
+            write_snapshots(collector_state);
+            flush_output(collector_state);
+            next_snapshot_ms = now_ms + collector_state->snapshot_interval_ms;
+        }
+
+        struct pollfd poll_fd = { .fd = collector_state->sock, .events = POLLIN };
+        if (poll(&poll_fd, 1, next_snapshot_ms - now_ms) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            free_collector_state(collector_state);
+            exit(EXIT_FAILURE);
+        }
+
+        for (uint32_t i = 0; i < COLLECTOR_MAX_BATCH; i++) {
+            int bytes_received = recv(collector_state->sock, rec_buffer, BUFFER_SIZE - 1, MSG_DONTWAIT);
+            if (bytes_received < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    break;
+                }
+                perror("recv failed");
+                free_collector_state(collector_state);
+                exit(EXIT_FAILURE);
+            }
+
+            collector_state->packets_received += 1;
+            if (decode_topology_delta(rec_buffer, bytes_received, &collector_state->delta) < 0) {
+                collector_state->packets_ignored += 1;
+                continue;
+            }
+            apply_topology_delta(&collector_state->graph, &collector_state->delta);
+        }
+        flush_output(collector_state);
+    }
+}
+
+FILE* open_output_socket(const char *socket_path) {
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("socket creation failed");
+        return NULL;
+    }
+
+    struct sockaddr_un out_addr;
+    memset(&out_addr, 0, sizeof(out_addr));
+    out_addr.sun_family = AF_UNIX;
+    strncpy(out_addr.sun_path, socket_path, sizeof(out_addr.sun_path) - 1);
+    if (connect(sock, (struct sockaddr*) &out_addr, sizeof(out_addr)) < 0) {
+        perror("output socket connect failed");
+        close(sock);
+        return NULL;
+    }
+
+    FILE *out = fdopen(sock, "w");
+    if (!out) {
+        perror("fdopen failed");
+        close(sock);
+    }
+    return out;
+}
+
+CollectorState* startup_collector(const char *out_filename, const char *out_socket_path) {
+    CollectorState *collector_state = calloc(1, sizeof(CollectorState));
+    collector_state->sock = -1;
+    init_topology_graph(&collector_state->graph, COLLECTOR_INITIAL_VERTICES, COLLECTOR_INITIAL_EDGES);
+    collector_state->graph.on_change = write_change_event;
+    collector_state->graph.on_change_arg = collector_state;
+    collector_state->delta.max_neighbors = ROUTER_TABLE_MAX_SIZE;
+    collector_state->delta.neighbor_ips = malloc(collector_state->delta.max_neighbors * sizeof(*collector_state->delta.neighbor_ips));
+
+    if (out_socket_path) {
+        collector_state->out = open_output_socket(out_socket_path);
+    } else if (out_filename) {
+        collector_state->out = fopen(out_filename, "a");
+        if (!collector_state->out) {
+            perror("output file open failed");
+        }
+    } else {
+        collector_state->out = stdout;
+    }
+    if (!collector_state->out) {
+        free_collector_state(collector_state);
+        exit(EXIT_FAILURE);
+    }
+
+    collector_state->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (collector_state->sock < 0) {
+        perror("socket creation failed");
+        free_collector_state(collector_state);
+        exit(EXIT_FAILURE);
+    }
+
+    int reuse = 1;
+    if (setsockopt(collector_state->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt with SO_REUSEADDR failed");
+        free_collector_state(collector_state);
+        exit(EXIT_FAILURE);
+    }
+    // bursts from thousands of routers queue up here while snapshots are written
+    if (setsockopt(collector_state->sock, SOL_SOCKET, SO_RCVBUF,
+                &COLLECTOR_RECEIVE_BUFFER, sizeof(COLLECTOR_RECEIVE_BUFFER)) < 0) {
+        perror("setsockopt with SO_RCVBUF failed");
+    }
+
+    struct sockaddr_in listen_addr;
+    memset(&listen_addr, 0, sizeof(listen_addr));
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_port = htons(BROADCAST_PORT);
+    listen_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(collector_state->sock, (struct sockaddr*) &listen_addr, sizeof(listen_addr)) < 0) {
+        perror("bind failed");
+        free_collector_state(collector_state);
+        exit(EXIT_FAILURE);
+    }
+
+    return collector_state;
+}
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-o out_file | -u out_socket] [-D dot_file] [-i snapshot_seconds]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_filename = NULL;
+    const char *out_socket_path = NULL;
+    const char *dot_filename = NULL;
+    double snapshot_seconds = COLLECTOR_SNAPSHOT_INTERVAL_MS / 1000.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:u:D:i:")) != -1) {
+        switch (opt) {
+            case 'o': out_filename = optarg; break;
+            case 'u': out_socket_path = optarg; break;
+            case 'D': dot_filename = optarg; break;
+            case 'i': snapshot_seconds = atof(optarg); break;
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if ((out_filename && out_socket_path) || snapshot_seconds <= 0) {
+        print_usage(argv[0]);
+        errno = EINVAL;
+        perror("Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    // a reader that goes away ends the collector through the failed flush
+    signal(SIGPIPE, SIG_IGN);
+
+    CollectorState *collector_state = startup_collector(out_filename, out_socket_path);
+    collector_state->dot_filename = dot_filename;
+    collector_state->snapshot_interval_ms = snapshot_seconds * 1000;
+    if (collector_state->snapshot_interval_ms == 0) {
+        collector_state->snapshot_interval_ms = 1;
+    }
+
+    collector_listen(collector_state);
+
+    free_collector_state(collector_state);
+    return 0;
+}
@@ -1,8 +1,14 @@
 #include <first.h>
 #include "topology-grapher.h"
 #include <gtk/gtk.h>
+#include <errno.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <pthread.h>
@@ -11,372 +17,796 @@
 const uint32_t WIDTH = 600;
 const uint32_t HEIGHT = 600;
 const uint32_t RADIUS = 15;
-const uint32_t ITERATIONS = 500;
-const uint32_t GRAPHER_MAX_VERTICES = 200;
-const uint32_t GRAPHER_MAX_EDGES = 300;
-
-
-void free_vertex_interfaces(GrapherState *grapher_state) {
-    for (uint32_t i = 0; i < grapher_state->num_vertices; i++) {
-        free(grapher_state->vertices[i].interfaces);
-    }
+const uint32_t GRAPHER_INITIAL_VERTICES = 256;
+const uint32_t GRAPHER_INITIAL_EDGES = 512;
+const uint32_t GRAPHER_FRAME_MS = 16;
+const uint32_t LABEL_WIDTH = 100;
+const uint32_t LABEL_HEIGHT = 16;
+const double GRAPHER_LABEL_MIN_SCALE = 0.5;
+const uint32_t GRAPHER_MAX_LABELS = 1000;
+const double GRAPHER_MIN_ARC_RADIUS = 2.5;
+const double GRAPHER_ZOOM_STEP = 1.1;
+const double GRAPHER_MIN_SCALE = 0.02;
+const double GRAPHER_MAX_SCALE = 20;
+const uint32_t FRAME_IS_FRESH = 4;
+const double GRAPHER_REHEAT_TEMPERATURE = 2.0;
+const uint32_t GRAPHER_SCRUB_SECONDS = 600;
+const uint32_t GRAPHER_HISTORY_REFRESH_MS = 1000;
+const double SPARKLINE_WIDTH = 160;
+const double SPARKLINE_HEIGHT = 40;
+
+// by heat level, from quiet to busy (vertices) or fresh to stale (edges)
+static const double VERTEX_HEAT_COLORS[4][3] = {
+    { 0.2, 0.4, 0.8 }, { 0.6, 0.4, 0.7 }, { 0.9, 0.5, 0.2 }, { 0.9, 0.1, 0.1 }
+};
+static const double EDGE_HEAT_COLORS[4][3] = {
+    { 0, 0, 0 }, { 0.5, 0.5, 0.5 }, { 0.8, 0.6, 0.3 }, { 0.9, 0.2, 0.2 }
+};
+// by PathStatus
+static const double PATH_STATUS_COLORS[3][3] = {
+    { 0.1, 0.7, 0.2 }, { 1.0, 0.6, 0.0 }, { 0.1, 0.1, 0.1 }
+};
+static const char *PATH_STATUS_NAMES[3] = { "delivered", "loop", "black hole" };
+
+
+void free_grapher_frame(GrapherFrame *frame) {
+    free(frame->xs);
+    free(frame->ys);
+    free(frame->labels);
+    free(frame->edge_vs);
+    free(frame->edge_us);
+    free(frame->vertex_heats);
+    free(frame->edge_heats);
+    free(frame->sparkline);
+    free(frame->path_statuses);
+    free(frame->path);
 }
 
-// ---- Physics Functions ----
-double fr(double x) {
-    return sqrt(WIDTH * HEIGHT) / x;
+void stop_grapher_layout(GrapherState *grapher_state) {
+    if (grapher_state->layout_wakeup_fd < 0) {
+        return;
+    }
+    atomic_store(&grapher_state->is_layout_stopping, 1);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
+    pthread_join(grapher_state->layout_thread, NULL);
+    close(grapher_state->layout_wakeup_fd);
+    grapher_state->layout_wakeup_fd = -1;
 }
 
-double fa(double x) {
-    return (x * x) / sqrt(WIDTH * HEIGHT);
+/* returns -1 when grapher_listen ended on an error
+ * */
+int stop_grapher_listen(GrapherState *grapher_state) {
+    if (grapher_state->listen_stop_fd < 0) {
+        return 0;
+    }
+    void *listen_rc;
+    signal_wakeup(grapher_state->listen_stop_fd);
+    pthread_join(grapher_state->listen_thread, &listen_rc);
+    close(grapher_state->listen_stop_fd);
+    grapher_state->listen_stop_fd = -1;
+    return listen_rc == NULL ? 0 : -1;
 }
 
-double cool(double t) {
-    return t * 0.99;
+// the threads are stopped first, this only frees
+void free_grapher_state(GrapherState *grapher_state) {
+    free_topology_graph(&grapher_state->graph);
+    free_layout(grapher_state->layout);
+    free(grapher_state->labels);
+    free(grapher_state->changed_vertices);
+    free_topology_history(&grapher_state->history);
+    free_path_index(&grapher_state->paths);
+    free(grapher_state->scrub_edge_vs);
+    free(grapher_state->scrub_edge_us);
+    for (uint32_t i = 0; i < 3; i++) {
+        free_grapher_frame(&grapher_state->frames[i]);
+    }
+    for (uint32_t i = 0; i < grapher_state->max_label_surfaces; i++) {
+        if (grapher_state->label_surfaces[i]) {
+            cairo_surface_destroy(grapher_state->label_surfaces[i]);
+        }
+    }
+    free(grapher_state->label_surfaces);
+    free_delta_ring(&grapher_state->delta_ring);
+    free(grapher_state->applied_delta.neighbor_ips);
+    free(grapher_state->applied_delta.entries);
+    pthread_mutex_destroy(&grapher_state->drag_mutex);
+    free(grapher_state);
 }
 
 // ---- Drawing ----
-gboolean draw_graph(GtkWidget *widget, cairo_t *cr, gpointer data) {
-    GrapherState *grapher_state = (GrapherState*) data;
-    cairo_set_line_width(cr, 1);
-    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
-    cairo_set_font_size(cr, 12);
-
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-    for (int i = 0; i < grapher_state->num_edges; i++) {
-        cairo_move_to(cr, grapher_state->edges[i].v->pos.x, grapher_state->edges[i].v->pos.y);
-        cairo_line_to(cr, grapher_state->edges[i].u->pos.x, grapher_state->edges[i].u->pos.y);
+/* the label of a vertex never changes, so it is rendered once into a
+ * small alpha surface and only blitted afterwards
+ * */
+cairo_surface_t* get_label_surface(GrapherState *grapher_state, GrapherFrame *frame, uint32_t vertex) {
+    if (vertex >= grapher_state->max_label_surfaces) {
+        uint32_t old_max = grapher_state->max_label_surfaces;
+        grapher_state->max_label_surfaces = frame->max_vertices;
+        grapher_state->label_surfaces = realloc(grapher_state->label_surfaces,
+                grapher_state->max_label_surfaces * sizeof(cairo_surface_t*));
+        memset(grapher_state->label_surfaces + old_max, 0,
+                (grapher_state->max_label_surfaces - old_max) * sizeof(cairo_surface_t*));
     }
-    cairo_stroke(cr);
-
-    uint32_t copy_num_vertices = grapher_state->num_vertices;
-    uint32_t size_vertexes = copy_num_vertices * sizeof(Vertex);
-
-    Vertex *copy_vertexes = malloc(size_vertexes);
-    memcpy(copy_vertexes, grapher_state->vertices, size_vertexes);
-
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
-
-    for (int i = 0; i < copy_num_vertices; i++) {
-        Vertex *v = &copy_vertexes[i];
-
-        cairo_arc(cr, v->pos.x, v->pos.y, RADIUS, 0, 2 * M_PI);
-        cairo_set_source_rgb(cr, 0.2, 0.4, 0.8);
-        cairo_fill(cr);
 
+    if (!grapher_state->label_surfaces[vertex]) {
         char label[20];
         snprintf(label, sizeof(label), "%u.%u.%u.%u",
-            v->interfaces[0].interface_ip[0],
-            v->interfaces[0].interface_ip[1],
-            v->interfaces[0].interface_ip[2],
-            v->interfaces[0].interface_ip[3]
+            frame->labels[vertex][0],
+            frame->labels[vertex][1],
+            frame->labels[vertex][2],
+            frame->labels[vertex][3]
         );
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        cairo_move_to(cr, v->pos.x + RADIUS + 2, v->pos.y - RADIUS - 2);
-        cairo_show_text(cr, label);
-    }
 
-    free(copy_vertexes);
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, LABEL_WIDTH, LABEL_HEIGHT);
+        cairo_t *label_cr = cairo_create(surface);
+        cairo_select_font_face(label_cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(label_cr, 12);
+        cairo_move_to(label_cr, 0, LABEL_HEIGHT - 4);
+        cairo_show_text(label_cr, label);
+        cairo_destroy(label_cr);
+        grapher_state->label_surfaces[vertex] = surface;
+    }
 
-    return FALSE;
+    return grapher_state->label_surfaces[vertex];
 }
 
-// ---- Simulation ----
-gboolean simulate(gpointer data) {
-    GrapherState *grapher_state = (GrapherState *) data;
+/* route changes (bars) and table size (line) of the selected router,
+ * over the time its samples cover
+ * */
+void draw_sparkline(GrapherState *grapher_state, GrapherFrame *frame, cairo_t *cr) {
+    const double left = 10, top = 10;
+    RouterSample *samples = frame->sparkline;
+    const uint32_t num_samples = frame->num_sparkline_samples;
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_rectangle(cr, left, top, SPARKLINE_WIDTH, SPARKLINE_HEIGHT + LABEL_HEIGHT);
+    cairo_fill(cr);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_mask_surface(cr, get_label_surface(grapher_state, frame, frame->sparkline_vertex), left, top);
+
+    uint32_t max_table_size = 1, max_route_changes = 1;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        max_table_size = samples[i].table_size > max_table_size ? samples[i].table_size : max_table_size;
+        max_route_changes = samples[i].route_changes > max_route_changes ? samples[i].route_changes : max_route_changes;
+    }
+    const double span_ms = num_samples > 1 ? samples[num_samples - 1].at_ms - samples[0].at_ms : 1;
+    const double bottom = top + LABEL_HEIGHT + SPARKLINE_HEIGHT;
 
-    if (grapher_state->curr_iteration++ >= ITERATIONS) {
-        gtk_widget_queue_draw(grapher_state->drawing_area);
-        return TRUE;
-    } 
+    for (uint32_t i = 0; i < num_samples; i++) {
+        const double x = left + (samples[i].at_ms - samples[0].at_ms) / fmax(span_ms, 1) * SPARKLINE_WIDTH;
+        cairo_move_to(cr, x, bottom);
+        cairo_line_to(cr, x, bottom - SPARKLINE_HEIGHT * samples[i].route_changes / max_route_changes);
+    }
+    cairo_set_source_rgb(cr, 0.9, 0.1, 0.1);
+    cairo_stroke(cr);
 
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-    for (int i = 0; i < grapher_state->num_vertices; i++) {
-        if (!grapher_state->vertices[i].dragging) {
-            grapher_state->vertices[i].disp.x = 0;
-            grapher_state->vertices[i].disp.y = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        const double x = left + (samples[i].at_ms - samples[0].at_ms) / fmax(span_ms, 1) * SPARKLINE_WIDTH;
+        const double y = bottom - SPARKLINE_HEIGHT * samples[i].table_size / max_table_size;
+        if (i == 0) {
+            cairo_move_to(cr, x, y);
+        } else {
+            cairo_line_to(cr, x, y);
         }
     }
+    cairo_set_source_rgb(cr, 0.2, 0.4, 0.8);
+    cairo_stroke(cr);
+}
 
-    // Repulsive
-    for (int i = 0; i < grapher_state->num_vertices; i++) {
-        for (int j = 0; j < grapher_state->num_vertices; j++) {
-            if (i == j) continue;
-            double dx = grapher_state->vertices[i].pos.x - grapher_state->vertices[j].pos.x;
-            double dy = grapher_state->vertices[i].pos.y - grapher_state->vertices[j].pos.y;
-            double dist = sqrt(dx * dx + dy * dy) + 0.1;
-            double force = fr(dist);
-            if (!grapher_state->vertices[i].dragging) {
-                grapher_state->vertices[i].disp.x += (dx / dist) * force;
-                grapher_state->vertices[i].disp.y += (dy / dist) * force;
-            }
+/* the path from the selected router, in the color of where it ends
+ * */
+void draw_path(GrapherFrame *frame, cairo_t *cr, double scale, double view_x, double view_y) {
+    for (uint32_t i = 0; i < frame->path_length; i++) {
+        const double x = frame->xs[frame->path[i]] * scale + view_x;
+        const double y = frame->ys[frame->path[i]] * scale + view_y;
+        if (i == 0) {
+            cairo_move_to(cr, x, y);
+        } else {
+            cairo_line_to(cr, x, y);
         }
     }
+    const uint8_t status = frame->path_statuses[frame->path[0]];
+    cairo_set_line_width(cr, 4);
+    cairo_set_source_rgb(cr, PATH_STATUS_COLORS[status][0], PATH_STATUS_COLORS[status][1], PATH_STATUS_COLORS[status][2]);
+    cairo_stroke(cr);
+    cairo_set_line_width(cr, 1);
+}
 
-    // Attractive
-    for (int i = 0; i < grapher_state->num_edges; i++) {
-        Vertex *v = grapher_state->edges[i].v;
-        Vertex *u = grapher_state->edges[i].u;
-        double dx = v->pos.x - u->pos.x;
-        double dy = v->pos.y - u->pos.y;
-        double dist = sqrt(dx * dx + dy * dy) + 0.1;
-        double force = fa(dist);
-        if (!v->dragging) {
-            v->disp.x -= (dx / dist) * force;
-            v->disp.y -= (dy / dist) * force;
+/* a ring around the queried router and around every router whose
+ * traffic for it loops or ends in a black hole, and the outcome of the
+ * path in the corner
+ * */
+void draw_path_flags(GrapherFrame *frame, cairo_t *cr, double scale, double view_x, double view_y,
+        double min_x, double min_y, double max_x, double max_y) {
+    const double radius = fmax(RADIUS * scale, GRAPHER_MIN_ARC_RADIUS) + 3;
+    cairo_set_line_width(cr, 2);
+    for (uint32_t status = 0; status < 3; status++) {
+        for (uint32_t i = 0; i < frame->num_vertices; i++) {
+            const int is_flagged = status == PATH_DELIVERED
+                ? i == (uint32_t) frame->query_vertex
+                : frame->path_statuses[i] == status;
+            if (!is_flagged ||
+                    frame->xs[i] < min_x || frame->xs[i] > max_x || frame->ys[i] < min_y || frame->ys[i] > max_y) {
+                continue;
+            }
+            cairo_new_sub_path(cr);
+            cairo_arc(cr, frame->xs[i] * scale + view_x, frame->ys[i] * scale + view_y, radius, 0, 2 * M_PI);
         }
-        if (!u->dragging) {
-            u->disp.x += (dx / dist) * force;
-            u->disp.y += (dy / dist) * force;
+        cairo_set_source_rgb(cr, PATH_STATUS_COLORS[status][0], PATH_STATUS_COLORS[status][1], PATH_STATUS_COLORS[status][2]);
+        cairo_stroke(cr);
+    }
+    cairo_set_line_width(cr, 1);
+
+    if (frame->path_length == 0) {
+        return;
+    }
+    char status_text[64];
+    snprintf(status_text, sizeof(status_text), "%s after %u hops",
+            PATH_STATUS_NAMES[frame->path_statuses[frame->path[0]]], frame->path_length - 1);
+    double clip_x1, clip_y1, clip_x2, clip_y2;
+    cairo_clip_extents(cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+    cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 12);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_move_to(cr, 10, clip_y2 - 10);
+    cairo_show_text(cr, status_text);
+}
+
+/* only what is inside the window is drawn. vertices become squares and
+ * labels disappear when zoomed out far enough
+ * */
+gboolean draw_graph(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    GrapherState *grapher_state = (GrapherState*) data;
+    // owned by the GTK thread until it takes the next one
+    GrapherFrame *frame = &grapher_state->frames[grapher_state->front_frame];
+    const double scale = grapher_state->view_scale;
+    const double view_x = grapher_state->view_x;
+    const double view_y = grapher_state->view_y;
+
+    // the visible part of the layout, with room for a vertex
+    double clip_x1, clip_y1, clip_x2, clip_y2;
+    cairo_clip_extents(cr, &clip_x1, &clip_y1, &clip_x2, &clip_y2);
+    const double min_x = (clip_x1 - view_x) / scale - RADIUS;
+    const double min_y = (clip_y1 - view_y) / scale - RADIUS;
+    const double max_x = (clip_x2 - view_x) / scale + RADIUS;
+    const double max_y = (clip_y2 - view_y) / scale + RADIUS;
+
+    // one path per heat level
+    cairo_set_line_width(cr, 1);
+    for (uint32_t heat = 0; heat < HISTORY_HEAT_LEVELS; heat++) {
+        for (uint32_t i = 0; i < frame->num_edges; i++) {
+            const double x1 = frame->xs[frame->edge_vs[i]];
+            const double y1 = frame->ys[frame->edge_vs[i]];
+            const double x2 = frame->xs[frame->edge_us[i]];
+            const double y2 = frame->ys[frame->edge_us[i]];
+            if (frame->edge_heats[i] != heat ||
+                    fmax(x1, x2) < min_x || fmin(x1, x2) > max_x || fmax(y1, y2) < min_y || fmin(y1, y2) > max_y) {
+                continue;
+            }
+            cairo_move_to(cr, x1 * scale + view_x, y1 * scale + view_y);
+            cairo_line_to(cr, x2 * scale + view_x, y2 * scale + view_y);
         }
+        cairo_set_source_rgb(cr, EDGE_HEAT_COLORS[heat][0], EDGE_HEAT_COLORS[heat][1], EDGE_HEAT_COLORS[heat][2]);
+        cairo_stroke(cr);
+    }
+    if (frame->path_length > 0) {
+        draw_path(frame, cr, scale, view_x, view_y);
     }
 
-    for (int i = 0; i < grapher_state->num_vertices; i++) {
-        if (!grapher_state->vertices[i].dragging) {
-            double dx = grapher_state->vertices[i].disp.x;
-            double dy = grapher_state->vertices[i].disp.y;
-            double dist = sqrt(dx * dx + dy * dy);
-            double disp = fmin(dist, grapher_state->t);
-            if (dist > 1e-8) {
-                grapher_state->vertices[i].pos.x += (dx / dist) * disp;
-                grapher_state->vertices[i].pos.y += (dy / dist) * disp;
+    const double radius = RADIUS * scale;
+    const int is_square = radius < GRAPHER_MIN_ARC_RADIUS;
+    const double half_square = fmax(radius, 1.0);
+    uint32_t num_visible = 0;
+    for (uint32_t heat = 0; heat < HISTORY_HEAT_LEVELS; heat++) {
+        for (uint32_t i = 0; i < frame->num_vertices; i++) {
+            if (frame->vertex_heats[i] != heat ||
+                    frame->xs[i] < min_x || frame->xs[i] > max_x || frame->ys[i] < min_y || frame->ys[i] > max_y) {
+                continue;
+            }
+            num_visible += 1;
+            const double x = frame->xs[i] * scale + view_x;
+            const double y = frame->ys[i] * scale + view_y;
+            if (is_square) {
+                cairo_rectangle(cr, x - half_square, y - half_square, 2 * half_square, 2 * half_square);
+            } else {
+                cairo_new_sub_path(cr);
+                cairo_arc(cr, x, y, radius, 0, 2 * M_PI);
             }
+        }
+        cairo_set_source_rgb(cr, VERTEX_HEAT_COLORS[heat][0], VERTEX_HEAT_COLORS[heat][1], VERTEX_HEAT_COLORS[heat][2]);
+        cairo_fill(cr);
+    }
+    if (frame->query_vertex >= 0) {
+        draw_path_flags(frame, cr, scale, view_x, view_y, min_x, min_y, max_x, max_y);
+    }
 
-            if (grapher_state->vertices[i].pos.x < 0) grapher_state->vertices[i].pos.x = 0;
-            if (grapher_state->vertices[i].pos.y < 0) grapher_state->vertices[i].pos.y = 0;
-            if (grapher_state->vertices[i].pos.x > WIDTH) grapher_state->vertices[i].pos.x = WIDTH;
-            if (grapher_state->vertices[i].pos.y > HEIGHT) grapher_state->vertices[i].pos.y = HEIGHT;
+    // too small or too many to read
+    if (scale >= GRAPHER_LABEL_MIN_SCALE && num_visible <= GRAPHER_MAX_LABELS) {
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        for (uint32_t i = 0; i < frame->num_vertices; i++) {
+            // labels stick out to the right
+            if (frame->xs[i] < min_x - LABEL_WIDTH / scale || frame->xs[i] > max_x ||
+                    frame->ys[i] < min_y || frame->ys[i] > max_y + LABEL_HEIGHT / scale) {
+                continue;
+            }
+            cairo_mask_surface(cr, get_label_surface(grapher_state, frame, i),
+                    frame->xs[i] * scale + view_x + radius + 2,
+                    frame->ys[i] * scale + view_y - radius - 2 - (LABEL_HEIGHT - 4));
         }
     }
 
-    grapher_state->t = cool(grapher_state->t);
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
+    if (frame->sparkline_vertex >= 0 && frame->sparkline_vertex < frame->num_vertices) {
+        draw_sparkline(grapher_state, frame, cr);
+    }
 
-    gtk_widget_queue_draw(grapher_state->drawing_area);
-    return TRUE;
+    return FALSE;
 }
 
-gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
-    GrapherState *grapher_state = (GrapherState *) data;
-
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-
-    for (int i = 0; i < grapher_state->num_vertices; i++) {
-        double dx = event->x - grapher_state->vertices[i].pos.x;
-        double dy = event->y - grapher_state->vertices[i].pos.y;
-        if (sqrt(dx * dx + dy * dy) < 15) {
-            grapher_state->vertices[i].dragging = TRUE;
-            grapher_state->dragged_vertex = &grapher_state->vertices[i];
-            break;
-        }
+/* swaps the displayed frame for the newest finished one.
+ * returns 1 if there was one
+ * */
+int take_fresh_frame(GrapherState *grapher_state) {
+    if (!(atomic_load(&grapher_state->ready_frame) & FRAME_IS_FRESH)) {
+        return 0;
     }
 
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
-    return TRUE;
+    grapher_state->front_frame =
+        atomic_exchange(&grapher_state->ready_frame, grapher_state->front_frame) & ~FRAME_IS_FRESH;
+    return 1;
 }
 
-gboolean on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+gboolean refresh_frame(gpointer data) {
     GrapherState *grapher_state = (GrapherState *) data;
 
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-    
-    if (grapher_state->dragged_vertex) {
-        grapher_state->dragged_vertex->dragging = FALSE;
-        grapher_state->dragged_vertex = NULL;
+    if (take_fresh_frame(grapher_state)) {
+        gtk_widget_queue_draw(grapher_state->drawing_area);
     }
-
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
     return TRUE;
 }
 
-gboolean on_motion_notify(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
-    GrapherState *grapher_state = (GrapherState *) data;
+// ---- Simulation ----
+/* copies the layout into the back frame and hands it to the GTK thread.
+ * while scrubbing, the vertices and edges of back then at today's
+ * positions, without heat
+ * */
+void publish_frame(GrapherState *grapher_state) {
+    GrapherFrame *frame = &grapher_state->frames[grapher_state->back_frame];
+    Layout *layout = grapher_state->layout;
+    TopologyHistory *history = &grapher_state->history;
+    const uint32_t now_ms = get_history_ms(history);
+
+    uint32_t num_vertices = layout->num_vertices;
+    uint32_t num_edges = layout->num_edges;
+    uint32_t *edge_vs = layout->edge_vs;
+    uint32_t *edge_us = layout->edge_us;
+    const uint32_t scrub_ms = grapher_state->layout_scrub_seconds * 1000;
+    if (scrub_ms > 0) {
+        uint32_t num_vertices_then;
+        num_edges = get_edges_at(history, &grapher_state->graph, now_ms > scrub_ms ? now_ms - scrub_ms : 0,
+                &grapher_state->scrub_edge_vs, &grapher_state->scrub_edge_us, &grapher_state->max_scrub_edges,
+                &num_vertices_then);
+        edge_vs = grapher_state->scrub_edge_vs;
+        edge_us = grapher_state->scrub_edge_us;
+        num_vertices = num_vertices_then < num_vertices ? num_vertices_then : num_vertices;
+    }
 
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
+    if (frame->max_vertices < num_vertices) {
+        frame->max_vertices = layout->max_vertices;
+        frame->xs = realloc(frame->xs, frame->max_vertices * sizeof(double));
+        frame->ys = realloc(frame->ys, frame->max_vertices * sizeof(double));
+        frame->labels = realloc(frame->labels, frame->max_vertices * sizeof(*frame->labels));
+        frame->vertex_heats = realloc(frame->vertex_heats, frame->max_vertices * sizeof(uint8_t));
+        frame->path_statuses = realloc(frame->path_statuses, frame->max_vertices * sizeof(uint8_t));
+        // a loop repeats one router, delivery adds the owner
+        frame->max_path_length = frame->max_vertices + 2;
+        frame->path = realloc(frame->path, frame->max_path_length * sizeof(uint32_t));
+    }
+    if (frame->max_edges < num_edges) {
+        frame->max_edges = num_edges > layout->max_edges ? num_edges : layout->max_edges;
+        frame->edge_vs = realloc(frame->edge_vs, frame->max_edges * sizeof(uint32_t));
+        frame->edge_us = realloc(frame->edge_us, frame->max_edges * sizeof(uint32_t));
+        frame->edge_heats = realloc(frame->edge_heats, frame->max_edges * sizeof(uint8_t));
+    }
+    if (!frame->sparkline) {
+        frame->sparkline = malloc(HISTORY_SAMPLES * sizeof(RouterSample));
+    }
 
-    if (grapher_state->dragged_vertex) {
-        grapher_state->dragged_vertex->pos.x = event->x;
-        grapher_state->dragged_vertex->pos.y = event->y;
-        gtk_widget_queue_draw(widget);
+    frame->num_vertices = num_vertices;
+    frame->num_edges = num_edges;
+    memcpy(frame->xs, layout->xs, num_vertices * sizeof(double));
+    memcpy(frame->ys, layout->ys, num_vertices * sizeof(double));
+    memcpy(frame->labels, grapher_state->labels, num_vertices * sizeof(*frame->labels));
+    memcpy(frame->edge_vs, edge_vs, num_edges * sizeof(uint32_t));
+    memcpy(frame->edge_us, edge_us, num_edges * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_vertices; i++) {
+        frame->vertex_heats[i] = scrub_ms > 0 ? 0 : get_router_heat(history, i, now_ms);
+    }
+    // layout edges are in the order of the graph's
+    for (uint32_t i = 0; i < num_edges; i++) {
+        frame->edge_heats[i] = scrub_ms > 0 ? 0 : get_edge_heat(history, i, now_ms);
     }
+    frame->scrub_seconds = grapher_state->layout_scrub_seconds;
+    frame->sparkline_vertex = grapher_state->layout_selected_vertex;
+    frame->num_sparkline_samples = frame->sparkline_vertex >= 0
+        ? get_router_samples(history, frame->sparkline_vertex, frame->sparkline)
+        : 0;
+
+    // paths follow today's tables, so none while scrubbing
+    PathIndex *paths = &grapher_state->paths;
+    frame->query_vertex = scrub_ms > 0 || !paths->is_active ? -1 : grapher_state->layout_query_vertex;
+    frame->path_length = 0;
+    if (frame->query_vertex >= 0) {
+        if (paths->is_dirty || paths->num_vertices < num_vertices) {
+            resolve_path_statuses(paths, &grapher_state->graph);
+        }
+        memcpy(frame->path_statuses, paths->statuses, num_vertices * sizeof(uint8_t));
+        if (frame->sparkline_vertex >= 0) {
+            frame->path_length = get_path(paths, &grapher_state->graph, frame->sparkline_vertex,
+                    frame->path, frame->max_path_length);
+        }
+    }
+    grapher_state->last_publish_ms = now_ms;
 
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
-    return TRUE;
+    // keep whichever frame the GTK thread left behind
+    grapher_state->back_frame =
+        atomic_exchange(&grapher_state->ready_frame, grapher_state->back_frame | FRAME_IS_FRESH) & ~FRAME_IS_FRESH;
 }
 
-void handle_reset(GtkButton *btn, gpointer data) {
-    GrapherState *grapher_state = (GrapherState *) data;
-
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-    grapher_state->t = 5.0;
-    grapher_state->curr_iteration = 0;
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
+void mark_vertex_changed(GrapherState *grapher_state, uint32_t vertex) {
+    if (grapher_state->num_changed_vertices == grapher_state->max_changed_vertices) {
+        grapher_state->max_changed_vertices =
+            grapher_state->max_changed_vertices > 0 ? 2 * grapher_state->max_changed_vertices : 64;
+        grapher_state->changed_vertices = realloc(grapher_state->changed_vertices,
+                grapher_state->max_changed_vertices * sizeof(uint32_t));
+    }
+    grapher_state->changed_vertices[grapher_state->num_changed_vertices++] = vertex;
 }
 
-
-// topology change utils for grapher
-int add_vertex_to_graph(GrapherState *grapher_state, uint32_t router_id, uint8_t *interface_ip) {
-    if (grapher_state->num_vertices >= GRAPHER_MAX_VERTICES) {
-        return -1;
+// called by the graph while deltas are applied
+void on_graph_change(TopologyGraph *graph, TopologyChange change, uint32_t v, uint32_t u) {
+    GrapherState *grapher_state = (GrapherState*) graph->on_change_arg;
+    record_topology_change(&grapher_state->history, graph, change, v, u);
+    if (change == TOPOLOGY_INTERFACE_ADDED) {
+        // v may own the destination now, and hops through the new ip reach v
+        update_path_hop(&grapher_state->paths, graph, &grapher_state->history, v);
+        grapher_state->paths.is_dirty = 1;
     }
+    if (change == TOPOLOGY_EDGE_ADDED || change == TOPOLOGY_EDGE_REMOVED) {
+        mark_vertex_changed(grapher_state, v);
+        mark_vertex_changed(grapher_state, u);
+    }
+}
 
-    grapher_state->vertices[grapher_state->num_vertices].router_id = router_id;
-    grapher_state->vertices[grapher_state->num_vertices].num_interfaces = 0;
-    grapher_state->vertices[grapher_state->num_vertices].interfaces = malloc(MAX_NUM_INTERFACES * sizeof(InterfaceTableEntry));
-
-    memcpy(
-        grapher_state->vertices[grapher_state->num_vertices].interfaces[0].interface_ip,
-        interface_ip,
-        4
-    );
-    grapher_state->vertices[grapher_state->num_vertices].num_interfaces += 1;
-
-    grapher_state->vertices[grapher_state->num_vertices].pos.x = rand() % WIDTH;
-    grapher_state->vertices[grapher_state->num_vertices].pos.y = rand() % HEIGHT;
-    grapher_state->vertices[grapher_state->num_vertices].disp.x = 0;
-    grapher_state->vertices[grapher_state->num_vertices].disp.y = 0;
-    grapher_state->vertices[grapher_state->num_vertices].dragging = FALSE;
-    grapher_state->num_vertices += 1;
-    return 0;
+/* the vertex and its neighbors may move again
+ * */
+void heat_neighborhood(GrapherState *grapher_state, uint32_t vertex, double t) {
+    TopologyGraph *graph = &grapher_state->graph;
+    heat_layout_vertex(grapher_state->layout, vertex, t);
+    for (uint32_t i = 0; i < graph->vertices[vertex].degree; i++) {
+        Edge *edge = &graph->edges[graph->vertices[vertex].adjacent_edges[i]];
+        heat_layout_vertex(grapher_state->layout, get_other_end(edge, vertex), t);
+    }
 }
 
-int get_index_of_vertex_in_graph_with_id(GrapherState *grapher_state, uint32_t router_id) {
-    for (uint32_t i = 0; i < grapher_state->num_vertices; i++) {
-        if (grapher_state->vertices[i].router_id == router_id) {
-            return i;
+/* next to the neighbors that are already placed, or anywhere if there
+ * are none
+ * */
+Vec2 get_new_vertex_position(GrapherState *grapher_state, uint32_t vertex) {
+    TopologyGraph *graph = &grapher_state->graph;
+    Layout *layout = grapher_state->layout;
+    Vec2 position = { 0, 0 };
+    uint32_t num_placed = 0;
+    for (uint32_t i = 0; i < graph->vertices[vertex].degree; i++) {
+        const uint32_t neighbor = get_other_end(&graph->edges[graph->vertices[vertex].adjacent_edges[i]], vertex);
+        if (neighbor < layout->num_vertices) {
+            position.x += layout->xs[neighbor];
+            position.y += layout->ys[neighbor];
+            num_placed += 1;
         }
     }
 
-    return -1;
+    if (num_placed == 0) {
+        position.x = rand() % WIDTH;
+        position.y = rand() % HEIGHT;
+        return position;
+    }
+    // a little apart, so the repulsion has a direction
+    position.x = position.x / num_placed + (rand() % (4 * RADIUS)) - 2.0 * RADIUS;
+    position.y = position.y / num_placed + (rand() % (4 * RADIUS)) - 2.0 * RADIUS;
+    return position;
 }
 
-int add_interface_to_vertex_if_not_exists(GrapherState *grapher_state, uint32_t vertex_index, uint8_t *interface_ip) {
-    uint32_t vertex_num_interfaces = grapher_state->vertices[vertex_index].num_interfaces;
-    if (vertex_num_interfaces >= MAX_NUM_INTERFACES) {
-        // vertex contains maximum number of interfaces
-        return -1;
+/* applies every pending delta, then brings new vertices, edges, the
+ * dragged vertex and resets over to the layout. returns 1 if anything
+ * changed
+ * */
+int sync_layout_with_graph(GrapherState *grapher_state) {
+    Layout *layout = grapher_state->layout;
+    TopologyGraph *graph = &grapher_state->graph;
+    int is_changed = 0;
+
+    TopologyDelta *delta = &grapher_state->applied_delta;
+    while (pop_topology_delta(&grapher_state->delta_ring, delta)) {
+        const uint32_t vertex = apply_topology_delta(graph, delta);
+        record_router_update(&grapher_state->history, graph, vertex, delta->entries, delta->num_entries);
+        update_path_hop(&grapher_state->paths, graph, &grapher_state->history, vertex);
+    }
+    // only a changed hop moves a path or a flag
+    if (grapher_state->paths.is_active && grapher_state->paths.is_dirty) {
+        is_changed = 1;
     }
 
-    for (uint32_t i = 0; i < vertex_num_interfaces; i++) {
-        if (match_ips(
-            grapher_state->vertices[vertex_index].interfaces[i].interface_ip,
-            interface_ip
-        )) {
-            // interface already exists in the found vertex
-            return 0;
+    while (layout->num_vertices < graph->num_vertices) {
+        if (grapher_state->max_labels == layout->num_vertices) {
+            grapher_state->max_labels = grapher_state->max_labels > 0 ? 2 * grapher_state->max_labels : 64;
+            grapher_state->labels = realloc(grapher_state->labels,
+                    grapher_state->max_labels * sizeof(*grapher_state->labels));
         }
+        memcpy(grapher_state->labels[layout->num_vertices],
+                graph->vertices[layout->num_vertices].interfaces[0].interface_ip, 4);
+        Vec2 position = get_new_vertex_position(grapher_state, layout->num_vertices);
+        add_layout_vertex(layout, position.x, position.y);
+        is_changed = 1;
     }
-    
-    // add interface to vertex
-    memcpy(
-        grapher_state->vertices[vertex_index].interfaces[vertex_num_interfaces].interface_ip,
-        interface_ip,
-        4
-    );
-    grapher_state->vertices[vertex_index].num_interfaces += 1;
 
-    return 0;
-}
+    for (uint32_t i = 0; i < grapher_state->num_changed_vertices; i++) {
+        heat_neighborhood(grapher_state, grapher_state->changed_vertices[i], GRAPHER_REHEAT_TEMPERATURE);
+    }
+    grapher_state->num_changed_vertices = 0;
 
-int remove_edge_between_interfaces(GrapherState *grapher_state, uint8_t *ip_one, uint8_t *ip_two) {
-    if (grapher_state->num_edges == 0) {
-        return -1;
+    if (grapher_state->layout_topology_version != graph->topology_version) {
+        layout->num_edges = 0;
+        for (uint32_t i = 0; i < graph->num_edges; i++) {
+            add_layout_edge(layout, graph->edges[i].v, graph->edges[i].u);
+        }
+        grapher_state->layout_topology_version = graph->topology_version;
+        is_changed = 1;
     }
 
-    for (uint32_t i = 0; i < grapher_state->num_edges; i++) {
-        Edge *curr_edge = &grapher_state->edges[i];
-        if (
-            (match_ips(curr_edge->v->interfaces[0].interface_ip, ip_one) && (match_ips(curr_edge->u->interfaces[0].interface_ip, ip_two))) ||
-            (match_ips(curr_edge->v->interfaces[0].interface_ip, ip_two) && (match_ips(curr_edge->u->interfaces[0].interface_ip, ip_one)))
-        ) {
-            if (i == grapher_state->num_edges - 1) {
-                memset(&grapher_state->edges[i], 0, sizeof(Edge));
-            }
-            else {
-                memcpy(
-                    &grapher_state->edges[i],
-                    &grapher_state->edges[grapher_state->num_edges - 1],
-                    sizeof(Edge)
-                );
-                memset(&grapher_state->edges[grapher_state->num_edges - 1], 0, sizeof(Edge));
-            }
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    if (grapher_state->is_reset_requested) {
+        heat_layout(layout, LAYOUT_START_TEMPERATURE);
+        grapher_state->is_reset_requested = 0;
+    }
+    int32_t dragged_vertex = grapher_state->dragged_vertex;
+    Vec2 drag_pos = grapher_state->drag_pos;
+    int32_t query_vertex = grapher_state->query_vertex;
+    if (grapher_state->layout_selected_vertex != grapher_state->selected_vertex ||
+            grapher_state->layout_scrub_seconds != grapher_state->scrub_seconds) {
+        grapher_state->layout_selected_vertex = grapher_state->selected_vertex;
+        grapher_state->layout_scrub_seconds = grapher_state->scrub_seconds;
+        is_changed = 1;
+    }
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+
+    // every hop once for a new destination, then only the routers that send a table
+    if (grapher_state->layout_query_vertex != query_vertex && query_vertex < (int32_t) graph->num_vertices) {
+        grapher_state->layout_query_vertex = query_vertex;
+        if (query_vertex >= 0) {
+            set_path_destination(&grapher_state->paths, graph, &grapher_state->history,
+                    graph->vertices[query_vertex].interfaces[0].interface_ip);
+        } else {
+            clear_path_destination(&grapher_state->paths);
+        }
+        is_changed = 1;
+    }
 
-            grapher_state->num_edges -= 1;
-            return 0;
+    if (grapher_state->layout_pinned_vertex >= 0 && grapher_state->layout_pinned_vertex != dragged_vertex) {
+        layout->pinned[grapher_state->layout_pinned_vertex] = 0;
+    }
+    grapher_state->layout_pinned_vertex = -1;
+    if (dragged_vertex >= 0 && dragged_vertex < layout->num_vertices) {
+        layout->pinned[dragged_vertex] = 1;
+        if (layout->xs[dragged_vertex] != drag_pos.x || layout->ys[dragged_vertex] != drag_pos.y) {
+            layout->xs[dragged_vertex] = drag_pos.x;
+            layout->ys[dragged_vertex] = drag_pos.y;
+            heat_neighborhood(grapher_state, dragged_vertex, GRAPHER_REHEAT_TEMPERATURE);
+            is_changed = 1;
         }
+        grapher_state->layout_pinned_vertex = dragged_vertex;
     }
 
-    return -1;
+    return is_changed;
 }
 
-int add_edge_to_graph(GrapherState *grapher_state, int index_one, int index_two) {
-    if (grapher_state->num_edges >= GRAPHER_MAX_EDGES) {
-        return -1;
+double get_monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/* one layout step per frame until the layout settles, then nothing
+ * until a change heats it again. the physics run here and on the layout
+ * workers, the GTK thread only swaps frames
+ * */
+void *grapher_layout(void *arg_grapher_state) {
+    GrapherState *grapher_state = (GrapherState *) arg_grapher_state;
+
+    while (!atomic_load(&grapher_state->is_layout_stopping)) {
+        const double step_start_ms = get_monotonic_ms();
+
+        int is_changed = sync_layout_with_graph(grapher_state);
+        if (!grapher_state->layout->is_settled) {
+            step_layout(grapher_state->layout);
+            is_changed = 1;
+        }
+        // heat fades and sparklines grow without any layout change
+        if (get_history_ms(&grapher_state->history) - grapher_state->last_publish_ms >= GRAPHER_HISTORY_REFRESH_MS) {
+            is_changed = 1;
+        }
+        if (is_changed) {
+            publish_frame(grapher_state);
+        }
+
+        // woken early by drags, resets and new routers
+        const double elapsed_ms = get_monotonic_ms() - step_start_ms;
+        const uint32_t timeout_ms = !grapher_state->layout->is_settled
+            ? (elapsed_ms < GRAPHER_FRAME_MS ? GRAPHER_FRAME_MS - elapsed_ms : 0)
+            : GRAPHER_HISTORY_REFRESH_MS;
+        if (wait_for_wakeup(grapher_state->layout_wakeup_fd, timeout_ms)) {
+            uint64_t wakeups;
+            ssize_t read_res = read(grapher_state->layout_wakeup_fd, &wakeups, sizeof(wakeups));
+            (void) read_res;
+        }
     }
 
-    grapher_state->edges[grapher_state->num_edges].v = &grapher_state->vertices[index_one];
-    grapher_state->edges[grapher_state->num_edges].u = &grapher_state->vertices[index_two];
-    grapher_state->num_edges += 1;
+    return NULL;
+}
 
-    return 0;
+void set_dragged_vertex(GrapherState *grapher_state, int32_t vertex, double x, double y) {
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    grapher_state->dragged_vertex = vertex;
+    grapher_state->drag_pos.x = x;
+    grapher_state->drag_pos.y = y;
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
+}
+
+void set_selected_vertex(GrapherState *grapher_state, int32_t vertex) {
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    grapher_state->selected_vertex = vertex;
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
 }
 
-NeighborsState *get_neighbors_of_vertex(GrapherState *grapher_state, uint8_t *interface_ip) {
-    NeighborsState *neighbors_state = malloc(sizeof(NeighborsState));
-    neighbors_state->neighbors = malloc(GRAPHER_MAX_VERTICES * sizeof(NeighborVert));
-    neighbors_state->num_neighbors = 0;
-
-    for (uint32_t i = 0; i < grapher_state->num_edges; i++) {
-        if (match_ips(grapher_state->edges[i].v->interfaces[0].interface_ip, interface_ip)) {
-            memcpy(
-                &neighbors_state->neighbors[neighbors_state->num_neighbors].vert,
-                grapher_state->edges[i].u,
-                sizeof(Vertex)
-            );
-            neighbors_state->neighbors[neighbors_state->num_neighbors].checked = 0;
-            neighbors_state->num_neighbors += 1;
+void set_query_vertex(GrapherState *grapher_state, int32_t vertex) {
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    grapher_state->query_vertex = vertex;
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
+}
+
+/* left click selects and drags a router, right click queries the path
+ * from the selected router to it
+ * */
+gboolean on_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+    GrapherFrame *frame = &grapher_state->frames[grapher_state->front_frame];
+    const double x = (event->x - grapher_state->view_x) / grapher_state->view_scale;
+    const double y = (event->y - grapher_state->view_y) / grapher_state->view_scale;
+
+    for (uint32_t i = 0; i < frame->num_vertices; i++) {
+        double dx = x - frame->xs[i];
+        double dy = y - frame->ys[i];
+        if (sqrt(dx * dx + dy * dy) < RADIUS && event->button == 3) {
+            set_query_vertex(grapher_state, i);
+            return TRUE;
         }
-        else if (match_ips(grapher_state->edges[i].u->interfaces[0].interface_ip, interface_ip)) {
-            memcpy(
-                &neighbors_state->neighbors[neighbors_state->num_neighbors].vert,
-                grapher_state->edges[i].v,
-                sizeof(Vertex)
-            );
-            neighbors_state->neighbors[neighbors_state->num_neighbors].checked = 0;
-            neighbors_state->num_neighbors += 1;
+        if (sqrt(dx * dx + dy * dy) < RADIUS) {
+            set_selected_vertex(grapher_state, i);
+            set_dragged_vertex(grapher_state, i, x, y);
+            return TRUE;
         }
     }
 
-    return neighbors_state;
+    if (event->button == 3) {
+        set_query_vertex(grapher_state, -1);
+        return TRUE;
+    }
+    // empty space, move the view
+    set_selected_vertex(grapher_state, -1);
+    grapher_state->is_panning = TRUE;
+    grapher_state->pan_from.x = event->x;
+    grapher_state->pan_from.y = event->y;
+    return TRUE;
+}
+
+gboolean on_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+
+    if (grapher_state->dragged_vertex >= 0) {
+        set_dragged_vertex(grapher_state, -1, 0, 0);
+    }
+    grapher_state->is_panning = FALSE;
+
+    return TRUE;
 }
 
-int get_index_of_vertex_in_graph_with_interface_ip(GrapherState *grapher_state, uint8_t *interface_ip) {
-    for (uint32_t i = 0; i < grapher_state->num_vertices; i++) {
-        for (uint32_t j = 0; j < grapher_state->vertices[i].num_interfaces; j++) {
-            if (match_ips(
-                grapher_state->vertices[i].interfaces[j].interface_ip,
-                interface_ip
-            )) {
-                return i;
-            }
+gboolean on_motion_notify(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+    GrapherFrame *frame = &grapher_state->frames[grapher_state->front_frame];
+    int32_t dragged_vertex = grapher_state->dragged_vertex;
+
+    if (dragged_vertex >= 0) {
+        const double x = (event->x - grapher_state->view_x) / grapher_state->view_scale;
+        const double y = (event->y - grapher_state->view_y) / grapher_state->view_scale;
+        set_dragged_vertex(grapher_state, dragged_vertex, x, y);
+        // follow the pointer before the layout thread catches up
+        if (dragged_vertex < frame->num_vertices) {
+            frame->xs[dragged_vertex] = x;
+            frame->ys[dragged_vertex] = y;
         }
+        gtk_widget_queue_draw(widget);
+    } else if (grapher_state->is_panning) {
+        grapher_state->view_x += event->x - grapher_state->pan_from.x;
+        grapher_state->view_y += event->y - grapher_state->pan_from.y;
+        grapher_state->pan_from.x = event->x;
+        grapher_state->pan_from.y = event->y;
+        gtk_widget_queue_draw(widget);
+    }
+
+    return TRUE;
+}
+
+/* zooms around the pointer
+ * */
+gboolean on_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+
+    double factor = 1.0;
+    if (event->direction == GDK_SCROLL_UP) {
+        factor = GRAPHER_ZOOM_STEP;
+    } else if (event->direction == GDK_SCROLL_DOWN) {
+        factor = 1 / GRAPHER_ZOOM_STEP;
+    } else if (event->direction == GDK_SCROLL_SMOOTH) {
+        factor = pow(GRAPHER_ZOOM_STEP, -event->delta_y);
     }
 
-    return -1;
+    const double new_scale = fmin(fmax(grapher_state->view_scale * factor, GRAPHER_MIN_SCALE), GRAPHER_MAX_SCALE);
+    grapher_state->view_x = event->x - (event->x - grapher_state->view_x) * new_scale / grapher_state->view_scale;
+    grapher_state->view_y = event->y - (event->y - grapher_state->view_y) * new_scale / grapher_state->view_scale;
+    grapher_state->view_scale = new_scale;
+    gtk_widget_queue_draw(widget);
+    return TRUE;
 }
 
-NeighborVert* find_vertex_in_neighbors_state(NeighborsState *neighbors_state, uint8_t *interface_ip) {
-    for (uint32_t i = 0; i < neighbors_state->num_neighbors; i++) {
-        if (match_ips(neighbors_state->neighbors[i].vert.interfaces[0].interface_ip, interface_ip)) {
-            return &neighbors_state->neighbors[i];
-        }
+void on_scrub(GtkRange *range, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+    const uint32_t scrub_seconds = gtk_range_get_value(range);
+
+    char scrub_text[32];
+    if (scrub_seconds == 0) {
+        snprintf(scrub_text, sizeof(scrub_text), "live");
+    } else {
+        snprintf(scrub_text, sizeof(scrub_text), "%us ago", scrub_seconds);
     }
+    gtk_label_set_text(GTK_LABEL(grapher_state->scrub_label), scrub_text);
 
-    return NULL;
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    grapher_state->scrub_seconds = scrub_seconds;
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
+}
+
+void handle_reset(GtkButton *btn, gpointer data) {
+    GrapherState *grapher_state = (GrapherState *) data;
+
+    pthread_mutex_lock(&grapher_state->drag_mutex);
+    grapher_state->is_reset_requested = 1;
+    pthread_mutex_unlock(&grapher_state->drag_mutex);
+    signal_wakeup(grapher_state->layout_wakeup_fd);
 }
 
 
+// run on the GTK thread, the listener can't call gtk_main_quit itself
+gboolean quit_grapher(gpointer data) {
+    (void) data;
+    gtk_main_quit();
+    return FALSE;
+}
 
+/* ends when listen_stop_fd is signalled. on an error it quits the GTK
+ * loop and returns non-NULL, main cleans up after it
+ * */
 void *grapher_listen(void *arg_grapher_state) {
     GrapherState *grapher_state = (GrapherState *) arg_grapher_state;
 
@@ -384,16 +814,17 @@ void *grapher_listen(void *arg_grapher_state) {
     struct sockaddr_in listen_addr, sender_addr;
     socklen_t addr_len = sizeof(sender_addr);
     uint8_t rec_buffer[BUFFER_SIZE];
+    TopologyDelta delta;
+    delta.max_neighbors = ROUTER_TABLE_MAX_SIZE;
+    delta.neighbor_ips = malloc(delta.max_neighbors * sizeof(*delta.neighbor_ips));
+    delta.max_entries = ROUTER_TABLE_MAX_SIZE;
+    delta.entries = malloc(delta.max_entries * sizeof(RouterTableEntry));
+    void *listen_rc = (void*) -1;
 
     sock = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock < 0) {
         perror("socket creation failed");
-        free_vertex_interfaces(grapher_state);
-        free(grapher_state->vertices);
-        free(grapher_state->edges);
-        pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-        free(grapher_state);
-        exit(EXIT_FAILURE);
+        goto end_listen;
     }
 
     int reuse = 1;
@@ -403,13 +834,7 @@ void *grapher_listen(void *arg_grapher_state) {
     );
     if (setsock_res < 0) {
         perror("setsockopt with SO_REUSEADDR failed");
-        close(sock);
-        free_vertex_interfaces(grapher_state);
-        free(grapher_state->vertices);
-        free(grapher_state->edges);
-        pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-        free(grapher_state);
-        exit(EXIT_FAILURE);
+        goto end_listen;
     }
 
     memset(&listen_addr, 0, sizeof(listen_addr));
@@ -423,16 +848,27 @@ void *grapher_listen(void *arg_grapher_state) {
     );
     if (bind_res < 0) {
         perror("bind failed");
-        close(sock);
-        free_vertex_interfaces(grapher_state);
-        free(grapher_state->vertices);
-        free(grapher_state->edges);
-        pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-        free(grapher_state);
-        exit(EXIT_FAILURE);
+        goto end_listen;
     }
 
     while (1) {
+        struct pollfd poll_fds[2] = {
+            { .fd = sock, .events = POLLIN },
+            { .fd = grapher_state->listen_stop_fd, .events = POLLIN }
+        };
+        if (poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll failed");
+            goto end_listen;
+        }
+
+        if (poll_fds[1].revents & POLLIN) {
+            listen_rc = NULL;
+            break;
+        }
+
         int bytes_received = recvfrom(sock,
                 rec_buffer, BUFFER_SIZE - 1,
                 0,
@@ -441,157 +877,101 @@ void *grapher_listen(void *arg_grapher_state) {
         );
         if (bytes_received < 0) {
             perror("recvform failed");
-            close(sock);
-            free_vertex_interfaces(grapher_state);
-            free(grapher_state->vertices);
-            free(grapher_state->edges);
-            pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-            free(grapher_state);
-            exit(EXIT_FAILURE);
-        }
-
-        if (bytes_received == 1 && rec_buffer[0] == 1) {
-            continue;
-        }
-
-        RouterState *rec_router_state = malloc(sizeof(RouterState));
-        rec_router_state->router_table = malloc(ROUTER_TABLE_MAX_SIZE * sizeof(RouterTableEntry));
-        rec_router_state->interfaces = malloc(MAX_NUM_INTERFACES * sizeof(InterfaceTableEntry));
-        memcpy(rec_router_state->interfaces[0].interface_ip, rec_buffer, 4);
-        memcpy(&rec_router_state->router_id, rec_buffer + 4, 4);
-        memcpy(&rec_router_state->num_entries, rec_buffer + 8, 4);
-        memcpy(
-            rec_router_state->router_table,
-            rec_buffer + 12,
-            rec_router_state->num_entries * sizeof(RouterTableEntry)
-        );
-        
-        pthread_mutex_lock(&grapher_state->change_graph_mutex);
-
-        int curr_router_index_in_graph = get_index_of_vertex_in_graph_with_id(grapher_state, rec_router_state->router_id);
-        if (curr_router_index_in_graph < 0) {
-            // if not in graph, add vertex for received router
-            int add_vertex_rc = add_vertex_to_graph(grapher_state, rec_router_state->router_id, rec_router_state->interfaces[0].interface_ip);
-            if (add_vertex_rc < 0) {
-                free(rec_router_state->router_table);
-                free(rec_router_state->interfaces);
-                free(rec_router_state);
-                free_vertex_interfaces(grapher_state);
-                free(grapher_state->vertices);
-                free(grapher_state->edges);
-                pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-                free(grapher_state);
-                exit(EXIT_FAILURE);
-            }
-
-            curr_router_index_in_graph = grapher_state->num_vertices - 1;
-        } else {
-            // else, add the received interface to the vertex if it is not already present
-            add_interface_to_vertex_if_not_exists(
-                grapher_state,
-                curr_router_index_in_graph,
-                rec_router_state->interfaces[0].interface_ip
-            );
+            goto end_listen;
         }
 
-        // the received router table is from a host (it has only one entry -> itself)
-        // we shouldn't update his neighbors in the graph
-        if (rec_router_state->num_entries == 1) {
-            pthread_mutex_unlock(&grapher_state->change_graph_mutex);
+        if (decode_topology_delta(rec_buffer, bytes_received, &delta) < 0) {
             continue;
         }
 
-        // get neighbors of current router vertex
-        NeighborsState *neighbors_state =
-            get_neighbors_of_vertex(grapher_state, rec_router_state->interfaces[0].interface_ip);
-
-        for (uint32_t i = 0; i < rec_router_state->num_entries; i++) {
-            if (rec_router_state->router_table[i].metric == 1) {
-                uint8_t *ip_to_find = rec_router_state->router_table[i].destination;
-                NeighborVert *found_vertex =
-                    find_vertex_in_neighbors_state(neighbors_state, ip_to_find);
-
-                if (found_vertex != NULL) {
-                    // neighbor already exists. make sure that edge stays in the graph
-                    found_vertex->checked = 1;
-                } else {
-                    // if vertex exists in the graph but is not a neighbor then
-                    // vertex needs to be added as a neighbor to the current router's vertex
-                    int found_index_in_graph = 
-                        get_index_of_vertex_in_graph_with_interface_ip(grapher_state, ip_to_find);
-
-                    if (found_index_in_graph >= 0) {
-                        add_edge_to_graph(
-                            grapher_state,
-                            curr_router_index_in_graph,
-                            found_index_in_graph
-                        );
-                    }
-                }
-            }
-        }
-
-        for (uint32_t i = 0; i < neighbors_state->num_neighbors; i++) {
-            if (neighbors_state->neighbors[i].checked == 0) {
-                // this vertex is no longer a neighbor of the router vertex.
-                remove_edge_between_interfaces(
-                    grapher_state,
-                    rec_router_state->interfaces[0].interface_ip,
-                    neighbors_state->neighbors[i].vert.interfaces[0].interface_ip
-                );
-            }
+        // the layout thread applies it with the next frame
+        int was_empty;
+        if (push_topology_delta(&grapher_state->delta_ring, &delta, &was_empty) == 0 && was_empty) {
+            signal_wakeup(grapher_state->layout_wakeup_fd);
         }
-        pthread_mutex_unlock(&grapher_state->change_graph_mutex);
-
-        // free neighbors state
-        free(neighbors_state->neighbors);
-        free(neighbors_state);
-
-        // free received router state
-        free(rec_router_state->router_table);
-        free(rec_router_state->interfaces);
-        free(rec_router_state);
     }
 
-    close(sock);
+end_listen:
+    if (listen_rc != NULL) {
+        g_idle_add(quit_grapher, NULL);
+    }
+    free(delta.neighbor_ips);
+    free(delta.entries);
+    if (sock >= 0) {
+        close(sock);
+    }
     log_printf("grapher_listen ended\n");
-    return NULL;
+    return listen_rc;
 }
 
-GrapherState *startup_grapher() {
-    GrapherState *grapher_state = malloc(sizeof(GrapherState));
-    grapher_state->vertices = malloc(GRAPHER_MAX_VERTICES * sizeof(Vertex));
-    grapher_state->edges = malloc(GRAPHER_MAX_EDGES * sizeof(Edge));
-    pthread_mutex_init(&grapher_state->change_graph_mutex, NULL);
-
-    grapher_state->num_vertices = 0;
-    grapher_state->num_edges = 0;
-    grapher_state->num_edges = 0;
-    grapher_state->curr_iteration = 0;
-    grapher_state->t = 5.0;
+GrapherState *startup_grapher(double theta, uint32_t num_layout_workers) {
+    GrapherState *grapher_state = calloc(1, sizeof(GrapherState));
+    grapher_state->listen_stop_fd = -1;
+    init_topology_graph(&grapher_state->graph, GRAPHER_INITIAL_VERTICES, GRAPHER_INITIAL_EDGES);
+    grapher_state->graph.on_change = on_graph_change;
+    grapher_state->graph.on_change_arg = grapher_state;
+    pthread_mutex_init(&grapher_state->drag_mutex, NULL);
+    init_delta_ring(&grapher_state->delta_ring, DELTA_RING_SIZE);
+    grapher_state->applied_delta.max_neighbors = ROUTER_TABLE_MAX_SIZE;
+    grapher_state->applied_delta.neighbor_ips =
+        malloc(grapher_state->applied_delta.max_neighbors * sizeof(*grapher_state->applied_delta.neighbor_ips));
+    grapher_state->applied_delta.max_entries = ROUTER_TABLE_MAX_SIZE;
+    grapher_state->applied_delta.entries =
+        malloc(grapher_state->applied_delta.max_entries * sizeof(RouterTableEntry));
+    init_topology_history(&grapher_state->history);
+
+    grapher_state->layout = create_layout(WIDTH, HEIGHT, theta, num_layout_workers);
+    grapher_state->layout_topology_version = 0;
+    grapher_state->layout_pinned_vertex = -1;
+    grapher_state->layout_query_vertex = -1;
+    init_path_index(&grapher_state->paths);
+    atomic_init(&grapher_state->is_layout_stopping, 0);
+    grapher_state->front_frame = 0;
+    atomic_init(&grapher_state->ready_frame, 1);
+    grapher_state->back_frame = 2;
+    grapher_state->dragged_vertex = -1;
+    grapher_state->selected_vertex = -1;
+    grapher_state->query_vertex = -1;
+    grapher_state->view_scale = 1.0;
     grapher_state->drawing_area = gtk_drawing_area_new();
-    grapher_state->dragged_vertex = NULL;
+
+    grapher_state->layout_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (grapher_state->layout_wakeup_fd < 0) {
+        perror("eventfd creation failed");
+        free_grapher_state(grapher_state);
+        exit(EXIT_FAILURE);
+    }
 
     // TODO delete this
     uint8_t test_ip_one[4] = { 0, 0, 0, 0 };
-    pthread_mutex_lock(&grapher_state->change_graph_mutex);
-    add_vertex_to_graph(grapher_state, 0, test_ip_one);
-    pthread_mutex_unlock(&grapher_state->change_graph_mutex);
+    add_vertex_to_graph(&grapher_state->graph, 0, test_ip_one);
 
     return grapher_state;
 }
 
+/* returns -1 when a thread can't be started, the ones that were are
+ * stopped by main
+ * */
 int split_threads(GrapherState *grapher_state) {
-    int is_thread_error = 0;
-    pthread_t threads[1];
-
-    int rc_one = pthread_create(&threads[0], NULL, grapher_listen, (void*) grapher_state);
+    int rc_one = pthread_create(&grapher_state->layout_thread, NULL, grapher_layout, (void*) grapher_state);
     if (rc_one) {
-        free_vertex_interfaces(grapher_state);
-        free(grapher_state->vertices);
-        free(grapher_state->edges);
-        pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-        free(grapher_state);
+        // nothing to join
+        close(grapher_state->layout_wakeup_fd);
+        grapher_state->layout_wakeup_fd = -1;
+        perror("Error initializing threads.");
+        return -1;
+    }
+
+    grapher_state->listen_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (grapher_state->listen_stop_fd < 0) {
+        perror("eventfd creation failed");
+        return -1;
+    }
+    int rc_two = pthread_create(&grapher_state->listen_thread, NULL, grapher_listen, (void*) grapher_state);
+    if (rc_two) {
+        close(grapher_state->listen_stop_fd);
+        grapher_state->listen_stop_fd = -1;
+        perror("Error initializing threads.");
         return -1;
     }
 
@@ -604,7 +984,27 @@ int main(int argc, char *argv[]) {
     srand(time(NULL));
     gtk_init(&argc, &argv);
 
-    GrapherState *grapher_state = startup_grapher();
+    // -t 0 is the exact O(V^2) repulsion
+    double theta = LAYOUT_DEFAULT_THETA;
+    long num_layout_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "t:w:")) != -1) {
+        switch (opt) {
+            case 't': theta = atof(optarg); break;
+            case 'w': num_layout_workers = atol(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-t barnes_hut_theta] [-w layout_workers]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (theta < 0 || num_layout_workers < 1) {
+        fprintf(stderr, "Usage: %s [-t barnes_hut_theta] [-w layout_workers]\n", argv[0]);
+        errno = EINVAL;
+        perror("Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    GrapherState *grapher_state = startup_grapher(theta, num_layout_workers);
 
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Force Graph GTK");
@@ -616,33 +1016,42 @@ int main(int argc, char *argv[]) {
     gtk_widget_set_size_request(grapher_state->drawing_area, WIDTH, HEIGHT);
     gtk_box_pack_start(GTK_BOX(vbox), grapher_state->drawing_area, TRUE, TRUE, 0);
 
+    // seconds back in the recorded topology, 0 = live
+    GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+    GtkWidget *scrub_scale = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, GRAPHER_SCRUB_SECONDS, 1);
+    gtk_scale_set_draw_value(GTK_SCALE(scrub_scale), FALSE);
+    gtk_box_pack_start(GTK_BOX(hbox), scrub_scale, TRUE, TRUE, 0);
+    grapher_state->scrub_label = gtk_label_new("live");
+    gtk_box_pack_start(GTK_BOX(hbox), grapher_state->scrub_label, FALSE, FALSE, 0);
+
     GtkWidget *button = gtk_button_new_with_label("Reset");
-    gtk_box_pack_start(GTK_BOX(vbox), button, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(hbox), button, FALSE, FALSE, 0);
 
     g_signal_connect(grapher_state->drawing_area, "draw", G_CALLBACK(draw_graph), grapher_state);
     g_signal_connect(grapher_state->drawing_area, "button-press-event", G_CALLBACK(on_button_press), grapher_state);
     g_signal_connect(grapher_state->drawing_area, "button-release-event", G_CALLBACK(on_button_release), grapher_state);
     g_signal_connect(grapher_state->drawing_area, "motion-notify-event", G_CALLBACK(on_motion_notify), grapher_state);
+    g_signal_connect(grapher_state->drawing_area, "scroll-event", G_CALLBACK(on_scroll), grapher_state);
 
-    gtk_widget_add_events(grapher_state->drawing_area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK);
+    gtk_widget_add_events(grapher_state->drawing_area,
+            GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK | GDK_SCROLL_MASK);
 
     g_signal_connect(button, "clicked", G_CALLBACK(handle_reset), grapher_state);
+    g_signal_connect(scrub_scale, "value-changed", G_CALLBACK(on_scrub), grapher_state);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), grapher_state);
 
     gtk_widget_show_all(window);
-    g_timeout_add(16, simulate, grapher_state);
+    g_timeout_add(GRAPHER_FRAME_MS, refresh_frame, grapher_state);
 
     int split_threads_rc = split_threads(grapher_state);
-    if (split_threads_rc < 0) {
-        exit(EXIT_FAILURE);
+    if (split_threads_rc == 0) {
+        gtk_main();
     }
 
-    gtk_main();
-
-    free_vertex_interfaces(grapher_state);
-    free(grapher_state->vertices);
-    free(grapher_state->edges);
-    pthread_mutex_destroy(&grapher_state->change_graph_mutex);
-    free(grapher_state);
-    return 0;
+    // nothing touches the state once both threads are joined
+    const int listen_rc = stop_grapher_listen(grapher_state);
+    stop_grapher_layout(grapher_state);
+    free_grapher_state(grapher_state);
+    return (split_threads_rc < 0 || listen_rc < 0) ? EXIT_FAILURE : 0;
 }
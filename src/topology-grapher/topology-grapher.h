@@ -3,53 +3,126 @@
 
 #include <gtk/gtk.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <first.h>
+#include <layout.h>
+#include <topology.h>
+#include <history.h>
+#include <paths.h>
 
 extern const uint32_t WIDTH;
 extern const uint32_t HEIGHT;
 extern const uint32_t RADIUS;
-extern const uint32_t ITERATIONS;
-extern const uint32_t GRAPHER_MAX_VERTICES;
-extern const uint32_t GRAPHER_MAX_EDGES;
+extern const uint32_t GRAPHER_INITIAL_VERTICES;
+extern const uint32_t GRAPHER_INITIAL_EDGES;
+extern const uint32_t GRAPHER_FRAME_MS;
+extern const uint32_t FRAME_IS_FRESH;
+extern const double GRAPHER_REHEAT_TEMPERATURE;
+extern const uint32_t GRAPHER_SCRUB_SECONDS;
+extern const uint32_t GRAPHER_HISTORY_REFRESH_MS;
+extern const double SPARKLINE_WIDTH;
+extern const double SPARKLINE_HEIGHT;
+extern const uint32_t LABEL_WIDTH;
+extern const uint32_t LABEL_HEIGHT;
+extern const double GRAPHER_LABEL_MIN_SCALE;
+extern const uint32_t GRAPHER_MAX_LABELS;
+extern const double GRAPHER_MIN_ARC_RADIUS;
+extern const double GRAPHER_ZOOM_STEP;
+extern const double GRAPHER_MIN_SCALE;
+extern const double GRAPHER_MAX_SCALE;
 
+// everything draw_graph needs from one layout step
 typedef struct {
-    double x, y;
-} Vec2;
+    double *xs, *ys;
+    // interfaces[0] of every vertex
+    uint8_t (*labels)[4];
+    uint32_t num_vertices;
+    uint32_t max_vertices;
+    uint32_t *edge_vs, *edge_us;
+    uint32_t num_edges;
+    uint32_t max_edges;
+    // 0 .. HISTORY_HEAT_LEVELS - 1
+    uint8_t *vertex_heats;
+    uint8_t *edge_heats;
+    // of the selected vertex, -1 for none
+    int32_t sparkline_vertex;
+    RouterSample *sparkline;
+    uint32_t num_sparkline_samples;
+    // 0 when live
+    uint32_t scrub_seconds;
+    // toward the queried vertex, -1 for no query
+    int32_t query_vertex;
+    uint8_t *path_statuses;
+    // from the selected vertex
+    uint32_t *path;
+    uint32_t path_length;
+    uint32_t max_path_length;
+} GrapherFrame;
 
-typedef struct {
-    Vec2 pos, disp;
-    gboolean dragging;
-    uint32_t router_id;
-    InterfaceTableEntry *interfaces;
-    uint32_t num_interfaces;
-} Vertex;
 
 typedef struct {
-    Vertex *v, *u;
-} Edge;
+    // grapher_listen decodes packets into deltas, the layout thread applies them
+    DeltaRing delta_ring;
 
+    // layout thread only
+    TopologyGraph graph;
+    TopologyDelta applied_delta;
+    TopologyHistory history;
+    // the edges while scrubbing
+    uint32_t *scrub_edge_vs, *scrub_edge_us;
+    uint32_t max_scrub_edges;
+    int32_t layout_selected_vertex;
+    uint32_t layout_scrub_seconds;
+    int32_t layout_query_vertex;
+    PathIndex paths;
+    uint32_t last_publish_ms;
+    // endpoints of edges that changed since the last sync, may repeat
+    uint32_t *changed_vertices;
+    uint32_t num_changed_vertices;
+    uint32_t max_changed_vertices;
 
-typedef struct {
-    Vertex vert;
-    int checked;
-} NeighborVert;
+    Layout *layout;
+    uint64_t layout_topology_version;
+    int32_t layout_pinned_vertex;
+    uint8_t (*labels)[4];
+    uint32_t max_labels;
+    pthread_t layout_thread;
+    int layout_wakeup_fd;
+    atomic_int is_layout_stopping;
+    pthread_t listen_thread;
+    // signalled once on quit, -1 while grapher_listen isn't running
+    int listen_stop_fd;
 
-typedef struct {
-    NeighborVert *neighbors;
-    uint32_t num_neighbors;
-} NeighborsState;
+    /* three frames: the layout thread fills frames[back_frame], draw_graph
+     * reads frames[front_frame], and the last one changes hands through
+     * ready_frame (index | FRAME_IS_FRESH once a new step is in it).
+     * neither side ever waits for the other
+     * */
+    GrapherFrame frames[3];
+    uint32_t back_frame;
+    uint32_t front_frame;
+    atomic_uint ready_frame;
 
+    // set by the GTK thread, picked up by the layout thread
+    pthread_mutex_t drag_mutex;
+    int32_t dragged_vertex;
+    Vec2 drag_pos;
+    int is_reset_requested;
+    int32_t selected_vertex;
+    int32_t query_vertex;
+    uint32_t scrub_seconds;
+
+    // GTK thread only. screen = layout * view_scale + view_x/y
+    double view_scale;
+    double view_x, view_y;
+    gboolean is_panning;
+    Vec2 pan_from;
+    // rendered labels by vertex index, NULL until first drawn
+    cairo_surface_t **label_surfaces;
+    uint32_t max_label_surfaces;
 
-typedef struct {
-    Vertex* vertices;
-    uint32_t num_vertices;
-    Edge* edges;
-    uint32_t num_edges;
-    uint32_t curr_iteration;
-    double t;
     GtkWidget* drawing_area;
-    Vertex* dragged_vertex;
-    pthread_mutex_t change_graph_mutex;
+    GtkWidget* scrub_label;
 } GrapherState;
 
 #endif
@@ -0,0 +1,433 @@
+#include "topology.h"
+#include <stdlib.h>
+#include <string.h>
+
+const uint32_t DELTA_RING_SIZE = 1 << 22;
+
+// what a record starts with in the ring, followed by the neighbor ips
+// and the entries
+typedef struct {
+    uint32_t router_id;
+    uint8_t interface_ip[4];
+    uint32_t is_host;
+    uint32_t num_neighbors;
+    uint32_t num_entries;
+} DeltaRecordHeader;
+
+/* returns -1 for anything that is not a router packet
+ * */
+int decode_topology_delta(uint8_t *packet, uint32_t packet_size, TopologyDelta *delta) {
+    if (packet_size < 12) {
+        return -1;
+    }
+
+    uint32_t num_entries;
+    memcpy(delta->interface_ip, packet, 4);
+    memcpy(&delta->router_id, packet + 4, 4);
+    memcpy(&num_entries, packet + 8, 4);
+    // never past what was received
+    if (num_entries > (packet_size - 12) / sizeof(RouterTableEntry)) {
+        num_entries = (packet_size - 12) / sizeof(RouterTableEntry);
+    }
+
+    delta->is_host = num_entries == 1;
+    delta->num_neighbors = 0;
+    delta->num_entries = num_entries < delta->max_entries ? num_entries : delta->max_entries;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        RouterTableEntry entry;
+        memcpy(&entry, packet + 12 + i * sizeof(RouterTableEntry), sizeof(RouterTableEntry));
+        if (entry.metric == 1 && delta->num_neighbors < delta->max_neighbors) {
+            memcpy(delta->neighbor_ips[delta->num_neighbors++], entry.destination, 4);
+        }
+        if (i < delta->num_entries) {
+            delta->entries[i] = entry;
+        }
+    }
+
+    return 0;
+}
+
+void init_delta_ring(DeltaRing *ring, uint32_t size) {
+    ring->data = malloc(size);
+    ring->size = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->deltas_dropped, 0);
+}
+
+void copy_into_ring(DeltaRing *ring, uint64_t pos, const void *data, uint32_t data_size) {
+    const uint32_t offset = pos & (ring->size - 1);
+    const uint32_t first_part = data_size < ring->size - offset ? data_size : ring->size - offset;
+    memcpy(ring->data + offset, data, first_part);
+    memcpy(ring->data, (const uint8_t*) data + first_part, data_size - first_part);
+}
+
+void copy_from_ring(DeltaRing *ring, uint64_t pos, void *data, uint32_t data_size) {
+    const uint32_t offset = pos & (ring->size - 1);
+    const uint32_t first_part = data_size < ring->size - offset ? data_size : ring->size - offset;
+    memcpy(data, ring->data + offset, first_part);
+    memcpy((uint8_t*) data + first_part, ring->data, data_size - first_part);
+}
+
+/* producer side. returns -1 when the ring is full and the delta was
+ * dropped. was_empty is set when the consumer had taken everything
+ * before this delta and may be going to sleep: head is published and
+ * tail read back in total order, the consumer does the opposite, so
+ * either it sees the new head or the producer sees its tail
+ * */
+int push_topology_delta(DeltaRing *ring, TopologyDelta *delta, int *was_empty) {
+    const uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    const uint32_t neighbors_size = delta->num_neighbors * 4;
+    const uint32_t record_size = sizeof(DeltaRecordHeader) + neighbors_size + delta->num_entries * sizeof(RouterTableEntry);
+    if (head - tail + record_size > ring->size) {
+        atomic_fetch_add(&ring->deltas_dropped, 1);
+        return -1;
+    }
+
+    DeltaRecordHeader header = {
+        .router_id = delta->router_id,
+        .is_host = delta->is_host,
+        .num_neighbors = delta->num_neighbors,
+        .num_entries = delta->num_entries
+    };
+    memcpy(header.interface_ip, delta->interface_ip, 4);
+    copy_into_ring(ring, head, &header, sizeof(header));
+    copy_into_ring(ring, head + sizeof(header), delta->neighbor_ips, neighbors_size);
+    copy_into_ring(ring, head + sizeof(header) + neighbors_size,
+            delta->entries, delta->num_entries * sizeof(RouterTableEntry));
+
+    atomic_store(&ring->head, head + record_size);
+    *was_empty = atomic_load(&ring->tail) == head;
+    return 0;
+}
+
+/* consumer side. returns 0 when the ring is empty. neighbors and
+ * entries past the delta's max_neighbors and max_entries are skipped
+ * */
+int pop_topology_delta(DeltaRing *ring, TopologyDelta *delta) {
+    const uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const uint64_t head = atomic_load(&ring->head);
+    if (head == tail) {
+        return 0;
+    }
+
+    DeltaRecordHeader header;
+    copy_from_ring(ring, tail, &header, sizeof(header));
+    delta->router_id = header.router_id;
+    memcpy(delta->interface_ip, header.interface_ip, 4);
+    delta->is_host = header.is_host;
+    delta->num_neighbors = header.num_neighbors < delta->max_neighbors ? header.num_neighbors : delta->max_neighbors;
+    copy_from_ring(ring, tail + sizeof(header), delta->neighbor_ips, delta->num_neighbors * 4);
+    const uint64_t entries_pos = tail + sizeof(header) + header.num_neighbors * 4;
+    delta->num_entries = header.num_entries < delta->max_entries ? header.num_entries : delta->max_entries;
+    copy_from_ring(ring, entries_pos, delta->entries, delta->num_entries * sizeof(RouterTableEntry));
+
+    atomic_store(&ring->tail, entries_pos + header.num_entries * sizeof(RouterTableEntry));
+    return 1;
+}
+
+void free_delta_ring(DeltaRing *ring) {
+    free(ring->data);
+    ring->data = NULL;
+}
+
+void init_topology_graph(TopologyGraph *graph, uint32_t initial_vertices, uint32_t initial_edges) {
+    memset(graph, 0, sizeof(TopologyGraph));
+    graph->max_vertices = initial_vertices;
+    graph->vertices = malloc(graph->max_vertices * sizeof(Vertex));
+    graph->max_edges = initial_edges;
+    graph->edges = malloc(graph->max_edges * sizeof(Edge));
+}
+
+void free_topology_graph(TopologyGraph *graph) {
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        free(graph->vertices[i].interfaces);
+        free(graph->vertices[i].adjacent_edges);
+    }
+    free(graph->vertices);
+    free(graph->edges);
+    free_table_index(&graph->id_index);
+    free_table_index(&graph->ip_index);
+    memset(graph, 0, sizeof(TopologyGraph));
+}
+
+void notify_topology_change(TopologyGraph *graph, TopologyChange change, uint32_t v, uint32_t u) {
+    if (graph->on_change) {
+        graph->on_change(graph, change, v, u);
+    }
+}
+
+uint32_t get_router_id_hash(uint32_t router_id) {
+    return fnv1a(FNV1A_OFFSET_BASIS, &router_id, sizeof(router_id));
+}
+
+uint32_t get_interface_ip_hash(uint8_t *interface_ip) {
+    return fnv1a(FNV1A_OFFSET_BASIS, interface_ip, 4);
+}
+
+void rebuild_vertex_indexes(TopologyGraph *graph) {
+    reset_table_index(&graph->id_index, graph->num_vertices);
+    reset_table_index(&graph->ip_index, graph->num_indexed_interfaces);
+    for (uint32_t i = 0; i < graph->num_vertices; i++) {
+        Vertex *vertex = &graph->vertices[i];
+        add_to_table_index(&graph->id_index, get_router_id_hash(vertex->router_id), i);
+        for (uint32_t j = 0; j < vertex->num_interfaces; j++) {
+            add_to_table_index(&graph->ip_index, get_interface_ip_hash(vertex->interfaces[j].interface_ip), i);
+        }
+    }
+}
+
+/* vertices are only ever appended, so a full index is the only reason
+ * to rebuild
+ * */
+void index_vertex(TopologyGraph *graph, uint32_t vertex_index) {
+    if (add_to_table_index(&graph->id_index,
+                get_router_id_hash(graph->vertices[vertex_index].router_id), vertex_index) < 0) {
+        rebuild_vertex_indexes(graph);
+    }
+}
+
+void index_vertex_interface(TopologyGraph *graph, uint32_t vertex_index, uint8_t *interface_ip) {
+    graph->num_indexed_interfaces += 1;
+    if (add_to_table_index(&graph->ip_index, get_interface_ip_hash(interface_ip), vertex_index) < 0) {
+        rebuild_vertex_indexes(graph);
+    }
+}
+
+int get_index_of_vertex_in_graph_with_id(TopologyGraph *graph, uint32_t router_id) {
+    TableIndex *index = &graph->id_index;
+    if (index->size == 0) {
+        return -1;
+    }
+
+    for (uint32_t i = get_router_id_hash(router_id) & (index->size - 1); index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        uint32_t position = index->slots[i] - 1;
+        if (graph->vertices[position].router_id == router_id) {
+            return position;
+        }
+    }
+
+    return -1;
+}
+
+/* returns the index of the new vertex
+ * */
+uint32_t add_vertex_to_graph(TopologyGraph *graph, uint32_t router_id, uint8_t *interface_ip) {
+    if (graph->num_vertices == graph->max_vertices) {
+        graph->max_vertices *= 2;
+        graph->vertices = realloc(graph->vertices, graph->max_vertices * sizeof(Vertex));
+    }
+
+    const uint32_t vertex_index = graph->num_vertices;
+    Vertex *vertex = &graph->vertices[vertex_index];
+    memset(vertex, 0, sizeof(Vertex));
+    vertex->router_id = router_id;
+    vertex->interfaces = malloc(MAX_NUM_INTERFACES * sizeof(InterfaceTableEntry));
+    memcpy(vertex->interfaces[0].interface_ip, interface_ip, 4);
+    vertex->num_interfaces = 1;
+    graph->num_vertices += 1;
+
+    index_vertex(graph, vertex_index);
+    index_vertex_interface(graph, vertex_index, interface_ip);
+    notify_topology_change(graph, TOPOLOGY_VERTEX_ADDED, vertex_index, 0);
+    return vertex_index;
+}
+
+int add_interface_to_vertex_if_not_exists(TopologyGraph *graph, uint32_t vertex_index, uint8_t *interface_ip) {
+    uint32_t vertex_num_interfaces = graph->vertices[vertex_index].num_interfaces;
+    if (vertex_num_interfaces >= MAX_NUM_INTERFACES) {
+        // vertex contains maximum number of interfaces
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < vertex_num_interfaces; i++) {
+        if (match_ips(
+            graph->vertices[vertex_index].interfaces[i].interface_ip,
+            interface_ip
+        )) {
+            // interface already exists in the found vertex
+            return 0;
+        }
+    }
+    
+    // add interface to vertex
+    memcpy(
+        graph->vertices[vertex_index].interfaces[vertex_num_interfaces].interface_ip,
+        interface_ip,
+        4
+    );
+    graph->vertices[vertex_index].num_interfaces += 1;
+    index_vertex_interface(graph, vertex_index, interface_ip);
+    notify_topology_change(graph, TOPOLOGY_INTERFACE_ADDED, vertex_index, vertex_num_interfaces);
+
+    return 0;
+}
+
+/* the lowest vertex index with the interface, like the scan over the
+ * vertices did before
+ * */
+int get_index_of_vertex_in_graph_with_interface_ip(TopologyGraph *graph, uint8_t *interface_ip) {
+    TableIndex *index = &graph->ip_index;
+    if (index->size == 0) {
+        return -1;
+    }
+
+    int found_index = -1;
+    for (uint32_t i = get_interface_ip_hash(interface_ip) & (index->size - 1); index->slots[i] != 0; i = (i + 1) & (index->size - 1)) {
+        uint32_t position = index->slots[i] - 1;
+        if (found_index >= 0 && position >= (uint32_t) found_index) {
+            continue;
+        }
+
+        Vertex *vertex = &graph->vertices[position];
+        for (uint32_t j = 0; j < vertex->num_interfaces; j++) {
+            if (match_ips(vertex->interfaces[j].interface_ip, interface_ip)) {
+                found_index = position;
+                break;
+            }
+        }
+    }
+
+    return found_index;
+}
+
+/* returns the slot of the edge in the adjacency list
+ * */
+uint32_t add_adjacent_edge(Vertex *vertex, uint32_t edge_index) {
+    if (vertex->degree == vertex->max_degree) {
+        vertex->max_degree = vertex->max_degree > 0 ? 2 * vertex->max_degree : 4;
+        vertex->adjacent_edges = realloc(vertex->adjacent_edges, vertex->max_degree * sizeof(uint32_t));
+    }
+
+    vertex->adjacent_edges[vertex->degree] = edge_index;
+    return vertex->degree++;
+}
+
+/* the edge now at edges[edge_index] has to be found by its endpoints
+ * */
+void set_edge_slots(TopologyGraph *graph, uint32_t edge_index) {
+    Edge *edge = &graph->edges[edge_index];
+    graph->vertices[edge->v].adjacent_edges[edge->v_slot] = edge_index;
+    graph->vertices[edge->u].adjacent_edges[edge->u_slot] = edge_index;
+}
+
+void remove_adjacent_edge(TopologyGraph *graph, uint32_t vertex_index, uint32_t slot) {
+    Vertex *vertex = &graph->vertices[vertex_index];
+    vertex->degree -= 1;
+    if (slot == vertex->degree) {
+        return;
+    }
+
+    // the last edge of the list takes the freed slot
+    const uint32_t moved_edge_index = vertex->adjacent_edges[vertex->degree];
+    Edge *moved_edge = &graph->edges[moved_edge_index];
+    vertex->adjacent_edges[slot] = moved_edge_index;
+    if (moved_edge->v == vertex_index && moved_edge->v_slot == vertex->degree) {
+        moved_edge->v_slot = slot;
+    } else {
+        moved_edge->u_slot = slot;
+    }
+}
+
+/* O(1), the last edge moves into edges[edge_index]
+ * */
+void remove_edge_from_graph(TopologyGraph *graph, uint32_t edge_index) {
+    Edge edge = graph->edges[edge_index];
+    remove_adjacent_edge(graph, edge.v, edge.v_slot);
+    remove_adjacent_edge(graph, edge.u, edge.u_slot);
+
+    graph->num_edges -= 1;
+    notify_topology_change(graph, TOPOLOGY_EDGE_REMOVED, edge.v, edge.u);
+    if (edge_index != graph->num_edges) {
+        graph->edges[edge_index] = graph->edges[graph->num_edges];
+        set_edge_slots(graph, edge_index);
+        notify_topology_change(graph, TOPOLOGY_EDGE_MOVED, graph->num_edges, edge_index);
+    }
+    graph->topology_version += 1;
+}
+
+void add_edge_to_graph(TopologyGraph *graph, uint32_t index_one, uint32_t index_two) {
+    if (graph->num_edges == graph->max_edges) {
+        graph->max_edges *= 2;
+        graph->edges = realloc(graph->edges, graph->max_edges * sizeof(Edge));
+    }
+
+    const uint32_t edge_index = graph->num_edges;
+    Edge *edge = &graph->edges[edge_index];
+    edge->v = index_one;
+    edge->u = index_two;
+    edge->v_slot = add_adjacent_edge(&graph->vertices[index_one], edge_index);
+    edge->u_slot = add_adjacent_edge(&graph->vertices[index_two], edge_index);
+    graph->num_edges += 1;
+    graph->topology_version += 1;
+    notify_topology_change(graph, TOPOLOGY_EDGE_ADDED, index_one, index_two);
+}
+
+uint32_t get_other_end(Edge *edge, uint32_t vertex_index) {
+    return edge->v == vertex_index ? edge->u : edge->v;
+}
+
+/* the destinations of a router's metric 1 entries are its neighbors:
+ * edges to new ones are added, edges to vertices no longer listed are
+ * removed. O(degree + neighbors)
+ * */
+void update_neighbors_of_vertex(TopologyGraph *graph, uint32_t vertex_index,
+        uint8_t (*neighbor_ips)[4], uint32_t num_neighbors) {
+    const uint32_t stamp = ++graph->diff_stamp;
+
+    for (uint32_t i = 0; i < graph->vertices[vertex_index].degree; i++) {
+        Edge *edge = &graph->edges[graph->vertices[vertex_index].adjacent_edges[i]];
+        graph->vertices[get_other_end(edge, vertex_index)].seen_stamp = stamp;
+    }
+
+    for (uint32_t i = 0; i < num_neighbors; i++) {
+        int found_index_in_graph =
+            get_index_of_vertex_in_graph_with_interface_ip(graph, neighbor_ips[i]);
+        if (found_index_in_graph < 0 || found_index_in_graph == vertex_index) {
+            continue;
+        }
+
+        Vertex *neighbor = &graph->vertices[found_index_in_graph];
+        if (neighbor->seen_stamp != stamp) {
+            // vertex exists in the graph but is not a neighbor yet
+            add_edge_to_graph(graph, vertex_index, found_index_in_graph);
+            neighbor->seen_stamp = stamp;
+        }
+        // make sure that edge stays in the graph
+        neighbor->checked_stamp = stamp;
+    }
+
+    // backwards, a removal moves the last edge of the list into the slot
+    for (uint32_t i = graph->vertices[vertex_index].degree; i-- > 0;) {
+        const uint32_t edge_index = graph->vertices[vertex_index].adjacent_edges[i];
+        const uint32_t neighbor_index = get_other_end(&graph->edges[edge_index], vertex_index);
+        if (graph->vertices[neighbor_index].checked_stamp != stamp) {
+            // this vertex is no longer a neighbor of the router vertex
+            remove_edge_from_graph(graph, edge_index);
+        }
+    }
+}
+
+/* adds the sender or its interface, then its neighbors unless it is a
+ * host. returns the sender's vertex
+ * */
+uint32_t apply_topology_delta(TopologyGraph *graph, TopologyDelta *delta) {
+    int curr_router_index_in_graph = get_index_of_vertex_in_graph_with_id(graph, delta->router_id);
+    if (curr_router_index_in_graph < 0) {
+        // if not in graph, add vertex for received router
+        curr_router_index_in_graph = add_vertex_to_graph(graph, delta->router_id, delta->interface_ip);
+    } else {
+        // else, add the received interface to the vertex if it is not already present
+        add_interface_to_vertex_if_not_exists(graph, curr_router_index_in_graph, delta->interface_ip);
+    }
+
+    // the received router table is from a host (it has only one entry -> itself)
+    // we shouldn't update his neighbors in the graph
+    if (!delta->is_host) {
+        update_neighbors_of_vertex(graph, curr_router_index_in_graph,
+                delta->neighbor_ips, delta->num_neighbors);
+    }
+
+    return curr_router_index_in_graph;
+}
@@ -0,0 +1,137 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <first.h>
+
+/* router packets reduced to what topology discovery needs: who sent it,
+ * from which interface, and the destinations of its metric 1 entries
+ * (its neighbors). a table with a single entry comes from a host.
+ *
+ * the receiving thread decodes, the thread that owns the graph applies.
+ * in between, deltas go through a single producer single consumer ring
+ * of variable length records, so neither side ever waits on the other.
+ *
+ * the graph has a vertex per router_id and an undirected edge between a
+ * router and every router it lists as a neighbor. it is only touched by
+ * one thread and has no GTK in it, the grapher and the collector share it
+ * */
+
+typedef struct {
+    uint32_t router_id;
+    uint8_t interface_ip[4];
+    uint32_t is_host;
+    uint32_t num_neighbors;
+    // caller's buffer of max_neighbors ips
+    uint8_t (*neighbor_ips)[4];
+    uint32_t max_neighbors;
+    // the received table, in the caller's buffer of max_entries entries
+    // (0 to only keep the neighbors)
+    RouterTableEntry *entries;
+    uint32_t num_entries;
+    uint32_t max_entries;
+} TopologyDelta;
+
+typedef struct {
+    uint8_t *data;
+    // power of two
+    uint32_t size;
+    // bytes ever pushed, written by the producer only
+    atomic_ulong head;
+    // bytes ever popped, written by the consumer only
+    atomic_ulong tail;
+    atomic_ulong deltas_dropped;
+} DeltaRing;
+
+typedef struct {
+    uint32_t router_id;
+    InterfaceTableEntry *interfaces;
+    uint32_t num_interfaces;
+    // indexes into edges
+    uint32_t *adjacent_edges;
+    uint32_t degree;
+    uint32_t max_degree;
+    // neighbor diffing of the packet with this stamp
+    uint32_t seen_stamp;
+    uint32_t checked_stamp;
+} Vertex;
+
+// vertex indexes, and where the edge sits in their adjacent_edges
+typedef struct {
+    uint32_t v, u;
+    uint32_t v_slot, u_slot;
+} Edge;
+
+typedef enum {
+    // v is the new vertex
+    TOPOLOGY_VERTEX_ADDED,
+    // u is the index of the new interface of v
+    TOPOLOGY_INTERFACE_ADDED,
+    // between vertices v and u
+    TOPOLOGY_EDGE_ADDED,
+    TOPOLOGY_EDGE_REMOVED,
+    // the edge at index v is now at index u, after a removal
+    TOPOLOGY_EDGE_MOVED
+} TopologyChange;
+
+typedef struct TopologyGraph TopologyGraph;
+
+typedef void (*TopologyChangeCallback)(TopologyGraph *graph, TopologyChange change, uint32_t v, uint32_t u);
+
+struct TopologyGraph {
+    // vertices are only ever appended, edges move on removal
+    Vertex *vertices;
+    uint32_t num_vertices;
+    uint32_t max_vertices;
+    Edge *edges;
+    uint32_t num_edges;
+    uint32_t max_edges;
+    uint32_t diff_stamp;
+    // bumped on every edge change
+    uint64_t topology_version;
+    // vertex index by router_id, and by the ip of every interface
+    TableIndex id_index;
+    TableIndex ip_index;
+    uint32_t num_indexed_interfaces;
+    // called after every change, may be NULL
+    TopologyChangeCallback on_change;
+    void *on_change_arg;
+};
+
+extern const uint32_t DELTA_RING_SIZE;
+
+int decode_topology_delta(uint8_t *packet, uint32_t packet_size, TopologyDelta *delta);
+
+void init_delta_ring(DeltaRing *ring, uint32_t size);
+
+int push_topology_delta(DeltaRing *ring, TopologyDelta *delta, int *was_empty);
+
+int pop_topology_delta(DeltaRing *ring, TopologyDelta *delta);
+
+void free_delta_ring(DeltaRing *ring);
+
+void init_topology_graph(TopologyGraph *graph, uint32_t initial_vertices, uint32_t initial_edges);
+
+void free_topology_graph(TopologyGraph *graph);
+
+int get_index_of_vertex_in_graph_with_id(TopologyGraph *graph, uint32_t router_id);
+
+int get_index_of_vertex_in_graph_with_interface_ip(TopologyGraph *graph, uint8_t *interface_ip);
+
+uint32_t add_vertex_to_graph(TopologyGraph *graph, uint32_t router_id, uint8_t *interface_ip);
+
+int add_interface_to_vertex_if_not_exists(TopologyGraph *graph, uint32_t vertex_index, uint8_t *interface_ip);
+
+void add_edge_to_graph(TopologyGraph *graph, uint32_t index_one, uint32_t index_two);
+
+void remove_edge_from_graph(TopologyGraph *graph, uint32_t edge_index);
+
+uint32_t get_other_end(Edge *edge, uint32_t vertex_index);
+
+void update_neighbors_of_vertex(TopologyGraph *graph, uint32_t vertex_index,
+        uint8_t (*neighbor_ips)[4], uint32_t num_neighbors);
+
+uint32_t apply_topology_delta(TopologyGraph *graph, TopologyDelta *delta);
+
+#endif